@@ -713,6 +713,49 @@ typedef struct auto_api_notify_s
 struct auto_regex_code_s;
 typedef struct auto_regex_code_s auto_regex_code_t;
 
+struct auto_regex_match_data_s;
+typedef struct auto_regex_match_data_s auto_regex_match_data_t;
+
+/**
+ * @brief Regex match flags.
+ */
+typedef enum auto_regex_flag_e
+{
+    /**
+     * @brief Do not check the subject for UTF validity.
+     *
+     * It is safe to set this flag when matching the same subject again, for
+     * example when iterating over all matches.
+     */
+    AUTO_REGEX_NO_UTF_CHECK = 1,
+
+    /**
+     * @brief An empty string at the start of the subject is not a valid match.
+     *
+     * Combine with #AUTO_REGEX_ANCHORED to retry after an empty match.
+     */
+    AUTO_REGEX_NOTEMPTY_ATSTART = 2,
+
+    /**
+     * @brief Match only at the start offset.
+     */
+    AUTO_REGEX_ANCHORED = 4,
+
+    /**
+     * @brief Subject is not complete, more data may follow.
+     *
+     * If the end of subject is reached before a match is complete, or a
+     * complete match might be extended with more data, it is a partial match.
+     * @see #auto_api_regex_t::match_ex()
+     */
+    AUTO_REGEX_PARTIAL = 8,
+
+    /**
+     * @brief Start of subject is not the beginning of a line.
+     */
+    AUTO_REGEX_NOTBOL = 16,
+} auto_regex_flag_t;
+
 /**
  * @brief Regex match callback.
  * @param[in] data      Original data to match.
@@ -758,6 +801,59 @@ typedef struct auto_api_regex_s
      */
     int (*match)(const auto_regex_code_t* self, const char* data, size_t size,
         size_t offset, auto_regex_cb cb, void* arg);
+
+    /**
+     * @brief Create match data for \p code.
+     *
+     * Match data holds the capture groups and JIT stack for one match at a
+     * time. Reuse it across matches to avoid memory allocation.
+     *
+     * @param[in] code      Regex bytecode.
+     * @return              Match data.
+     */
+    auto_regex_match_data_t* (*match_data_create)(const auto_regex_code_t* code);
+
+    /**
+     * @brief Release match data.
+     * @param[in] self      Match data.
+     */
+    void (*match_data_destroy)(auto_regex_match_data_t* self);
+
+    /**
+     * @brief Like #auto_api_regex_t::match(), but use caller owned match data.
+     *
+     * If \p match_data is NULL, the match data owned by \p self is used, the
+     * same as #auto_api_regex_t::match() does.
+     *
+     * @note MT-Safe as long as \p match_data is not shared between threads.
+     * @param[in] self          Compiled regular expression.
+     * @param[in] data          The string to match.
+     * @param[in] size          The string length in bytes.
+     * @param[in] offset        The offset of start position.
+     * @param[in] flags         Bit-OR of #auto_regex_flag_t.
+     * @param[in] match_data    Match data created by #auto_api_regex_t::match_data_create(),
+     *   or NULL.
+     * @param[in] cb            Match callback. It is only called if match success.
+     * @param[in] arg           User defined arguments.
+     * @return                  The number of groups captured, or -1 if not match.
+     *   If #AUTO_REGEX_PARTIAL is set and it is a partial match, return 0 and
+     *   \p cb is called with one group, whose start is the start of the
+     *   partial match.
+     */
+    int (*match_ex)(const auto_regex_code_t* self, const char* data, size_t size,
+        size_t offset, int flags, auto_regex_match_data_t* match_data,
+        auto_regex_cb cb, void* arg);
+
+    /**
+     * @brief Get the longest lookbehind in characters.
+     *
+     * When matching over chunks of data, keep at least this number of
+     * characters before the match start offset.
+     *
+     * @param[in] code      Regex bytecode.
+     * @return              Lookbehind length.
+     */
+    size_t (*get_max_lookbehind)(const auto_regex_code_t* code);
 } auto_api_regex_t;
 
 #define AUTO_LUA_OPEQ           0
@@ -1,6 +1,9 @@
 #include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
 #include "coroutine.h"
 #include "runtime.h"
+#include "utils/trace.h"
 
 /**
  * @brief Host Lua coroutine as managed coroutine.
@@ -10,18 +13,19 @@
 static auto_coroutine_t* _coroutine_host(lua_State* L)
 {
     auto_runtime_t* rt = auto_get_runtime(L);
-    atd_coroutine_impl_t* thr = api.memory->malloc(sizeof(atd_coroutine_impl_t));
+    atd_coroutine_impl_t* thr = auto_runtime_coroutine_alloc(rt);
 
     memset(thr, 0, sizeof(*thr));
     thr->rt = rt;
     thr->base.L = L;
     thr->base.status = AUTO_COROUTINE_BUSY;
     ev_list_init(&thr->hook.queue);
+    thr->trace.id = ++rt->schedule.id_seq;
 
     /* Save to schedule table to check duplicate */
     if (ev_map_insert(&rt->schedule.all_table, &thr->t_node) != NULL)
     {
-        api.memory->free(thr);
+        auto_runtime_coroutine_release(rt, thr);
         return NULL;
     }
 
@@ -32,6 +36,13 @@ static auto_coroutine_t* _coroutine_host(lua_State* L)
     /* Save to busy_queue */
     ev_list_push_back(&rt->schedule.busy_queue, &thr->q_node);
 
+    if (auto_trace_enabled)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "coroutine %" PRIu64, thr->trace.id);
+        auto_trace_name(thr->trace.id, name);
+    }
+
     return &thr->base;
 }
 
@@ -70,7 +81,19 @@ static auto_coroutine_hook_t* _coroutine_hook(struct auto_coroutine* self,
 {
     atd_coroutine_impl_t* impl = container_of(self, atd_coroutine_impl_t, base);
 
-    auto_coroutine_hook_t* token = api.memory->malloc(sizeof(auto_coroutine_hook_t));
+    /*
+     * Most coroutines have a hook of its handle and one of current wait
+     * operation, which need no allocation.
+     */
+    auto_coroutine_hook_t* token = &impl->hook.token[0];
+    if (token->impl != NULL)
+    {
+        token = &impl->hook.token[1];
+    }
+    if (token->impl != NULL)
+    {
+        token = api.memory->malloc(sizeof(auto_coroutine_hook_t));
+    }
     token->fn = fn;
     token->arg = arg;
     token->impl = impl;
@@ -102,7 +125,40 @@ static void _coroutine_unhook(struct auto_coroutine* self, auto_coroutine_hook_t
     ev_list_erase(&impl->hook.queue, &token->node);
     token->impl = NULL;
 
-    api.memory->free(token);
+    if (token != &impl->hook.token[0] && token != &impl->hook.token[1])
+    {
+        api.memory->free(token);
+    }
+}
+
+/**
+ * @brief Record time spent in wait queue as event on track of coroutine.
+ */
+static void _coroutine_trace_wait(atd_coroutine_impl_t* impl, int old_state, int state)
+{
+    uint64_t now = uv_hrtime();
+
+    if (old_state && !state)
+    {
+        /* Name the wait by the function that yields, e.g. `sleep` or `join`. */
+        lua_Debug ar;
+        const char* name = NULL;
+        if (lua_getstack(impl->base.L, 0, &ar) && lua_getinfo(impl->base.L, "n", &ar))
+        {
+            name = ar.name;
+        }
+        snprintf(impl->trace.wait_name, sizeof(impl->trace.wait_name),
+            "wait %s", name != NULL ? name : "?");
+        impl->trace.wait_since = now;
+        return;
+    }
+
+    if (!old_state && state && impl->trace.wait_since != 0)
+    {
+        auto_trace_record(impl->trace.id, impl->trace.wait_name,
+            impl->trace.wait_since, now - impl->trace.wait_since);
+        impl->trace.wait_since = 0;
+    }
 }
 
 /**
@@ -117,11 +173,23 @@ static void _coroutine_set_state(struct auto_coroutine* self, int state)
 
     /* Backup and update state. */
     int old_state = impl->base.status;
+
+    /* A dead coroutine never runs again, even if something wakes it up. */
+    if ((old_state & AUTO_COROUTINE_DEAD) && !(state & AUTO_COROUTINE_DEAD))
+    {
+        return;
+    }
     impl->base.status = state;
 
+    if (auto_trace_enabled)
+    {
+        _coroutine_trace_wait(impl, old_state, state);
+    }
+
     /* move from wait_queue to busy_queue */
     if (!old_state && state)
     {
+        impl->flags.woken = 1;
         ev_list_erase(&rt->schedule.wait_queue, &impl->q_node);
         ev_list_push_back(&rt->schedule.busy_queue, &impl->q_node);
         return;
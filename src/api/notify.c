@@ -1,5 +1,6 @@
 #include <uv.h>
 #include "runtime.h"
+#include "utils/trace.h"
 #include "notify.h"
 
 struct auto_notify_s
@@ -19,7 +20,10 @@ static void _async_on_close(uv_handle_t* handle)
 static void _async_on_active(uv_async_t* handle)
 {
     auto_notify_t* impl = container_of(handle, auto_notify_t, async);
+
+    uint64_t trace_beg = AUTO_TRACE_BEGIN();
     impl->fn(impl->arg);
+    AUTO_TRACE_END("notify", trace_beg);
 }
 
 static void api_async_destroy(auto_notify_t* self)
@@ -9,8 +9,99 @@
  */
 #define PCRE2_STATIC
 #include <pcre2.h>
+#include <uv.h>
+#include <string.h>
 #include "regex.h"
 
+/**
+ * @brief Initial JIT stack size in bytes.
+ */
+#define AUTO_REGEX_JIT_STACK_START  (32 * 1024)
+
+/**
+ * @brief Max JIT stack size in bytes.
+ */
+#define AUTO_REGEX_JIT_STACK_MAX    (512 * 1024)
+
+struct auto_regex_match_data_s
+{
+    pcre2_match_data*       data;           /**< Capture groups */
+    pcre2_match_context*    context;        /**< Match context, NULL if no JIT */
+    pcre2_jit_stack*        jit_stack;      /**< JIT stack, NULL if no JIT */
+};
+
+struct auto_regex_code_s
+{
+    pcre2_code*             code;           /**< Compiled pattern */
+    size_t                  group_count;    /**< Group count, include the whole match */
+    size_t                  max_lookbehind; /**< Longest lookbehind in characters */
+
+    uv_mutex_t              jit_lock;       /**< Guard for #auto_regex_code_s::jit_partial */
+    int                     jit_partial;    /**< Whether JIT support partial match */
+
+    uv_mutex_t              match_data_lock;/**< Guard for #auto_regex_code_s::match_data */
+    auto_regex_match_data_t match_data;     /**< Match data reused by match() */
+};
+
+static int _regex_init_match_data(const pcre2_code* code, auto_regex_match_data_t* match_data)
+{
+    memset(match_data, 0, sizeof(*match_data));
+
+    if ((match_data->data = pcre2_match_data_create_from_pattern(code, NULL)) == NULL)
+    {
+        return -1;
+    }
+
+    /* JIT stack is only necessary if the pattern is JIT compiled. */
+    size_t jit_size = 0;
+    if (pcre2_pattern_info(code, PCRE2_INFO_JITSIZE, &jit_size) != 0 || jit_size == 0)
+    {
+        return 0;
+    }
+
+    match_data->context = pcre2_match_context_create(NULL);
+    match_data->jit_stack = pcre2_jit_stack_create(AUTO_REGEX_JIT_STACK_START,
+        AUTO_REGEX_JIT_STACK_MAX, NULL);
+    if (match_data->context == NULL || match_data->jit_stack == NULL)
+    {
+        return -1;
+    }
+    pcre2_jit_stack_assign(match_data->context, NULL, match_data->jit_stack);
+
+    return 0;
+}
+
+static void _regex_exit_match_data(auto_regex_match_data_t* match_data)
+{
+    if (match_data->data != NULL)
+    {
+        pcre2_match_data_free(match_data->data);
+        match_data->data = NULL;
+    }
+    if (match_data->context != NULL)
+    {
+        pcre2_match_context_free(match_data->context);
+        match_data->context = NULL;
+    }
+    if (match_data->jit_stack != NULL)
+    {
+        pcre2_jit_stack_free(match_data->jit_stack);
+        match_data->jit_stack = NULL;
+    }
+}
+
+static void _regex_api_destroy(auto_regex_code_t* self)
+{
+    _regex_exit_match_data(&self->match_data);
+    uv_mutex_destroy(&self->match_data_lock);
+    uv_mutex_destroy(&self->jit_lock);
+
+    pcre2_code_free(self->code);
+    self->code = NULL;
+
+    api.memory->free(self);
+}
+
 static auto_regex_code_t* _regex_api_create(const char* pattern, size_t size, size_t* errpos)
 {
     int errcode;
@@ -38,54 +129,211 @@ static auto_regex_code_t* _regex_api_create(const char* pattern, size_t size, si
     /* Try to enable jit support */
     pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
 
+    auto_regex_code_t* self = api.memory->malloc(sizeof(auto_regex_code_t));
+    self->code = code;
+    uv_mutex_init(&self->match_data_lock);
+    uv_mutex_init(&self->jit_lock);
+    self->jit_partial = 0;
+
+    uint32_t capture_count = 0;
+    pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+    self->group_count = (size_t)capture_count + 1;
+
+    uint32_t max_lookbehind = 0;
+    pcre2_pattern_info(code, PCRE2_INFO_MAXLOOKBEHIND, &max_lookbehind);
+    self->max_lookbehind = max_lookbehind;
+
+    if (_regex_init_match_data(code, &self->match_data) != 0)
+    {
+        *errpos = 0;
+        _regex_api_destroy(self);
+        return NULL;
+    }
+
     *errpos = (size_t)-1;
-    return (auto_regex_code_t*)code;
+    return self;
 }
 
-static void _regex_api_destroy(auto_regex_code_t* code)
+static size_t _regex_api_get_group_count(const auto_regex_code_t* code)
 {
-    pcre2_code_free((pcre2_code*)code);
+    return code->group_count;
 }
 
-static size_t _regex_api_get_group_count(const auto_regex_code_t* code)
+static auto_regex_match_data_t* _regex_api_match_data_create(const auto_regex_code_t* code)
 {
-    pcre2_match_data* match_data = pcre2_match_data_create_from_pattern((pcre2_code*)code, NULL);
-    size_t count = pcre2_get_ovector_count(match_data);
-    pcre2_match_data_free(match_data);
-    return count;
+    auto_regex_match_data_t* self = api.memory->malloc(sizeof(auto_regex_match_data_t));
+
+    if (_regex_init_match_data(code->code, self) != 0)
+    {
+        _regex_exit_match_data(self);
+        api.memory->free(self);
+        return NULL;
+    }
+
+    return self;
 }
 
-static int _regex_api_match(const auto_regex_code_t* self, const char* subject,
-    size_t subject_len, size_t offset, auto_regex_cb cb, void* arg)
+static void _regex_api_match_data_destroy(auto_regex_match_data_t* self)
+{
+    _regex_exit_match_data(self);
+    api.memory->free(self);
+}
+
+/**
+ * @brief JIT compile for partial match on first use, otherwise partial match
+ *   fall back to interpreter.
+ */
+static void _regex_jit_partial(auto_regex_code_t* self)
+{
+    uv_mutex_lock(&self->jit_lock);
+    if (!self->jit_partial)
+    {
+        pcre2_jit_compile(self->code, PCRE2_JIT_PARTIAL_HARD);
+        self->jit_partial = 1;
+    }
+    uv_mutex_unlock(&self->jit_lock);
+}
+
+static int _regex_do_match(const auto_regex_code_t* self, const char* subject,
+    size_t subject_len, size_t offset, int flags, auto_regex_match_data_t* match_data,
+    auto_regex_cb cb, void* arg)
 {
-    pcre2_code* code = (pcre2_code*)self;
-    pcre2_match_data* match_data = (cb != NULL) ?
-        pcre2_match_data_create_from_pattern(code, NULL) : NULL;
-    int ret = pcre2_match(code, (PCRE2_SPTR)subject, subject_len, offset, 0, match_data, NULL);
-    if (ret <= 0)
+    uint32_t options = 0;
+    if (flags & AUTO_REGEX_NO_UTF_CHECK)
+    {
+        options |= PCRE2_NO_UTF_CHECK;
+    }
+    if (flags & AUTO_REGEX_NOTEMPTY_ATSTART)
+    {
+        options |= PCRE2_NOTEMPTY_ATSTART;
+    }
+    if (flags & AUTO_REGEX_ANCHORED)
+    {
+        options |= PCRE2_ANCHORED;
+    }
+    if (flags & AUTO_REGEX_NOTBOL)
+    {
+        options |= PCRE2_NOTBOL;
+    }
+    if (flags & AUTO_REGEX_PARTIAL)
+    {
+        options |= PCRE2_PARTIAL_HARD;
+        _regex_jit_partial((auto_regex_code_t*)self);
+    }
+
+    int ret = pcre2_match(self->code, (PCRE2_SPTR)subject, subject_len, offset,
+        options, match_data->data, match_data->context);
+    if (ret == PCRE2_ERROR_PARTIAL)
+    {
+        ret = 0;
+    }
+    else if (ret <= 0)
     {
-        ret = -1;
-        goto finish;
+        return -1;
     }
 
     if (cb != NULL)
     {
-        PCRE2_SIZE* o_vector = pcre2_get_ovector_pointer(match_data);
+        PCRE2_SIZE* o_vector = pcre2_get_ovector_pointer(match_data->data);
         static_assert(sizeof(*o_vector) == sizeof(size_t), ERR_HINT_DEFINITION_MISMATCH);
-        cb(subject, o_vector, ret, arg);
+        cb(subject, o_vector, ret == 0 ? 1 : ret, arg);
     }
 
-finish:
+    return ret;
+}
+
+static int _regex_api_match_ex(const auto_regex_code_t* self, const char* subject,
+    size_t subject_len, size_t offset, int flags, auto_regex_match_data_t* match_data,
+    auto_regex_cb cb, void* arg)
+{
     if (match_data != NULL)
     {
-        pcre2_match_data_free(match_data);
+        return _regex_do_match(self, subject, subject_len, offset, flags,
+            match_data, cb, arg);
     }
+
+    auto_regex_code_t* code = (auto_regex_code_t*)self;
+
+    /* Fast path: reuse match data owned by regex. */
+    int locked = uv_mutex_trylock(&code->match_data_lock) == 0;
+    if (locked)
+    {
+        match_data = &code->match_data;
+    }
+    else if ((match_data = _regex_api_match_data_create(self)) == NULL)
+    {
+        /* Match data is in use by other thread or by the callback. */
+        return -1;
+    }
+
+    int ret = _regex_do_match(self, subject, subject_len, offset, flags,
+        match_data, NULL, NULL);
+
+    /*
+     * The callback may raise a Lua error and never return, so copy groups
+     * and release match data first.
+     */
+    size_t stack_groups[AUTO_REGEX_STACK_GROUPS * 2];
+    size_t* groups = NULL;
+    size_t group_sz = ret == 0 ? 1 : (size_t)ret;
+    if (ret >= 0 && cb != NULL)
+    {
+        /*
+         * Only patterns with many groups need heap, which leaks if callback
+         * raise error. Lua callers pass their own match data for them.
+         */
+        groups = group_sz <= AUTO_REGEX_STACK_GROUPS ? stack_groups
+            : api.memory->malloc(sizeof(size_t) * 2 * group_sz);
+        if (groups != NULL)
+        {
+            memcpy(groups, pcre2_get_ovector_pointer(match_data->data),
+                sizeof(size_t) * 2 * group_sz);
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
+
+    if (locked)
+    {
+        uv_mutex_unlock(&code->match_data_lock);
+    }
+    else
+    {
+        _regex_api_match_data_destroy(match_data);
+    }
+
+    if (groups != NULL)
+    {
+        cb(subject, groups, group_sz, arg);
+        if (groups != stack_groups)
+        {
+            api.memory->free(groups);
+        }
+    }
+
     return ret;
 }
 
+static int _regex_api_match(const auto_regex_code_t* self, const char* subject,
+    size_t subject_len, size_t offset, auto_regex_cb cb, void* arg)
+{
+    return _regex_api_match_ex(self, subject, subject_len, offset, 0, NULL, cb, arg);
+}
+
+static size_t _regex_api_get_max_lookbehind(const auto_regex_code_t* code)
+{
+    return code->max_lookbehind;
+}
+
 const auto_api_regex_t api_regex = {
     _regex_api_create,
     _regex_api_destroy,
     _regex_api_get_group_count,
     _regex_api_match,
+    _regex_api_match_data_create,
+    _regex_api_match_data_destroy,
+    _regex_api_match_ex,
+    _regex_api_get_max_lookbehind,
 };
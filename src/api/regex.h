@@ -7,6 +7,14 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Max number of groups copied on stack for match callback.
+ *
+ * Match without match data copies groups to heap for patterns with more
+ * groups, which leaks if the callback raise error.
+ */
+#define AUTO_REGEX_STACK_GROUPS     32
+
 /**
 * @brief Exposed API for regex.
 */
@@ -1,6 +1,7 @@
 #include <uv.h>
 #include "timer.h"
 #include "runtime.h"
+#include "utils/trace.h"
 
 struct auto_timer_s
 {
@@ -19,7 +20,10 @@ static void _on_timer_close(uv_handle_t* handle)
 static void _timer_on_active(uv_timer_t* handle)
 {
     auto_timer_t* impl = container_of(handle, auto_timer_t, timer);
+
+    uint64_t trace_beg = AUTO_TRACE_BEGIN();
     impl->fn(impl->arg);
+    AUTO_TRACE_END("api timer", trace_beg);
 }
 
 static void api_timer_destroy(auto_timer_t* self)
@@ -1,14 +1,20 @@
 #include <string.h>
 #include "api.h"
+#include "lua/channel.h"
 #include "lua/coroutine.h"
+#include "lua/csv.h"
 #include "lua/download.h"
 #include "lua/fs.h"
 #include "lua/json.h"
 #include "lua/process.h"
 #include "lua/regex.h"
+#include "lua/regex_set.h"
 #include "lua/sleep.h"
 #include "lua/sqlite.h"
+#include "lua/sqlite_pool.h"
+#include "lua/stats.h"
 #include "lua/string.h"
+#include "lua/sync.h"
 #include "lua/uname.h"
 
 /******************************************************************************
@@ -19,7 +25,12 @@
  * @brief Lua API list.
  */
 #define AUTO_LUA_API_MAP(xx) \
+    xx("await_all",         auto_lua_await_all)     \
+    xx("await_any",         auto_lua_await_any)     \
+    xx("channel",           auto_lua_channel)       \
+    xx("channel_select",    auto_lua_channel_select) \
     xx("coroutine",         auto_new_coroutine)     \
+    xx("csv_rows",          auto_lua_csv_rows)      \
     xx("download",          auto_lua_download)      \
     xx("fs_abspath",        auto_lua_fs_abspath)    \
     xx("fs_basename",       auto_lua_fs_basename)   \
@@ -33,12 +44,19 @@
     xx("fs_mkdir",          auto_lua_fs_mkdir)      \
     xx("fs_splitpath",      auto_lua_fs_splitpath)  \
     xx("json",              auto_lua_json)          \
+    xx("mutex",             auto_lua_mutex)         \
     xx("process",           atd_lua_process)        \
     xx("regex",             auto_lua_regex)         \
+    xx("regex_cache",       auto_lua_regex_cache)   \
+    xx("regex_set",         auto_lua_regex_set)     \
+    xx("semaphore",         auto_lua_semaphore)     \
     xx("sleep",             atd_lua_sleep)          \
     xx("sqlite",            auto_lua_sqlite)        \
+    xx("sqlite_pool",       auto_lua_sqlite_pool)   \
+    xx("stats",             auto_lua_stats)         \
     xx("string_split",      auto_lua_string_split)  \
-    xx("uname",             auto_lua_uname)
+    xx("uname",             auto_lua_uname)         \
+    xx("waitgroup",         auto_lua_waitgroup)
 
 #define EXPAND_MAP_AS_LUA_FUNCTION(name, func) \
     { name, func },
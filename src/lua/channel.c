@@ -0,0 +1,506 @@
+#include <stdlib.h>
+#include <limits.h>
+#include "runtime.h"
+#include "api/coroutine.h"
+#include "channel.h"
+
+#define AUTO_CHANNEL_NAME   "__auto_channel"
+
+typedef struct lua_channel
+{
+    lua_Integer             capacity;   /**< Max number of buffered messages */
+    lua_Integer             head;       /**< Position of first message, 0 based */
+    lua_Integer             size;       /**< Number of buffered messages */
+    int                     closed;     /**< Channel is closed */
+    auto_list_t             recv_queue; /**< #channel_wait_node_t of receivers */
+    auto_list_t             send_queue; /**< #channel_wait_node_t of senders */
+} lua_channel_t;
+
+struct channel_wait;
+
+typedef struct channel_wait_node
+{
+    auto_list_node_t        node;       /**< Node in wait queue of channel */
+    lua_channel_t*          channel;    /**< Channel to wait */
+    struct channel_wait*    wait;       /**< Wait operation it belongs to */
+} channel_wait_node_t;
+
+/**
+ * @brief A blocked send, receive or select. It waits on one or more
+ *   channels, and is removed from all of them once woken up.
+ */
+typedef struct channel_wait
+{
+    auto_coroutine_t*       co;         /**< Waiting coroutine */
+    auto_coroutine_hook_t*  hook;       /**< Hook to cancel wait if \p co is closed */
+    int                     linked;     /**< Nodes are in wait queues */
+    int                     is_send;    /**< Wait in send queue */
+    size_t                  size;       /**< Number of nodes */
+
+#if defined(_MSC_VER)
+#    pragma warning(push)
+#    pragma warning(disable : 4200)
+#endif
+    channel_wait_node_t     nodes[];    /**< One node per channel */
+#if defined(_MSC_VER)
+#    pragma warning(pop)
+#endif
+} channel_wait_t;
+
+static auto_list_t* _channel_queue(channel_wait_node_t* node)
+{
+    return node->wait->is_send ? &node->channel->send_queue : &node->channel->recv_queue;
+}
+
+static void _channel_wait_link(channel_wait_t* wait)
+{
+    size_t i;
+    for (i = 0; i < wait->size; i++)
+    {
+        ev_list_push_back(_channel_queue(&wait->nodes[i]), &wait->nodes[i].node);
+    }
+    wait->linked = 1;
+}
+
+static void _channel_wait_unlink(channel_wait_t* wait)
+{
+    if (!wait->linked)
+    {
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < wait->size; i++)
+    {
+        ev_list_erase(_channel_queue(&wait->nodes[i]), &wait->nodes[i].node);
+    }
+    wait->linked = 0;
+}
+
+/**
+ * @brief Release wait operation and its timeout.
+ */
+static void _channel_wait_release(channel_wait_t* wait)
+{
+    if (wait == NULL)
+    {
+        return;
+    }
+
+    _channel_wait_unlink(wait);
+    auto_runtime_timeout_stop(wait->co);
+    api_coroutine.unhook(wait->co, wait->hook);
+    free(wait);
+}
+
+/**
+ * @brief Wake up the first coroutine in \p queue. It checks channel again
+ *   after resume, and wait again if it loses the race.
+ */
+static void _channel_wake_one(auto_list_t* queue)
+{
+    auto_list_node_t* it = ev_list_begin(queue);
+    if (it == NULL)
+    {
+        return;
+    }
+
+    channel_wait_t* wait = container_of(it, channel_wait_node_t, node)->wait;
+    _channel_wait_unlink(wait);
+    api_coroutine.set_state(wait->co, AUTO_COROUTINE_BUSY);
+}
+
+static void _channel_wake_all(auto_list_t* queue)
+{
+    while (ev_list_size(queue) != 0)
+    {
+        _channel_wake_one(queue);
+    }
+}
+
+/**
+ * @brief Release wait operation if its coroutine is closed.
+ */
+static void _channel_on_waiter_state_change(auto_coroutine_t* co, void* arg)
+{
+    channel_wait_t* wait = arg;
+
+    if (!(co->status & AUTO_COROUTINE_DEAD))
+    {
+        return;
+    }
+
+    /* Woken up but never run, pass the wakeup on so it is not lost. */
+    if (!wait->linked)
+    {
+        size_t i;
+        for (i = 0; i < wait->size; i++)
+        {
+            lua_channel_t* channel = wait->nodes[i].channel;
+            if (channel->closed
+                || (wait->is_send ? channel->size < channel->capacity : channel->size != 0))
+            {
+                _channel_wake_one(_channel_queue(&wait->nodes[i]));
+            }
+        }
+    }
+
+    _channel_wait_release(wait);
+}
+
+/**
+ * @brief Block current coroutine until woken up by channel or timeout.
+ * @param[in] L         Lua VM.
+ * @param[in] wait      Wait operation, or NULL to create.
+ * @param[in] channels  Channels to wait.
+ * @param[in] size      Number of channels.
+ * @param[in] is_send   Wait for space instead of message.
+ * @param[in] timeout   Timeout in milliseconds, or -1 if no limit.
+ * @return              Wait operation.
+ */
+static channel_wait_t* _channel_wait(lua_State* L, channel_wait_t* wait,
+    lua_channel_t** channels, size_t size, int is_send, lua_Integer timeout)
+{
+    if (wait == NULL)
+    {
+        auto_coroutine_t* co = api_coroutine.find(L);
+        if (co == NULL)
+        {
+            api.lua->A_error(L, ERR_HINT_NOT_IN_MANAGED_COROUTINE);
+            return NULL;
+        }
+
+        wait = malloc(sizeof(channel_wait_t) + sizeof(channel_wait_node_t) * size);
+        wait->co = co;
+        wait->linked = 0;
+        wait->is_send = is_send;
+        wait->size = size;
+
+        size_t i;
+        for (i = 0; i < size; i++)
+        {
+            wait->nodes[i].channel = channels[i];
+            wait->nodes[i].wait = wait;
+        }
+        wait->hook = api_coroutine.hook(co, _channel_on_waiter_state_change, wait);
+
+        if (timeout > 0)
+        {
+            auto_runtime_timeout_start(co, (uint64_t)timeout);
+        }
+    }
+
+    _channel_wait_link(wait);
+    api_coroutine.set_state(wait->co, AUTO_COROUTINE_WAIT);
+    return wait;
+}
+
+/**
+ * @brief Whether wait operation should stop for timeout.
+ */
+static int _channel_timeout(channel_wait_t* wait, lua_Integer timeout)
+{
+    return timeout == 0 || (wait != NULL && auto_runtime_timeout_expired(wait->co));
+}
+
+/**
+ * @brief Pop first message and push it on top of \p L.
+ */
+static void _channel_pop(lua_State* L, lua_channel_t* self, int idx)
+{
+    lua_getiuservalue(L, idx, 1);
+    lua_rawgeti(L, -1, self->head + 1);
+
+    /* Release reference so the message can be collected. */
+    lua_pushnil(L);
+    lua_rawseti(L, -3, self->head + 1);
+    lua_remove(L, -2);
+
+    self->head = (self->head + 1) % self->capacity;
+    self->size--;
+
+    _channel_wake_one(&self->send_queue);
+}
+
+static lua_channel_t* _channel_check(lua_State* L, int idx)
+{
+    return luaL_checkudata(L, idx, AUTO_CHANNEL_NAME);
+}
+
+static int _channel_send_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    channel_wait_t* wait = (channel_wait_t*)ctx;
+    lua_channel_t* self = lua_touserdata(L, 1);
+    lua_Integer timeout = lua_tointeger(L, 3);
+
+    if (self->closed)
+    {
+        _channel_wait_release(wait);
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, "closed");
+        return 2;
+    }
+
+    if (self->size < self->capacity)
+    {
+        _channel_wait_release(wait);
+
+        lua_getiuservalue(L, 1, 1);
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, (self->head + self->size) % self->capacity + 1);
+        lua_pop(L, 1);
+        self->size++;
+
+        _channel_wake_one(&self->recv_queue);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    if (_channel_timeout(wait, timeout))
+    {
+        _channel_wait_release(wait);
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, "timeout");
+        return 2;
+    }
+
+    wait = _channel_wait(L, wait, &self, 1, 1, timeout);
+    return lua_yieldk(L, 0, (lua_KContext)wait, _channel_send_resume);
+}
+
+static int _channel_send(lua_State* L)
+{
+    _channel_check(L, 1);
+    luaL_checkany(L, 2);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 3);
+
+    lua_settop(L, 2);
+    lua_pushinteger(L, timeout);
+
+    return _channel_send_resume(L, LUA_OK, 0);
+}
+
+static int _channel_recv_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    channel_wait_t* wait = (channel_wait_t*)ctx;
+    lua_channel_t* self = lua_touserdata(L, 1);
+    lua_Integer timeout = lua_tointeger(L, 2);
+
+    if (self->size != 0)
+    {
+        _channel_wait_release(wait);
+        _channel_pop(L, self, 1);
+        lua_pushboolean(L, 1);
+        return 2;
+    }
+
+    if (self->closed)
+    {
+        _channel_wait_release(wait);
+        lua_pushnil(L);
+        lua_pushboolean(L, 0);
+        return 2;
+    }
+
+    if (_channel_timeout(wait, timeout))
+    {
+        _channel_wait_release(wait);
+        lua_pushnil(L);
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, "timeout");
+        return 3;
+    }
+
+    wait = _channel_wait(L, wait, &self, 1, 0, timeout);
+    return lua_yieldk(L, 0, (lua_KContext)wait, _channel_recv_resume);
+}
+
+static int _channel_recv(lua_State* L)
+{
+    _channel_check(L, 1);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
+
+    lua_settop(L, 1);
+    lua_pushinteger(L, timeout);
+
+    return _channel_recv_resume(L, LUA_OK, 0);
+}
+
+static int _channel_close(lua_State* L)
+{
+    lua_channel_t* self = _channel_check(L, 1);
+    if (self->closed)
+    {
+        return 0;
+    }
+
+    self->closed = 1;
+    _channel_wake_all(&self->recv_queue);
+    _channel_wake_all(&self->send_queue);
+
+    return 0;
+}
+
+static int _channel_len(lua_State* L)
+{
+    lua_channel_t* self = _channel_check(L, 1);
+    lua_pushinteger(L, self->size);
+    return 1;
+}
+
+static int _channel_capacity(lua_State* L)
+{
+    lua_channel_t* self = _channel_check(L, 1);
+    lua_pushinteger(L, self->capacity);
+    return 1;
+}
+
+static int _channel_is_closed(lua_State* L)
+{
+    lua_channel_t* self = _channel_check(L, 1);
+    lua_pushboolean(L, self->closed);
+    return 1;
+}
+
+static void _channel_set_metatable(lua_State* L)
+{
+    static const luaL_Reg s_channel_meta[] = {
+        { "__len",      _channel_len },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_channel_method[] = {
+        { "capacity",   _channel_capacity },
+        { "close",      _channel_close },
+        { "closed",     _channel_is_closed },
+        { "recv",       _channel_recv },
+        { "send",       _channel_send },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, AUTO_CHANNEL_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_channel_meta, 0);
+        luaL_newlib(L, s_channel_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+}
+
+int auto_lua_channel(lua_State* L)
+{
+    lua_Integer capacity = luaL_optinteger(L, 1, 1);
+    luaL_argcheck(L, capacity > 0 && capacity < INT_MAX, 1, "capacity must be positive");
+
+    lua_channel_t* self = lua_newuserdatauv(L, sizeof(lua_channel_t), 1);
+    self->capacity = capacity;
+    self->head = 0;
+    self->size = 0;
+    self->closed = 0;
+    ev_list_init(&self->recv_queue);
+    ev_list_init(&self->send_queue);
+    _channel_set_metatable(L);
+
+    /* Ring buffer, allocated once. */
+    lua_createtable(L, (int)capacity, 0);
+    lua_setiuservalue(L, -2, 1);
+
+    return 1;
+}
+
+/**
+ * @brief Get channel \p i in select list, the copied list is at index 1.
+ */
+static lua_channel_t* _channel_select_get(lua_State* L, lua_Integer i)
+{
+    lua_rawgeti(L, 1, i);
+    lua_channel_t* self = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return self;
+}
+
+static int _channel_select_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    channel_wait_t* wait = (channel_wait_t*)ctx;
+    lua_Integer timeout = lua_tointeger(L, 2);
+    lua_Integer i, size = (lua_Integer)lua_rawlen(L, 1);
+
+    for (i = 1; i <= size; i++)
+    {
+        lua_channel_t* self = _channel_select_get(L, i);
+        if (self->size == 0 && !self->closed)
+        {
+            continue;
+        }
+
+        _channel_wait_release(wait);
+        lua_pushinteger(L, i);
+        if (self->size != 0)
+        {
+            lua_rawgeti(L, 1, i);
+            _channel_pop(L, self, -1);
+            lua_remove(L, -2);
+            lua_pushboolean(L, 1);
+        }
+        else
+        {
+            lua_pushnil(L);
+            lua_pushboolean(L, 0);
+        }
+        return 3;
+    }
+
+    if (_channel_timeout(wait, timeout))
+    {
+        _channel_wait_release(wait);
+        lua_pushnil(L);
+        return 1;
+    }
+
+    if (wait == NULL)
+    {
+        lua_channel_t** channels = lua_newuserdatauv(L, sizeof(lua_channel_t*) * (size_t)size, 0);
+        for (i = 1; i <= size; i++)
+        {
+            channels[i - 1] = _channel_select_get(L, i);
+        }
+        wait = _channel_wait(L, NULL, channels, (size_t)size, 0, timeout);
+        lua_pop(L, 1);
+    }
+    else
+    {
+        _channel_wait(L, wait, NULL, 0, 0, timeout);
+    }
+
+    return lua_yieldk(L, 0, (lua_KContext)wait, _channel_select_resume);
+}
+
+int auto_lua_channel_select(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
+    lua_Integer i, size = (lua_Integer)lua_rawlen(L, 1);
+    luaL_argcheck(L, size != 0, 1, "empty channel list");
+
+    /*
+     * The list is read again on every resume. Copy it so it cannot be changed,
+     * and keep channels alive.
+     */
+    lua_createtable(L, (int)size, 0);
+    for (i = 1; i <= size; i++)
+    {
+        lua_rawgeti(L, 1, i);
+        if (luaL_testudata(L, -1, AUTO_CHANNEL_NAME) == NULL)
+        {
+            return api.lua->A_error(L, "element %d is not a channel", (int)i);
+        }
+        lua_rawseti(L, -2, i);
+    }
+    lua_replace(L, 1);
+
+    lua_settop(L, 1);
+    lua_pushinteger(L, timeout);
+
+    return _channel_select_resume(L, LUA_OK, 0);
+}
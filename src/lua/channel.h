@@ -0,0 +1,28 @@
+#ifndef __AUTO_LUA_CHANNEL_H__
+#define __AUTO_LUA_CHANNEL_H__
+
+#include "api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Create a bounded channel for passing messages between coroutines.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_channel(lua_State* L);
+
+/**
+ * @brief Receive from whichever channel in a list is ready first.
+ * @param[in] L     Lua VM.
+ * @return          Number of results.
+ */
+AUTO_LOCAL int auto_lua_channel_select(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
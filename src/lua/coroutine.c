@@ -1,8 +1,10 @@
 #include "coroutine.h"
+#include "stats.h"
 #include "runtime.h"
 #include "api/list.h"
 #include "api/coroutine.h"
 #include <string.h>
+#include <limits.h>
 #include <autodo.h>
 
 typedef struct lua_coroutine
@@ -15,21 +17,42 @@ typedef struct lua_coroutine
     int                     flag_closed;
 
     int                     sch_status;
-    lua_State*              storage;
-    int                     ref_storage;
+    int                     ref_storage;    /**< Error object, single result, or table of results. */
     int                     n_ret;
+    auto_coroutine_stats_t  stats;          /**< Statistics saved when finished. */
 } lua_coroutine_t;
 
+struct lua_wait_group;
+
 typedef struct lua_wait_record
 {
     auto_list_node_t         node;
     struct
     {
         auto_coroutine_t*    wait_coroutine;
+        auto_coroutine_hook_t* hook;    /**< Hook of waiting coroutine, NULL in group. */
         lua_coroutine_t*    belong;
+        struct lua_wait_group* group;   /**< Group wait, or NULL. */
     } data;
 } lua_wait_record_t;
 
+/**
+ * @brief Wait for a list of coroutines with only one allocation.
+ *
+ * Each unfinished coroutine has one record linked into its wait queue. The
+ * waiting coroutine is only woken up when the wait is satisfied.
+ */
+typedef struct lua_wait_group
+{
+    auto_coroutine_t*       wait_coroutine; /**< Waiting coroutine. */
+    auto_coroutine_hook_t*  hook;           /**< Hook of waiting coroutine. */
+    size_t                  n_remain;       /**< Number of unfinished coroutines. */
+    size_t                  first;          /**< 1-based index of first finished coroutine, 0 if none. */
+    int                     wait_all;       /**< Wait for all coroutines or only the first one. */
+    size_t                  n_record;       /**< Number of records. */
+    lua_wait_record_t       records[];      /**< Records, `belong` is NULL if not linked. */
+} lua_wait_group_t;
+
 static int _coroutine_gc(lua_State* L)
 {
     lua_coroutine_t* co = lua_touserdata(L, 1);
@@ -56,46 +79,83 @@ static void _on_coroutine_state_change(auto_coroutine_t* coroutine, void* arg)
         return;
     }
 
-    /* Remove the hook */
+    /* Remove the hook, the coroutine handle is released soon. */
+    self->stats = *auto_runtime_coroutine_stats(self->thr);
     api_coroutine.unhook(self->thr, self->hook);
     self->hook = NULL;
+    self->thr = NULL;
 
     /* Wakeup */
     auto_list_node_t* it = api_list.begin(&self->wait_queue);
     for (; it != NULL; it = api_list.next(it))
     {
         lua_wait_record_t* record = container_of(it, lua_wait_record_t, node);
-        api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_BUSY);
+        lua_wait_group_t* group = record->data.group;
+        if (group == NULL)
+        {
+            api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_BUSY);
+            continue;
+        }
+
+        group->n_remain--;
+        if (group->first == 0)
+        {
+            group->first = record - group->records + 1;
+        }
+        if (group->n_remain == 0 || !group->wait_all)
+        {
+            api_coroutine.set_state(group->wait_coroutine, AUTO_COROUTINE_BUSY);
+        }
     }
 
     self->flag_have_result = 1;
     self->sch_status = coroutine->status;
     self->n_ret = coroutine->nresults;
 
+    /* Stack of closed coroutine is not result. */
+    if (self->flag_closed)
+    {
+        self->n_ret = 0;
+        return;
+    }
+
     if (coroutine->status & AUTO_COROUTINE_ERROR)
-    {/* Push error object on top of stack and raise an error */
+    {/* Save error object */
         lua_pushvalue(coroutine->L, -1);
-        lua_xmove(coroutine->L, self->storage, 1);
+        self->ref_storage = luaL_ref(coroutine->L, LUA_REGISTRYINDEX);
         return;
     }
 
-    /* Push result on top of stack for storage. */
+    /* Save result without extra allocation if possible. */
     int co_sp = lua_gettop(coroutine->L);
     int co_sp_start = co_sp - coroutine->nresults + 1;
-    for (; co_sp_start <= co_sp; co_sp_start++)
+    if (self->n_ret == 1)
+    {
+        lua_pushvalue(coroutine->L, co_sp);
+        self->ref_storage = luaL_ref(coroutine->L, LUA_REGISTRYINDEX);
+    }
+    else if (self->n_ret > 1)
     {
-        lua_pushvalue(coroutine->L, co_sp_start);
+        int i;
+        lua_createtable(coroutine->L, self->n_ret, 0);
+        for (i = 1; i <= self->n_ret; i++)
+        {
+            lua_pushvalue(coroutine->L, co_sp_start + i - 1);
+            lua_rawseti(coroutine->L, -2, i);
+        }
+        self->ref_storage = luaL_ref(coroutine->L, LUA_REGISTRYINDEX);
     }
-    lua_xmove(coroutine->L, self->storage, self->thr->nresults);
 }
 
-static int _coroutine_on_resume(lua_State* L, int status, lua_KContext ctx)
+/**
+ * @brief Push result of finished coroutine, in the same form as
+ *   `coroutine:await()`.
+ * @param[in] L     Lua VM.
+ * @param[in] self  Finished or closed coroutine.
+ * @return          Number of values pushed.
+ */
+static int _coroutine_push_result(lua_State* L, lua_coroutine_t* self)
 {
-    (void)status;
-
-    lua_wait_record_t* record = (lua_wait_record_t*)ctx;
-    lua_coroutine_t* self = record->data.belong;
-
     if (self->flag_closed)
     {
         lua_pushboolean(L, 0);
@@ -103,42 +163,93 @@ static int _coroutine_on_resume(lua_State* L, int status, lua_KContext ctx)
         return 2;
     }
 
-    if (!self->flag_have_result)
-    {
-        api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_WAIT);
-        return lua_yieldk(L, 0, (lua_KContext)record, _coroutine_on_resume);
-    }
-
-    api_list.erase(&self->wait_queue, &record->node);
-    api.memory->free(record);
-
     if (self->sch_status & AUTO_COROUTINE_ERROR)
     {/* Error occur */
         lua_pushboolean(L, 0);
-        lua_pushvalue(self->storage, 1);
-        lua_xmove(self->storage, L, 1);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_storage);
         return 2;
     }
 
     lua_pushboolean(L, 1);
+    if (self->n_ret == 0)
+    {
+        return 1;
+    }
 
-    int i;
-    for (i = 1; i <= self->n_ret; i++)
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_storage);
+    if (self->n_ret > 1)
     {
-        lua_pushvalue(self->storage, i);
+        int i;
+        luaL_checkstack(L, self->n_ret, NULL);
+        for (i = 1; i <= self->n_ret; i++)
+        {
+            lua_rawgeti(L, -i, i);
+        }
+        lua_remove(L, -(self->n_ret + 1));
     }
-    lua_xmove(self->storage, L, self->n_ret);
 
     return self->n_ret + 1;
 }
 
+/**
+ * @brief Unlink and release wait record of `coroutine:await()`.
+ */
+static void _coroutine_wait_release(lua_wait_record_t* record)
+{
+    api_coroutine.unhook(record->data.wait_coroutine, record->data.hook);
+    api_list.erase(&record->data.belong->wait_queue, &record->node);
+    api.memory->free(record);
+}
+
+/**
+ * @brief Cancel wait if waiting coroutine is closed.
+ */
+static void _coroutine_on_waiter_state_change(auto_coroutine_t* coroutine, void* arg)
+{
+    if (coroutine->status & AUTO_COROUTINE_DEAD)
+    {
+        _coroutine_wait_release(arg);
+    }
+}
+
+static int _coroutine_on_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+
+    lua_wait_record_t* record = (lua_wait_record_t*)ctx;
+    lua_coroutine_t* self = record->data.belong;
+
+    if (!self->flag_have_result)
+    {
+        if (auto_runtime_timeout_expired(record->data.wait_coroutine))
+        {
+            auto_runtime_timeout_stop(record->data.wait_coroutine);
+            _coroutine_wait_release(record);
+
+            lua_pushboolean(L, 0);
+            lua_pushstring(L, "timeout");
+            return 2;
+        }
+
+        api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_WAIT);
+        return lua_yieldk(L, 0, (lua_KContext)record, _coroutine_on_resume);
+    }
+
+    auto_runtime_timeout_stop(record->data.wait_coroutine);
+    _coroutine_wait_release(record);
+
+    return _coroutine_push_result(L, self);
+}
+
 static int _coroutine_await(lua_State* L)
 {
     lua_coroutine_t* co = lua_touserdata(L, 1);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
 
     lua_wait_record_t* record = api.memory->malloc(sizeof(lua_wait_record_t));
 
     record->data.belong = co;
+    record->data.group = NULL;
     record->data.wait_coroutine = api_coroutine.find(L);
 
     if (record->data.wait_coroutine == NULL)
@@ -148,6 +259,13 @@ static int _coroutine_await(lua_State* L)
     }
 
     api_list.push_back(&co->wait_queue, &record->node);
+    record->data.hook = api_coroutine.hook(record->data.wait_coroutine,
+        _coroutine_on_waiter_state_change, record);
+
+    if (timeout >= 0 && !co->flag_have_result)
+    {
+        auto_runtime_timeout_start(record->data.wait_coroutine, (uint64_t)timeout);
+    }
 
     return _coroutine_on_resume(L, LUA_YIELD, (lua_KContext)record);
 }
@@ -155,23 +273,87 @@ static int _coroutine_await(lua_State* L)
 static int _coroutine_suspend(lua_State* L)
 {
     lua_coroutine_t* co = lua_touserdata(L, 1);
-    api_coroutine.set_state(co->thr, AUTO_COROUTINE_WAIT);
+    if (co->thr != NULL)
+    {
+        api_coroutine.set_state(co->thr, AUTO_COROUTINE_WAIT);
+    }
     return 0;
 }
 
 static int _coroutine_resume(lua_State* L)
 {
     lua_coroutine_t* co = lua_touserdata(L, 1);
-    api_coroutine.set_state(co->thr, AUTO_COROUTINE_BUSY);
+    if (co->thr != NULL)
+    {
+        api_coroutine.set_state(co->thr, AUTO_COROUTINE_BUSY);
+    }
     return 0;
 }
 
+static int _coroutine_preempt(lua_State* L)
+{
+    lua_coroutine_t* self = lua_touserdata(L, 1);
+    lua_Integer count = 0, time = 0;
+
+    if (!lua_isnoneornil(L, 2))
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        if (lua_getfield(L, 2, "count") != LUA_TNIL)
+        {
+            count = luaL_checkinteger(L, -1);
+            luaL_argcheck(L, count >= 0 && count <= INT_MAX, 2, "invalid count");
+        }
+        lua_pop(L, 1);
+
+        if (lua_getfield(L, 2, "time") != LUA_TNIL)
+        {
+            time = luaL_checkinteger(L, -1);
+            luaL_argcheck(L, time >= 0, 2, "invalid time");
+        }
+        lua_pop(L, 1);
+    }
+
+    if (self->thr != NULL)
+    {
+        auto_runtime_preempt(self->thr, (int)count, (uint64_t)time);
+    }
+    return 0;
+}
+
+static const auto_coroutine_stats_t* _coroutine_get_stats(lua_coroutine_t* self)
+{
+    return self->thr != NULL ? auto_runtime_coroutine_stats(self->thr) : &self->stats;
+}
+
+static int _coroutine_preempted(lua_State* L)
+{
+    lua_coroutine_t* self = lua_touserdata(L, 1);
+    lua_pushinteger(L, (lua_Integer)_coroutine_get_stats(self)->preempt);
+    return 1;
+}
+
+static int _coroutine_stats(lua_State* L)
+{
+    lua_coroutine_t* self = lua_touserdata(L, 1);
+    auto_lua_push_coroutine_stats(L, _coroutine_get_stats(self));
+    return 1;
+}
+
 static int _coroutine_close(lua_State* L)
 {
     lua_coroutine_t* self = lua_touserdata(L, 1);
 
+    /* Already finished */
+    if (self->thr == NULL)
+    {
+        return 0;
+    }
+
     self->flag_closed = 1;
-    api_coroutine.set_state(self->thr, AUTO_COROUTINE_DEAD);
+
+    /* Scheduler does not run hook for closed coroutine, so run them here. */
+    auto_runtime_coroutine_close(self->thr);
 
     return 0;
 }
@@ -184,9 +366,8 @@ int auto_new_coroutine(lua_State *L)
     memset(self, 0, sizeof(*self));
 
     /* Initialize */
-    self->thr = api_coroutine.host(lua_newthread(L)); lua_pop(L, 1);
-    self->storage = lua_newthread(L);
-    self->ref_storage = luaL_ref(L, LUA_REGISTRYINDEX);
+    self->thr = api_coroutine.host(auto_runtime_new_thread(L)); lua_pop(L, 1);
+    self->ref_storage = LUA_NOREF;
 
     /* Set metatable */
     static const luaL_Reg s_co_meta[] = {
@@ -196,8 +377,11 @@ int auto_new_coroutine(lua_State *L)
     static const luaL_Reg s_co_method[] = {
         { "await",      _coroutine_await },
         { "close",      _coroutine_close },
+        { "preempt",    _coroutine_preempt },
+        { "preempted",  _coroutine_preempted },
         { "suspend",    _coroutine_suspend },
         { "resume",     _coroutine_resume },
+        { "stats",      _coroutine_stats },
         { NULL,         NULL },
     };
     if (luaL_newmetatable(L, "__auto_coroutine") != 0)
@@ -222,3 +406,196 @@ int auto_new_coroutine(lua_State *L)
 
     return 1;
 }
+
+/**
+ * @brief Push results of coroutine list at index 1.
+ * @param[in] L         Lua VM.
+ * @param[in] wait_all  Push a list of results, or result of coroutine \p first.
+ * @param[in] first     1-based index of first finished coroutine.
+ * @return              Number of values pushed.
+ */
+static int _coroutine_group_push_result(lua_State* L, int wait_all, lua_Integer first)
+{
+    if (!wait_all)
+    {
+        lua_pushinteger(L, first);
+        lua_rawgeti(L, 1, first);
+        lua_coroutine_t* co = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        return _coroutine_push_result(L, co) + 1;
+    }
+
+    lua_Integer i, size = (lua_Integer)lua_rawlen(L, 1);
+    lua_createtable(L, (int)size, 0);
+    for (i = 1; i <= size; i++)
+    {
+        lua_rawgeti(L, 1, i);
+        lua_coroutine_t* co = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+
+        /* Same as table.pack() */
+        int j, n = _coroutine_push_result(L, co);
+        lua_createtable(L, n, 1);
+        lua_insert(L, -(n + 1));
+        for (j = n; j >= 1; j--)
+        {
+            lua_rawseti(L, -(j + 1), j);
+        }
+        lua_pushinteger(L, n);
+        lua_setfield(L, -2, "n");
+
+        lua_rawseti(L, -2, i);
+    }
+    return 1;
+}
+
+/**
+ * @brief Unlink and release group wait.
+ */
+static void _coroutine_group_release(lua_wait_group_t* group)
+{
+    size_t i;
+    for (i = 0; i < group->n_record; i++)
+    {
+        lua_wait_record_t* record = &group->records[i];
+        if (record->data.belong != NULL)
+        {
+            api_list.erase(&record->data.belong->wait_queue, &record->node);
+        }
+    }
+    api_coroutine.unhook(group->wait_coroutine, group->hook);
+    api.memory->free(group);
+}
+
+/**
+ * @brief Cancel group wait if waiting coroutine is closed.
+ */
+static void _coroutine_group_on_waiter_state_change(auto_coroutine_t* coroutine, void* arg)
+{
+    if (coroutine->status & AUTO_COROUTINE_DEAD)
+    {
+        _coroutine_group_release(arg);
+    }
+}
+
+static int _coroutine_group_on_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+
+    lua_wait_group_t* group = (lua_wait_group_t*)ctx;
+
+    if (group->n_remain != 0 && (group->wait_all || group->first == 0))
+    {
+        if (!auto_runtime_timeout_expired(group->wait_coroutine))
+        {
+            api_coroutine.set_state(group->wait_coroutine, AUTO_COROUTINE_WAIT);
+            return lua_yieldk(L, 0, (lua_KContext)group, _coroutine_group_on_resume);
+        }
+    }
+
+    int wait_all = group->wait_all;
+    lua_Integer first = (lua_Integer)group->first;
+    int finished = group->n_remain == 0 || (!wait_all && first != 0);
+
+    auto_runtime_timeout_stop(group->wait_coroutine);
+    _coroutine_group_release(group);
+
+    if (!finished)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, "timeout");
+        return 2;
+    }
+
+    return _coroutine_group_push_result(L, wait_all, first);
+}
+
+static int _coroutine_group_wait(lua_State* L, int wait_all)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
+    lua_Integer i, size = (lua_Integer)lua_rawlen(L, 1);
+    luaL_argcheck(L, wait_all || size != 0, 1, "empty coroutine list");
+
+    auto_coroutine_t* wait_coroutine = api_coroutine.find(L);
+    if (wait_coroutine == NULL)
+    {
+        return api.lua->A_error(L, ERR_HINT_NOT_IN_MANAGED_COROUTINE);
+    }
+
+    /* Copy the list so it cannot be changed, and keep coroutines alive. */
+    lua_createtable(L, (int)size, 0);
+    size_t n_remain = 0;
+    lua_Integer first = 0;
+    for (i = 1; i <= size; i++)
+    {
+        lua_rawgeti(L, 1, i);
+        lua_coroutine_t* co = luaL_testudata(L, -1, "__auto_coroutine");
+        if (co == NULL)
+        {
+            return api.lua->A_error(L, "element %d is not a coroutine", (int)i);
+        }
+        lua_rawseti(L, -2, i);
+
+        if (co->flag_have_result || co->flag_closed)
+        {
+            first = first != 0 ? first : i;
+        }
+        else
+        {
+            n_remain++;
+        }
+    }
+    lua_replace(L, 1);
+    lua_settop(L, 1);
+
+    if (n_remain == 0 || (!wait_all && first != 0))
+    {
+        return _coroutine_group_push_result(L, wait_all, first);
+    }
+
+    lua_wait_group_t* group = api.memory->malloc(
+        sizeof(lua_wait_group_t) + sizeof(lua_wait_record_t) * (size_t)size);
+    group->wait_coroutine = wait_coroutine;
+    group->n_remain = n_remain;
+    group->first = 0;
+    group->wait_all = wait_all;
+    group->n_record = (size_t)size;
+
+    for (i = 1; i <= size; i++)
+    {
+        lua_wait_record_t* record = &group->records[i - 1];
+        lua_rawgeti(L, 1, i);
+        lua_coroutine_t* co = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+
+        record->data.wait_coroutine = wait_coroutine;
+        record->data.hook = NULL;
+        record->data.group = group;
+        record->data.belong = NULL;
+        if (!co->flag_have_result && !co->flag_closed)
+        {
+            record->data.belong = co;
+            api_list.push_back(&co->wait_queue, &record->node);
+        }
+    }
+
+    group->hook = api_coroutine.hook(wait_coroutine, _coroutine_group_on_waiter_state_change, group);
+
+    if (timeout >= 0)
+    {
+        auto_runtime_timeout_start(wait_coroutine, (uint64_t)timeout);
+    }
+
+    return _coroutine_group_on_resume(L, LUA_OK, (lua_KContext)group);
+}
+
+int auto_lua_await_all(lua_State* L)
+{
+    return _coroutine_group_wait(L, 1);
+}
+
+int auto_lua_await_any(lua_State* L)
+{
+    return _coroutine_group_wait(L, 0);
+}
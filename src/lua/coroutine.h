@@ -18,6 +18,20 @@ extern "C" {
  */
 AUTO_LOCAL int auto_new_coroutine(lua_State *L);
 
+/**
+ * @brief Wait for all coroutines in list to finish.
+ * @param[in] L     Lua VM.
+ * @return          Number of results.
+ */
+AUTO_LOCAL int auto_lua_await_all(lua_State* L);
+
+/**
+ * @brief Wait for the first coroutine in list to finish.
+ * @param[in] L     Lua VM.
+ * @return          Number of results.
+ */
+AUTO_LOCAL int auto_lua_await_any(lua_State* L);
+
 #ifdef __cplusplus
 }
 #endif
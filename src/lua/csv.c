@@ -0,0 +1,185 @@
+#include <string.h>
+#include "csv.h"
+#include "utils.h"
+#include "utils/csv.h"
+
+/**
+ * @brief Lua userdata type of CSV row iterator.
+ */
+#define AUTO_LUA_CSV_ROWS   "__auto_csv_rows"
+
+typedef struct lua_csv_rows
+{
+    auto_csv_t*     csv;        /**< CSV reader, NULL if closed */
+    int             header;     /**< Whether rows are keyed by header */
+} lua_csv_rows_t;
+
+static int _lua_csv_rows_gc(lua_State* L)
+{
+    lua_csv_rows_t* self = lua_touserdata(L, 1);
+
+    if (self->csv != NULL)
+    {
+        auto_csv_close(self->csv);
+        self->csv = NULL;
+    }
+
+    return 0;
+}
+
+static void _lua_csv_rows_setmetatable(lua_State* L)
+{
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _lua_csv_rows_gc },
+        { "__close",    _lua_csv_rows_gc },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, AUTO_LUA_CSV_ROWS) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+    }
+    lua_setmetatable(L, -2);
+}
+
+/**
+ * @brief Read next row.
+ * @return  Field count, or 0 if end of input and reader is closed.
+ */
+static int _lua_csv_rows_read(lua_State* L, lua_csv_rows_t* self,
+    const auto_csv_field_t** fields)
+{
+    if (self->csv == NULL)
+    {
+        return 0;
+    }
+
+    int ret = auto_csv_next(self->csv, fields);
+    if (ret > 0)
+    {
+        return ret;
+    }
+
+    auto_csv_close(self->csv);
+    self->csv = NULL;
+
+    if (ret < 0)
+    {
+        char buf[256];
+        return api.lua->A_error(L, "read CSV failed: %s", auto_strerror(-ret, buf, sizeof(buf)));
+    }
+    return 0;
+}
+
+static int _lua_csv_rows_iter(lua_State* L)
+{
+    lua_csv_rows_t* self = luaL_checkudata(L, 1, AUTO_LUA_CSV_ROWS);
+
+    const auto_csv_field_t* fields;
+    int i, field_cnt = _lua_csv_rows_read(L, self, &fields);
+    if (field_cnt == 0)
+    {
+        return 0;
+    }
+
+    if (!self->header)
+    {
+        lua_createtable(L, field_cnt, 0);
+        for (i = 0; i < field_cnt; i++)
+        {
+            lua_pushlstring(L, fields[i].data, fields[i].size);
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    /* Fields without column name are keyed by index. */
+    lua_getiuservalue(L, 1, 1);
+    lua_Integer column_cnt = luaL_len(L, -1);
+    lua_createtable(L, 0, field_cnt);
+    for (i = 0; i < field_cnt; i++)
+    {
+        if (i < column_cnt)
+        {
+            lua_rawgeti(L, -2, i + 1);
+        }
+        else
+        {
+            lua_pushinteger(L, i + 1);
+        }
+        lua_pushlstring(L, fields[i].data, fields[i].size);
+        lua_rawset(L, -3);
+    }
+    return 1;
+}
+
+/**
+ * @brief Consume header line and save column names as uservalue.
+ */
+static void _lua_csv_rows_read_header(lua_State* L, int idx, lua_csv_rows_t* self)
+{
+    const auto_csv_field_t* fields;
+    int i, field_cnt = _lua_csv_rows_read(L, self, &fields);
+
+    lua_createtable(L, field_cnt, 0);
+    for (i = 0; i < field_cnt; i++)
+    {
+        lua_pushlstring(L, fields[i].data, fields[i].size);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setiuservalue(L, idx, 1);
+}
+
+int auto_lua_csv_rows(lua_State* L)
+{
+    const char* path = luaL_checkstring(L, 1);
+
+    char delimiter = ',';
+    int header = 0;
+    if (lua_type(L, 2) == LUA_TTABLE)
+    {
+        if (lua_getfield(L, 2, "delimiter") != LUA_TNIL)
+        {
+            size_t sz;
+            const char* s = lua_tolstring(L, -1, &sz);
+            if (s == NULL || sz != 1)
+            {
+                return api.lua->A_error(L, "delimiter must be one character");
+            }
+            delimiter = s[0];
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, 2, "header");
+        header = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    /* 1: Push iterator function */
+    lua_pushcfunction(L, _lua_csv_rows_iter);
+
+    /* 2: Iterator context */
+    lua_csv_rows_t* self = lua_newuserdatauv(L, sizeof(lua_csv_rows_t), 1);
+    memset(self, 0, sizeof(*self));
+    _lua_csv_rows_setmetatable(L);
+    int self_idx = lua_gettop(L);
+
+    int errcode;
+    if ((self->csv = auto_csv_open_file(path, delimiter, &errcode)) == NULL)
+    {
+        char buf[1024];
+        return api.lua->A_error(L, "open %s failed: %s", path,
+            auto_strerror(errcode, buf, sizeof(buf)));
+    }
+    if ((self->header = header) != 0)
+    {
+        _lua_csv_rows_read_header(L, self_idx, self);
+    }
+
+    /* 3: Nil required by `for ... in` syntax */
+    lua_pushnil(L);
+
+    /* 4: Closing value, release the file when loop breaks */
+    lua_pushvalue(L, self_idx);
+
+    return 4;
+}
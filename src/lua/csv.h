@@ -0,0 +1,21 @@
+#ifndef __AUTO_LUA_CSV_H__
+#define __AUTO_LUA_CSV_H__
+
+#include "api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Iterate over rows of CSV file.
+ * @param[in] L     Lua VM.
+ * @return          Always 4.
+ */
+AUTO_LOCAL int auto_lua_csv_rows(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
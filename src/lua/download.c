@@ -112,23 +112,25 @@ static int _download_with_installed_tool(lua_State* L, lua_download_token_t* tok
 
 static int _download_on_wait_resume(lua_State* L, int status, lua_KContext ctx)
 {
-    (void)status; (void)ctx;
+    (void)status;
 
-    lua_Integer exit_code = lua_tointeger(L, -1);
-    lua_pushinteger(L, exit_code);
-    return 1;
+    /* Results of `process:join()` */
+    return lua_gettop(L) - (int)ctx;
 }
 
 static int _download_wait_for_finish(lua_State *L)
 {
     lua_download_token_t* token = lua_touserdata(L, 1);
+    lua_settop(L, 2);
 
     lua_rawgeti(L, LUA_REGISTRYINDEX, token->process_ref);
     lua_getfield(L, -1, "join");
     lua_pushvalue(L, -2);
+    lua_pushvalue(L, 2);
 
-    lua_callk(L, 1, 1, (lua_KContext)token, _download_on_wait_resume);
-    return _download_on_wait_resume(L, LUA_YIELD, (lua_KContext)token);
+    lua_KContext sp = 3;
+    lua_callk(L, 2, LUA_MULTRET, sp, _download_on_wait_resume);
+    return _download_on_wait_resume(L, LUA_OK, sp);
 }
 
 static void _download_set_metatable(lua_State* L)
@@ -6,6 +6,7 @@
 #include "process.h"
 #include "utils.h"
 #include "utils/list.h"
+#include "utils/trace.h"
 
 struct atd_process_s;
 typedef struct atd_process_s atd_process_t;
@@ -82,7 +83,10 @@ typedef struct process_write_record
         uv_write_t          req;            /**< Write request */
         lua_process_t*      process;        /**< Process handle */
         auto_coroutine_t*   wait_coroutine; /**< The waiting coroutine */
+        auto_coroutine_hook_t* hook;        /**< Hook of waiting coroutine */
         size_t              size;           /**< Send data size */
+        int                 done;           /**< Write request finished */
+        int                 canceled;       /**< Waiting coroutine is closed, not in wait queue and released when done */
 
 #if defined(_MSC_VER)
 #    pragma warning(push)
@@ -101,7 +105,9 @@ typedef struct process_wait_record
     struct
     {
         auto_coroutine_t*   wait_coroutine; /**< The waiting coroutine */
+        auto_coroutine_hook_t* hook;        /**< Hook of waiting coroutine */
         lua_process_t*      process;        /**< The process handle */
+        auto_list_t*        queue;          /**< Wait queue that record belongs to */
     } data;
 } process_wait_record_t;
 
@@ -435,6 +441,80 @@ static int _lua_process_kill(lua_State *L)
     return 0;
 }
 
+/**
+ * @brief Finish wait operation of \p record.
+ * @param[in] queue     Wait queue that \p record belongs to.
+ * @param[in] record    Wait record, released.
+ */
+static void _process_wait_finish(auto_list_t* queue, process_wait_record_t* record)
+{
+    auto_runtime_timeout_stop(record->data.wait_coroutine);
+    api_coroutine.unhook(record->data.wait_coroutine, record->data.hook);
+    ev_list_erase(queue, &record->node);
+    free(record);
+}
+
+/**
+ * @brief Cancel wait if waiting coroutine is closed.
+ */
+static void _process_on_waiter_state_change(auto_coroutine_t* coroutine, void* arg)
+{
+    process_wait_record_t* record = arg;
+
+    if (coroutine->status & AUTO_COROUTINE_DEAD)
+    {
+        _process_wait_finish(record->data.queue, record);
+    }
+}
+
+/**
+ * @brief Finish wait operation if its timeout expired.
+ * @return  Number of results if timeout, otherwise -1.
+ */
+static int _process_wait_timeout(lua_State* L, auto_list_t* queue, process_wait_record_t* record)
+{
+    if (!auto_runtime_timeout_expired(record->data.wait_coroutine))
+    {
+        return -1;
+    }
+
+    _process_wait_finish(queue, record);
+    lua_pushnil(L);
+    lua_pushstring(L, "timeout");
+    return 2;
+}
+
+/**
+ * @brief Create wait record for current coroutine, and start timeout if
+ *   argument \p idx is a timeout.
+ */
+static process_wait_record_t* _process_wait_record(lua_State* L, int idx,
+    lua_process_t* process, auto_list_t* queue)
+{
+    lua_Integer timeout = auto_runtime_opt_timeout(L, idx);
+
+    auto_coroutine_t* co = api_coroutine.find(L);
+    if (co == NULL)
+    {
+        api.lua->A_error(L, ERR_HINT_NOT_IN_MANAGED_COROUTINE);
+        return NULL;
+    }
+
+    process_wait_record_t* record = malloc(sizeof(process_wait_record_t));
+    record->data.process = process;
+    record->data.queue = queue;
+    record->data.wait_coroutine = co;
+    record->data.hook = api_coroutine.hook(co, _process_on_waiter_state_change, record);
+    ev_list_push_back(queue, &record->node);
+
+    if (timeout >= 0)
+    {
+        auto_runtime_timeout_start(co, (uint64_t)timeout);
+    }
+
+    return record;
+}
+
 static int _lua_process_on_stdout_resume(lua_State *L, int status, lua_KContext ctx)
 {
     (void)status;
@@ -446,9 +526,16 @@ static int _lua_process_on_stdout_resume(lua_State *L, int status, lua_KContext
     {
         if (process->flag.have_error || !process->process->flag.process_running)
         {
+            _process_wait_finish(&process->await.stdout_wait_queue, record);
             return 0;
         }
 
+        int ret = _process_wait_timeout(L, &process->await.stdout_wait_queue, record);
+        if (ret >= 0)
+        {
+            return ret;
+        }
+
         api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_WAIT);
         return lua_yieldk(L, 0, (lua_KContext)record,
             _lua_process_on_stdout_resume);
@@ -464,8 +551,7 @@ static int _lua_process_on_stdout_resume(lua_State *L, int status, lua_KContext
         free(cache);
     }
 
-    ev_list_erase(&process->await.stdout_wait_queue, &record->node);
-    free(record);
+    _process_wait_finish(&process->await.stdout_wait_queue, record);
 
     luaL_pushresult(&buf);
     return 1;
@@ -480,11 +566,18 @@ static int _lua_process_on_stderr_resume(lua_State *L, int status, lua_KContext
 
     if (ev_list_size(&process->await.stderr_cache) == 0)
     {
-        if (process->flag.have_error|| !process->process->flag.process_running)
+        if (process->flag.have_error || !process->process->flag.process_running)
         {
+            _process_wait_finish(&process->await.stderr_wait_queue, record);
             return 0;
         }
 
+        int ret = _process_wait_timeout(L, &process->await.stderr_wait_queue, record);
+        if (ret >= 0)
+        {
+            return ret;
+        }
+
         api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_WAIT);
         return lua_yieldk(L, 0, (lua_KContext)record,
             _lua_process_on_stderr_resume);
@@ -500,13 +593,23 @@ static int _lua_process_on_stderr_resume(lua_State *L, int status, lua_KContext
         free(cache);
     }
 
-    ev_list_erase(&process->await.stderr_wait_queue, &record->node);
-    free(record);
+    _process_wait_finish(&process->await.stderr_wait_queue, record);
 
     luaL_pushresult(&buf);
     return 1;
 }
 
+static int _lua_process_on_stdin_resume(lua_State* L, int status, lua_KContext ctx);
+
+static int _lua_process_stdin_yield(lua_State* L, process_write_record_t* record)
+{
+    if (record->data.wait_coroutine != NULL)
+    {
+        api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_WAIT);
+    }
+    return lua_yieldk(L, 0, (lua_KContext)record, _lua_process_on_stdin_resume);
+}
+
 static int _lua_process_on_stdin_resume(lua_State* L, int status, lua_KContext ctx)
 {
     (void)L; (void)status;
@@ -514,19 +617,64 @@ static int _lua_process_on_stdin_resume(lua_State* L, int status, lua_KContext c
     process_write_record_t* record = (process_write_record_t*)ctx;
     lua_process_t* process = record->data.process;
 
+    /* The buffer is in use until write request finish. */
+    if (!record->data.done)
+    {
+        return _lua_process_stdin_yield(L, record);
+    }
+
     lua_pushinteger(L, record->data.size);
 
+    if (record->data.wait_coroutine != NULL)
+    {
+        api_coroutine.unhook(record->data.wait_coroutine, record->data.hook);
+    }
     ev_list_erase(&process->await.stdin_wait_queue, &record->node);
     free(record);
 
     return 1;
 }
 
+/**
+ * @brief Detach write request from waiting coroutine if it is closed. The
+ *   buffer is in use until write request finish.
+ */
+static void _process_on_stdin_waiter_state_change(auto_coroutine_t* coroutine, void* arg)
+{
+    process_write_record_t* record = arg;
+
+    if (!(coroutine->status & AUTO_COROUTINE_DEAD))
+    {
+        return;
+    }
+
+    api_coroutine.unhook(record->data.wait_coroutine, record->data.hook);
+    record->data.wait_coroutine = NULL;
+    ev_list_erase(&record->data.process->await.stdin_wait_queue, &record->node);
+
+    if (!record->data.done)
+    {
+        record->data.canceled = 1;
+        return;
+    }
+    free(record);
+}
+
 static void _process_on_write_done(uv_write_t* req, int status)
 {
     (void)status;
     process_write_record_t* record = container_of(req, process_write_record_t, data.req);
-    api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_BUSY);
+    uint64_t trace_beg = AUTO_TRACE_BEGIN();
+    record->data.done = 1;
+    if (record->data.canceled)
+    {
+        free(record);
+    }
+    else if (record->data.wait_coroutine != NULL)
+    {
+        api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_BUSY);
+    }
+    AUTO_TRACE_END("process stdin", trace_beg);
 }
 
 static int _lua_process_async_stdin(lua_State* L)
@@ -542,7 +690,10 @@ static int _lua_process_async_stdin(lua_State* L)
 
     record->data.process = process;
     record->data.wait_coroutine = api_coroutine.find(L);
+    record->data.hook = NULL;
     record->data.size = data_size;
+    record->data.done = 0;
+    record->data.canceled = 0;
     memcpy(record->data.data, data, data_size);
     ev_list_push_back(&process->await.stdin_wait_queue, &record->node);
 
@@ -558,7 +709,13 @@ static int _lua_process_async_stdin(lua_State* L)
         return 1;
     }
 
-    return lua_yieldk(L, 0, (lua_KContext)record, _lua_process_on_stdin_resume);
+    if (record->data.wait_coroutine != NULL)
+    {
+        record->data.hook = api_coroutine.hook(record->data.wait_coroutine,
+            _process_on_stdin_waiter_state_change, record);
+    }
+
+    return _lua_process_stdin_yield(L, record);
 }
 
 static int _lua_process_await_stdout(lua_State *L)
@@ -569,11 +726,8 @@ static int _lua_process_await_stdout(lua_State *L)
         return api.lua->A_error(L, ERR_HINT_STDOUT_DISABLED);
     }
 
-    process_wait_record_t* record = malloc(sizeof(process_wait_record_t));
-
-    record->data.process = process;
-    record->data.wait_coroutine = api_coroutine.find(L);
-    ev_list_push_back(&process->await.stdout_wait_queue, &record->node);
+    process_wait_record_t* record = _process_wait_record(L, 2, process,
+        &process->await.stdout_wait_queue);
 
     return _lua_process_on_stdout_resume(L, LUA_YIELD, (lua_KContext)record);
 }
@@ -587,11 +741,8 @@ static int _lua_process_await_stderr(lua_State *L)
         return api.lua->A_error(L, ERR_HINT_STDIN_DISABLED);
     }
 
-    process_wait_record_t* record = malloc(sizeof(process_wait_record_t));
-
-    record->data.process = process;
-    record->data.wait_coroutine = api_coroutine.find(L);
-    ev_list_push_back(&process->await.stderr_wait_queue, &record->node);
+    process_wait_record_t* record = _process_wait_record(L, 2, process,
+        &process->await.stderr_wait_queue);
 
     return _lua_process_on_stderr_resume(L, LUA_YIELD, (lua_KContext)record);
 }
@@ -607,6 +758,8 @@ static void _process_on_exit(uv_process_t* process, int64_t exit_status, int ter
     atd_process_t* impl = container_of(process, atd_process_t, process);
     impl->flag.process_running = 0;
 
+    uint64_t trace_beg = AUTO_TRACE_BEGIN();
+
     if (impl->belong != NULL)
     {
         /* Set exit information. */
@@ -618,6 +771,8 @@ static void _process_on_exit(uv_process_t* process, int64_t exit_status, int ter
         _process_wakeup_stderr_queue(impl->belong);
         _process_wakeup_join_queue(impl->belong);
     }
+
+    AUTO_TRACE_END("process exit", trace_beg);
 }
 
 static void _process_on_stderr(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
@@ -632,8 +787,10 @@ static void _process_on_stderr(uv_stream_t* stream, ssize_t nread, const uv_buf_
 
     if (buf->base != NULL)
     {
+        uint64_t trace_beg = AUTO_TRACE_BEGIN();
         _lua_process_stderr(impl, buf->base, nread);
         free(buf->base);
+        AUTO_TRACE_END("process stderr", trace_beg);
     }
 }
 
@@ -649,8 +806,10 @@ static void _process_on_stdout(uv_stream_t* stream, ssize_t nread, const uv_buf_
 
     if (buf->base != NULL)
     {
+        uint64_t trace_beg = AUTO_TRACE_BEGIN();
         _lua_process_stdout(impl, buf->base, nread);
         free(buf->base);
+        AUTO_TRACE_END("process stdout", trace_beg);
     }
 }
 
@@ -748,12 +907,18 @@ static int _lua_process_on_join_resume(lua_State* L, int status, lua_KContext ct
             lua_pushinteger(L, process->exit_status);
         }
 
-        ev_list_erase(&process->await.join_wait_queue, &record->node);
-        free(record);
+        _process_wait_finish(&process->await.join_wait_queue, record);
 
         return 1;
     }
 
+    int ret = _process_wait_timeout(L, &process->await.join_wait_queue, record);
+    if (ret >= 0)
+    {
+        return ret;
+    }
+
+    api_coroutine.set_state(record->data.wait_coroutine, AUTO_COROUTINE_WAIT);
     return lua_yieldk(L, 0, ctx, _lua_process_on_join_resume);
 }
 
@@ -761,11 +926,8 @@ static int _lua_process_wait_for_exit(lua_State* L)
 {
     lua_process_t* process = lua_touserdata(L, 1);
 
-    process_wait_record_t* record = malloc(sizeof(process_wait_record_t));
-    record->data.process = process;
-    record->data.wait_coroutine = api_coroutine.find(L);
-
-    ev_list_push_back(&process->await.join_wait_queue, &record->node);
+    process_wait_record_t* record = _process_wait_record(L, 2, process,
+        &process->await.join_wait_queue);
 
     return _lua_process_on_join_resume(L, LUA_YIELD, (lua_KContext)record);
 }
@@ -1,24 +1,269 @@
 #include <string.h>
+#include <errno.h>
 #include "regex.h"
+#include "runtime.h"
+#include "api/regex.h"
+#include "utils.h"
+#include "utils/mmap.h"
 
 typedef struct lua_regex
 {
-    auto_regex_code_t*  code;
+    lua_regex_cache_entry_t*    entry;
 } lua_regex_t;
 
+/**
+ * @brief Global match state.
+ *
+ * Capture groups are copied into #regex_iter_t::groups so that Lua is never
+ * called while match data is locked.
+ */
+typedef struct regex_iter
+{
+    const auto_regex_code_t*    code;       /**< Compiled regex */
+    const char*                 str;        /**< Subject */
+    size_t                      size;       /**< Subject size */
+    size_t                      offset;     /**< Next match position */
+    int                         flags;      /**< Flags for next match */
+    int                         done;       /**< No more match */
+
+    size_t                      group_sz;   /**< Group count, include the whole match */
+    size_t*                     groups;     /**< Positions of last match, (begin, end) pairs */
+} regex_iter_t;
+
+static int _regex_cache_on_cmp(const auto_map_node_t* key1, const auto_map_node_t* key2, void* arg)
+{
+    (void)arg;
+    lua_regex_cache_entry_t* e1 = container_of(key1, lua_regex_cache_entry_t, t_node);
+    lua_regex_cache_entry_t* e2 = container_of(key2, lua_regex_cache_entry_t, t_node);
+
+    if (e1->pattern.size != e2->pattern.size)
+    {
+        return e1->pattern.size < e2->pattern.size ? -1 : 1;
+    }
+    return memcmp(e1->pattern.data, e2->pattern.data, e1->pattern.size);
+}
+
+static void _regex_cache_destroy_entry(lua_regex_cache_entry_t* entry)
+{
+    api.regex->destroy(entry->code);
+    entry->code = NULL;
+    api.memory->free(entry);
+}
+
+/**
+ * @brief Remove \p entry from cache. It is destroyed if nobody use it.
+ */
+static void _regex_cache_evict(auto_runtime_t* rt, lua_regex_cache_entry_t* entry)
+{
+    ev_map_erase(&rt->regex_cache.table, &entry->t_node);
+    ev_list_erase(&rt->regex_cache.lru, &entry->q_node);
+    entry->cached = 0;
+
+    if (entry->refcnt == 0)
+    {
+        _regex_cache_destroy_entry(entry);
+    }
+}
+
+static void _regex_cache_shrink(auto_runtime_t* rt, size_t capacity)
+{
+    auto_list_node_t* it;
+    while (ev_map_size(&rt->regex_cache.table) > capacity
+        && (it = ev_list_end(&rt->regex_cache.lru)) != NULL)
+    {
+        _regex_cache_evict(rt, container_of(it, lua_regex_cache_entry_t, q_node));
+    }
+}
+
+void auto_regex_cache_init(auto_runtime_t* rt)
+{
+    ev_map_init(&rt->regex_cache.table, _regex_cache_on_cmp, NULL);
+    ev_list_init(&rt->regex_cache.lru);
+    rt->regex_cache.capacity = AUTO_REGEX_CACHE_SIZE;
+    rt->regex_cache.hit = 0;
+    rt->regex_cache.miss = 0;
+    rt->regex_cache.borrowed = NULL;
+}
+
+void auto_regex_cache_exit(auto_runtime_t* rt)
+{
+    if (rt->regex_cache.borrowed != NULL)
+    {
+        auto_regex_cache_release(rt->regex_cache.borrowed);
+        rt->regex_cache.borrowed = NULL;
+    }
+    _regex_cache_shrink(rt, 0);
+}
+
+/**
+ * @brief Find or compile regex for \p pattern, without taking reference.
+ * @return  Cache entry, or NULL if failed. The entry is not cached if cache is
+ *   disabled.
+ */
+static lua_regex_cache_entry_t* _regex_cache_get(auto_runtime_t* rt,
+    const char* pattern, size_t size, size_t* errpos)
+{
+
+    lua_regex_cache_entry_t tmp;
+    tmp.pattern.data = pattern;
+    tmp.pattern.size = size;
+
+    auto_map_node_t* it = ev_map_find(&rt->regex_cache.table, &tmp.t_node);
+    if (it != NULL)
+    {
+        lua_regex_cache_entry_t* entry = container_of(it, lua_regex_cache_entry_t, t_node);
+        rt->regex_cache.hit++;
+
+        /* Move to front as most recently used. */
+        ev_list_erase(&rt->regex_cache.lru, &entry->q_node);
+        ev_list_push_front(&rt->regex_cache.lru, &entry->q_node);
+
+        return entry;
+    }
+    rt->regex_cache.miss++;
+
+    auto_regex_code_t* code = api.regex->create(pattern, size, errpos);
+    if (code == NULL)
+    {
+        return NULL;
+    }
+
+    lua_regex_cache_entry_t* entry = api.memory->malloc(sizeof(lua_regex_cache_entry_t) + size + 1);
+    if (entry == NULL)
+    {
+        api.regex->destroy(code);
+        *errpos = SIZE_MAX;
+        return NULL;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->code = code;
+
+    char* data = (char*)(entry + 1);
+    memcpy(data, pattern, size);
+    data[size] = '\0';
+    entry->pattern.data = data;
+    entry->pattern.size = size;
+
+    if (rt->regex_cache.capacity == 0)
+    {
+        return entry;
+    }
+
+    /* Make room for new entry. */
+    _regex_cache_shrink(rt, rt->regex_cache.capacity - 1);
+
+    entry->cached = 1;
+    ev_map_insert(&rt->regex_cache.table, &entry->t_node);
+    ev_list_push_front(&rt->regex_cache.lru, &entry->q_node);
+
+    return entry;
+}
+
+lua_regex_cache_entry_t* auto_regex_cache_acquire(lua_State* L,
+    const char* pattern, size_t size, size_t* errpos)
+{
+    lua_regex_cache_entry_t* entry = _regex_cache_get(auto_get_runtime(L), pattern, size, errpos);
+    if (entry != NULL)
+    {
+        entry->refcnt++;
+    }
+    return entry;
+}
+
+lua_regex_cache_entry_t* auto_regex_cache_borrow(lua_State* L,
+    const char* pattern, size_t size, size_t* errpos)
+{
+    auto_runtime_t* rt = auto_get_runtime(L);
+    lua_regex_cache_entry_t* entry = _regex_cache_get(rt, pattern, size, errpos);
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    /*
+     * Runtime hold the last borrowed one, so it survives eviction by finalizers
+     * and caller need not release it.
+     */
+    entry->refcnt++;
+    if (rt->regex_cache.borrowed != NULL)
+    {
+        auto_regex_cache_release(rt->regex_cache.borrowed);
+    }
+    rt->regex_cache.borrowed = entry;
+
+    return entry;
+}
+
+int auto_regex_cache_error(lua_State* L, size_t errpos)
+{
+    if (errpos == SIZE_MAX)
+    {
+        return api.lua->A_error(L, "out of memory");
+    }
+    return api.lua->A_error(L, "compile regex failed at position %d", (int)errpos);
+}
+
+void auto_regex_cache_release(lua_regex_cache_entry_t* entry)
+{
+    entry->refcnt--;
+
+    if (entry->refcnt == 0 && !entry->cached)
+    {
+        _regex_cache_destroy_entry(entry);
+    }
+}
+
 static int _regex_lua_gc(lua_State* L)
 {
     lua_regex_t* self = lua_touserdata(L, 1);
 
-    if (self->code != NULL)
+    if (self->entry != NULL)
     {
-        api.regex->destroy(self->code);
-        self->code = NULL;
+        auto_regex_cache_release(self->entry);
+        self->entry = NULL;
     }
 
     return 0;
 }
 
+static int _regex_lua_match_data_gc(lua_State* L)
+{
+    auto_regex_match_data_t** match_data = lua_touserdata(L, 1);
+
+    if (*match_data != NULL)
+    {
+        api.regex->match_data_destroy(*match_data);
+        *match_data = NULL;
+    }
+
+    return 0;
+}
+
+auto_regex_match_data_t* auto_regex_match_data_push(lua_State* L, const auto_regex_code_t* code)
+{
+    if (api.regex->get_group_count(code) <= AUTO_REGEX_STACK_GROUPS)
+    {
+        lua_pushnil(L);
+        return NULL;
+    }
+
+    auto_regex_match_data_t** match_data = lua_newuserdata(L, sizeof(auto_regex_match_data_t*));
+    *match_data = NULL;
+    if (luaL_newmetatable(L, "__auto_regex_match_data") != 0)
+    {
+        lua_pushcfunction(L, _regex_lua_match_data_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    if ((*match_data = api.regex->match_data_create(code)) == NULL)
+    {
+        api.lua->A_error(L, "out of memory");
+        return NULL;
+    }
+    return *match_data;
+}
+
 static void _regex_match_cb(const char* subject, size_t* groups, size_t group_sz, void* arg)
 {
     lua_State* L = arg;
@@ -64,7 +309,10 @@ static int _regex_lua_match(lua_State* L)
         }
     }
 
-    if (api.regex->match(self->code, str, str_size, offset, _regex_match_cb, L) < 0)
+    lua_settop(L, 2);
+    auto_regex_match_data_t* match_data = auto_regex_match_data_push(L, self->entry->code);
+    if (api.regex->match_ex(self->entry->code, str, str_size, offset, 0, match_data,
+        _regex_match_cb, L) < 0)
     {
         lua_pushnil(L);
     }
@@ -72,6 +320,627 @@ static int _regex_lua_match(lua_State* L)
     return 1;
 }
 
+static void _regex_iter_match_cb(const char* subject, size_t* groups, size_t group_sz, void* arg)
+{
+    (void)subject;
+    regex_iter_t* iter = arg;
+
+    size_t i;
+    for (i = 0; i < iter->group_sz; i++)
+    {
+        if (i < group_sz)
+        {
+            iter->groups[2 * i] = groups[2 * i];
+            iter->groups[2 * i + 1] = groups[2 * i + 1];
+        }
+        else
+        {
+            iter->groups[2 * i] = (size_t)-1;
+            iter->groups[2 * i + 1] = (size_t)-1;
+        }
+    }
+}
+
+/**
+ * @brief Create global match state as userdata on top of stack.
+ */
+static regex_iter_t* _regex_iter_new(lua_State* L, lua_regex_t* self,
+    const char* str, size_t size, size_t offset)
+{
+    size_t group_sz = api.regex->get_group_count(self->entry->code);
+    regex_iter_t* iter = lua_newuserdata(L, sizeof(regex_iter_t) + sizeof(size_t) * 2 * group_sz);
+
+    iter->code = self->entry->code;
+    iter->str = str;
+    iter->size = size;
+    iter->offset = offset;
+    iter->flags = 0;
+    iter->done = offset > size;
+    iter->group_sz = group_sz;
+    iter->groups = (size_t*)(iter + 1);
+
+    return iter;
+}
+
+/**
+ * @brief Find next match.
+ *
+ * After an empty match, try a non-empty match at the same position, then
+ * advance one character. This is the same as Perl's /g.
+ *
+ * @return  0 if match, -1 if no more match.
+ */
+static int _regex_iter_next(regex_iter_t* iter)
+{
+    while (!iter->done)
+    {
+        int retry = iter->flags & AUTO_REGEX_ANCHORED;
+        int ret = api.regex->match_ex(iter->code, iter->str, iter->size, iter->offset,
+            iter->flags, NULL, _regex_iter_match_cb, iter);
+
+        /* Subject is checked by first match. */
+        iter->flags = AUTO_REGEX_NO_UTF_CHECK;
+
+        if (ret >= 0)
+        {
+            /* Pattern with \K may end before it starts. */
+            if (iter->groups[1] > iter->offset)
+            {
+                iter->offset = iter->groups[1];
+            }
+            if (iter->groups[0] == iter->groups[1])
+            {
+                iter->flags |= AUTO_REGEX_NOTEMPTY_ATSTART | AUTO_REGEX_ANCHORED;
+            }
+            return 0;
+        }
+
+        if (!retry || iter->offset >= iter->size)
+        {
+            break;
+        }
+
+        /* No non-empty match after an empty one, skip one UTF-8 character. */
+        iter->offset++;
+        while (iter->offset < iter->size && ((unsigned char)iter->str[iter->offset] & 0xC0) == 0x80)
+        {
+            iter->offset++;
+        }
+    }
+
+    iter->done = 1;
+    return -1;
+}
+
+/**
+ * @brief Get optional offset at \p idx.
+ */
+static size_t _regex_opt_offset(lua_State* L, int idx)
+{
+    if (lua_type(L, idx) == LUA_TNUMBER)
+    {
+        lua_Integer tmp_offset = lua_tointeger(L, idx);
+        if (tmp_offset > 0)
+        {
+            return (size_t)tmp_offset;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Push captures of last match, or the whole match if no capture.
+ *
+ * Unset group is pushed as false.
+ *
+ * @return  Number of values pushed.
+ */
+static int _regex_push_captures(lua_State* L, regex_iter_t* iter)
+{
+    size_t i = iter->group_sz > 1 ? 1 : 0;
+    int cnt = (int)(iter->group_sz - i);
+    luaL_checkstack(L, cnt, "too many captures");
+
+    for (; i < iter->group_sz; i++)
+    {
+        size_t pos_beg = iter->groups[2 * i], pos_end = iter->groups[2 * i + 1];
+        if (pos_beg == (size_t)-1)
+        {
+            lua_pushboolean(L, 0);
+            continue;
+        }
+        lua_pushlstring(L, iter->str + pos_beg, pos_end - pos_beg);
+    }
+
+    return cnt;
+}
+
+static int _regex_lua_gmatch_next(lua_State* L)
+{
+    regex_iter_t* iter = lua_touserdata(L, lua_upvalueindex(3));
+
+    if (_regex_iter_next(iter) != 0)
+    {
+        return 0;
+    }
+
+    return _regex_push_captures(L, iter);
+}
+
+static int _regex_lua_gmatch(lua_State* L)
+{
+    lua_regex_t* self = lua_touserdata(L, 1);
+
+    size_t str_size;
+    const char* str = luaL_checklstring(L, 2, &str_size);
+    size_t offset = _regex_opt_offset(L, 3);
+
+    /* Keep regex and subject alive as upvalues. */
+    lua_settop(L, 2);
+    _regex_iter_new(L, self, str, str_size, offset);
+    lua_pushcclosure(L, _regex_lua_gmatch_next, 3);
+
+    return 1;
+}
+
+/**
+ * @brief Push absolute offset of last match followed by captures.
+ */
+static int _regex_push_offset_captures(lua_State* L, regex_iter_t* iter, size_t base)
+{
+    lua_pushinteger(L, (lua_Integer)(base + iter->groups[0]));
+    return _regex_push_captures(L, iter) + 1;
+}
+
+static int _regex_lua_mmap_gc(lua_State* L)
+{
+    auto_mmap_t* map = lua_touserdata(L, 1);
+    auto_mmap_close(map);
+    return 0;
+}
+
+static int _regex_lua_gmatch_file_next(lua_State* L)
+{
+    regex_iter_t* iter = lua_touserdata(L, lua_upvalueindex(3));
+
+    if (_regex_iter_next(iter) != 0)
+    {
+        return 0;
+    }
+
+    return _regex_push_offset_captures(L, iter, 0);
+}
+
+static int _regex_lua_gmatch_file(lua_State* L)
+{
+    lua_regex_t* self = lua_touserdata(L, 1);
+    const char* path = luaL_checkstring(L, 2);
+    size_t offset = _regex_opt_offset(L, 3);
+    lua_settop(L, 1);
+
+    auto_mmap_t* map = lua_newuserdata(L, sizeof(auto_mmap_t));
+    memset(map, 0, sizeof(*map));
+    if (luaL_newmetatable(L, "__auto_regex_mmap") != 0)
+    {
+        lua_pushcfunction(L, _regex_lua_mmap_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    int errcode = auto_mmap_open(map, path);
+    if (errcode == ENODEV)
+    {
+        return api.lua->A_error(L, "`%s` is not a regular file, use regex:gmatch_stream() instead", path);
+    }
+    if (errcode != 0)
+    {
+        char buf[256];
+        return api.lua->A_error(L, "open `%s` failed: %s", path,
+            auto_strerror(errcode, buf, sizeof(buf)));
+    }
+
+    /* Regex and mapping are kept alive as upvalues. */
+    _regex_iter_new(L, self, map->data != NULL ? map->data : "", map->size, offset);
+    lua_pushcclosure(L, _regex_lua_gmatch_file_next, 3);
+
+    return 1;
+}
+
+/**
+ * @brief Global match state over a stream.
+ *
+ * #regex_stream_t::iter works on the buffered data. The buffer only keeps
+ * data that may be part of a future match: the start of a partial match and
+ * enough characters before it for lookbehind.
+ */
+typedef struct regex_stream
+{
+    char*                       buf;        /**< Buffered data */
+    size_t                      buf_sz;     /**< Buffered data size */
+    size_t                      buf_cap;    /**< Buffer capacity */
+    size_t                      base;       /**< Absolute offset of buffer */
+    size_t                      keep;       /**< Bytes to keep before match start */
+    int                         eof;        /**< Reader finished */
+    regex_iter_t*               iter;       /**< Match state */
+} regex_stream_t;
+
+static int _regex_lua_stream_gc(lua_State* L)
+{
+    regex_stream_t* stream = lua_touserdata(L, 1);
+
+    if (stream->buf != NULL)
+    {
+        api.memory->free(stream->buf);
+        stream->buf = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Size of data without incomplete UTF-8 character at the end.
+ */
+static size_t _regex_utf8_complete_size(const char* data, size_t size)
+{
+    size_t pos = size, i;
+    for (i = 0; i < 4 && pos > 0; i++)
+    {
+        unsigned char c = (unsigned char)data[--pos];
+        if ((c & 0xC0) == 0x80)
+        {
+            continue;
+        }
+
+        size_t need = c < 0x80 ? 1 : (c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 1)));
+        return size - pos >= need ? size : pos;
+    }
+    return size;
+}
+
+/**
+ * @brief Drop data that is not needed by next match and read next chunk.
+ */
+static void _regex_stream_read(lua_State* L, regex_stream_t* stream)
+{
+    regex_iter_t* iter = stream->iter;
+
+    /* Drop consumed data. */
+    size_t drop = iter->offset > stream->keep ? iter->offset - stream->keep : 0;
+    if (drop > 0)
+    {
+        memmove(stream->buf, stream->buf + drop, stream->buf_sz - drop);
+        stream->buf_sz -= drop;
+        stream->base += drop;
+        iter->offset -= drop;
+    }
+
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_call(L, 0, 1);
+
+    size_t data_sz = 0;
+    const char* data = lua_tolstring(L, -1, &data_sz);
+    if (data == NULL)
+    {
+        stream->eof = 1;
+        lua_pop(L, 1);
+        return;
+    }
+
+    if (stream->buf_sz + data_sz > stream->buf_cap)
+    {
+        size_t new_cap = stream->buf_cap * 2;
+        if (new_cap < stream->buf_sz + data_sz)
+        {
+            new_cap = stream->buf_sz + data_sz;
+        }
+        stream->buf = api.memory->realloc(stream->buf, new_cap);
+        stream->buf_cap = new_cap;
+    }
+    memcpy(stream->buf + stream->buf_sz, data, data_sz);
+    stream->buf_sz += data_sz;
+    lua_pop(L, 1);
+
+    /* New data is not checked yet. */
+    iter->flags &= ~AUTO_REGEX_NO_UTF_CHECK;
+}
+
+static int _regex_lua_gmatch_stream_next(lua_State* L)
+{
+    regex_stream_t* stream = lua_touserdata(L, lua_upvalueindex(3));
+    regex_iter_t* iter = stream->iter;
+
+    while (!iter->done)
+    {
+        size_t avail = stream->eof ? stream->buf_sz
+            : _regex_utf8_complete_size(stream->buf, stream->buf_sz);
+
+        /* Wait for more data before matching at end of buffer. */
+        if (!stream->eof && iter->offset >= avail)
+        {
+            _regex_stream_read(L, stream);
+            continue;
+        }
+
+        int flags = iter->flags;
+        int retry = flags & AUTO_REGEX_ANCHORED;
+        if (!stream->eof)
+        {
+            flags |= AUTO_REGEX_PARTIAL;
+        }
+        if (stream->base > 0)
+        {
+            flags |= AUTO_REGEX_NOTBOL;
+        }
+
+        iter->str = stream->buf != NULL ? stream->buf : "";
+        iter->size = avail;
+        int ret = api.regex->match_ex(iter->code, iter->str, avail, iter->offset,
+            flags, NULL, _regex_iter_match_cb, iter);
+
+        if (ret == 0)
+        {
+            /* Partial match, need more data. Nothing match before it. */
+            iter->offset = iter->groups[0];
+            _regex_stream_read(L, stream);
+            continue;
+        }
+
+        iter->flags = AUTO_REGEX_NO_UTF_CHECK;
+
+        if (ret > 0)
+        {
+            if (iter->groups[1] > iter->offset)
+            {
+                iter->offset = iter->groups[1];
+            }
+            if (iter->groups[0] == iter->groups[1])
+            {
+                iter->flags |= AUTO_REGEX_NOTEMPTY_ATSTART | AUTO_REGEX_ANCHORED;
+            }
+            return _regex_push_offset_captures(L, iter, stream->base);
+        }
+
+        if (retry && iter->offset < avail)
+        {
+            /* No non-empty match after an empty one, skip one UTF-8 character. */
+            iter->offset++;
+            while (iter->offset < avail && ((unsigned char)iter->str[iter->offset] & 0xC0) == 0x80)
+            {
+                iter->offset++;
+            }
+            continue;
+        }
+
+        if (stream->eof)
+        {
+            break;
+        }
+
+        /* No match start before end of data. */
+        iter->offset = avail;
+        _regex_stream_read(L, stream);
+    }
+
+    iter->done = 1;
+    return 0;
+}
+
+static int _regex_lua_gmatch_stream(lua_State* L)
+{
+    lua_regex_t* self = lua_touserdata(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_settop(L, 2);
+
+    regex_stream_t* stream = lua_newuserdata(L, sizeof(regex_stream_t));
+    memset(stream, 0, sizeof(*stream));
+    if (luaL_newmetatable(L, "__auto_regex_stream") != 0)
+    {
+        lua_pushcfunction(L, _regex_lua_stream_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    /* A word boundary looks back one character, UTF-8 character is at most 4 bytes. */
+    size_t lookbehind = api.regex->get_max_lookbehind(self->entry->code);
+    stream->keep = (lookbehind > 0 ? lookbehind : 1) * 4;
+
+    /* Keep state alive by uservalue of stream. */
+    stream->iter = _regex_iter_new(L, self, "", 0, 0);
+    lua_setiuservalue(L, -2, 1);
+
+    lua_pushcclosure(L, _regex_lua_gmatch_stream_next, 3);
+    return 1;
+}
+
+static int _regex_lua_find_all(lua_State* L)
+{
+    lua_regex_t* self = lua_touserdata(L, 1);
+
+    size_t str_size;
+    const char* str = luaL_checklstring(L, 2, &str_size);
+    size_t offset = _regex_opt_offset(L, 3);
+
+    regex_iter_t* iter = _regex_iter_new(L, self, str, str_size, offset);
+    lua_newtable(L);
+
+    lua_Integer idx = 1;
+    while (_regex_iter_next(iter) == 0)
+    {
+        lua_pushinteger(L, (lua_Integer)iter->groups[0]);
+        lua_rawseti(L, -2, idx++);
+        lua_pushinteger(L, (lua_Integer)(iter->groups[1] - iter->groups[0]));
+        lua_rawseti(L, -2, idx++);
+    }
+
+    return 1;
+}
+
+static int _regex_lua_count(lua_State* L)
+{
+    lua_regex_t* self = lua_touserdata(L, 1);
+
+    size_t str_size;
+    const char* str = luaL_checklstring(L, 2, &str_size);
+    size_t offset = _regex_opt_offset(L, 3);
+
+    regex_iter_t* iter = _regex_iter_new(L, self, str, str_size, offset);
+
+    lua_Integer cnt = 0;
+    while (_regex_iter_next(iter) == 0)
+    {
+        cnt++;
+    }
+
+    lua_pushinteger(L, cnt);
+    return 1;
+}
+
+/**
+ * @brief Append group \p idx of last match.
+ */
+static void _regex_replace_add_group(lua_State* L, luaL_Buffer* buf, regex_iter_t* iter, size_t idx)
+{
+    if (idx >= iter->group_sz)
+    {
+        api.lua->A_error(L, "invalid capture index $%d in replacement string", (int)idx);
+        return;
+    }
+
+    size_t pos_beg = iter->groups[2 * idx], pos_end = iter->groups[2 * idx + 1];
+    if (pos_beg != (size_t)-1)
+    {
+        luaL_addlstring(buf, iter->str + pos_beg, pos_end - pos_beg);
+    }
+}
+
+/**
+ * @brief Expand replacement template.
+ *
+ * `$n` or `${n}` is replaced by group n, `$$` is a literal `$`.
+ */
+static void _regex_replace_add_template(lua_State* L, luaL_Buffer* buf, regex_iter_t* iter,
+    const char* repl, size_t repl_size)
+{
+    size_t i;
+    for (i = 0; i < repl_size; i++)
+    {
+        if (repl[i] != '$' || i + 1 == repl_size)
+        {
+            luaL_addchar(buf, repl[i]);
+            continue;
+        }
+
+        char c = repl[++i];
+        if (c == '$')
+        {
+            luaL_addchar(buf, '$');
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            _regex_replace_add_group(L, buf, iter, (size_t)(c - '0'));
+        }
+        else if (c == '{')
+        {
+            size_t idx = 0;
+            for (i++; i < repl_size && repl[i] >= '0' && repl[i] <= '9'; i++)
+            {
+                idx = idx * 10 + (size_t)(repl[i] - '0');
+            }
+            if (i == repl_size || repl[i] != '}')
+            {
+                api.lua->A_error(L, "malformed ${n} in replacement string");
+                return;
+            }
+            _regex_replace_add_group(L, buf, iter, idx);
+        }
+        else
+        {
+            luaL_addchar(buf, '$');
+            luaL_addchar(buf, c);
+        }
+    }
+}
+
+/**
+ * @brief Append result of replacement function for last match.
+ */
+static void _regex_replace_add_call(lua_State* L, luaL_Buffer* buf, regex_iter_t* iter, int func_idx)
+{
+    lua_pushvalue(L, func_idx);
+    int cnt = _regex_push_captures(L, iter);
+    lua_call(L, cnt, 1);
+
+    if (!lua_toboolean(L, -1))
+    {
+        /* Keep original text. */
+        lua_pop(L, 1);
+        luaL_addlstring(buf, iter->str + iter->groups[0], iter->groups[1] - iter->groups[0]);
+        return;
+    }
+    if (!lua_isstring(L, -1))
+    {
+        api.lua->A_error(L, "invalid replacement value (a %s)", luaL_typename(L, -1));
+        return;
+    }
+    luaL_addvalue(buf);
+}
+
+static int _regex_lua_replace(lua_State* L)
+{
+    lua_regex_t* self = lua_touserdata(L, 1);
+
+    size_t str_size;
+    const char* str = luaL_checklstring(L, 2, &str_size);
+
+    size_t repl_size = 0;
+    const char* repl = NULL;
+    int repl_type = lua_type(L, 3);
+    if (repl_type == LUA_TSTRING || repl_type == LUA_TNUMBER)
+    {
+        repl = lua_tolstring(L, 3, &repl_size);
+    }
+    else if (repl_type != LUA_TFUNCTION)
+    {
+        return api.lua->A_error(L, "bad argument #2 to 'replace' (string or function expected)");
+    }
+
+    lua_Integer max_cnt = luaL_optinteger(L, 4, LUA_MAXINTEGER);
+
+    regex_iter_t* iter = _regex_iter_new(L, self, str, str_size, 0);
+
+    luaL_Buffer buf;
+    luaL_buffinit(L, &buf);
+
+    size_t last = 0;
+    lua_Integer cnt = 0;
+    while (cnt < max_cnt && _regex_iter_next(iter) == 0)
+    {
+        if (iter->groups[0] < last)
+        {
+            continue;
+        }
+        luaL_addlstring(&buf, str + last, iter->groups[0] - last);
+
+        if (repl != NULL)
+        {
+            _regex_replace_add_template(L, &buf, iter, repl, repl_size);
+        }
+        else
+        {
+            _regex_replace_add_call(L, &buf, iter, 3);
+        }
+
+        last = iter->groups[1];
+        cnt++;
+    }
+    luaL_addlstring(&buf, str + last, str_size - last);
+
+    luaL_pushresult(&buf);
+    lua_pushinteger(L, cnt);
+
+    return 2;
+}
+
 static void _regex_set_metatable(lua_State* L)
 {
     static const luaL_Reg s_regex_meta[] = {
@@ -80,6 +949,12 @@ static void _regex_set_metatable(lua_State* L)
     };
     static const luaL_Reg s_regex_method[] = {
         { "match",      _regex_lua_match },
+        { "gmatch",     _regex_lua_gmatch },
+        { "gmatch_file",_regex_lua_gmatch_file },
+        { "gmatch_stream", _regex_lua_gmatch_stream },
+        { "find_all",   _regex_lua_find_all },
+        { "count",      _regex_lua_count },
+        { "replace",    _regex_lua_replace },
         { NULL,         NULL },
     };
     if (luaL_newmetatable(L, "__auto_regex") != 0)
@@ -101,10 +976,39 @@ int auto_lua_regex(lua_State* L)
     _regex_set_metatable(L);
 
     size_t err_pos;
-    if ((self->code = api.regex->create(pattern, pattern_size, &err_pos)) == NULL)
+    if ((self->entry = auto_regex_cache_acquire(L, pattern, pattern_size, &err_pos)) == NULL)
     {
-        return api.lua->A_error(L, "compile regex failed at position %d", (int)err_pos);
+        return auto_regex_cache_error(L, err_pos);
     }
 
     return 1;
 }
+
+int auto_lua_regex_cache(lua_State* L)
+{
+    auto_runtime_t* rt = auto_get_runtime(L);
+
+    /* Update capacity if required. */
+    if (lua_type(L, 1) == LUA_TNUMBER)
+    {
+        lua_Integer capacity = lua_tointeger(L, 1);
+        rt->regex_cache.capacity = capacity > 0 ? (size_t)capacity : 0;
+        _regex_cache_shrink(rt, rt->regex_cache.capacity);
+    }
+
+    lua_newtable(L);
+
+    lua_pushinteger(L, (lua_Integer)rt->regex_cache.capacity);
+    lua_setfield(L, -2, "capacity");
+
+    lua_pushinteger(L, (lua_Integer)ev_map_size(&rt->regex_cache.table));
+    lua_setfield(L, -2, "size");
+
+    lua_pushinteger(L, (lua_Integer)rt->regex_cache.hit);
+    lua_setfield(L, -2, "hit");
+
+    lua_pushinteger(L, (lua_Integer)rt->regex_cache.miss);
+    lua_setfield(L, -2, "miss");
+
+    return 1;
+}
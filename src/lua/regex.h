@@ -7,6 +7,26 @@
 extern "C" {
 #endif
 
+struct auto_runtime;
+
+/**
+ * @brief Compiled regex shared through the runtime regex cache.
+ */
+typedef struct lua_regex_cache_entry
+{
+    auto_map_node_t         t_node;     /**< Cache table node */
+    auto_list_node_t        q_node;     /**< LRU queue node, most recently used at front */
+    auto_regex_code_t*      code;       /**< Compiled regex */
+    size_t                  refcnt;     /**< Number of active users */
+    int                     cached;     /**< Whether still tracked by cache */
+
+    struct
+    {
+        const char*         data;       /**< Pattern bytes */
+        size_t              size;       /**< Pattern size in bytes */
+    } pattern;
+} lua_regex_cache_entry_t;
+
 /**
  * @brief Regex
  * @param[in] L     Lua VM.
@@ -14,6 +34,74 @@ extern "C" {
  */
 AUTO_LOCAL int auto_lua_regex(lua_State* L);
 
+/**
+ * @brief Query and configure regex cache.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_regex_cache(lua_State* L);
+
+/**
+ * @brief Initialize regex cache.
+ * @param[in] rt    Global runtime.
+ */
+AUTO_LOCAL void auto_regex_cache_init(struct auto_runtime* rt);
+
+/**
+ * @brief Release all cached regex that is not in use.
+ * @param[in] rt    Global runtime.
+ */
+AUTO_LOCAL void auto_regex_cache_exit(struct auto_runtime* rt);
+
+/**
+ * @brief Get compiled regex for \p pattern, compile it if not cached.
+ * @note Release it by #auto_regex_cache_release() after use.
+ * @param[in] L         Lua VM.
+ * @param[in] pattern   Regex pattern.
+ * @param[in] size      Regex pattern size.
+ * @param[out] errpos   The error position if compile failed, or SIZE_MAX if
+ *   out of memory.
+ * @return              Cache entry, or NULL if failed.
+ */
+AUTO_LOCAL lua_regex_cache_entry_t* auto_regex_cache_acquire(lua_State* L,
+    const char* pattern, size_t size, size_t* errpos);
+
+/**
+ * @brief Same as #auto_regex_cache_acquire(), but caller need not release it.
+ * @warning The entry is only valid until next borrow, so it must not be kept
+ *   after calling any function that may borrow regex.
+ */
+AUTO_LOCAL lua_regex_cache_entry_t* auto_regex_cache_borrow(lua_State* L,
+    const char* pattern, size_t size, size_t* errpos);
+
+/**
+ * @brief Push match data for callback that may raise error.
+ *
+ * Patterns with few groups need no match data, nil is pushed. Otherwise the
+ * match data is owned by userdata on top of stack, so it is released by GC
+ * even if callback raise error.
+ *
+ * @param[in] L         Lua VM.
+ * @param[in] code      Compiled regex.
+ * @return              Match data for #auto_api_regex_t::match_ex(), or NULL.
+ */
+AUTO_LOCAL auto_regex_match_data_t* auto_regex_match_data_push(lua_State* L,
+    const auto_regex_code_t* code);
+
+/**
+ * @brief Raise error for failed #auto_regex_cache_acquire().
+ * @param[in] L         Lua VM.
+ * @param[in] errpos    Error position.
+ * @return              This function never returns.
+ */
+AUTO_LOCAL int auto_regex_cache_error(lua_State* L, size_t errpos);
+
+/**
+ * @brief Release cache entry returned by #auto_regex_cache_acquire().
+ * @param[in] entry     Cache entry.
+ */
+AUTO_LOCAL void auto_regex_cache_release(lua_regex_cache_entry_t* entry);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,554 @@
+#include <string.h>
+#include "regex_set.h"
+#include "regex.h"
+#include "utils/aho_corasick.h"
+
+typedef struct lua_regex_set_item
+{
+    lua_regex_cache_entry_t* entry;     /**< Compiled regex from regex cache */
+    int                     has_literal;/**< Only match if literal found by prefilter */
+    uint32_t                stamp;      /**< Generation when literal found */
+} lua_regex_set_item_t;
+
+typedef struct lua_regex_set
+{
+    lua_regex_set_item_t*   items;      /**< Patterns */
+    size_t                  size;       /**< Pattern count */
+    auto_ac_t*              prefilter;  /**< Literal prefilter, NULL if no literal */
+    uint32_t                generation; /**< Increase on every match */
+} lua_regex_set_t;
+
+#define IS_ALNUM(c) \
+    (((c) >= '0' && (c) <= '9') || ((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
+
+#define IS_DIGIT(c) \
+    ((c) >= '0' && (c) <= '9')
+
+#define IS_HEX(c) \
+    (IS_DIGIT(c) || ((c) >= 'a' && (c) <= 'f') || ((c) >= 'A' && (c) <= 'F'))
+
+/**
+ * @brief Skip to the position after \p end_c.
+ */
+static size_t _regex_set_skip_to(const char* pattern, size_t size, size_t pos, char end_c)
+{
+    while (pos < size && pattern[pos] != end_c)
+    {
+        pos++;
+    }
+    return pos < size ? pos + 1 : size;
+}
+
+/**
+ * @brief Skip quoted sequence, in which everything is literal.
+ * @param[in] pos   Position after `\Q`.
+ * @return          Position after `\E`, or \p size if not terminated.
+ */
+static size_t _regex_set_skip_quote(const char* pattern, size_t size, size_t pos)
+{
+    for (; pos + 1 < size; pos++)
+    {
+        if (pattern[pos] == '\\' && pattern[pos + 1] == 'E')
+        {
+            return pos + 2;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Skip character class.
+ * @param[in] pos   Position of `[`.
+ * @return          Position after `]`.
+ */
+static size_t _regex_set_skip_class(const char* pattern, size_t size, size_t pos)
+{
+    pos++;
+    if (pos < size && pattern[pos] == '^')
+    {
+        pos++;
+    }
+    /* Leading `]` is literal. */
+    if (pos < size && pattern[pos] == ']')
+    {
+        pos++;
+    }
+
+    while (pos < size && pattern[pos] != ']')
+    {
+        if (pattern[pos] == '\\' && pos + 1 < size && pattern[pos + 1] == 'Q')
+        {
+            pos = _regex_set_skip_quote(pattern, size, pos + 2);
+        }
+        else if (pattern[pos] == '\\')
+        {
+            pos += 2;
+        }
+        else if (pattern[pos] == '[' && pos + 1 < size && pattern[pos + 1] == ':')
+        {
+            /* POSIX class like [:alpha:] */
+            pos = _regex_set_skip_to(pattern, size, pos + 2, ']');
+        }
+        else
+        {
+            pos++;
+        }
+    }
+
+    return pos < size ? pos + 1 : size;
+}
+
+/**
+ * @brief Skip escape sequence that is not a literal.
+ * @param[in] pos   Position of the letter after `\`.
+ * @return          Position after the escape sequence.
+ */
+static size_t _regex_set_skip_escape(const char* pattern, size_t size, size_t pos)
+{
+    char c = pattern[pos++];
+    if (pos >= size)
+    {
+        return size;
+    }
+
+    char n = pattern[pos];
+    if (n == '{' && (c == 'x' || c == 'o' || c == 'N' || c == 'p' || c == 'P' || c == 'g' || c == 'k'))
+    {
+        return _regex_set_skip_to(pattern, size, pos + 1, '}');
+    }
+    if ((c == 'g' || c == 'k') && (n == '<' || n == '\''))
+    {
+        return _regex_set_skip_to(pattern, size, pos + 1, n == '<' ? '>' : '\'');
+    }
+
+    size_t i;
+    switch (c)
+    {
+    case 'x':
+        for (i = 0; i < 2 && pos < size && IS_HEX(pattern[pos]); i++)
+        {
+            pos++;
+        }
+        break;
+
+    case 'c':
+        pos++;
+        break;
+
+    case 'g':
+        if (n == '+' || n == '-')
+        {
+            pos++;
+        }
+        /* fall through */
+    default:
+        if (c == 'g' || IS_DIGIT(c))
+        {
+            while (pos < size && IS_DIGIT(pattern[pos]))
+            {
+                pos++;
+            }
+        }
+        break;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Check if `{` at \p pos starts a quantifier.
+ * @return          Position after `}`, or 0 if not a quantifier.
+ */
+static size_t _regex_set_quantifier_end(const char* pattern, size_t size, size_t pos)
+{
+    int digits = 0;
+    for (pos++; pos < size && (IS_DIGIT(pattern[pos]) || pattern[pos] == ','); pos++)
+    {
+        digits += IS_DIGIT(pattern[pos]);
+    }
+    if (pos < size && pattern[pos] == '}' && digits > 0)
+    {
+        return pos + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check if `(` at \p pos sets options for the rest of pattern, like `(?i)`.
+ */
+static int _regex_set_is_option_setting(const char* pattern, size_t size, size_t pos)
+{
+    if (pos + 1 >= size || pattern[pos + 1] != '?')
+    {
+        return 0;
+    }
+
+    for (pos += 2; pos < size; pos++)
+    {
+        char c = pattern[pos];
+        if (c == ')')
+        {
+            return 1;
+        }
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '^'))
+        {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Remove last UTF-8 character.
+ */
+static size_t _regex_set_drop_last(const char* buf, size_t len)
+{
+    while (len > 0 && ((unsigned char)buf[len - 1] & 0xC0) == 0x80)
+    {
+        len--;
+    }
+    return len > 0 ? len - 1 : 0;
+}
+
+/**
+ * @brief Extract the longest literal that every match of \p pattern contains.
+ *
+ * Only literal runs outside of groups are considered. The extraction is
+ * conservative: if the pattern has top-level alternation or changes options
+ * for the rest of the pattern, no literal is returned.
+ *
+ * @param[in] pattern   Regex pattern.
+ * @param[in] size      Pattern size.
+ * @param[out] best     Buffer to store literal, at least \p size bytes.
+ * @param[in] cur       Scratch buffer, at least \p size bytes.
+ * @return              Literal size, 0 if not found.
+ */
+static size_t _regex_set_literal(const char* pattern, size_t size, char* best, char* cur)
+{
+    size_t best_len = 0, cur_len = 0;
+    int depth = 0;
+
+#define FLUSH_RUN() \
+    do {\
+        if (cur_len > best_len) {\
+            memcpy(best, cur, cur_len);\
+            best_len = cur_len;\
+        }\
+        cur_len = 0;\
+    } while (0)
+
+    size_t pos = 0;
+    while (pos < size)
+    {
+        char c = pattern[pos];
+
+        if (depth > 0)
+        {
+            /* Quoted `(` and `)` do not change depth. */
+            if (c == '\\' && pos + 1 < size && pattern[pos + 1] == 'Q')
+            {
+                pos = _regex_set_skip_quote(pattern, size, pos + 2);
+                continue;
+            }
+            if (c == '\\')
+            {
+                pos += 2;
+                continue;
+            }
+            if (c == '[')
+            {
+                pos = _regex_set_skip_class(pattern, size, pos);
+                continue;
+            }
+            depth += c == '(' ? 1 : (c == ')' ? -1 : 0);
+            pos++;
+            continue;
+        }
+
+        size_t end;
+        switch (c)
+        {
+        case '\\':
+            if (pos + 1 >= size)
+            {
+                return 0;
+            }
+            c = pattern[pos + 1];
+            if (c == 'Q')
+            {
+                for (pos += 2; pos < size; pos++)
+                {
+                    if (pattern[pos] == '\\' && pos + 1 < size && pattern[pos + 1] == 'E')
+                    {
+                        pos += 2;
+                        break;
+                    }
+                    cur[cur_len++] = pattern[pos];
+                }
+                continue;
+            }
+            if (IS_ALNUM(c))
+            {
+                FLUSH_RUN();
+                pos = _regex_set_skip_escape(pattern, size, pos + 1);
+                continue;
+            }
+            cur[cur_len++] = c;
+            pos += 2;
+            continue;
+
+        case '[':
+            FLUSH_RUN();
+            pos = _regex_set_skip_class(pattern, size, pos);
+            continue;
+
+        case '(':
+            if (_regex_set_is_option_setting(pattern, size, pos))
+            {
+                return 0;
+            }
+            FLUSH_RUN();
+            depth = 1;
+            break;
+
+        case ')':
+        case '|':
+            return 0;
+
+        case '?':
+        case '*':
+            cur_len = _regex_set_drop_last(cur, cur_len);
+            FLUSH_RUN();
+            break;
+
+        case '+':
+            FLUSH_RUN();
+            break;
+
+        case '{':
+            if ((end = _regex_set_quantifier_end(pattern, size, pos)) != 0)
+            {
+                cur_len = _regex_set_drop_last(cur, cur_len);
+                FLUSH_RUN();
+                pos = end;
+                continue;
+            }
+            FLUSH_RUN();
+            break;
+
+        case '.':
+        case '^':
+        case '$':
+            FLUSH_RUN();
+            break;
+
+        default:
+            cur[cur_len++] = c;
+            break;
+        }
+
+        pos++;
+    }
+
+    FLUSH_RUN();
+
+#undef FLUSH_RUN
+
+    return best_len;
+}
+
+static int _regex_set_on_literal(size_t id, size_t pos, void* arg)
+{
+    (void)pos;
+    lua_regex_set_t* self = arg;
+
+    self->items[id].stamp = self->generation;
+
+    return 0;
+}
+
+static int _regex_set_lua_gc(lua_State* L)
+{
+    lua_regex_set_t* self = lua_touserdata(L, 1);
+
+    size_t i;
+    for (i = 0; i < self->size; i++)
+    {
+        if (self->items[i].entry != NULL)
+        {
+            auto_regex_cache_release(self->items[i].entry);
+            self->items[i].entry = NULL;
+        }
+    }
+    self->size = 0;
+
+    if (self->items != NULL)
+    {
+        api.memory->free(self->items);
+        self->items = NULL;
+    }
+
+    if (self->prefilter != NULL)
+    {
+        auto_ac_destroy(self->prefilter);
+        self->prefilter = NULL;
+    }
+
+    return 0;
+}
+
+static int _regex_set_lua_len(lua_State* L)
+{
+    lua_regex_set_t* self = lua_touserdata(L, 1);
+    lua_pushinteger(L, (lua_Integer)self->size);
+    return 1;
+}
+
+static int _regex_set_lua_match(lua_State* L)
+{
+    lua_regex_set_t* self = luaL_checkudata(L, 1, "__auto_regex_set");
+
+    size_t str_size;
+    const char* str = luaL_checklstring(L, 2, &str_size);
+
+    /* Stamps from previous matches become stale. */
+    if (++self->generation == 0)
+    {
+        size_t i;
+        for (i = 0; i < self->size; i++)
+        {
+            self->items[i].stamp = 0;
+        }
+        self->generation = 1;
+    }
+
+    if (self->prefilter != NULL)
+    {
+        auto_ac_scan(self->prefilter, str, str_size, _regex_set_on_literal, self);
+    }
+
+    lua_newtable(L);
+
+    int flags = 0;
+    lua_Integer idx = 1;
+    size_t i;
+    for (i = 0; i < self->size; i++)
+    {
+        lua_regex_set_item_t* item = &self->items[i];
+        if (item->has_literal && item->stamp != self->generation)
+        {
+            continue;
+        }
+
+        if (api.regex->match_ex(item->entry->code, str, str_size, 0, flags, NULL, NULL, NULL) < 0)
+        {
+            continue;
+        }
+
+        /* Subject is valid UTF-8 once anything match. */
+        flags = AUTO_REGEX_NO_UTF_CHECK;
+
+        lua_pushinteger(L, (lua_Integer)(i + 1));
+        lua_rawseti(L, -2, idx++);
+    }
+
+    return 1;
+}
+
+static void _regex_set_set_metatable(lua_State* L)
+{
+    static const luaL_Reg s_regex_set_meta[] = {
+        { "__gc",       _regex_set_lua_gc },
+        { "__len",      _regex_set_lua_len },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_regex_set_method[] = {
+        { "match",      _regex_set_lua_match },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, "__auto_regex_set") != 0)
+    {
+        luaL_setfuncs(L, s_regex_set_meta, 0);
+        luaL_newlib(L, s_regex_set_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+}
+
+/**
+ * @brief Compile pattern at \p idx of table at stack index 1.
+ * @return          Whether literal is added to prefilter.
+ */
+static int _regex_set_add(lua_State* L, lua_regex_set_t* self, size_t idx)
+{
+    lua_geti(L, 1, (lua_Integer)idx + 1);
+
+    size_t pattern_size;
+    const char* pattern = lua_tolstring(L, -1, &pattern_size);
+    if (pattern == NULL)
+    {
+        return api.lua->A_error(L, "pattern #%d is not a string", (int)idx + 1);
+    }
+
+    size_t err_pos;
+    if ((self->items[idx].entry = auto_regex_cache_acquire(L, pattern, pattern_size, &err_pos)) == NULL)
+    {
+        if (err_pos == SIZE_MAX)
+        {
+            return api.lua->A_error(L, "out of memory");
+        }
+        return api.lua->A_error(L, "compile regex #%d failed at position %d", (int)idx + 1, (int)err_pos);
+    }
+
+    /* Scratch buffer for literal extraction. */
+    char* buf = lua_newuserdata(L, pattern_size * 2 + 1);
+    size_t literal_size = _regex_set_literal(pattern, pattern_size, buf, buf + pattern_size);
+    if (literal_size > 0 && auto_ac_add(self->prefilter, buf, literal_size, idx) == 0)
+    {
+        self->items[idx].has_literal = 1;
+    }
+
+    lua_pop(L, 2);
+    return self->items[idx].has_literal;
+}
+
+int auto_lua_regex_set(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    size_t size = (size_t)luaL_len(L, 1);
+
+    lua_regex_set_t* self = lua_newuserdata(L, sizeof(lua_regex_set_t));
+    memset(self, 0, sizeof(*self));
+    _regex_set_set_metatable(L);
+
+    if (size == 0)
+    {
+        return 1;
+    }
+
+    self->items = api.memory->calloc(size, sizeof(lua_regex_set_item_t));
+    self->size = size;
+    if ((self->prefilter = auto_ac_create()) == NULL)
+    {
+        return api.lua->A_error(L, "out of memory");
+    }
+
+    size_t i, literal_cnt = 0;
+    for (i = 0; i < size; i++)
+    {
+        literal_cnt += _regex_set_add(L, self, i);
+    }
+
+    if (literal_cnt == 0)
+    {
+        auto_ac_destroy(self->prefilter);
+        self->prefilter = NULL;
+    }
+    else if (auto_ac_compile(self->prefilter) != 0)
+    {
+        return api.lua->A_error(L, "out of memory");
+    }
+
+    return 1;
+}
@@ -0,0 +1,21 @@
+#ifndef __AUTO_LUA_REGEX_SET_H__
+#define __AUTO_LUA_REGEX_SET_H__
+
+#include "api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Compile a list of patterns into one matcher.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_regex_set(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,41 +2,63 @@
 #include <cJSON.h>
 #include <stdlib.h>
 #include <string.h>
-#include <csvparser.h>
-#include <errno.h>
+#include <uv.h>
 #include "sqlite.h"
+#include "sqlite_async.h"
+#include "sqlite_csv.h"
+#include "sqlite_func.h"
+#include "sqlite_vtab.h"
 #include "utils.h"
+#include "utils/list.h"
+#include "utils/map.h"
 
 /**
- * @brief Lua userdata type of sqlite
+ * @brief Default statement cache size.
  */
-#define AUTO_LUA_SQLITE         "__auto_sqlite3"
+#define AUTO_SQLITE_STMT_CACHE_SIZE 16
 
-typedef struct lua_sqlite
+int auto_sqlite_opt_boolean(lua_State* L, int idx, const char* name)
 {
-    sqlite3*        db;         /**< Database connection */
+    lua_getfield(L, idx, name);
+    int ret = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    return ret;
+}
 
-    struct
+static void _sqlite_lua_parse_options(lua_State* L, int idx, lua_sqlite_t* self)
+{
+    self->stmt_cache.capacity = AUTO_SQLITE_STMT_CACHE_SIZE;
+    self->config.flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (lua_type(L, idx) != LUA_TTABLE)
     {
-        char*       filename;   /**< Database filename (UTF-8) */
-    } config;
-} lua_sqlite_t;
+        self->config.filename = auto_strdup("");
+        return;
+    }
 
-typedef struct lua_sqlite_exec_helper
-{
-    lua_State*      L;          /**< Lua VM. */
-    lua_sqlite_t*   belong;     /**< SQLite instance. */
-    int             tbsp;       /**< The SP of result table for store result. */
-} lua_sqlite_exec_helper_t;
+    if (auto_sqlite_opt_boolean(L, idx, "readonly"))
+    {
+        self->config.flags = SQLITE_OPEN_READONLY;
+    }
+    if (auto_sqlite_opt_boolean(L, idx, "nomutex"))
+    {
+        self->config.flags |= SQLITE_OPEN_NOMUTEX;
+    }
+    if (auto_sqlite_opt_boolean(L, idx, "shared_cache"))
+    {
+        self->config.flags |= SQLITE_OPEN_SHAREDCACHE;
+    }
+    if (auto_sqlite_opt_boolean(L, idx, "uri"))
+    {
+        self->config.flags |= SQLITE_OPEN_URI;
+    }
 
-typedef struct sqlite_to_csv_helper
-{
-    int             line_cnt;   /**< Line counter. */
-    luaL_Buffer     csv_buf;    /**< Buffer for holding CSV content. */
-} sqlite_to_csv_helper_t;
+    if (lua_getfield(L, idx, "stmt_cache_size") == LUA_TNUMBER)
+    {
+        lua_Integer capacity = lua_tointeger(L, -1);
+        self->stmt_cache.capacity = capacity > 0 ? (size_t)capacity : 0;
+    }
+    lua_pop(L, 1);
 
-static void _sqlite_lua_parse_options(lua_State* L, int idx, lua_sqlite_t* self)
-{
     if (lua_getfield(L, idx, "filename") == LUA_TSTRING)
     {
         self->config.filename = auto_strdup(lua_tostring(L, -1));
@@ -48,12 +70,169 @@ static void _sqlite_lua_parse_options(lua_State* L, int idx, lua_sqlite_t* self)
     lua_pop(L, 1);
 }
 
-static int _sqlite_lua_close(lua_State* L)
+static int _sqlite_stmt_cache_on_cmp(const auto_map_node_t* key1, const auto_map_node_t* key2, void* arg)
+{
+    (void)arg;
+    sqlite_stmt_entry_t* e1 = container_of(key1, sqlite_stmt_entry_t, t_node);
+    sqlite_stmt_entry_t* e2 = container_of(key2, sqlite_stmt_entry_t, t_node);
+
+    if (e1->sql.size != e2->sql.size)
+    {
+        return e1->sql.size < e2->sql.size ? -1 : 1;
+    }
+    return memcmp(e1->sql.data, e2->sql.data, e1->sql.size);
+}
+
+static void _sqlite_stmt_cache_init(lua_sqlite_t* self)
+{
+    ev_map_init(&self->stmt_cache.table, _sqlite_stmt_cache_on_cmp, NULL);
+    ev_list_init(&self->stmt_cache.lru);
+    ev_list_init(&self->stmt_cache.all);
+}
+
+static void _sqlite_stmt_entry_destroy(lua_sqlite_t* self, sqlite_stmt_entry_t* entry)
+{
+    if (entry->stmt != NULL)
+    {
+        sqlite3_finalize(entry->stmt);
+        entry->stmt = NULL;
+        ev_list_erase(&self->stmt_cache.all, &entry->a_node);
+    }
+    api.memory->free(entry);
+}
+
+/**
+ * @brief Remove \p entry from cache. It is destroyed if nobody use it.
+ */
+static void _sqlite_stmt_cache_evict(lua_sqlite_t* self, sqlite_stmt_entry_t* entry)
+{
+    ev_map_erase(&self->stmt_cache.table, &entry->t_node);
+    ev_list_erase(&self->stmt_cache.lru, &entry->q_node);
+    entry->cached = 0;
+
+    if (!entry->in_use)
+    {
+        _sqlite_stmt_entry_destroy(self, entry);
+    }
+}
+
+static void _sqlite_stmt_cache_shrink(lua_sqlite_t* self, size_t capacity)
+{
+    auto_list_node_t* it;
+    while (ev_map_size(&self->stmt_cache.table) > capacity
+        && (it = ev_list_end(&self->stmt_cache.lru)) != NULL)
+    {
+        _sqlite_stmt_cache_evict(self, container_of(it, sqlite_stmt_entry_t, q_node));
+    }
+}
+
+/**
+ * @brief Finalize all statements. Statements in use become invalid.
+ */
+static void _sqlite_stmt_cache_exit(lua_sqlite_t* self)
+{
+    _sqlite_stmt_cache_shrink(self, 0);
+
+    auto_list_node_t* it;
+    while ((it = ev_list_pop_front(&self->stmt_cache.all)) != NULL)
+    {
+        sqlite_stmt_entry_t* entry = container_of(it, sqlite_stmt_entry_t, a_node);
+        sqlite3_finalize(entry->stmt);
+        entry->stmt = NULL;
+    }
+}
+
+sqlite_stmt_entry_t* auto_sqlite_stmt_acquire(lua_State* L, lua_sqlite_t* self,
+    const char* sql, size_t sql_sz)
+{
+    sqlite_stmt_entry_t tmp;
+    tmp.sql.data = sql;
+    tmp.sql.size = sql_sz;
+
+    auto_map_node_t* it = ev_map_find(&self->stmt_cache.table, &tmp.t_node);
+    sqlite_stmt_entry_t* entry = it != NULL ? container_of(it, sqlite_stmt_entry_t, t_node) : NULL;
+    if (entry != NULL && !entry->in_use)
+    {
+        /* Move to front as most recently used. */
+        ev_list_erase(&self->stmt_cache.lru, &entry->q_node);
+        ev_list_push_front(&self->stmt_cache.lru, &entry->q_node);
+
+        entry->in_use = 1;
+        return entry;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    const char* tail = NULL;
+    if (sqlite3_prepare_v3(self->db, sql, (int)sql_sz, SQLITE_PREPARE_PERSISTENT, &stmt, &tail) != SQLITE_OK)
+    {
+        lua_pushstring(L, sqlite3_errmsg(self->db));
+        return NULL;
+    }
+    if (stmt == NULL)
+    {
+        lua_pushstring(L, "empty SQL statement");
+        return NULL;
+    }
+    for (; tail < sql + sql_sz; tail++)
+    {
+        if (*tail != ' ' && *tail != '\t' && *tail != '\r' && *tail != '\n' && *tail != ';')
+        {
+            sqlite3_finalize(stmt);
+            lua_pushstring(L, "only one SQL statement is allowed");
+            return NULL;
+        }
+    }
+
+    sqlite_stmt_entry_t* new_entry = api.memory->malloc(sizeof(sqlite_stmt_entry_t) + sql_sz + 1);
+    memset(new_entry, 0, sizeof(*new_entry));
+    new_entry->stmt = stmt;
+    new_entry->in_use = 1;
+    ev_list_push_back(&self->stmt_cache.all, &new_entry->a_node);
+
+    char* data = (char*)(new_entry + 1);
+    memcpy(data, sql, sql_sz);
+    data[sql_sz] = '\0';
+    new_entry->sql.data = data;
+    new_entry->sql.size = sql_sz;
+
+    /* Same SQL is in use, do not cache the new one. */
+    if (entry != NULL || self->stmt_cache.capacity == 0)
+    {
+        return new_entry;
+    }
+
+    /* Make room for new entry. */
+    _sqlite_stmt_cache_shrink(self, self->stmt_cache.capacity - 1);
+
+    new_entry->cached = 1;
+    ev_map_insert(&self->stmt_cache.table, &new_entry->t_node);
+    ev_list_push_front(&self->stmt_cache.lru, &new_entry->q_node);
+
+    return new_entry;
+}
+
+void auto_sqlite_stmt_release(lua_sqlite_t* self, sqlite_stmt_entry_t* entry)
+{
+    entry->in_use = 0;
+
+    if (entry->stmt == NULL || !entry->cached)
+    {
+        _sqlite_stmt_entry_destroy(self, entry);
+        return;
+    }
+
+    sqlite3_reset(entry->stmt);
+    sqlite3_clear_bindings(entry->stmt);
+}
+
+int auto_sqlite_lua_close(lua_State* L)
 {
     lua_sqlite_t* self = lua_touserdata(L, 1);
 
     if (self->db != NULL)
     {
+        auto_sqlite_async_exit(self);
+        _sqlite_stmt_cache_exit(self);
         sqlite3_close(self->db);
         self->db = NULL;
     }
@@ -69,7 +248,7 @@ static int _sqlite_lua_close(lua_State* L)
 
 static int _sqlite_lua_gc(lua_State* L)
 {
-    return _sqlite_lua_close(L);
+    return auto_sqlite_lua_close(L);
 }
 
 static int _sqlite_lua_tostring(lua_State* L)
@@ -106,372 +285,1238 @@ static int _sqlite_lua_tostring(lua_State* L)
     return 1;
 }
 
-static int _sqlite_lua_exec_callback(void* data, int argc, char** argv, char** azColName)
+lua_sqlite_t* auto_sqlite_check_db(lua_State* L, int idx)
 {
-    lua_sqlite_exec_helper_t* helper = data;
-
-    /* Create new result line */
-    lua_newtable(helper->L);
-
-    /* Store query results. */
-    int i;
-    for (i = 0; i < argc; i++)
+    lua_sqlite_t* self = luaL_checkudata(L, idx, AUTO_LUA_SQLITE);
+    if (self->db == NULL)
     {
-        if (argv[i] != NULL)
-        {
-            lua_pushstring(helper->L, argv[i]);
-            lua_setfield(helper->L, -2, azColName[i]);
-        }
+        api.lua->A_error(L, "database is closed");
+        return NULL;
     }
-
-    /* Append result line to result table. */
-    lua_rawseti(helper->L, helper->tbsp, luaL_len(helper->L, helper->tbsp) + 1);
-
-    return 0;
+    if (self->async.job != NULL)
+    {
+        api.lua->A_error(L, "database is busy with async query");
+        return NULL;
+    }
+    return self;
 }
 
-static int _sqlite_lua_exec(lua_State* L)
+/**
+ * @brief Push column \p i of current row with its native type.
+ */
+static void _sqlite_push_column(lua_State* L, sqlite3_stmt* stmt, int i)
 {
-    lua_sqlite_t* self = luaL_checkudata(L, 1, AUTO_LUA_SQLITE);
-    const char* sql = luaL_checkstring(L, 2);
+    switch (sqlite3_column_type(stmt, i))
+    {
+    case SQLITE_INTEGER:
+        lua_pushinteger(L, (lua_Integer)sqlite3_column_int64(stmt, i));
+        break;
 
-    /* Create a table for restore exec results. */
-    lua_newtable(L);
+    case SQLITE_FLOAT:
+        lua_pushnumber(L, (lua_Number)sqlite3_column_double(stmt, i));
+        break;
 
-    /* Create exec helper context. */
-    lua_sqlite_exec_helper_t helper;
-    helper.L = L;
-    helper.belong = self;
-    helper.tbsp = lua_gettop(L);
+    case SQLITE_TEXT:
+        lua_pushlstring(L, (const char*)sqlite3_column_text(stmt, i), sqlite3_column_bytes(stmt, i));
+        break;
 
-    /* Do sql exec */
-    char* errmsg = NULL;
-    if (sqlite3_exec(self->db, sql, _sqlite_lua_exec_callback, &helper, &errmsg) != SQLITE_OK)
-    {
-        lua_pushstring(L, errmsg);
-        sqlite3_free(errmsg);
-        return lua_error(L);
+    case SQLITE_BLOB:
+        lua_pushlstring(L, sqlite3_column_blob(stmt, i), sqlite3_column_bytes(stmt, i));
+        break;
+
+    default:
+        lua_pushnil(L);
+        break;
     }
+}
 
-    /* Ensure result table is at top of stack. */
-    lua_settop(L, helper.tbsp);
+/**
+ * @brief Push column \p i of current row, with its native type if \p typed,
+ *   otherwise as text.
+ */
+static void _sqlite_push_result(lua_State* L, sqlite3_stmt* stmt, int i, int typed)
+{
+    if (typed)
+    {
+        _sqlite_push_column(L, stmt, i);
+        return;
+    }
 
-    return 1;
+    const char* text = (const char*)sqlite3_column_text(stmt, i);
+    lua_pushlstring(L, text, sqlite3_column_bytes(stmt, i));
 }
 
-static int _sqlite_lua_csv_create_table(lua_State* L, lua_sqlite_t* self, const char* table_name, CsvParser* csv_parser)
+/**
+ * @brief Append all remaining rows of \p stmt to result table at \p res_idx.
+ *
+ * Column names are pushed once and reused as keys of every row.
+ *
+ * @param[in] res_idx   Result table.
+ * @param[in,out] cnt   Number of rows in result table.
+ * @param[in] columnar  Store as `{ column = { value, ... } }` instead of
+ *   `{ { column = value }, ... }`.
+ * @param[in] typed     Push values with native type, otherwise as text.
+ * @return              0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_fetch_rows(lua_State* L, sqlite3_stmt* stmt, int res_idx,
+    lua_Integer* cnt, int columnar, int typed)
 {
-    luaL_Buffer sql_buf;
-    luaL_buffinit(L, &sql_buf);
-    luaL_addstring(&sql_buf, "CREATE TABLE IF NOT EXISTS ");
-    luaL_addstring(&sql_buf, table_name);
+    int i, column_cnt = sqlite3_column_count(stmt);
+    res_idx = lua_absindex(L, res_idx);
+    luaL_checkstack(L, column_cnt * 2 + 4, "too many columns");
+
+    /* Interned column names. */
+    int name_idx = lua_gettop(L) + 1;
+    for (i = 0; i < column_cnt; i++)
+    {
+        lua_pushstring(L, sqlite3_column_name(stmt, i));
+    }
 
+    /* Column arrays, shared by statements with same column name. */
+    int col_idx = lua_gettop(L) + 1;
+    for (i = 0; columnar && i < column_cnt; i++)
     {
-        luaL_addstring(&sql_buf, "(");
+        lua_pushvalue(L, name_idx + i);
+        if (lua_rawget(L, res_idx) != LUA_TTABLE)
+        {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, name_idx + i);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, res_idx);
+        }
+    }
 
-        const CsvRow* header = CsvParser_getHeader(csv_parser);
-        const char **headerFields = CsvParser_getFields(header);
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        (*cnt)++;
 
-        int i;
-        for (i = 0; i < CsvParser_getNumFields(header); i++)
+        if (columnar)
         {
-            char* zQuoted = sqlite3_mprintf("\"%w\"", headerFields[i]);
-            luaL_addstring(&sql_buf, zQuoted);
-            sqlite3_free(zQuoted);
-            luaL_addchar(&sql_buf, ',');
+            for (i = 0; i < column_cnt; i++)
+            {
+                if (sqlite3_column_type(stmt, i) != SQLITE_NULL)
+                {
+                    _sqlite_push_result(L, stmt, i, typed);
+                    lua_rawseti(L, col_idx + i, *cnt);
+                }
+            }
+            continue;
         }
 
-        luaL_buffsub(&sql_buf, 1);
-        luaL_addstring(&sql_buf, ")");
+        lua_createtable(L, 0, column_cnt);
+        for (i = 0; i < column_cnt; i++)
+        {
+            if (sqlite3_column_type(stmt, i) != SQLITE_NULL)
+            {
+                lua_pushvalue(L, name_idx + i);
+                _sqlite_push_result(L, stmt, i, typed);
+                lua_rawset(L, -3);
+            }
+        }
+        lua_rawseti(L, res_idx, *cnt);
     }
 
-    luaL_pushresult(&sql_buf);
-
-    /* Create table */
-    const char* sql_cmd = lua_tostring(L, -1);
-    char* errmsg = NULL;
-    int ret = sqlite3_exec(self->db, sql_cmd, NULL, NULL, &errmsg);
-    lua_pop(L, 1);
+    lua_settop(L, name_idx - 1);
 
-    /* If there is any error, push error string on top of stack. */
-    if (ret != SQLITE_OK)
+    if (ret != SQLITE_DONE)
     {
-        lua_pushstring(L, errmsg);
-        sqlite3_free(errmsg);
-        return 1;
+        lua_pushstring(L, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        return -1;
     }
-
     return 0;
 }
 
-static int _sqlite_lua_csv_import_data(lua_State* L, lua_sqlite_t* self, const char* table_name, CsvParser* csv_parser)
+/**
+ * @brief Check boolean option \p name of option table at \p idx, which may
+ *   be absent.
+ */
+static int _sqlite_opt_flag(lua_State* L, int idx, const char* name)
 {
-    /* Parse CSV */
-    CsvRow* row = NULL;
-    while ((row = CsvParser_getRow(csv_parser)) != NULL)
+    if (lua_type(L, idx) != LUA_TTABLE)
     {
-        luaL_Buffer sql_buf;
-        luaL_buffinit(L, &sql_buf);
-        luaL_addstring(&sql_buf, "INSERT INTO ");
-        luaL_addstring(&sql_buf, table_name);
-        luaL_addstring(&sql_buf, " VALUES(");
+        return 0;
+    }
+    return auto_sqlite_opt_boolean(L, idx, name);
+}
 
-        const char** rowFields = CsvParser_getFields(row);
+static int _sqlite_lua_exec(lua_State* L)
+{
+    lua_sqlite_t* self = auto_sqlite_check_db(L, 1);
+    size_t sql_sz;
+    const char* sql = luaL_checklstring(L, 2, &sql_sz);
+    int columnar = _sqlite_opt_flag(L, 3, "columnar");
+    int typed = _sqlite_opt_flag(L, 3, "typed");
+    const char* sql_end = sql + sql_sz;
 
-        int i;
-        for (i = 0; i < CsvParser_getNumFields(row); i++)
-        {
-            char* zQuoted = sqlite3_mprintf("\"%w\"", rowFields[i]);
-            luaL_addstring(&sql_buf, zQuoted);
-            sqlite3_free(zQuoted);
+    /* Create a table for restore exec results. */
+    lua_settop(L, 3);
+    lua_newtable(L);
 
-            luaL_addchar(&sql_buf, ',');
+    lua_Integer cnt = 0;
+    while (sql < sql_end)
+    {
+        sqlite3_stmt* stmt = NULL;
+        if (sqlite3_prepare_v2(self->db, sql, (int)(sql_end - sql), &stmt, &sql) != SQLITE_OK)
+        {
+            lua_pushstring(L, sqlite3_errmsg(self->db));
+            return lua_error(L);
         }
 
-        CsvParser_destroy_row(row);
-
-        luaL_buffsub(&sql_buf, 1);
-        luaL_addstring(&sql_buf, ")");
-        luaL_pushresult(&sql_buf);
-
-        const char* sql_cmd = lua_tostring(L, -1);
+        /* Comment or white space. */
+        if (stmt == NULL)
+        {
+            continue;
+        }
 
-        char* errmsg = NULL;
-        int ret = sqlite3_exec(self->db, sql_cmd, NULL, NULL, &errmsg);
-        lua_pop(L, 1);
+        int ret = _sqlite_fetch_rows(L, stmt, 4, &cnt, columnar, typed);
+        sqlite3_finalize(stmt);
 
-        if (ret != SQLITE_OK)
+        if (ret != 0)
         {
-            lua_pushstring(L, errmsg);
-            sqlite3_free(errmsg);
-            return -1;
+            return lua_error(L);
         }
     }
 
-    return 0;
+    lua_pushinteger(L, cnt);
+    return 2;
 }
 
 /**
- * @brief Parse CSV into SQL table.
- * @param[in] L             Lua VM.
- * @param[in] self          SQLite instance.
- * @param[in] table_name    SQL table name.
- * @param[in] csv_parser    A CSV parser. The ownership is taken.
- * @return                  Always 0.
+ * @brief Bind value at \p idx to parameter \p pos.
+ * @param[in] destructor    SQLITE_STATIC if the value outlive the statement
+ *   execution, otherwise SQLITE_TRANSIENT.
+ * @return  0 if success, otherwise error message is pushed on top of stack.
  */
-static int _sqlite_lua_from_csv_parser(lua_State* L, lua_sqlite_t* self,
-    const char* table_name, CsvParser* csv_parser)
+static int _sqlite_bind_value(lua_State* L, sqlite3_stmt* stmt, int pos, int idx,
+    sqlite3_destructor_type destructor)
 {
     int ret;
+    size_t size;
+    const char* data;
 
-    if (csv_parser == NULL)
+    switch (lua_type(L, idx))
     {
-        return api.lua->A_error(L, "create CSV parser failed");
-    }
+    case LUA_TNIL:
+        ret = sqlite3_bind_null(stmt, pos);
+        break;
 
-    /* Create table */
-    if ((ret = _sqlite_lua_csv_create_table(L, self, table_name, csv_parser)) != 0)
-    {
-        goto finish;
+    case LUA_TBOOLEAN:
+        ret = sqlite3_bind_int(stmt, pos, lua_toboolean(L, idx));
+        break;
+
+    case LUA_TNUMBER:
+        if (lua_isinteger(L, idx))
+        {
+            ret = sqlite3_bind_int64(stmt, pos, (sqlite3_int64)lua_tointeger(L, idx));
+        }
+        else
+        {
+            ret = sqlite3_bind_double(stmt, pos, (double)lua_tonumber(L, idx));
+        }
+        break;
+
+    case LUA_TSTRING:
+        data = lua_tolstring(L, idx, &size);
+        ret = sqlite3_bind_text64(stmt, pos, data, size, destructor, SQLITE_UTF8);
+        break;
+
+    default:
+        lua_pushfstring(L, "unsupported parameter type %s", luaL_typename(L, idx));
+        return -1;
     }
 
-    /* Import CSV data */
-    if ((ret = _sqlite_lua_csv_import_data(L, self, table_name, csv_parser)) != 0)
+    if (ret != SQLITE_OK)
     {
-        goto finish;
+        lua_pushstring(L, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        return -1;
     }
-
-finish:
-    /* CSV parser is no longer needed. */
-    CsvParser_destroy(csv_parser);
-    return ret != 0 ? lua_error(L) : 0;
+    return 0;
 }
 
-static int _sqlite_lua_from_csv(lua_State* L)
+/**
+ * @brief Bind named parameters by string keys of table at \p idx.
+ *
+ * Key `name` match parameter `:name`, `@name` or `$name`.
+ */
+static int _sqlite_bind_named(lua_State* L, sqlite3_stmt* stmt, int idx,
+    sqlite3_destructor_type destructor)
 {
-    /* Get parameters */
-    lua_sqlite_t* self = luaL_checkudata(L, 1, AUTO_LUA_SQLITE);
-    const char* table_name = luaL_checkstring(L, 2);
-    const char* csv_data = luaL_checkstring(L, 3);
-    int is_header = !(lua_type(L, 4) == LUA_TBOOLEAN && !lua_toboolean(L, 4));
+    idx = lua_absindex(L, idx);
 
-    /* Create CSV parser */
-    CsvParser* csv_parser = CsvParser_new_from_string(csv_data, NULL, is_header);
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0)
+    {
+        if (lua_type(L, -2) != LUA_TSTRING)
+        {
+            lua_pop(L, 1);
+            continue;
+        }
 
-    return _sqlite_lua_from_csv_parser(L, self, table_name, csv_parser);
-}
+        const char* key = lua_tostring(L, -2);
+        int pos = sqlite3_bind_parameter_index(stmt, key);
 
-static int _sqlite_lua_from_csv_file(lua_State* L)
-{
-    /* Get parameters */
-    lua_sqlite_t* self = luaL_checkudata(L, 1, AUTO_LUA_SQLITE);
-    const char* table_name = luaL_checkstring(L, 2);
-    const char* csv_file = luaL_checkstring(L, 3);
-    int is_header = !(lua_type(L, 4) == LUA_TBOOLEAN && !lua_toboolean(L, 4));
+        static const char* s_prefix = ":@$";
+        const char* prefix;
+        for (prefix = s_prefix; pos == 0 && *prefix != '\0'; prefix++)
+        {
+            char name[128];
+            snprintf(name, sizeof(name), "%c%s", *prefix, key);
+            pos = sqlite3_bind_parameter_index(stmt, name);
+        }
+        if (pos == 0)
+        {
+            lua_pop(L, 2);
+            lua_pushfstring(L, "no such parameter: %s", key);
+            return -1;
+        }
 
-    /* Create CSV parser */
-    CsvParser* csv_parser = CsvParser_new(csv_file, NULL, is_header);
+        if (_sqlite_bind_value(L, stmt, pos, -1, destructor) != 0)
+        {
+            lua_replace(L, -3);
+            lua_pop(L, 1);
+            return -1;
+        }
+        lua_pop(L, 1);
+    }
 
-    return _sqlite_lua_from_csv_parser(L, self, table_name, csv_parser);
+    return 0;
 }
 
-static int _sqlite_lua_to_csv_callback(void* arg, int argc, char** argv, char** azColName)
+/**
+ * @brief Bind parameters at stack [\p beg, \p end].
+ *
+ * A single table is bound by array part as positional parameters, and by
+ * string keys as named parameters.
+ *
+ * @return  0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_bind_args(lua_State* L, sqlite3_stmt* stmt, int beg, int end,
+    sqlite3_destructor_type destructor)
 {
     int i;
-    sqlite_to_csv_helper_t* helper = arg;
-    int orig_line_cnt = helper->line_cnt++;
 
-    /* Add header */
-    if (orig_line_cnt == 0)
+    if (beg == end && lua_type(L, beg) == LUA_TTABLE)
     {
-        for (i = 0; i < argc; i++)
+        int cnt = (int)luaL_len(L, beg);
+        for (i = 1; i <= cnt; i++)
         {
-            luaL_addstring(&helper->csv_buf, azColName[i]);
-            luaL_addchar(&helper->csv_buf, ',');
+            lua_rawgeti(L, beg, i);
+            if (_sqlite_bind_value(L, stmt, i, -1, destructor) != 0)
+            {
+                lua_remove(L, -2);
+                return -1;
+            }
+            lua_pop(L, 1);
         }
-        luaL_buffsub(&helper->csv_buf, 1);
-        luaL_addstring(&helper->csv_buf, "\r\n");
+        return _sqlite_bind_named(L, stmt, beg, destructor);
     }
 
-    /* Add data */
-    for (i = 0; i < argc; i++)
+    for (i = beg; i <= end; i++)
     {
-        luaL_addstring(&helper->csv_buf, argv[i]);
-        luaL_addchar(&helper->csv_buf, ',');
+        if (_sqlite_bind_value(L, stmt, i - beg + 1, i, destructor) != 0)
+        {
+            return -1;
+        }
     }
-    luaL_buffsub(&helper->csv_buf, 1);
-    luaL_addstring(&helper->csv_buf, "\r\n");
 
     return 0;
 }
 
-static int _sqlite_lua_to_csv(lua_State* L)
+lua_sqlite_stmt_t* auto_sqlite_check_stmt(lua_State* L, int idx)
 {
-    /* Get parameters */
-    lua_sqlite_t* self = luaL_checkudata(L, 1, AUTO_LUA_SQLITE);
-    const char* table_name = luaL_checkstring(L, 2);
+    lua_sqlite_stmt_t* self = luaL_checkudata(L, idx, AUTO_LUA_SQLITE_STMT);
+    if (self->entry == NULL || self->entry->stmt == NULL)
+    {
+        api.lua->A_error(L, "statement is closed");
+        return NULL;
+    }
+    if (self->belong->async.job != NULL)
+    {
+        api.lua->A_error(L, "database is busy with async query");
+        return NULL;
+    }
+    return self;
+}
 
-    /* Construct SQL command. */
-    lua_pushfstring(L, "SELECT * FROM %s", table_name);
-    const char* sql_cmd = lua_tostring(L, -1);
+static int _sqlite_stmt_lua_close(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = lua_touserdata(L, 1);
 
-    sqlite_to_csv_helper_t helper;
-    helper.line_cnt = 0;
-    luaL_buffinit(L, &helper.csv_buf);
+    if (self->entry != NULL && auto_sqlite_async_using(self->belong, self->entry->stmt))
+    {
+        return api.lua->A_error(L, "statement is busy with async query");
+    }
 
-    /* Do SQL command */
-    char* errmsg = NULL;
-    int ret = sqlite3_exec(self->db, sql_cmd, _sqlite_lua_to_csv_callback, &helper, &errmsg);
+    if (self->entry != NULL)
+    {
+        auto_sqlite_stmt_release(self->belong, self->entry);
+        self->entry = NULL;
+    }
 
-    /* There were extra line wrapper that need to delete. */
-    luaL_buffsub(&helper.csv_buf, 2);
-    luaL_pushresult(&helper.csv_buf);
+    return 0;
+}
 
-    /* Remove SQL command. */
-    lua_remove(L, -2);
+static int _sqlite_stmt_lua_bind(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
 
-    if (ret != SQLITE_OK)
+    if (_sqlite_bind_args(L, self->entry->stmt, 2, lua_gettop(L), SQLITE_TRANSIENT) != 0)
     {
-        lua_pushstring(L, errmsg);
-        sqlite3_free(errmsg);
         return lua_error(L);
     }
 
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int _sqlite_stmt_lua_reset(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
+
+    self->async_eof = 0;
+    sqlite3_reset(self->entry->stmt);
+    sqlite3_clear_bindings(self->entry->stmt);
+
+    lua_settop(L, 1);
     return 1;
 }
 
-static int _sqlite_lua_to_csv_file(lua_State* L)
+/**
+ * @brief Push current row as a table keyed by column name. NULL columns are
+ *   not set.
+ *
+ * Column names are cached in the second user value of statement at \p idx.
+ */
+static void _sqlite_stmt_push_row(lua_State* L, int idx, sqlite3_stmt* stmt)
 {
-    /* Get parameters. */
-    const char* file_path = luaL_checkstring(L, 3);
+    int i, column_cnt = sqlite3_column_count(stmt);
 
-    const char* mode = "a";
-    if (lua_type(L, 4) == LUA_TSTRING)
+    if (lua_getiuservalue(L, idx, 2) != LUA_TTABLE || (int)lua_rawlen(L, -1) != column_cnt)
     {
-        mode = lua_tostring(L, 4);
-        if (strcmp(mode, "a") != 0 && strcmp(mode, "w") != 0)
+        lua_pop(L, 1);
+        lua_createtable(L, column_cnt, 0);
+        for (i = 0; i < column_cnt; i++)
         {
-            return api.lua->A_error(L, "invalid mode: %s", mode);
+            lua_pushstring(L, sqlite3_column_name(stmt, i));
+            lua_rawseti(L, -2, i + 1);
         }
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, idx, 2);
     }
 
-    int errcode;
-    FILE* csv_file;
-#if defined(_MSC_VER)
-    errcode = fopen_s(&csv_file, file_path, mode);
-#else
-    csv_file = fopen(file_path, mode);
-    errcode = errno;
-#endif
-
-    if (csv_file == NULL)
+    lua_createtable(L, 0, column_cnt);
+    for (i = 0; i < column_cnt; i++)
     {
-        char buf[1024];
-        return api.lua->A_error(L, "%s", auto_strerror(errcode, buf, sizeof(buf)));
+        if (sqlite3_column_type(stmt, i) == SQLITE_NULL)
+        {
+            continue;
+        }
+        lua_rawgeti(L, -2, i + 1);
+        _sqlite_push_column(L, stmt, i);
+        lua_rawset(L, -3);
     }
+    lua_remove(L, -2);
+}
 
-    /* Call sqlite:to_csv(). */
-    lua_pushcfunction(L, _sqlite_lua_to_csv);
-    lua_pushvalue(L, 1);
-    lua_pushvalue(L, 2);
-    if (lua_pcall(L, 2, 1, 0) != LUA_OK)
+/**
+ * @brief Step statement at \p idx.
+ * @return  1 if a row is pushed, 0 if done.
+ */
+static int _sqlite_stmt_step(lua_State* L, int idx, sqlite3_stmt* stmt)
+{
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_ROW)
     {
-        fclose(csv_file);
-        return lua_error(L);
+        _sqlite_stmt_push_row(L, idx, stmt);
+        return 1;
     }
-
-    /* Write to file. */
-    size_t csv_data_len = 0;
-    const char* csv_data = luaL_tolstring(L, -1, &csv_data_len);
-    size_t write_size = fwrite(csv_data, csv_data_len, 1, csv_file);
-    fclose(csv_file);
-
-    if (write_size != 1)
+    if (ret == SQLITE_DONE)
     {
-        return api.lua->A_error(L, "write to %s failed", file_path);
+        return 0;
     }
 
-    return 0;
+    lua_pushstring(L, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+    sqlite3_reset(stmt);
+    return lua_error(L);
 }
 
-static void _sqlite_init_metatable(lua_State* L)
+static int _sqlite_stmt_lua_step(lua_State* L)
 {
-    static const luaL_Reg s_sqlite_meta[] = {
-        { "__gc",           _sqlite_lua_gc },
-        { "__tostring",     _sqlite_lua_tostring },
-        { NULL,             NULL },
-    };
-    static const luaL_Reg s_sqlite_method[] = {
-        { "close",          _sqlite_lua_close },
-        { "exec",           _sqlite_lua_exec },
-        { "from_csv",       _sqlite_lua_from_csv },
-        { "from_csv_file",  _sqlite_lua_from_csv_file },
-        { "to_csv",         _sqlite_lua_to_csv },
-        { "to_csv_file",    _sqlite_lua_to_csv_file },
-        { NULL,             NULL },
-    };
-    if (luaL_newmetatable(L, AUTO_LUA_SQLITE) != 0)
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
+
+    if (_sqlite_stmt_step(L, 1, self->entry->stmt) == 0)
     {
-        luaL_setfuncs(L, s_sqlite_meta, 0);
-        luaL_newlib(L, s_sqlite_method);
-        lua_setfield(L, -2, "__index");
+        lua_pushnil(L);
     }
-    lua_setmetatable(L, -2);
+
+    return 1;
 }
 
-int auto_lua_sqlite(lua_State* L)
+static int _sqlite_stmt_lua_rows_next(lua_State* L)
 {
-    lua_sqlite_t* self = lua_newuserdata(L, sizeof(lua_sqlite_t));
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, lua_upvalueindex(1));
+    return _sqlite_stmt_step(L, lua_upvalueindex(1), self->entry->stmt);
+}
 
-    memset(self, 0, sizeof(*self));
-    _sqlite_init_metatable(L);
+static int _sqlite_stmt_lua_rows(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
+    self->async_eof = 0;
+    sqlite3_reset(self->entry->stmt);
+
+    int top = lua_gettop(L);
+    if (top >= 2 && _sqlite_bind_args(L, self->entry->stmt, 2, top, SQLITE_TRANSIENT) != 0)
+    {
+        return lua_error(L);
+    }
+
+    lua_settop(L, 1);
+    lua_pushcclosure(L, _sqlite_stmt_lua_rows_next, 1);
+    return 1;
+}
+
+static int _sqlite_stmt_lua_fetch_all(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
+    int columnar = _sqlite_opt_flag(L, 2, "columnar");
+
+    lua_settop(L, 2);
+    lua_newtable(L);
+
+    lua_Integer cnt = 0;
+    if (_sqlite_fetch_rows(L, self->entry->stmt, 3, &cnt, columnar, 1) != 0)
+    {
+        sqlite3_reset(self->entry->stmt);
+        return lua_error(L);
+    }
+
+    lua_pushinteger(L, cnt);
+    return 2;
+}
+
+int auto_sqlite_exec_simple(lua_State* L, sqlite3* db, const char* sql)
+{
+    char* errmsg = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+        lua_pushstring(L, errmsg);
+        sqlite3_free(errmsg);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Bind and run statement for row at top of stack.
+ * @return  0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_stmt_exec_row(lua_State* L, sqlite3_stmt* stmt)
+{
+    int top = lua_gettop(L);
+
+    /*
+     * Values are referenced by the row, so no copy is needed. Bindings of
+     * previous row must be cleared, they may refer to collected strings.
+     */
+    sqlite3_clear_bindings(stmt);
+    if (_sqlite_bind_args(L, stmt, top, top, SQLITE_STATIC) != 0)
+    {
+        return -1;
+    }
+
+    int ret;
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+    }
+    if (ret != SQLITE_DONE)
+    {
+        lua_pushstring(L, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        return -1;
+    }
+
+    sqlite3_reset(stmt);
+    return 0;
+}
+
+static int _sqlite_stmt_lua_exec_many(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 2);
+
+    sqlite3_stmt* stmt = self->entry->stmt;
+    sqlite3* db = sqlite3_db_handle(stmt);
+    sqlite3_reset(stmt);
+
+    /* One transaction for all rows, or nested in current transaction. */
+    if (auto_sqlite_exec_simple(L, db, "SAVEPOINT __auto_exec_many") != 0)
+    {
+        return lua_error(L);
+    }
+
+    lua_Integer changes = 0;
+    lua_Integer i, cnt = luaL_len(L, 2);
+    for (i = 1; i <= cnt; i++)
+    {
+        lua_rawgeti(L, 2, i);
+        if (_sqlite_stmt_exec_row(L, stmt) != 0)
+        {
+            goto error;
+        }
+        changes += sqlite3_changes(db);
+        lua_pop(L, 1);
+    }
+    sqlite3_clear_bindings(stmt);
+
+    if (auto_sqlite_exec_simple(L, db, "RELEASE __auto_exec_many") != 0)
+    {
+        goto error;
+    }
+
+    lua_pushinteger(L, changes);
+    return 1;
+
+error:
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    sqlite3_exec(db, "ROLLBACK TO __auto_exec_many; RELEASE __auto_exec_many", NULL, NULL, NULL);
+    return lua_error(L);
+}
+
+static void _sqlite_stmt_init_metatable(lua_State* L)
+{
+    static const luaL_Reg s_stmt_meta[] = {
+        { "__gc",           _sqlite_stmt_lua_close },
+        { "__close",        _sqlite_stmt_lua_close },
+        { NULL,             NULL },
+    };
+    static const luaL_Reg s_stmt_method[] = {
+        { "bind",           _sqlite_stmt_lua_bind },
+        { "close",          _sqlite_stmt_lua_close },
+        { "exec_many",      _sqlite_stmt_lua_exec_many },
+        { "fetch_all",      _sqlite_stmt_lua_fetch_all },
+        { "reset",          _sqlite_stmt_lua_reset },
+        { "rows",           _sqlite_stmt_lua_rows },
+        { "step",           _sqlite_stmt_lua_step },
+        { "step_async",     auto_sqlite_stmt_lua_step_async },
+        { NULL,             NULL },
+    };
+    if (luaL_newmetatable(L, AUTO_LUA_SQLITE_STMT) != 0)
+    {
+        luaL_setfuncs(L, s_stmt_meta, 0);
+        luaL_newlib(L, s_stmt_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+}
+
+int auto_sqlite_push_stmt(lua_State* L, int idx, const char* sql, size_t sql_sz)
+{
+    lua_sqlite_t* self = lua_touserdata(L, idx);
+    idx = lua_absindex(L, idx);
+
+    if (self->db == NULL)
+    {
+        lua_pushstring(L, "database is closed");
+        return -1;
+    }
+
+    /* User values: connection, column names. */
+    lua_sqlite_stmt_t* stmt = lua_newuserdatauv(L, sizeof(lua_sqlite_stmt_t), 2);
+    memset(stmt, 0, sizeof(*stmt));
+    _sqlite_stmt_init_metatable(L);
+
+    /* Keep connection alive as long as statement. */
+    lua_pushvalue(L, idx);
+    lua_setiuservalue(L, -2, 1);
+
+    if ((stmt->entry = auto_sqlite_stmt_acquire(L, self, sql, sql_sz)) == NULL)
+    {
+        lua_remove(L, -2);
+        return -1;
+    }
+    stmt->belong = self;
+
+    return 0;
+}
+
+static int _sqlite_lua_prepare(lua_State* L)
+{
+    auto_sqlite_check_db(L, 1);
+    size_t sql_sz;
+    const char* sql = luaL_checklstring(L, 2, &sql_sz);
+
+    if (auto_sqlite_push_stmt(L, 1, sql, sql_sz) != 0)
+    {
+        return lua_error(L);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief SQL function implemented in Lua.
+ */
+typedef struct sqlite_lua_func
+{
+    lua_State*      L;          /**< Thread to call function, its first stack slot is the function table */
+    uv_thread_t     owner;      /**< Thread that runs Lua */
+    const char*     name;       /**< Function name, stored after this struct */
+} sqlite_lua_func_t;
+
+static void _sqlite_lua_func_destroy(void* p)
+{
+    api.memory->free(p);
+}
+
+/**
+ * @brief Push SQL value with its native type.
+ */
+static void _sqlite_push_value(lua_State* L, sqlite3_value* value)
+{
+    switch (sqlite3_value_type(value))
+    {
+    case SQLITE_INTEGER:
+        lua_pushinteger(L, (lua_Integer)sqlite3_value_int64(value));
+        break;
+
+    case SQLITE_FLOAT:
+        lua_pushnumber(L, (lua_Number)sqlite3_value_double(value));
+        break;
+
+    case SQLITE_TEXT:
+        lua_pushlstring(L, (const char*)sqlite3_value_text(value), sqlite3_value_bytes(value));
+        break;
+
+    case SQLITE_BLOB:
+        lua_pushlstring(L, sqlite3_value_blob(value), sqlite3_value_bytes(value));
+        break;
+
+    default:
+        lua_pushnil(L);
+        break;
+    }
+}
+
+/**
+ * @brief Set function result from Lua value at \p idx.
+ */
+static void _sqlite_lua_func_result(sqlite3_context* ctx, lua_State* L, int idx)
+{
+    size_t size;
+    const char* data;
+
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNIL:
+        sqlite3_result_null(ctx);
+        break;
+
+    case LUA_TBOOLEAN:
+        sqlite3_result_int(ctx, lua_toboolean(L, idx));
+        break;
+
+    case LUA_TNUMBER:
+        if (lua_isinteger(L, idx))
+        {
+            sqlite3_result_int64(ctx, (sqlite3_int64)lua_tointeger(L, idx));
+        }
+        else
+        {
+            sqlite3_result_double(ctx, (double)lua_tonumber(L, idx));
+        }
+        break;
+
+    case LUA_TSTRING:
+        data = lua_tolstring(L, idx, &size);
+        sqlite3_result_text64(ctx, data, size, SQLITE_TRANSIENT, SQLITE_UTF8);
+        break;
+
+    default:
+        lua_pushfstring(L, "unsupported return type %s", luaL_typename(L, idx));
+        sqlite3_result_error(ctx, lua_tostring(L, -1), -1);
+        lua_pop(L, 1);
+        break;
+    }
+}
+
+/**
+ * @brief Check function is called on Lua thread, and push the function (or
+ *   the table of aggregate function).
+ * @return  Thread to call function, or NULL if failed and error is set.
+ */
+static lua_State* _sqlite_lua_func_prepare(sqlite3_context* ctx, sqlite_lua_func_t* func, int argc)
+{
+    uv_thread_t self = uv_thread_self();
+    if (!uv_thread_equal(&self, &func->owner))
+    {
+        char* errmsg = sqlite3_mprintf("Lua function %s cannot run in async query", func->name);
+        sqlite3_result_error(ctx, errmsg, -1);
+        sqlite3_free(errmsg);
+        return NULL;
+    }
+
+    lua_State* L = func->L;
+    if (!lua_checkstack(L, argc + 4))
+    {
+        sqlite3_result_error_nomem(ctx);
+        return NULL;
+    }
+
+    lua_rawgetp(L, 1, func);
+    return L;
+}
+
+/**
+ * @brief Call function with \p nargs arguments on top of stack.
+ * @return  0 if success, otherwise error is set.
+ */
+static int _sqlite_lua_func_pcall(sqlite3_context* ctx, lua_State* L, int nargs, int nresults)
+{
+    if (lua_pcall(L, nargs, nresults, 0) == LUA_OK)
+    {
+        return 0;
+    }
+
+    const char* errmsg = lua_tostring(L, -1);
+    sqlite3_result_error(ctx, errmsg != NULL ? errmsg : "error in Lua function", -1);
+    return -1;
+}
+
+static void _sqlite_lua_func_scalar(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    sqlite_lua_func_t* func = sqlite3_user_data(ctx);
+    lua_State* L = _sqlite_lua_func_prepare(ctx, func, argc);
+    if (L == NULL)
+    {
+        return;
+    }
+
+    int i, top = lua_gettop(L) - 1;
+    for (i = 0; i < argc; i++)
+    {
+        _sqlite_push_value(L, argv[i]);
+    }
+    if (_sqlite_lua_func_pcall(ctx, L, argc, 1) == 0)
+    {
+        _sqlite_lua_func_result(ctx, L, -1);
+    }
+
+    lua_settop(L, top);
+}
+
+/**
+ * @brief Push state of current group. Each group has its own aggregate
+ *   context, whose address is the key of state in function table.
+ */
+static void _sqlite_lua_func_push_state(lua_State* L, void* key)
+{
+    if (key == NULL)
+    {
+        lua_newtable(L);
+        return;
+    }
+    if (lua_rawgetp(L, 1, key) == LUA_TTABLE)
+    {
+        return;
+    }
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, 1, key);
+}
+
+static void _sqlite_lua_func_step(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    sqlite_lua_func_t* func = sqlite3_user_data(ctx);
+    void* key = sqlite3_aggregate_context(ctx, 1);
+    if (key == NULL)
+    {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+
+    lua_State* L = _sqlite_lua_func_prepare(ctx, func, argc);
+    if (L == NULL)
+    {
+        return;
+    }
+
+    int i, top = lua_gettop(L) - 1;
+    lua_getfield(L, -1, "step");
+    _sqlite_lua_func_push_state(L, key);
+    for (i = 0; i < argc; i++)
+    {
+        _sqlite_push_value(L, argv[i]);
+    }
+    _sqlite_lua_func_pcall(ctx, L, argc + 1, 0);
+
+    lua_settop(L, top);
+}
+
+static void _sqlite_lua_func_final(sqlite3_context* ctx)
+{
+    sqlite_lua_func_t* func = sqlite3_user_data(ctx);
+    void* key = sqlite3_aggregate_context(ctx, 0);
+
+    lua_State* L = _sqlite_lua_func_prepare(ctx, func, 0);
+    if (L == NULL)
+    {
+        return;
+    }
+
+    int top = lua_gettop(L) - 1;
+    lua_getfield(L, -1, "final");
+    _sqlite_lua_func_push_state(L, key);
+    if (_sqlite_lua_func_pcall(ctx, L, 1, 1) == 0)
+    {
+        _sqlite_lua_func_result(ctx, L, -1);
+    }
+
+    /* Group is finished. */
+    if (key != NULL)
+    {
+        lua_pushnil(L);
+        lua_rawsetp(L, 1, key);
+    }
+
+    lua_settop(L, top);
+}
+
+/**
+ * @brief Get thread that calls Lua functions of connection at \p idx. It is
+ *   the user value of connection, and its first stack slot is the function
+ *   table.
+ */
+static lua_State* _sqlite_lua_func_thread(lua_State* L, int idx)
+{
+    lua_State* T;
+    if (lua_getiuservalue(L, idx, 1) == LUA_TTHREAD)
+    {
+        T = lua_tothread(L, -1);
+        lua_pop(L, 1);
+        return T;
+    }
+    lua_pop(L, 1);
+
+    T = lua_newthread(L);
+    lua_newtable(T);
+    lua_setiuservalue(L, idx, 1);
+    return T;
+}
+
+static int _sqlite_lua_create_function(lua_State* L)
+{
+    lua_sqlite_t* self = auto_sqlite_check_db(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+
+    int aggregate = lua_type(L, 3) == LUA_TTABLE;
+    if (aggregate)
+    {
+        if (lua_getfield(L, 3, "step") != LUA_TFUNCTION || lua_getfield(L, 3, "final") != LUA_TFUNCTION)
+        {
+            return api.lua->A_error(L, "aggregate function requires step and final");
+        }
+        lua_pop(L, 2);
+    }
+    else
+    {
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+    }
+
+    lua_Integer nargs = -1;
+    int flags = SQLITE_UTF8;
+    if (lua_type(L, 4) == LUA_TTABLE)
+    {
+        if (lua_getfield(L, 4, "nargs") != LUA_TNIL)
+        {
+            nargs = luaL_checkinteger(L, -1);
+        }
+        if (auto_sqlite_opt_boolean(L, 4, "deterministic"))
+        {
+            flags |= SQLITE_DETERMINISTIC;
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_State* T = _sqlite_lua_func_thread(L, 1);
+
+    size_t name_sz = strlen(name);
+    sqlite_lua_func_t* func = api.memory->malloc(sizeof(sqlite_lua_func_t) + name_sz + 1);
+    if (func == NULL)
+    {
+        return api.lua->A_error(L, "out of memory");
+    }
+    func->L = T;
+    func->owner = uv_thread_self();
+
+    char* data = (char*)(func + 1);
+    memcpy(data, name, name_sz + 1);
+    func->name = data;
+
+    /* The function is destroyed by SQLite, even if failed. */
+    int ret = sqlite3_create_function_v2(self->db, name, (int)nargs, flags, func,
+        aggregate ? NULL : _sqlite_lua_func_scalar,
+        aggregate ? _sqlite_lua_func_step : NULL,
+        aggregate ? _sqlite_lua_func_final : NULL,
+        _sqlite_lua_func_destroy);
+    if (ret != SQLITE_OK)
+    {
+        return api.lua->A_error(L, "%s", sqlite3_errmsg(self->db));
+    }
+
+    /* Drop the function it replaces. */
+    lua_pushfstring(T, "%s/%d", name, (int)nargs);
+    lua_pushvalue(T, -1);
+    if (lua_rawget(T, 1) == LUA_TLIGHTUSERDATA)
+    {
+        lua_pushnil(T);
+        lua_rawset(T, 1);
+    }
+    else
+    {
+        lua_pop(T, 1);
+    }
+    lua_pushlightuserdata(T, func);
+    lua_rawset(T, 1);
+
+    lua_pushvalue(L, 3);
+    lua_xmove(L, T, 1);
+    lua_rawsetp(T, 1, func);
+
+    return 0;
+}
+
+static void _sqlite_init_metatable(lua_State* L)
+{
+    static const luaL_Reg s_sqlite_meta[] = {
+        { "__gc",           _sqlite_lua_gc },
+        { "__tostring",     _sqlite_lua_tostring },
+        { NULL,             NULL },
+    };
+    static const luaL_Reg s_sqlite_method[] = {
+        { "close",          auto_sqlite_lua_close },
+        { "create_function", _sqlite_lua_create_function },
+        { "exec",           _sqlite_lua_exec },
+        { "exec_async",     auto_sqlite_lua_exec_async },
+        { "from_csv",       auto_sqlite_lua_from_csv },
+        { "from_csv_file",  auto_sqlite_lua_from_csv_file },
+        { "prepare",        _sqlite_lua_prepare },
+        { "to_csv",         auto_sqlite_lua_to_csv },
+        { "to_csv_file",    auto_sqlite_lua_to_csv_file },
+        { "to_csv_rows",    auto_sqlite_lua_to_csv_rows },
+        { NULL,             NULL },
+    };
+    if (luaL_newmetatable(L, AUTO_LUA_SQLITE) != 0)
+    {
+        luaL_setfuncs(L, s_sqlite_meta, 0);
+        luaL_newlib(L, s_sqlite_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+}
+
+/**
+ * @brief Get option \p name that is one of \p names (case insensitive) or
+ *   an index of it.
+ * @return  Index in \p names, -1 if not set, or -2 if invalid and error
+ *   message is pushed on top of stack.
+ */
+static int _sqlite_opt_enum(lua_State* L, int idx, const char* name,
+    const char* const names[], int name_cnt)
+{
+    int i, ret = -1;
+    switch (lua_getfield(L, idx, name))
+    {
+    case LUA_TNIL:
+        break;
+
+    case LUA_TNUMBER:
+        if (lua_isinteger(L, -1) && lua_tointeger(L, -1) >= 0 && lua_tointeger(L, -1) < name_cnt)
+        {
+            ret = (int)lua_tointeger(L, -1);
+        }
+        else
+        {
+            ret = -2;
+        }
+        break;
+
+    case LUA_TSTRING:
+        ret = -2;
+        for (i = 0; i < name_cnt; i++)
+        {
+            if (sqlite3_stricmp(lua_tostring(L, -1), names[i]) == 0)
+            {
+                ret = i;
+                break;
+            }
+        }
+        break;
+
+    default:
+        ret = -2;
+        break;
+    }
+
+    if (ret == -2)
+    {
+        lua_pushfstring(L, "invalid %s: %s", name, luaL_tolstring(L, -1, NULL));
+        lua_remove(L, -2);
+        lua_remove(L, -2);
+        return -2;
+    }
+
+    lua_pop(L, 1);
+    return ret;
+}
+
+/**
+ * @brief Get integer option \p name.
+ * @return  1 if set, 0 if not set, -1 if invalid and error message is pushed
+ *   on top of stack.
+ */
+static int _sqlite_opt_integer(lua_State* L, int idx, const char* name, lua_Integer* value)
+{
+    int type = lua_getfield(L, idx, name);
+    if (type == LUA_TNIL)
+    {
+        lua_pop(L, 1);
+        return 0;
+    }
+    if (!lua_isinteger(L, -1))
+    {
+        lua_pushfstring(L, "invalid %s: %s", name, luaL_tolstring(L, -1, NULL));
+        lua_remove(L, -2);
+        lua_remove(L, -2);
+        return -1;
+    }
+
+    *value = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return 1;
+}
+
+/**
+ * @brief Execute the PRAGMA on top of stack and pop it.
+ * @return  0 if success, otherwise error message replaces the PRAGMA.
+ */
+static int _sqlite_exec_pragma(lua_State* L, sqlite3* db)
+{
+    if (auto_sqlite_exec_simple(L, db, lua_tostring(L, -1)) != 0)
+    {
+        lua_remove(L, -2);
+        return -1;
+    }
+
+    lua_pop(L, 1);
+    return 0;
+}
+
+/**
+ * @brief Apply connection options that take effect after open.
+ * @return  0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_apply_options(lua_State* L, int idx, lua_sqlite_t* self)
+{
+    static const char* const s_journal_mode[] = { "delete", "truncate", "persist", "memory", "wal", "off" };
+    static const char* const s_synchronous[] = { "off", "normal", "full", "extra" };
+    static const char* const s_temp_store[] = { "default", "file", "memory" };
+    static const struct
+    {
+        const char*         name;
+        const char* const*  names;
+        int                 name_cnt;
+    } s_enum_pragma[] = {
+        { "journal_mode",   s_journal_mode, ARRAY_SIZE(s_journal_mode) },
+        { "synchronous",    s_synchronous,  ARRAY_SIZE(s_synchronous) },
+        { "temp_store",     s_temp_store,   ARRAY_SIZE(s_temp_store) },
+    };
+    static const char* const s_integer_pragma[] = { "cache_size", "mmap_size" };
+
+    int ret;
+    size_t i;
+    lua_Integer value;
+
+    /* Set busy timeout first, so changing journal mode can wait for locks. */
+    if ((ret = _sqlite_opt_integer(L, idx, "busy_timeout", &value)) < 0)
+    {
+        return -1;
+    }
+    if (ret > 0)
+    {
+        sqlite3_busy_timeout(self->db, value > 0 ? (int)value : 0);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(s_enum_pragma); i++)
+    {
+        ret = _sqlite_opt_enum(L, idx, s_enum_pragma[i].name, s_enum_pragma[i].names,
+            s_enum_pragma[i].name_cnt);
+        if (ret == -2)
+        {
+            return -1;
+        }
+        if (ret < 0)
+        {
+            continue;
+        }
+
+        lua_pushfstring(L, "PRAGMA %s=%s", s_enum_pragma[i].name, s_enum_pragma[i].names[ret]);
+        if (_sqlite_exec_pragma(L, self->db) != 0)
+        {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(s_integer_pragma); i++)
+    {
+        if ((ret = _sqlite_opt_integer(L, idx, s_integer_pragma[i], &value)) < 0)
+        {
+            return -1;
+        }
+        if (ret == 0)
+        {
+            continue;
+        }
+
+        lua_pushfstring(L, "PRAGMA %s=%I", s_integer_pragma[i], (LUAI_UACINT)value);
+        if (_sqlite_exec_pragma(L, self->db) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int auto_lua_sqlite(lua_State* L)
+{
+    lua_sqlite_t* self = lua_newuserdata(L, sizeof(lua_sqlite_t));
+
+    memset(self, 0, sizeof(*self));
+    _sqlite_stmt_cache_init(self);
+    _sqlite_init_metatable(L);
 
     _sqlite_lua_parse_options(L, 1, self);
 
-    if (sqlite3_open(self->config.filename, &self->db) != SQLITE_OK)
+    /* On failure the connection is closed by __gc. */
+    if (sqlite3_open_v2(self->config.filename, &self->db, self->config.flags, NULL) != SQLITE_OK)
     {
         return api.lua->A_error(L, "%s", sqlite3_errmsg(self->db));
     }
 
+    if (auto_sqlite_func_init(self->db) != SQLITE_OK || auto_sqlite_vtab_init(self->db) != SQLITE_OK)
+    {
+        return api.lua->A_error(L, "%s", sqlite3_errmsg(self->db));
+    }
+
+    if (lua_type(L, 1) == LUA_TTABLE && _sqlite_apply_options(L, 1, self) != 0)
+    {
+        return lua_error(L);
+    }
+
     return 1;
 }
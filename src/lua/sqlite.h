@@ -1,11 +1,81 @@
 #ifndef __AUTO_LUA_API_SQLITE_H__
 #define __AUTO_LUA_API_SQLITE_H__
+
+#include <sqlite3.h>
+#include <uv.h>
 #include "api.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Lua userdata type of sqlite
+ */
+#define AUTO_LUA_SQLITE         "__auto_sqlite3"
+
+/**
+ * @brief Lua userdata type of sqlite prepared statement
+ */
+#define AUTO_LUA_SQLITE_STMT    "__auto_sqlite3_stmt"
+
+struct sqlite_async_job;
+
+/**
+ * @brief Prepared statement, may be shared through statement cache.
+ */
+typedef struct sqlite_stmt_entry
+{
+    auto_map_node_t     t_node;     /**< Cache table node */
+    auto_list_node_t    q_node;     /**< LRU queue node, most recently used at front */
+    auto_list_node_t    a_node;     /**< Node in list of all statements */
+    sqlite3_stmt*       stmt;       /**< Prepared statement, NULL if connection closed */
+    int                 in_use;     /**< Whether hold by a Lua statement object */
+    int                 cached;     /**< Whether still tracked by cache */
+
+    struct
+    {
+        const char*     data;       /**< SQL text */
+        size_t          size;       /**< SQL size in bytes */
+    } sql;
+} sqlite_stmt_entry_t;
+
+typedef struct lua_sqlite
+{
+    sqlite3*        db;         /**< Database connection */
+
+    struct
+    {
+        auto_map_t  table;      /**< Idle or in use statements, keyed by SQL */
+        auto_list_t lru;        /**< Cached statements, most recently used at front */
+        auto_list_t all;        /**< All statements that are not finalized */
+        size_t      capacity;   /**< Max number of cached statements */
+    } stmt_cache;
+
+    struct
+    {
+        auto_thread_t*  thread;     /**< Worker thread, started on first async query */
+        auto_notify_t*  notifier;   /**< Wakeup loop thread when batch is ready */
+        uv_mutex_t      lock;       /**< Guard for fields below */
+        uv_cond_t       cond;       /**< Signal for job submit, batch consume, job finish and exit */
+        struct sqlite_async_job* job;   /**< Job of worker, NULL if idle */
+        int             exiting;    /**< Ask worker to exit */
+    } async;
+
+    struct
+    {
+        char*       filename;   /**< Database filename (UTF-8) */
+        int         flags;      /**< Flags of sqlite3_open_v2() */
+    } config;
+} lua_sqlite_t;
+
+typedef struct lua_sqlite_stmt
+{
+    lua_sqlite_t*           belong; /**< SQLite instance */
+    sqlite_stmt_entry_t*    entry;  /**< Prepared statement */
+    int                     async_eof; /**< step_async() reached end with rows returned */
+} lua_sqlite_stmt_t;
+
 /**
  * @brief Create a new SQLite instance.
  * @param[in] L     Lua VM.
@@ -13,6 +83,55 @@ extern "C" {
  */
 AUTO_LOCAL int auto_lua_sqlite(lua_State *L);
 
+/**
+ * @brief Get boolean field \p name of option table at \p idx.
+ */
+AUTO_LOCAL int auto_sqlite_opt_boolean(lua_State* L, int idx, const char* name);
+
+/**
+ * @brief Close connection at stack index 1. Running async query is interrupted.
+ * @param[in] L     Lua VM.
+ * @return          Always 0.
+ */
+AUTO_LOCAL int auto_sqlite_lua_close(lua_State* L);
+
+/**
+ * @brief Check connection at \p idx is open and not running async query.
+ */
+AUTO_LOCAL lua_sqlite_t* auto_sqlite_check_db(lua_State* L, int idx);
+
+/**
+ * @brief Check statement at \p idx is open and connection is not running async query.
+ */
+AUTO_LOCAL lua_sqlite_stmt_t* auto_sqlite_check_stmt(lua_State* L, int idx);
+
+/**
+ * @brief Get an idle prepared statement for \p sql, prepare it if not cached.
+ * @note Release it by #auto_sqlite_stmt_release() after use.
+ * @return  Statement entry, or NULL if prepare failed and error message is
+ *   pushed on top of stack.
+ */
+AUTO_LOCAL sqlite_stmt_entry_t* auto_sqlite_stmt_acquire(lua_State* L, lua_sqlite_t* self,
+    const char* sql, size_t sql_sz);
+
+/**
+ * @brief Release statement returned by #auto_sqlite_stmt_acquire().
+ */
+AUTO_LOCAL void auto_sqlite_stmt_release(lua_sqlite_t* self, sqlite_stmt_entry_t* entry);
+
+/**
+ * @brief Push a statement object of \p sql.
+ * @param[in] idx   Index of connection.
+ * @return          0 if success, otherwise error message is pushed on top of stack.
+ */
+AUTO_LOCAL int auto_sqlite_push_stmt(lua_State* L, int idx, const char* sql, size_t sql_sz);
+
+/**
+ * @brief Execute SQL that does not return data.
+ * @return  0 if success, otherwise error message is pushed on top of stack.
+ */
+AUTO_LOCAL int auto_sqlite_exec_simple(lua_State* L, sqlite3* db, const char* sql);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,739 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite_async.h"
+#include "utils.h"
+#include "utils/list.h"
+#include "utils/trace.h"
+
+/**
+ * @brief Default number of rows in one batch of async query.
+ */
+#define AUTO_SQLITE_ASYNC_BATCH_SIZE    256
+
+/**
+ * @brief Max number of batches produced by worker but not consumed yet.
+ */
+#define AUTO_SQLITE_ASYNC_MAX_PENDING   4
+
+/**
+ * @brief Column value copied out of worker thread.
+ */
+typedef struct sqlite_async_cell
+{
+    int                 type;       /**< SQLite fundamental datatype */
+    union
+    {
+        sqlite3_int64   i;          /**< SQLITE_INTEGER */
+        double          d;          /**< SQLITE_FLOAT */
+        struct
+        {
+            size_t      offset;     /**< Offset in #sqlite_async_batch_t::arena */
+            size_t      size;       /**< Size in bytes */
+        } s;                        /**< SQLITE_TEXT or SQLITE_BLOB */
+    } u;
+} sqlite_async_cell_t;
+
+/**
+ * @brief Rows of one statement produced by worker thread.
+ *
+ * The first #sqlite_async_batch_t::column_cnt cells are column names.
+ */
+typedef struct sqlite_async_batch
+{
+    auto_list_node_t        node;       /**< Node in #sqlite_async_job_t::ready */
+    int                     column_cnt; /**< Column count */
+    size_t                  row_cnt;    /**< Row count */
+
+    struct
+    {
+        sqlite_async_cell_t* data;      /**< Column names, then rows */
+        size_t              size;       /**< Cell count */
+        size_t              capacity;   /**< Cell capacity */
+    } cells;
+
+    struct
+    {
+        char*               data;       /**< Text and blob values */
+        size_t              size;       /**< Size in bytes */
+        size_t              capacity;   /**< Capacity in bytes */
+    } arena;
+} sqlite_async_batch_t;
+
+/**
+ * @brief Query run on worker thread.
+ *
+ * Fields in `state` are guarded by #lua_sqlite_t::async::lock, other fields
+ * are not changed after submit.
+ */
+typedef struct sqlite_async_job
+{
+    lua_sqlite_t*           belong;     /**< SQLite instance */
+    auto_coroutine_t*       co;         /**< Waiting coroutine, NULL if nobody waits */
+    auto_coroutine_hook_t*  hook;       /**< Hook to forget \p co once it is closed */
+    sqlite3_stmt*           stmt;       /**< Statement to step, or NULL to run #sqlite_async_job_t::sql */
+    const char*             sql;        /**< SQL of exec_async() */
+    size_t                  sql_sz;     /**< SQL size in bytes */
+    size_t                  batch_size; /**< Max rows in one batch */
+    size_t                  max_rows;   /**< Stop after this many rows */
+    lua_Integer             row_cnt;    /**< Rows delivered to Lua */
+
+    struct
+    {
+        auto_list_t         ready;      /**< Batches ready for loop thread */
+        int                 started;    /**< Worker pick up the job */
+        int                 done;       /**< Worker finish the job */
+        int                 cancel;     /**< Ask worker to stop */
+        int                 detached;   /**< Removed from connection */
+        int                 eof;        /**< Statement is finished */
+        char*               errmsg;     /**< Error message, NULL if success */
+    } state;
+} sqlite_async_job_t;
+
+static size_t _sqlite_async_batch_put_data(sqlite_async_batch_t* batch, const void* data, size_t size)
+{
+    if (batch->arena.size + size > batch->arena.capacity)
+    {
+        size_t capacity = batch->arena.capacity != 0 ? batch->arena.capacity * 2 : 4096;
+        while (capacity < batch->arena.size + size)
+        {
+            capacity *= 2;
+        }
+        batch->arena.data = api.memory->realloc(batch->arena.data, capacity);
+        batch->arena.capacity = capacity;
+    }
+
+    size_t offset = batch->arena.size;
+    if (size != 0)
+    {
+        memcpy(batch->arena.data + offset, data, size);
+    }
+    batch->arena.size += size;
+
+    return offset;
+}
+
+static sqlite_async_cell_t* _sqlite_async_batch_new_cell(sqlite_async_batch_t* batch)
+{
+    if (batch->cells.size == batch->cells.capacity)
+    {
+        batch->cells.capacity = batch->cells.capacity != 0 ? batch->cells.capacity * 2 : 64;
+        batch->cells.data = api.memory->realloc(batch->cells.data,
+            sizeof(sqlite_async_cell_t) * batch->cells.capacity);
+    }
+    return &batch->cells.data[batch->cells.size++];
+}
+
+static void _sqlite_async_batch_put_bytes(sqlite_async_batch_t* batch, int type,
+    const void* data, size_t size)
+{
+    sqlite_async_cell_t* cell = _sqlite_async_batch_new_cell(batch);
+    cell->type = type;
+    cell->u.s.size = size;
+    cell->u.s.offset = _sqlite_async_batch_put_data(batch, data, size);
+}
+
+static sqlite_async_batch_t* _sqlite_async_batch_new(sqlite3_stmt* stmt)
+{
+    sqlite_async_batch_t* batch = api.memory->calloc(1, sizeof(sqlite_async_batch_t));
+    batch->column_cnt = sqlite3_column_count(stmt);
+
+    int i;
+    for (i = 0; i < batch->column_cnt; i++)
+    {
+        const char* name = sqlite3_column_name(stmt, i);
+        _sqlite_async_batch_put_bytes(batch, SQLITE_TEXT, name, strlen(name));
+    }
+
+    return batch;
+}
+
+static void _sqlite_async_batch_add_row(sqlite_async_batch_t* batch, sqlite3_stmt* stmt)
+{
+    int i;
+    for (i = 0; i < batch->column_cnt; i++)
+    {
+        int type = sqlite3_column_type(stmt, i);
+        if (type == SQLITE_TEXT || type == SQLITE_BLOB)
+        {
+            const void* data = type == SQLITE_TEXT ? (const void*)sqlite3_column_text(stmt, i)
+                : sqlite3_column_blob(stmt, i);
+            _sqlite_async_batch_put_bytes(batch, type, data, sqlite3_column_bytes(stmt, i));
+            continue;
+        }
+
+        sqlite_async_cell_t* cell = _sqlite_async_batch_new_cell(batch);
+        cell->type = type;
+        if (type == SQLITE_INTEGER)
+        {
+            cell->u.i = sqlite3_column_int64(stmt, i);
+        }
+        else if (type == SQLITE_FLOAT)
+        {
+            cell->u.d = sqlite3_column_double(stmt, i);
+        }
+    }
+    batch->row_cnt++;
+}
+
+static void _sqlite_async_batch_destroy(sqlite_async_batch_t* batch)
+{
+    api.memory->free(batch->cells.data);
+    api.memory->free(batch->arena.data);
+    api.memory->free(batch);
+}
+
+/**
+ * @brief Append rows of \p batch to the table at \p res_idx.
+ */
+static void _sqlite_async_batch_push(lua_State* L, sqlite_async_batch_t* batch, int res_idx,
+    lua_Integer* cnt)
+{
+    int i;
+    size_t row;
+    const sqlite_async_cell_t* cell = batch->cells.data;
+
+    luaL_checkstack(L, batch->column_cnt + 4, NULL);
+    int names_idx = lua_gettop(L) + 1;
+    for (i = 0; i < batch->column_cnt; i++, cell++)
+    {
+        lua_pushlstring(L, batch->arena.data + cell->u.s.offset, cell->u.s.size);
+    }
+
+    for (row = 0; row < batch->row_cnt; row++)
+    {
+        lua_createtable(L, 0, batch->column_cnt);
+        for (i = 0; i < batch->column_cnt; i++, cell++)
+        {
+            switch (cell->type)
+            {
+            case SQLITE_INTEGER:
+                lua_pushinteger(L, (lua_Integer)cell->u.i);
+                break;
+            case SQLITE_FLOAT:
+                lua_pushnumber(L, (lua_Number)cell->u.d);
+                break;
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                lua_pushlstring(L, batch->arena.data + cell->u.s.offset, cell->u.s.size);
+                break;
+            default:
+                continue;
+            }
+            lua_pushvalue(L, names_idx + i);
+            lua_insert(L, -2);
+            lua_rawset(L, -3);
+        }
+        lua_rawseti(L, res_idx, ++(*cnt));
+    }
+
+    lua_settop(L, names_idx - 1);
+}
+
+/**
+ * @brief Hand over \p batch to loop thread. Wait if too many batches are pending.
+ * @return  Non-zero if job is cancelled.
+ */
+static int _sqlite_async_submit(lua_sqlite_t* self, sqlite_async_job_t* job,
+    sqlite_async_batch_t* batch)
+{
+    uv_mutex_lock(&self->async.lock);
+
+    ev_list_push_back(&job->state.ready, &batch->node);
+    api.notify->send(self->async.notifier);
+
+    while (!job->state.cancel && ev_list_size(&job->state.ready) >= AUTO_SQLITE_ASYNC_MAX_PENDING)
+    {
+        uv_cond_wait(&self->async.cond, &self->async.lock);
+    }
+    int cancel = job->state.cancel;
+
+    uv_mutex_unlock(&self->async.lock);
+
+    return cancel;
+}
+
+/**
+ * @brief Step \p stmt on worker thread and submit rows in batches.
+ * @return  SQLITE_DONE if finished, SQLITE_ROW if row limit is reached,
+ *   otherwise error code.
+ */
+static int _sqlite_async_step(lua_sqlite_t* self, sqlite_async_job_t* job,
+    sqlite3_stmt* stmt, size_t* row_cnt)
+{
+    int ret = SQLITE_ROW;
+    sqlite_async_batch_t* batch = NULL;
+
+    while (*row_cnt < job->max_rows && (ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        if (batch == NULL)
+        {
+            batch = _sqlite_async_batch_new(stmt);
+        }
+        _sqlite_async_batch_add_row(batch, stmt);
+        (*row_cnt)++;
+
+        if (batch->row_cnt < job->batch_size)
+        {
+            continue;
+        }
+
+        int cancel = _sqlite_async_submit(self, job, batch);
+        batch = NULL;
+        if (cancel)
+        {
+            return SQLITE_INTERRUPT;
+        }
+    }
+
+    if (batch != NULL && _sqlite_async_submit(self, job, batch) && ret == SQLITE_ROW)
+    {
+        ret = SQLITE_INTERRUPT;
+    }
+
+    return ret;
+}
+
+static void _sqlite_async_run(lua_sqlite_t* self, sqlite_async_job_t* job)
+{
+    int ret = SQLITE_DONE;
+    size_t row_cnt = 0;
+    char* errmsg = NULL;
+
+    if (job->stmt != NULL)
+    {
+        ret = _sqlite_async_step(self, job, job->stmt, &row_cnt);
+        if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+        {
+            errmsg = auto_strdup(sqlite3_errmsg(self->db));
+            sqlite3_reset(job->stmt);
+        }
+    }
+
+    const char* sql = job->sql;
+    const char* sql_end = sql != NULL ? sql + job->sql_sz : NULL;
+    while (sql < sql_end && ret == SQLITE_DONE)
+    {
+        sqlite3_stmt* stmt = NULL;
+        if (sqlite3_prepare_v2(self->db, sql, (int)(sql_end - sql), &stmt, &sql) != SQLITE_OK)
+        {
+            ret = SQLITE_ERROR;
+            errmsg = auto_strdup(sqlite3_errmsg(self->db));
+            break;
+        }
+
+        /* Comment or white space. */
+        if (stmt == NULL)
+        {
+            continue;
+        }
+
+        ret = _sqlite_async_step(self, job, stmt, &row_cnt);
+        if (ret != SQLITE_DONE)
+        {
+            errmsg = auto_strdup(sqlite3_errmsg(self->db));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    uv_mutex_lock(&self->async.lock);
+    job->state.eof = ret == SQLITE_DONE;
+    job->state.errmsg = errmsg;
+    job->state.done = 1;
+    api.notify->send(self->async.notifier);
+    uv_cond_broadcast(&self->async.cond);
+    uv_mutex_unlock(&self->async.lock);
+}
+
+static void _sqlite_async_worker(void* arg)
+{
+    lua_sqlite_t* self = arg;
+
+    uv_mutex_lock(&self->async.lock);
+    while (!self->async.exiting)
+    {
+        sqlite_async_job_t* job = self->async.job;
+        if (job == NULL || job->state.started)
+        {
+            uv_cond_wait(&self->async.cond, &self->async.lock);
+            continue;
+        }
+
+        job->state.started = 1;
+        uv_mutex_unlock(&self->async.lock);
+
+        uint64_t trace_beg = AUTO_TRACE_BEGIN();
+        _sqlite_async_run(self, job);
+        AUTO_TRACE_END("sqlite job", trace_beg);
+
+        uv_mutex_lock(&self->async.lock);
+    }
+    uv_mutex_unlock(&self->async.lock);
+}
+
+static void _sqlite_async_on_notify(void* arg)
+{
+    lua_sqlite_t* self = arg;
+
+    /* Job and its coroutine are only changed in loop thread. */
+    sqlite_async_job_t* job = self->async.job;
+    if (job != NULL && job->co != NULL)
+    {
+        api.coroutine->set_state(job->co, AUTO_COROUTINE_BUSY);
+    }
+}
+
+/**
+ * @brief Remove \p job from connection. If it is running, interrupt it and
+ *   wait for worker.
+ */
+static void _sqlite_async_detach(lua_sqlite_t* self, sqlite_async_job_t* job)
+{
+    if (job->state.detached)
+    {
+        return;
+    }
+
+    uv_mutex_lock(&self->async.lock);
+
+    if (job->state.started && !job->state.done)
+    {
+        job->state.cancel = 1;
+        sqlite3_interrupt(self->db);
+        uv_cond_broadcast(&self->async.cond);
+        while (!job->state.done)
+        {
+            uv_cond_wait(&self->async.cond, &self->async.lock);
+        }
+    }
+    else if (!job->state.started)
+    {
+        job->state.done = 1;
+        job->state.errmsg = auto_strdup("database is closed");
+    }
+
+    if (self->async.job == job)
+    {
+        self->async.job = NULL;
+    }
+    job->state.detached = 1;
+
+    uv_mutex_unlock(&self->async.lock);
+
+    /* Let waiting coroutine see the result. */
+    if (job->co != NULL)
+    {
+        api.coroutine->set_state(job->co, AUTO_COROUTINE_BUSY);
+    }
+}
+
+/**
+ * @brief Stop waking up coroutine of \p job.
+ */
+static void _sqlite_async_unwait(sqlite_async_job_t* job)
+{
+    if (job->co != NULL)
+    {
+        api.coroutine->unhook(job->co, job->hook);
+        job->co = NULL;
+        job->hook = NULL;
+    }
+}
+
+/**
+ * @brief Interrupt job if waiting coroutine is closed, its context is reused
+ *   by other coroutines.
+ */
+static void _sqlite_async_on_waiter_state_change(auto_coroutine_t* co, void* arg)
+{
+    sqlite_async_job_t* job = arg;
+
+    if (co->status & AUTO_COROUTINE_DEAD)
+    {
+        _sqlite_async_unwait(job);
+        _sqlite_async_detach(job->belong, job);
+    }
+}
+
+static int _sqlite_async_job_gc(lua_State* L)
+{
+    sqlite_async_job_t* job = lua_touserdata(L, 1);
+
+    _sqlite_async_unwait(job);
+    _sqlite_async_detach(job->belong, job);
+
+    auto_list_node_t* it;
+    while ((it = ev_list_pop_front(&job->state.ready)) != NULL)
+    {
+        _sqlite_async_batch_destroy(container_of(it, sqlite_async_batch_t, node));
+    }
+    if (job->state.errmsg != NULL)
+    {
+        free(job->state.errmsg);
+        job->state.errmsg = NULL;
+    }
+
+    return 0;
+}
+
+void auto_sqlite_async_exit(lua_sqlite_t* self)
+{
+    if (self->async.thread == NULL)
+    {
+        return;
+    }
+
+    if (self->async.job != NULL)
+    {
+        _sqlite_async_detach(self, self->async.job);
+    }
+
+    uv_mutex_lock(&self->async.lock);
+    self->async.exiting = 1;
+    uv_cond_broadcast(&self->async.cond);
+    uv_mutex_unlock(&self->async.lock);
+
+    api.thread->join(self->async.thread);
+    self->async.thread = NULL;
+
+    api.notify->destroy(self->async.notifier);
+    self->async.notifier = NULL;
+
+    uv_cond_destroy(&self->async.cond);
+    uv_mutex_destroy(&self->async.lock);
+}
+
+int auto_sqlite_async_using(lua_sqlite_t* self, sqlite3_stmt* stmt)
+{
+    return self->async.job != NULL && self->async.job->stmt == stmt;
+}
+
+/**
+ * @brief Push a new job for connection at \p idx and submit it to worker.
+ *
+ * The connection and \p keep_idx (SQL string or statement object) are kept as
+ * user values of job, so they outlive the worker.
+ */
+static sqlite_async_job_t* _sqlite_async_submit_job(lua_State* L, int idx, int keep_idx,
+    sqlite3_stmt* stmt, size_t batch_size, size_t max_rows)
+{
+    lua_sqlite_t* self = lua_touserdata(L, idx);
+
+    auto_coroutine_t* co = api.coroutine->find(L);
+    if (co == NULL || !lua_isyieldable(L))
+    {
+        api.lua->A_error(L, "async query must run in a managed coroutine");
+        return NULL;
+    }
+
+    /* Loop thread still resets and finalizes statements while worker steps. */
+    if (self->config.flags & SQLITE_OPEN_NOMUTEX)
+    {
+        api.lua->A_error(L, "async query is not supported on connection opened with nomutex");
+        return NULL;
+    }
+
+    sqlite_async_job_t* job = lua_newuserdatauv(L, sizeof(sqlite_async_job_t), 2);
+    memset(job, 0, sizeof(*job));
+    ev_list_init(&job->state.ready);
+    job->belong = self;
+    job->stmt = stmt;
+    job->batch_size = batch_size;
+    job->max_rows = max_rows;
+    if (stmt == NULL)
+    {
+        job->sql = lua_tolstring(L, keep_idx, &job->sql_sz);
+    }
+
+    static const luaL_Reg s_job_meta[] = {
+        { "__gc",       _sqlite_async_job_gc },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, "__auto_sqlite3_async") != 0)
+    {
+        luaL_setfuncs(L, s_job_meta, 0);
+    }
+    lua_setmetatable(L, -2);
+
+    /* Finalizer is set, so the hook is always removed. */
+    job->co = co;
+    job->hook = api.coroutine->hook(co, _sqlite_async_on_waiter_state_change, job);
+
+    lua_pushvalue(L, idx);
+    lua_setiuservalue(L, -2, 1);
+    lua_pushvalue(L, keep_idx);
+    lua_setiuservalue(L, -2, 2);
+
+    /* Start worker on first use. */
+    if (self->async.thread == NULL)
+    {
+        uv_mutex_init(&self->async.lock);
+        uv_cond_init(&self->async.cond);
+        self->async.exiting = 0;
+        self->async.notifier = api.notify->create(L, _sqlite_async_on_notify, self);
+        self->async.thread = api.thread->create(_sqlite_async_worker, self);
+    }
+
+    uv_mutex_lock(&self->async.lock);
+    self->async.job = job;
+    uv_cond_broadcast(&self->async.cond);
+    uv_mutex_unlock(&self->async.lock);
+
+    return job;
+}
+
+/**
+ * @brief Move ready rows of \p job into table at \p res_idx.
+ * @return  Whether job is finished.
+ */
+static int _sqlite_async_collect(lua_State* L, sqlite_async_job_t* job, int res_idx)
+{
+    auto_list_t ready;
+    ev_list_init(&ready);
+
+    int done;
+    lua_sqlite_t* self = job->belong;
+    if (job->state.detached)
+    {
+        ev_list_migrate(&ready, &job->state.ready);
+        done = 1;
+    }
+    else
+    {
+        uv_mutex_lock(&self->async.lock);
+        ev_list_migrate(&ready, &job->state.ready);
+        done = job->state.done;
+        uv_cond_broadcast(&self->async.cond);
+        uv_mutex_unlock(&self->async.lock);
+    }
+
+    auto_list_node_t* it;
+    while ((it = ev_list_pop_front(&ready)) != NULL)
+    {
+        sqlite_async_batch_t* batch = container_of(it, sqlite_async_batch_t, node);
+        _sqlite_async_batch_push(L, batch, res_idx, &job->row_cnt);
+        _sqlite_async_batch_destroy(batch);
+    }
+
+    return done;
+}
+
+/**
+ * @brief Collect rows of \p job into table at \p res_idx, raise error if job failed.
+ * @return  Non-zero if still running and coroutine should yield.
+ */
+static int _sqlite_async_wait(lua_State* L, sqlite_async_job_t* job, int res_idx)
+{
+    if (!_sqlite_async_collect(L, job, res_idx))
+    {
+        api.coroutine->set_state(job->co, AUTO_COROUTINE_WAIT);
+        return 1;
+    }
+
+    _sqlite_async_unwait(job);
+    _sqlite_async_detach(job->belong, job);
+
+    if (job->state.errmsg != NULL)
+    {
+        lua_pushstring(L, job->state.errmsg);
+        lua_error(L);
+    }
+
+    return 0;
+}
+
+static int _sqlite_lua_exec_async_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    sqlite_async_job_t* job = (sqlite_async_job_t*)ctx;
+
+    /* Stack: db, sql, options, job, rows. */
+    if (_sqlite_async_wait(L, job, 5))
+    {
+        return lua_yieldk(L, 0, ctx, _sqlite_lua_exec_async_resume);
+    }
+
+    lua_settop(L, 5);
+    lua_pushinteger(L, job->row_cnt);
+    return 2;
+}
+
+int auto_sqlite_lua_exec_async(lua_State* L)
+{
+    auto_sqlite_check_db(L, 1);
+    luaL_checktype(L, 2, LUA_TSTRING);
+
+    lua_Integer batch_size = AUTO_SQLITE_ASYNC_BATCH_SIZE;
+    if (lua_type(L, 3) == LUA_TTABLE)
+    {
+        if (lua_getfield(L, 3, "batch_size") == LUA_TNUMBER && lua_tointeger(L, -1) > 0)
+        {
+            batch_size = lua_tointeger(L, -1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_settop(L, 3);
+
+    sqlite_async_job_t* job = _sqlite_async_submit_job(L, 1, 2, NULL,
+        (size_t)batch_size, (size_t)-1);
+
+    /* Rows are collected here. */
+    lua_newtable(L);
+
+    api.coroutine->set_state(job->co, AUTO_COROUTINE_WAIT);
+    return lua_yieldk(L, 0, (lua_KContext)job, _sqlite_lua_exec_async_resume);
+}
+
+static int _sqlite_stmt_lua_step_async_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    sqlite_async_job_t* job = (sqlite_async_job_t*)ctx;
+
+    /* Stack: stmt, n, db, job, rows. */
+    if (_sqlite_async_wait(L, job, 5))
+    {
+        return lua_yieldk(L, 0, ctx, _sqlite_stmt_lua_step_async_resume);
+    }
+
+    lua_settop(L, 5);
+    if (job->row_cnt == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    /*
+     * The SQLITE_DONE is consumed by worker, remember it so next call return
+     * nil instead of restart the statement.
+     */
+    if (job->state.eof)
+    {
+        lua_sqlite_stmt_t* self = lua_touserdata(L, 1);
+        self->async_eof = 1;
+    }
+    return 1;
+}
+
+int auto_sqlite_stmt_lua_step_async(lua_State* L)
+{
+    lua_sqlite_stmt_t* self = auto_sqlite_check_stmt(L, 1);
+    lua_Integer n = luaL_optinteger(L, 2, AUTO_SQLITE_ASYNC_BATCH_SIZE);
+    luaL_argcheck(L, n > 0, 2, "must be positive");
+    lua_settop(L, 2);
+
+    if (self->async_eof)
+    {
+        self->async_eof = 0;
+        lua_pushnil(L);
+        return 1;
+    }
+
+    /* Connection is the first user value of statement. */
+    lua_getiuservalue(L, 1, 1);
+    sqlite_async_job_t* job = _sqlite_async_submit_job(L, 3, 1, self->entry->stmt,
+        (size_t)n, (size_t)n);
+
+    lua_newtable(L);
+
+    api.coroutine->set_state(job->co, AUTO_COROUTINE_WAIT);
+    return lua_yieldk(L, 0, (lua_KContext)job, _sqlite_stmt_lua_step_async_resume);
+}
@@ -0,0 +1,42 @@
+#ifndef __AUTO_LUA_SQLITE_ASYNC_H__
+#define __AUTO_LUA_SQLITE_ASYNC_H__
+
+#include "sqlite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Stop worker thread of connection. Any running job is interrupted.
+ * @param[in] self  SQLite instance.
+ */
+AUTO_LOCAL void auto_sqlite_async_exit(lua_sqlite_t* self);
+
+/**
+ * @brief Check whether async job of connection is using \p stmt.
+ * @param[in] self  SQLite instance.
+ * @param[in] stmt  Prepared statement.
+ * @return          Boolean.
+ */
+AUTO_LOCAL int auto_sqlite_async_using(lua_sqlite_t* self, sqlite3_stmt* stmt);
+
+/**
+ * @brief `db:exec_async(sql, options)`, run \p sql on worker thread.
+ * @param[in] L     Lua VM.
+ * @return          Always 2.
+ */
+AUTO_LOCAL int auto_sqlite_lua_exec_async(lua_State* L);
+
+/**
+ * @brief `stmt:step_async(n)`, step statement on worker thread.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_sqlite_stmt_lua_step_async(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
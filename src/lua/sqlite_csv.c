@@ -0,0 +1,808 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "sqlite_csv.h"
+#include "utils.h"
+#include "utils/csv.h"
+
+/**
+ * @brief Write buffer size of CSV export.
+ */
+#define AUTO_SQLITE_CSV_WRITE_BUF_SIZE  (64 * 1024)
+
+/**
+ * @brief Options of CSV import.
+ */
+typedef struct sqlite_csv_import
+{
+    int             header;         /**< First line is header */
+    int             infer_types;    /**< Store numbers as INTEGER/REAL, empty field as NULL */
+    lua_Integer     batch_size;     /**< Commit every N rows, 0 for one transaction */
+    int             own_txn;        /**< Whether transaction is started by import */
+    lua_Integer     row_cnt;        /**< Number of rows imported */
+} sqlite_csv_import_t;
+
+static void _sqlite_csv_parse_options(lua_State* L, int idx, sqlite_csv_import_t* opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->header = 1;
+
+    if (lua_type(L, idx) == LUA_TBOOLEAN)
+    {
+        opt->header = lua_toboolean(L, idx);
+        return;
+    }
+    if (lua_type(L, idx) != LUA_TTABLE)
+    {
+        return;
+    }
+
+    if (lua_getfield(L, idx, "header") == LUA_TBOOLEAN)
+    {
+        opt->header = lua_toboolean(L, -1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, idx, "infer_types");
+    opt->infer_types = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    if (lua_getfield(L, idx, "batch_size") == LUA_TNUMBER)
+    {
+        opt->batch_size = lua_tointeger(L, -1);
+    }
+    lua_pop(L, 1);
+}
+
+/**
+ * @brief Infer SQL type of CSV field.
+ *
+ * Only plain decimal numbers are treated as number, so that values like
+ * `007`, `0x10` or `inf` are kept as text.
+ *
+ * @return  SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, or SQLITE_NULL if empty.
+ */
+static int _sqlite_csv_infer_type(const char* field, size_t size, sqlite3_int64* i_val,
+    double* d_val)
+{
+    const char* p = field;
+    const char* end = field + size;
+    if (p == end)
+    {
+        return SQLITE_NULL;
+    }
+
+    if (*p == '+' || *p == '-')
+    {
+        p++;
+    }
+
+    int digits = 0, is_float = 0;
+    const char* digit_beg = p;
+    for (; p < end; p++)
+    {
+        if (*p >= '0' && *p <= '9')
+        {
+            digits++;
+        }
+        else if (*p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')
+        {
+            is_float = 1;
+        }
+        else
+        {
+            return SQLITE_TEXT;
+        }
+    }
+    if (digits == 0 || (digit_beg + 1 < end && digit_beg[0] == '0'
+        && digit_beg[1] >= '0' && digit_beg[1] <= '9'))
+    {
+        return SQLITE_TEXT;
+    }
+
+    /* Field is not NUL terminated. */
+    char num[64];
+    if (size >= sizeof(num))
+    {
+        return SQLITE_TEXT;
+    }
+    memcpy(num, field, size);
+    num[size] = '\0';
+
+    char* num_end = NULL;
+    errno = 0;
+    if (!is_float)
+    {
+        long long v = strtoll(num, &num_end, 10);
+        if (errno == 0 && *num_end == '\0')
+        {
+            *i_val = v;
+            return SQLITE_INTEGER;
+        }
+    }
+
+    double v = strtod(num, &num_end);
+    if (*num_end == '\0')
+    {
+        *d_val = v;
+        return SQLITE_FLOAT;
+    }
+
+    return SQLITE_TEXT;
+}
+
+/**
+ * @brief Create table for CSV.
+ * @param[in] header_idx    Stack index of column name array, or 0 to name
+ *   columns as c1, c2, ...
+ * @param[in] first         First data row for infer column types, or NULL.
+ * @return                  0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_csv_create_table(lua_State* L, lua_sqlite_t* self, const char* table_name,
+    const sqlite_csv_import_t* opt, int header_idx, const auto_csv_field_t* first,
+    int first_cnt, int column_cnt)
+{
+    luaL_Buffer sql_buf;
+    luaL_buffinit(L, &sql_buf);
+    luaL_addstring(&sql_buf, "CREATE TABLE IF NOT EXISTS ");
+    luaL_addstring(&sql_buf, table_name);
+    luaL_addstring(&sql_buf, "(");
+
+    int i;
+    for (i = 0; i < column_cnt; i++)
+    {
+        char* zQuoted;
+        if (header_idx != 0)
+        {
+            lua_rawgeti(L, header_idx, i + 1);
+            zQuoted = sqlite3_mprintf("\"%w\"", lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+        else
+        {
+            zQuoted = sqlite3_mprintf("\"c%d\"", i + 1);
+        }
+        luaL_addstring(&sql_buf, zQuoted);
+        sqlite3_free(zQuoted);
+
+        if (opt->infer_types && i < first_cnt)
+        {
+            sqlite3_int64 i_val; double d_val;
+            switch (_sqlite_csv_infer_type(first[i].data, first[i].size, &i_val, &d_val))
+            {
+            case SQLITE_INTEGER:    luaL_addstring(&sql_buf, " INTEGER"); break;
+            case SQLITE_FLOAT:      luaL_addstring(&sql_buf, " REAL"); break;
+            case SQLITE_TEXT:       luaL_addstring(&sql_buf, " TEXT"); break;
+            default:                break;
+            }
+        }
+        luaL_addchar(&sql_buf, ',');
+    }
+
+    luaL_buffsub(&sql_buf, 1);
+    luaL_addstring(&sql_buf, ")");
+    luaL_pushresult(&sql_buf);
+
+    int ret = auto_sqlite_exec_simple(L, self->db, lua_tostring(L, -1));
+    lua_remove(L, ret == 0 ? -1 : -2);
+
+    return ret;
+}
+
+/**
+ * @brief Prepare `INSERT INTO table_name VALUES(?, ...)`.
+ * @return  Statement, or NULL if failed and error message is pushed on top of stack.
+ */
+static sqlite3_stmt* _sqlite_csv_prepare_insert(lua_State* L, lua_sqlite_t* self,
+    const char* table_name, int column_cnt)
+{
+    luaL_Buffer sql_buf;
+    luaL_buffinit(L, &sql_buf);
+    luaL_addstring(&sql_buf, "INSERT INTO ");
+    luaL_addstring(&sql_buf, table_name);
+    luaL_addstring(&sql_buf, " VALUES(");
+
+    int i;
+    for (i = 0; i < column_cnt; i++)
+    {
+        luaL_addstring(&sql_buf, i == 0 ? "?" : ",?");
+    }
+    luaL_addstring(&sql_buf, ")");
+    luaL_pushresult(&sql_buf);
+
+    sqlite3_stmt* stmt = NULL;
+    int ret = sqlite3_prepare_v2(self->db, lua_tostring(L, -1), -1, &stmt, NULL);
+    lua_pop(L, 1);
+
+    if (ret != SQLITE_OK)
+    {
+        lua_pushstring(L, sqlite3_errmsg(self->db));
+        return NULL;
+    }
+    return stmt;
+}
+
+/**
+ * @brief Insert one CSV row.
+ * @return  0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_csv_insert_row(lua_State* L, sqlite3_stmt* stmt,
+    const sqlite_csv_import_t* opt, const auto_csv_field_t* fields, int field_cnt,
+    int column_cnt)
+{
+    int i;
+    if (field_cnt > column_cnt)
+    {
+        lua_pushfstring(L, "row %d has %d fields, but table has %d columns",
+            (int)opt->row_cnt + 1, field_cnt, column_cnt);
+        return -1;
+    }
+
+    for (i = 0; i < field_cnt; i++)
+    {
+        /* Field is valid until next row is read, which is after step. */
+        if (!opt->infer_types)
+        {
+            sqlite3_bind_text(stmt, i + 1, fields[i].data, (int)fields[i].size, SQLITE_STATIC);
+            continue;
+        }
+
+        sqlite3_int64 i_val; double d_val;
+        switch (_sqlite_csv_infer_type(fields[i].data, fields[i].size, &i_val, &d_val))
+        {
+        case SQLITE_INTEGER:    sqlite3_bind_int64(stmt, i + 1, i_val); break;
+        case SQLITE_FLOAT:      sqlite3_bind_double(stmt, i + 1, d_val); break;
+        case SQLITE_NULL:       sqlite3_bind_null(stmt, i + 1); break;
+        default:
+            sqlite3_bind_text(stmt, i + 1, fields[i].data, (int)fields[i].size, SQLITE_STATIC);
+            break;
+        }
+    }
+    /* Missing fields are NULL. */
+    for (; i < column_cnt; i++)
+    {
+        sqlite3_bind_null(stmt, i + 1);
+    }
+
+    int ret = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    if (ret != SQLITE_DONE)
+    {
+        lua_pushstring(L, sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read next CSV row.
+ * @return  Field count, 0 if end of input, or -1 if failed and error message
+ *   is pushed on top of stack.
+ */
+static int _sqlite_csv_next(lua_State* L, auto_csv_t* csv, const auto_csv_field_t** fields)
+{
+    int ret = auto_csv_next(csv, fields);
+    if (ret < 0)
+    {
+        char buf[256];
+        lua_pushfstring(L, "read CSV failed: %s", auto_strerror(-ret, buf, sizeof(buf)));
+        return -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Import all rows, commit every #sqlite_csv_import_t::batch_size rows.
+ * @return  0 if success, otherwise error message is pushed on top of stack.
+ */
+static int _sqlite_csv_import_data(lua_State* L, lua_sqlite_t* self, sqlite3_stmt* stmt,
+    sqlite_csv_import_t* opt, auto_csv_t* csv, const auto_csv_field_t* fields,
+    int field_cnt, int column_cnt)
+{
+    while (field_cnt > 0)
+    {
+        if (_sqlite_csv_insert_row(L, stmt, opt, fields, field_cnt, column_cnt) != 0)
+        {
+            return -1;
+        }
+        opt->row_cnt++;
+
+        if (opt->own_txn && opt->batch_size > 0 && opt->row_cnt % opt->batch_size == 0
+            && auto_sqlite_exec_simple(L, self->db, "COMMIT; BEGIN") != 0)
+        {
+            return -1;
+        }
+
+        if ((field_cnt = _sqlite_csv_next(L, csv, &fields)) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Push header fields as an array of column names.
+ * @return  Column count, or -1 if failed and error message is pushed on top of stack.
+ */
+static int _sqlite_csv_read_header(lua_State* L, auto_csv_t* csv)
+{
+    const auto_csv_field_t* fields;
+    int i, field_cnt = _sqlite_csv_next(L, csv, &fields);
+    if (field_cnt < 0)
+    {
+        return -1;
+    }
+
+    lua_createtable(L, field_cnt, 0);
+    for (i = 0; i < field_cnt; i++)
+    {
+        lua_pushlstring(L, fields[i].data, fields[i].size);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return field_cnt;
+}
+
+/**
+ * @brief Parse CSV into SQL table.
+ *
+ * The import is done in one transaction, or in batches of
+ * #sqlite_csv_import_t::batch_size rows. If there is a transaction already,
+ * the import is a savepoint in it.
+ *
+ * @param[in] L             Lua VM.
+ * @param[in] self          SQLite instance.
+ * @param[in] table_name    SQL table name.
+ * @param[in] opt           Import options.
+ * @param[in] csv           CSV reader. The ownership is taken.
+ * @return                  Always 1.
+ */
+static int _sqlite_lua_from_csv_reader(lua_State* L, lua_sqlite_t* self,
+    const char* table_name, sqlite_csv_import_t* opt, auto_csv_t* csv)
+{
+    int ret = -1;
+    sqlite3_stmt* stmt = NULL;
+    const auto_csv_field_t* first = NULL;
+    int first_cnt, header_idx = 0, column_cnt = 0;
+
+    if (opt->header)
+    {
+        if ((column_cnt = _sqlite_csv_read_header(L, csv)) < 0)
+        {
+            goto finish;
+        }
+        header_idx = lua_gettop(L);
+    }
+    if ((first_cnt = _sqlite_csv_next(L, csv, &first)) < 0)
+    {
+        goto finish;
+    }
+    if (!opt->header)
+    {
+        column_cnt = first_cnt;
+    }
+
+    if (column_cnt == 0)
+    {
+        lua_pushstring(L, "no column in CSV");
+        goto finish;
+    }
+
+    opt->own_txn = sqlite3_get_autocommit(self->db);
+    if (auto_sqlite_exec_simple(L, self->db, opt->own_txn ? "BEGIN" : "SAVEPOINT __auto_csv_import") != 0)
+    {
+        goto finish;
+    }
+
+    if ((ret = _sqlite_csv_create_table(L, self, table_name, opt, header_idx,
+            first, first_cnt, column_cnt)) != 0
+        || (stmt = _sqlite_csv_prepare_insert(L, self, table_name, column_cnt)) == NULL)
+    {
+        ret = -1;
+        goto rollback;
+    }
+
+    ret = _sqlite_csv_import_data(L, self, stmt, opt, csv, first, first_cnt, column_cnt);
+    if (ret != 0)
+    {
+        goto rollback;
+    }
+
+    ret = auto_sqlite_exec_simple(L, self->db, opt->own_txn ? "COMMIT" : "RELEASE __auto_csv_import");
+    if (ret == 0)
+    {
+        goto finish;
+    }
+
+rollback:
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    sqlite3_exec(self->db, opt->own_txn ? "ROLLBACK"
+        : "ROLLBACK TO __auto_csv_import; RELEASE __auto_csv_import", NULL, NULL, NULL);
+
+finish:
+    sqlite3_finalize(stmt);
+    /* CSV reader is no longer needed. */
+    auto_csv_close(csv);
+
+    if (ret != 0)
+    {
+        return lua_error(L);
+    }
+
+    lua_pushinteger(L, opt->row_cnt);
+    return 1;
+}
+
+int auto_sqlite_lua_from_csv(lua_State* L)
+{
+    /* Get parameters */
+    lua_sqlite_t* self = auto_sqlite_check_db(L, 1);
+    const char* table_name = luaL_checkstring(L, 2);
+    size_t csv_size;
+    const char* csv_data = luaL_checklstring(L, 3, &csv_size);
+
+    sqlite_csv_import_t opt;
+    _sqlite_csv_parse_options(L, 4, &opt);
+
+    /* Parse in place, the string is kept on stack. */
+    auto_csv_t* csv = auto_csv_open_memory(csv_data, csv_size, ',');
+    if (csv == NULL)
+    {
+        return api.lua->A_error(L, "out of memory");
+    }
+
+    return _sqlite_lua_from_csv_reader(L, self, table_name, &opt, csv);
+}
+
+int auto_sqlite_lua_from_csv_file(lua_State* L)
+{
+    /* Get parameters */
+    lua_sqlite_t* self = auto_sqlite_check_db(L, 1);
+    const char* table_name = luaL_checkstring(L, 2);
+    const char* csv_file = luaL_checkstring(L, 3);
+
+    sqlite_csv_import_t opt;
+    _sqlite_csv_parse_options(L, 4, &opt);
+
+    int errcode;
+    auto_csv_t* csv = auto_csv_open_file(csv_file, ',', &errcode);
+    if (csv == NULL)
+    {
+        char buf[1024];
+        return api.lua->A_error(L, "open %s failed: %s", csv_file,
+            auto_strerror(errcode, buf, sizeof(buf)));
+    }
+
+    return _sqlite_lua_from_csv_reader(L, self, table_name, &opt, csv);
+}
+
+/**
+ * @brief Buffered CSV writer.
+ *
+ * Lines are either written to #sqlite_csv_writer_t::file through a fixed
+ * size buffer, or appended to a Lua buffer.
+ */
+typedef struct sqlite_csv_writer
+{
+    FILE*           file;       /**< Output file, NULL to write into #sqlite_csv_writer_t::lbuf */
+    luaL_Buffer*    lbuf;       /**< Output Lua buffer */
+    int             errcode;    /**< First write error */
+    char*           buf;        /**< Write buffer of #AUTO_SQLITE_CSV_WRITE_BUF_SIZE bytes */
+    size_t          size;       /**< Pending data size in #sqlite_csv_writer_t::buf */
+} sqlite_csv_writer_t;
+
+static void _sqlite_csv_writer_flush(sqlite_csv_writer_t* w)
+{
+    if (w->size != 0 && w->errcode == 0 && fwrite(w->buf, w->size, 1, w->file) != 1)
+    {
+        w->errcode = errno != 0 ? errno : EIO;
+    }
+    w->size = 0;
+}
+
+static void _sqlite_csv_put(sqlite_csv_writer_t* w, const char* data, size_t size)
+{
+    if (w->file == NULL)
+    {
+        luaL_addlstring(w->lbuf, data, size);
+        return;
+    }
+
+    if (w->size + size > AUTO_SQLITE_CSV_WRITE_BUF_SIZE)
+    {
+        _sqlite_csv_writer_flush(w);
+    }
+    if (size > AUTO_SQLITE_CSV_WRITE_BUF_SIZE)
+    {
+        if (w->errcode == 0 && fwrite(data, size, 1, w->file) != 1)
+        {
+            w->errcode = errno != 0 ? errno : EIO;
+        }
+        return;
+    }
+
+    memcpy(w->buf + w->size, data, size);
+    w->size += size;
+}
+
+/**
+ * @brief Write one CSV field, quote it if necessary (RFC 4180).
+ */
+static void _sqlite_csv_put_field(sqlite_csv_writer_t* w, const char* data, size_t size)
+{
+    size_t i;
+    int need_quote = size > 0 && (data[0] == ' ' || data[size - 1] == ' ');
+    for (i = 0; i < size && !need_quote; i++)
+    {
+        need_quote = data[i] == ',' || data[i] == '"' || data[i] == '\r' || data[i] == '\n';
+    }
+
+    if (!need_quote)
+    {
+        _sqlite_csv_put(w, data, size);
+        return;
+    }
+
+    _sqlite_csv_put(w, "\"", 1);
+    const char* quote;
+    while ((quote = memchr(data, '"', size)) != NULL)
+    {
+        /* Write up to and include the quote, then escape it by another quote. */
+        size_t n = quote - data + 1;
+        _sqlite_csv_put(w, data, n);
+        _sqlite_csv_put(w, "\"", 1);
+        data += n;
+        size -= n;
+    }
+    _sqlite_csv_put(w, data, size);
+    _sqlite_csv_put(w, "\"", 1);
+}
+
+/**
+ * @brief Write header line, or current row if \p header is 0.
+ */
+static void _sqlite_csv_put_row(sqlite_csv_writer_t* w, sqlite3_stmt* stmt, int header)
+{
+    int i, column_cnt = sqlite3_column_count(stmt);
+    for (i = 0; i < column_cnt; i++)
+    {
+        if (i != 0)
+        {
+            _sqlite_csv_put(w, ",", 1);
+        }
+
+        if (header)
+        {
+            const char* name = sqlite3_column_name(stmt, i);
+            _sqlite_csv_put_field(w, name, strlen(name));
+            continue;
+        }
+
+        switch (sqlite3_column_type(stmt, i))
+        {
+        case SQLITE_NULL:
+            break;
+        case SQLITE_BLOB:
+            _sqlite_csv_put_field(w, sqlite3_column_blob(stmt, i), sqlite3_column_bytes(stmt, i));
+            break;
+        default:
+            _sqlite_csv_put_field(w, (const char*)sqlite3_column_text(stmt, i), sqlite3_column_bytes(stmt, i));
+            break;
+        }
+    }
+    _sqlite_csv_put(w, "\r\n", 2);
+}
+
+/**
+ * @brief Prepare statement for export \p table_name.
+ * @return  Statement entry, or NULL if failed and error message is pushed on top of stack.
+ */
+static sqlite_stmt_entry_t* _sqlite_csv_export_begin(lua_State* L, lua_sqlite_t* self,
+    const char* table_name)
+{
+    if (self->db == NULL)
+    {
+        lua_pushstring(L, "database is closed");
+        return NULL;
+    }
+
+    const char* sql = lua_pushfstring(L, "SELECT * FROM %s", table_name);
+    sqlite_stmt_entry_t* entry = auto_sqlite_stmt_acquire(L, self, sql, lua_rawlen(L, -1));
+    lua_remove(L, entry != NULL ? -1 : -2);
+
+    return entry;
+}
+
+/**
+ * @brief Write header and all rows.
+ * @return  SQLITE_DONE if success.
+ */
+static int _sqlite_csv_export(sqlite_csv_writer_t* w, sqlite3_stmt* stmt)
+{
+    int ret;
+    _sqlite_csv_put_row(w, stmt, 1);
+    while ((ret = sqlite3_step(stmt)) == SQLITE_ROW && w->errcode == 0)
+    {
+        _sqlite_csv_put_row(w, stmt, 0);
+    }
+    return w->errcode == 0 ? ret : SQLITE_IOERR;
+}
+
+int auto_sqlite_lua_to_csv(lua_State* L)
+{
+    /* Get parameters */
+    lua_sqlite_t* self = auto_sqlite_check_db(L, 1);
+    const char* table_name = luaL_checkstring(L, 2);
+
+    sqlite_stmt_entry_t* entry = _sqlite_csv_export_begin(L, self, table_name);
+    if (entry == NULL)
+    {
+        return lua_error(L);
+    }
+
+    luaL_Buffer csv_buf;
+    luaL_buffinit(L, &csv_buf);
+
+    sqlite_csv_writer_t w;
+    memset(&w, 0, sizeof(w));
+    w.lbuf = &csv_buf;
+
+    int ret = _sqlite_csv_export(&w, entry->stmt);
+
+    /* There is an extra line wrapper that need to delete. */
+    luaL_buffsub(&csv_buf, 2);
+    luaL_pushresult(&csv_buf);
+
+    if (ret != SQLITE_DONE)
+    {
+        lua_pushstring(L, sqlite3_errmsg(self->db));
+        auto_sqlite_stmt_release(self, entry);
+        return lua_error(L);
+    }
+
+    auto_sqlite_stmt_release(self, entry);
+    return 1;
+}
+
+int auto_sqlite_lua_to_csv_file(lua_State* L)
+{
+    /* Get parameters. */
+    lua_sqlite_t* self = auto_sqlite_check_db(L, 1);
+    const char* table_name = luaL_checkstring(L, 2);
+    const char* file_path = luaL_checkstring(L, 3);
+
+    const char* mode = "a";
+    if (lua_type(L, 4) == LUA_TSTRING)
+    {
+        mode = lua_tostring(L, 4);
+        if (strcmp(mode, "a") != 0 && strcmp(mode, "w") != 0)
+        {
+            return api.lua->A_error(L, "invalid mode: %s", mode);
+        }
+    }
+
+    sqlite_csv_writer_t writer, *w = &writer;
+    memset(w, 0, sizeof(*w));
+    w->buf = lua_newuserdatauv(L, AUTO_SQLITE_CSV_WRITE_BUF_SIZE, 0);
+
+    sqlite_stmt_entry_t* entry = _sqlite_csv_export_begin(L, self, table_name);
+    if (entry == NULL)
+    {
+        return lua_error(L);
+    }
+
+    /* Binary mode, so line wrapper is always CRLF. */
+    const char* fmode = mode[0] == 'a' ? "ab" : "wb";
+    int errcode;
+#if defined(_MSC_VER)
+    errcode = fopen_s(&w->file, file_path, fmode);
+#else
+    w->file = fopen(file_path, fmode);
+    errcode = errno;
+#endif
+
+    if (w->file == NULL)
+    {
+        auto_sqlite_stmt_release(self, entry);
+        char buf[1024];
+        return api.lua->A_error(L, "%s", auto_strerror(errcode, buf, sizeof(buf)));
+    }
+
+    int ret = _sqlite_csv_export(w, entry->stmt);
+    _sqlite_csv_writer_flush(w);
+    if (fclose(w->file) != 0 && w->errcode == 0)
+    {
+        w->errcode = errno != 0 ? errno : EIO;
+    }
+
+    if (w->errcode != 0)
+    {
+        auto_sqlite_stmt_release(self, entry);
+        char buf[1024];
+        return api.lua->A_error(L, "write to %s failed: %s", file_path,
+            auto_strerror(w->errcode, buf, sizeof(buf)));
+    }
+    if (ret != SQLITE_DONE)
+    {
+        lua_pushstring(L, sqlite3_errmsg(self->db));
+        auto_sqlite_stmt_release(self, entry);
+        return lua_error(L);
+    }
+
+    auto_sqlite_stmt_release(self, entry);
+    return 0;
+}
+
+/**
+ * @brief Iterator of sqlite:to_csv_rows().
+ *
+ * Upvalue 1 is the statement, upvalue 2 is whether header is returned.
+ */
+static int _sqlite_lua_to_csv_rows_next(lua_State* L)
+{
+    lua_sqlite_stmt_t* stmt = lua_touserdata(L, lua_upvalueindex(1));
+    if (stmt->entry == NULL)
+    {
+        return 0;
+    }
+
+    /* Connection may be closed or busy since last row. */
+    auto_sqlite_check_stmt(L, lua_upvalueindex(1));
+
+    int header = !lua_toboolean(L, lua_upvalueindex(2));
+    int ret = SQLITE_ROW;
+    if (header)
+    {
+        lua_pushboolean(L, 1);
+        lua_replace(L, lua_upvalueindex(2));
+    }
+    else if ((ret = sqlite3_step(stmt->entry->stmt)) != SQLITE_ROW)
+    {
+        if (ret != SQLITE_DONE)
+        {
+            lua_pushstring(L, sqlite3_errmsg(stmt->belong->db));
+        }
+        auto_sqlite_stmt_release(stmt->belong, stmt->entry);
+        stmt->entry = NULL;
+        return ret == SQLITE_DONE ? 0 : lua_error(L);
+    }
+
+    luaL_Buffer line_buf;
+    luaL_buffinit(L, &line_buf);
+
+    sqlite_csv_writer_t w;
+    memset(&w, 0, sizeof(w));
+    w.lbuf = &line_buf;
+    _sqlite_csv_put_row(&w, stmt->entry->stmt, header);
+    luaL_pushresult(&line_buf);
+
+    return 1;
+}
+
+int auto_sqlite_lua_to_csv_rows(lua_State* L)
+{
+    auto_sqlite_check_db(L, 1);
+    const char* table_name = luaL_checkstring(L, 2);
+
+    /* Statement object is released on GC or on close. */
+    const char* sql = lua_pushfstring(L, "SELECT * FROM %s", table_name);
+    if (auto_sqlite_push_stmt(L, 1, sql, lua_rawlen(L, -1)) != 0)
+    {
+        return lua_error(L);
+    }
+
+    lua_pushvalue(L, -1);
+    lua_pushboolean(L, 0);
+    lua_pushcclosure(L, _sqlite_lua_to_csv_rows_next, 2);
+
+    /* for ... in iter, nil, nil, stmt: the statement is closed on break. */
+    lua_insert(L, -2);
+    lua_pushnil(L);
+    lua_insert(L, -2);
+    lua_pushnil(L);
+    lua_insert(L, -2);
+    return 4;
+}
@@ -0,0 +1,49 @@
+#ifndef __AUTO_LUA_SQLITE_CSV_H__
+#define __AUTO_LUA_SQLITE_CSV_H__
+
+#include "sqlite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief `db:from_csv(table, data, options)`, import CSV string.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_sqlite_lua_from_csv(lua_State* L);
+
+/**
+ * @brief `db:from_csv_file(table, path, options)`, import CSV file.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_sqlite_lua_from_csv_file(lua_State* L);
+
+/**
+ * @brief `db:to_csv(sql, options)`, export query result as CSV string.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_sqlite_lua_to_csv(lua_State* L);
+
+/**
+ * @brief `db:to_csv_file(sql, path, options)`, export query result to file.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_sqlite_lua_to_csv_file(lua_State* L);
+
+/**
+ * @brief `db:to_csv_rows(table)`, iterate table as CSV lines.
+ * @param[in] L     Lua VM.
+ * @return          Always 4.
+ */
+AUTO_LOCAL int auto_sqlite_lua_to_csv_rows(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,176 @@
+#include <string.h>
+#include "sqlite_func.h"
+#include "utils.h"
+
+typedef struct sqlite_func_capture
+{
+    size_t      group;      /**< Group to capture */
+    size_t      beg;        /**< Group start offset */
+    size_t      end;        /**< Group end offset */
+    int         found;      /**< Whether group is set */
+} sqlite_func_capture_t;
+
+static void _sqlite_func_regex_destroy(void* p)
+{
+    api.regex->destroy(p);
+}
+
+/**
+ * @brief Get compiled pattern of argument \p idx, which is cached while the
+ *   pattern is constant.
+ * @param[out] cached   Whether pattern is from cache.
+ * @return              Compiled pattern, or NULL if pattern is NULL or invalid,
+ *   in which case result is set.
+ */
+static auto_regex_code_t* _sqlite_func_regex(sqlite3_context* ctx, sqlite3_value** argv,
+    int idx, int* cached)
+{
+    auto_regex_code_t* code = sqlite3_get_auxdata(ctx, idx);
+    if ((*cached = code != NULL) != 0)
+    {
+        return code;
+    }
+
+    const char* pattern = (const char*)sqlite3_value_text(argv[idx]);
+    if (pattern == NULL)
+    {
+        sqlite3_result_null(ctx);
+        return NULL;
+    }
+
+    size_t errpos;
+    if ((code = api.regex->create(pattern, sqlite3_value_bytes(argv[idx]), &errpos)) == NULL)
+    {
+        char* errmsg = sqlite3_mprintf("invalid regex pattern at %llu: %s",
+            (unsigned long long)errpos, pattern);
+        sqlite3_result_error(ctx, errmsg, -1);
+        sqlite3_free(errmsg);
+    }
+    return code;
+}
+
+/**
+ * @brief Keep compiled pattern for next row. It may be released at once, so
+ *   it must be the last use of \p code.
+ */
+static void _sqlite_func_regex_cache(sqlite3_context* ctx, int idx,
+    auto_regex_code_t* code, int cached)
+{
+    if (!cached)
+    {
+        sqlite3_set_auxdata(ctx, idx, code, _sqlite_func_regex_destroy);
+    }
+}
+
+/**
+ * @brief `regexp(pattern, text)`, which also implements `text REGEXP pattern`.
+ */
+static void _sqlite_func_regexp(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    (void)argc;
+    int cached;
+    auto_regex_code_t* code = _sqlite_func_regex(ctx, argv, 0, &cached);
+    if (code == NULL)
+    {
+        return;
+    }
+
+    const char* text = (const char*)sqlite3_value_text(argv[1]);
+    if (text == NULL)
+    {
+        sqlite3_result_null(ctx);
+    }
+    else
+    {
+        int ret = api.regex->match(code, text, sqlite3_value_bytes(argv[1]), 0, NULL, NULL);
+        sqlite3_result_int(ctx, ret >= 0);
+    }
+
+    _sqlite_func_regex_cache(ctx, 0, code, cached);
+}
+
+static void _sqlite_func_capture_cb(const char* data, size_t* groups, size_t group_sz, void* arg)
+{
+    (void)data;
+    sqlite_func_capture_t* capture = arg;
+
+    if (capture->group < group_sz && groups[capture->group * 2] != (size_t)-1)
+    {
+        capture->beg = groups[capture->group * 2];
+        capture->end = groups[capture->group * 2 + 1];
+        capture->found = 1;
+    }
+}
+
+/**
+ * @brief `regexp_capture(text, pattern[, group])`, return the first match of
+ *   \p group, or NULL if not matched.
+ */
+static void _sqlite_func_regexp_capture(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+{
+    int cached;
+    auto_regex_code_t* code = _sqlite_func_regex(ctx, argv, 1, &cached);
+    if (code == NULL)
+    {
+        return;
+    }
+
+    sqlite_func_capture_t capture;
+    memset(&capture, 0, sizeof(capture));
+
+    const char* text = (const char*)sqlite3_value_text(argv[0]);
+    sqlite3_int64 group = argc > 2 ? sqlite3_value_int64(argv[2]) : 0;
+    if (group < 0 || (size_t)group >= api.regex->get_group_count(code))
+    {
+        sqlite3_result_error(ctx, "regexp_capture: no such group", -1);
+    }
+    else if (text == NULL)
+    {
+        sqlite3_result_null(ctx);
+    }
+    else
+    {
+        capture.group = (size_t)group;
+        api.regex->match(code, text, sqlite3_value_bytes(argv[0]), 0,
+            _sqlite_func_capture_cb, &capture);
+        if (capture.found)
+        {
+            sqlite3_result_text(ctx, text + capture.beg, (int)(capture.end - capture.beg),
+                SQLITE_TRANSIENT);
+        }
+        else
+        {
+            sqlite3_result_null(ctx);
+        }
+    }
+
+    _sqlite_func_regex_cache(ctx, 1, code, cached);
+}
+
+int auto_sqlite_func_init(sqlite3* db)
+{
+    static const struct
+    {
+        const char* name;
+        int         nargs;
+        void        (*fn)(sqlite3_context*, int, sqlite3_value**);
+    } s_funcs[] = {
+        { "regexp",         2,  _sqlite_func_regexp },
+        { "regexp_capture", 2,  _sqlite_func_regexp_capture },
+        { "regexp_capture", 3,  _sqlite_func_regexp_capture },
+    };
+
+    size_t i;
+    for (i = 0; i < ARRAY_SIZE(s_funcs); i++)
+    {
+        int ret = sqlite3_create_function_v2(db, s_funcs[i].name, s_funcs[i].nargs,
+            SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS, NULL,
+            s_funcs[i].fn, NULL, NULL, NULL);
+        if (ret != SQLITE_OK)
+        {
+            return ret;
+        }
+    }
+
+    return SQLITE_OK;
+}
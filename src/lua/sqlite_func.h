@@ -0,0 +1,22 @@
+#ifndef __AUTO_LUA_SQLITE_FUNC_H__
+#define __AUTO_LUA_SQLITE_FUNC_H__
+
+#include <sqlite3.h>
+#include "api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register built-in SQL functions on connection.
+ * @param[in] db    SQLite connection.
+ * @return          SQLite error code.
+ */
+AUTO_LOCAL int auto_sqlite_func_init(sqlite3* db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include "sqlite.h"
+#include "sqlite_async.h"
+#include "sqlite_pool.h"
+#include "utils.h"
+#include "utils/list.h"
+
+/**
+ * @brief Lua userdata type of sqlite connection pool
+ */
+#define AUTO_LUA_SQLITE_POOL    "__auto_sqlite3_pool"
+
+/**
+ * @brief Read connections sharing one database file.
+ *
+ * User value 1 is the array of connections.
+ */
+typedef struct lua_sqlite_pool
+{
+    int             size;       /**< Connection count */
+    int             next;       /**< Connection to try first, round robin */
+    int             closed;     /**< Whether pool is closed */
+    auto_list_t     wait_queue; /**< #sqlite_pool_waiter_t, first come first served */
+} lua_sqlite_pool_t;
+
+/**
+ * @brief Coroutine waiting for an idle connection.
+ */
+typedef struct sqlite_pool_waiter
+{
+    auto_list_node_t        node;       /**< Node in wait queue */
+    auto_coroutine_t*       co;         /**< Waiting coroutine */
+    auto_coroutine_hook_t*  hook;       /**< Hook to cancel wait if \p co is closed */
+    lua_sqlite_pool_t*      belong;     /**< Pool waiting for */
+    int                     woken;      /**< Woken up, not in queue any more */
+} sqlite_pool_waiter_t;
+
+static lua_sqlite_pool_t* _sqlite_pool_check(lua_State* L, int idx)
+{
+    lua_sqlite_pool_t* self = luaL_checkudata(L, idx, AUTO_LUA_SQLITE_POOL);
+    if (self->closed)
+    {
+        api.lua->A_error(L, "pool is closed");
+        return NULL;
+    }
+    return self;
+}
+
+/**
+ * @brief Push an idle connection of pool at \p idx.
+ * @return  Whether found.
+ */
+static int _sqlite_pool_acquire(lua_State* L, int idx, lua_sqlite_pool_t* self)
+{
+    int i;
+    lua_getiuservalue(L, idx, 1);
+
+    for (i = 0; i < self->size; i++)
+    {
+        int pos = (self->next + i) % self->size;
+        lua_rawgeti(L, -1, pos + 1);
+
+        lua_sqlite_t* db = lua_touserdata(L, -1);
+        if (db->db != NULL && db->async.job == NULL)
+        {
+            self->next = (pos + 1) % self->size;
+            lua_remove(L, -2);
+            return 1;
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 1);
+    return 0;
+}
+
+/**
+ * @brief Wake coroutines waiting for idle connection.
+ * @param[in] all   Wake all of them, otherwise only the first one.
+ */
+static void _sqlite_pool_wake(lua_sqlite_pool_t* self, int all)
+{
+    auto_list_node_t* it;
+    while ((it = ev_list_pop_front(&self->wait_queue)) != NULL)
+    {
+        sqlite_pool_waiter_t* waiter = container_of(it, sqlite_pool_waiter_t, node);
+        waiter->woken = 1;
+        api.coroutine->set_state(waiter->co, AUTO_COROUTINE_BUSY);
+        if (!all)
+        {
+            break;
+        }
+    }
+}
+
+static void _sqlite_pool_waiter_release(sqlite_pool_waiter_t* waiter)
+{
+    api.coroutine->unhook(waiter->co, waiter->hook);
+    free(waiter);
+}
+
+/**
+ * @brief Remove waiter if its coroutine is closed.
+ */
+static void _sqlite_pool_on_waiter_state_change(auto_coroutine_t* co, void* arg)
+{
+    sqlite_pool_waiter_t* waiter = arg;
+    lua_sqlite_pool_t* self = waiter->belong;
+
+    if (!(co->status & AUTO_COROUTINE_DEAD))
+    {
+        return;
+    }
+
+    if (!waiter->woken)
+    {
+        ev_list_erase(&self->wait_queue, &waiter->node);
+    }
+    else if (!self->closed)
+    {
+        /* Woken up but never run, pass the wakeup on so it is not lost. */
+        _sqlite_pool_wake(self, 0);
+    }
+    _sqlite_pool_waiter_release(waiter);
+}
+
+static int _sqlite_pool_lua_close(lua_State* L)
+{
+    lua_sqlite_pool_t* self = luaL_checkudata(L, 1, AUTO_LUA_SQLITE_POOL);
+    if (self->closed)
+    {
+        return 0;
+    }
+    self->closed = 1;
+
+    /* Running queries are interrupted. */
+    int i;
+    lua_getiuservalue(L, 1, 1);
+    for (i = 0; i < self->size; i++)
+    {
+        lua_pushcfunction(L, auto_sqlite_lua_close);
+        lua_rawgeti(L, -2, i + 1);
+        lua_call(L, 1, 0);
+    }
+    lua_pop(L, 1);
+
+    /* Waiting coroutines see the pool is closed. */
+    _sqlite_pool_wake(self, 1);
+
+    return 0;
+}
+
+static int _sqlite_pool_lua_gc(lua_State* L)
+{
+    /* Connections are closed by their own finalizer. */
+    lua_sqlite_pool_t* self = lua_touserdata(L, 1);
+    self->closed = 1;
+    return 0;
+}
+
+static int _sqlite_pool_lua_len(lua_State* L)
+{
+    lua_sqlite_pool_t* self = luaL_checkudata(L, 1, AUTO_LUA_SQLITE_POOL);
+    lua_pushinteger(L, self->size);
+    return 1;
+}
+
+static int _sqlite_pool_lua_exec_done(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)ctx;
+    lua_sqlite_pool_t* self = lua_touserdata(L, 1);
+
+    /* Connection is idle again. */
+    if (!self->closed)
+    {
+        _sqlite_pool_wake(self, 0);
+    }
+
+    if (status != LUA_OK && status != LUA_YIELD)
+    {
+        return lua_error(L);
+    }
+    return 2;
+}
+
+static int _sqlite_pool_lua_exec_acquire(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    sqlite_pool_waiter_t* waiter = (sqlite_pool_waiter_t*)ctx;
+    int waited = waiter != NULL;
+    if (waited)
+    {
+        _sqlite_pool_waiter_release(waiter);
+    }
+
+    /* Stack: pool, sql, options. */
+    lua_sqlite_pool_t* self = _sqlite_pool_check(L, 1);
+
+    /* New query does not overtake waiting ones. */
+    if ((waited || ev_list_size(&self->wait_queue) == 0)
+        && _sqlite_pool_acquire(L, 1, self))
+    {
+        lua_pushcfunction(L, auto_sqlite_lua_exec_async);
+        lua_insert(L, -2);
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, 3);
+        return _sqlite_pool_lua_exec_done(L,
+            lua_pcallk(L, 3, 2, 0, 0, _sqlite_pool_lua_exec_done), 0);
+    }
+
+    auto_coroutine_t* co = api.coroutine->find(L);
+    if (co == NULL || !lua_isyieldable(L))
+    {
+        return api.lua->A_error(L, "async query must run in a managed coroutine");
+    }
+
+    waiter = malloc(sizeof(sqlite_pool_waiter_t));
+    if (waiter == NULL)
+    {
+        return api.lua->A_error(L, "out of memory");
+    }
+    waiter->co = co;
+    waiter->belong = self;
+    waiter->woken = 0;
+    waiter->hook = api.coroutine->hook(co, _sqlite_pool_on_waiter_state_change, waiter);
+
+    /* A woken coroutine that lost the race keeps its place. */
+    if (waited)
+    {
+        ev_list_push_front(&self->wait_queue, &waiter->node);
+    }
+    else
+    {
+        ev_list_push_back(&self->wait_queue, &waiter->node);
+    }
+
+    api.coroutine->set_state(co, AUTO_COROUTINE_WAIT);
+    return lua_yieldk(L, 0, (lua_KContext)waiter, _sqlite_pool_lua_exec_acquire);
+}
+
+static int _sqlite_pool_lua_exec(lua_State* L)
+{
+    _sqlite_pool_check(L, 1);
+    luaL_checktype(L, 2, LUA_TSTRING);
+    lua_settop(L, 3);
+
+    return _sqlite_pool_lua_exec_acquire(L, LUA_OK, 0);
+}
+
+static void _sqlite_pool_init_metatable(lua_State* L)
+{
+    static const luaL_Reg s_pool_meta[] = {
+        { "__gc",           _sqlite_pool_lua_gc },
+        { "__close",        _sqlite_pool_lua_close },
+        { "__len",          _sqlite_pool_lua_len },
+        { NULL,             NULL },
+    };
+    static const luaL_Reg s_pool_method[] = {
+        { "close",          _sqlite_pool_lua_close },
+        { "exec",           _sqlite_pool_lua_exec },
+        { NULL,             NULL },
+    };
+    if (luaL_newmetatable(L, AUTO_LUA_SQLITE_POOL) != 0)
+    {
+        luaL_setfuncs(L, s_pool_meta, 0);
+        luaL_newlib(L, s_pool_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+}
+
+/**
+ * @brief Push a shallow copy of options at \p idx.
+ */
+static void _sqlite_pool_copy_options(lua_State* L, int idx)
+{
+    lua_newtable(L);
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0)
+    {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_settable(L, -4);
+    }
+}
+
+int auto_lua_sqlite_pool(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+
+    if (lua_getfield(L, 1, "filename") != LUA_TSTRING)
+    {
+        return api.lua->A_error(L, "filename is required");
+    }
+    lua_pop(L, 1);
+
+    lua_Integer size = 4;
+    if (lua_getfield(L, 1, "size") != LUA_TNIL)
+    {
+        if (!lua_isinteger(L, -1) || (size = lua_tointeger(L, -1)) <= 0 || size > INT_MAX)
+        {
+            return api.lua->A_error(L, "size must be a positive integer");
+        }
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "wal");
+    int wal = lua_isnil(L, -1) || lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    if (auto_sqlite_opt_boolean(L, 1, "nomutex"))
+    {
+        return api.lua->A_error(L, "nomutex is not supported, queries run on worker threads");
+    }
+
+    /* Readers cannot change journal mode, switch it with a writable connection. */
+    if (wal)
+    {
+        lua_pushcfunction(L, auto_lua_sqlite);
+        _sqlite_pool_copy_options(L, 1);
+        lua_pushstring(L, "wal");
+        lua_setfield(L, -2, "journal_mode");
+        lua_pushboolean(L, 0);
+        lua_setfield(L, -2, "readonly");
+        lua_call(L, 1, 1);
+
+        lua_pushcfunction(L, auto_sqlite_lua_close);
+        lua_insert(L, -2);
+        lua_call(L, 1, 0);
+    }
+
+    lua_sqlite_pool_t* self = lua_newuserdatauv(L, sizeof(lua_sqlite_pool_t), 1);
+    memset(self, 0, sizeof(*self));
+    self->size = (int)size;
+    ev_list_init(&self->wait_queue);
+    _sqlite_pool_init_metatable(L);
+
+    _sqlite_pool_copy_options(L, 1);
+    lua_pushboolean(L, 1);
+    lua_setfield(L, -2, "readonly");
+    lua_pushnil(L);
+    lua_setfield(L, -2, "journal_mode");
+    int opt_idx = lua_gettop(L);
+
+    lua_createtable(L, self->size, 0);
+    lua_Integer i;
+    for (i = 1; i <= size; i++)
+    {
+        lua_pushcfunction(L, auto_lua_sqlite);
+        lua_pushvalue(L, opt_idx);
+        lua_call(L, 1, 1);
+        lua_rawseti(L, -2, i);
+    }
+    lua_setiuservalue(L, 2, 1);
+
+    lua_settop(L, 2);
+    return 1;
+}
@@ -0,0 +1,21 @@
+#ifndef __AUTO_LUA_SQLITE_POOL_H__
+#define __AUTO_LUA_SQLITE_POOL_H__
+
+#include "api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Create a pool of read connections.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_sqlite_pool(lua_State *L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
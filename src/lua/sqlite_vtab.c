@@ -0,0 +1,642 @@
+#include <cJSON.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "sqlite_vtab.h"
+#include "utils.h"
+#include "utils/csv.h"
+
+/**
+ * @brief Columns not less than this index share the last bit of colUsed.
+ */
+#define AUTO_SQLITE_VTAB_COL_USED_BITS  63
+
+typedef enum sqlite_vtab_type
+{
+    AUTO_SQLITE_VTAB_CSV,
+    AUTO_SQLITE_VTAB_NDJSON,
+} sqlite_vtab_type_t;
+
+typedef struct sqlite_vtab_file
+{
+    sqlite3_vtab            base;           /**< Base class, must be first */
+    sqlite_vtab_type_t      type;           /**< File format */
+
+    struct
+    {
+        char*               filename;       /**< File path */
+        char                delimiter;      /**< CSV field delimiter */
+        int                 header;         /**< CSV first line is header */
+    } config;
+
+    int                     column_cnt;     /**< Column count */
+    char**                  columns;        /**< NDJSON keys of columns */
+} sqlite_vtab_file_t;
+
+typedef struct sqlite_vtab_cursor
+{
+    sqlite3_vtab_cursor     base;           /**< Base class, must be first */
+    auto_csv_t*             csv;            /**< Reader, NULL if end of file */
+    sqlite3_int64           rowid;          /**< Row number, start from 1 */
+    sqlite3_uint64          col_used;       /**< Columns used by query */
+
+    const auto_csv_field_t* fields;         /**< Fields of current row */
+    int                     field_cnt;      /**< Field count */
+
+    cJSON*                  json;           /**< Current NDJSON row */
+    cJSON**                 values;         /**< Values of used columns in #sqlite_vtab_cursor_t::json */
+} sqlite_vtab_cursor_t;
+
+static int _sqlite_vtab_column_used(sqlite3_uint64 col_used, int i)
+{
+    return (int)((col_used >> (i < AUTO_SQLITE_VTAB_COL_USED_BITS ? i
+        : AUTO_SQLITE_VTAB_COL_USED_BITS)) & 1);
+}
+
+static void _sqlite_vtab_free(sqlite_vtab_file_t* self)
+{
+    int i;
+    if (self->columns != NULL)
+    {
+        for (i = 0; i < self->column_cnt; i++)
+        {
+            sqlite3_free(self->columns[i]);
+        }
+        sqlite3_free(self->columns);
+    }
+    sqlite3_free(self->config.filename);
+    sqlite3_free(self);
+}
+
+/**
+ * @brief Remove quotes and surrounding spaces of module argument.
+ * @return  String allocated by sqlite3_malloc(), or NULL if out of memory.
+ */
+static char* _sqlite_vtab_dequote(const char* s, size_t size)
+{
+    while (size > 0 && (*s == ' ' || *s == '\t'))
+    {
+        s++; size--;
+    }
+    while (size > 0 && (s[size - 1] == ' ' || s[size - 1] == '\t'))
+    {
+        size--;
+    }
+
+    char quote = size >= 2 ? s[0] : '\0';
+    if (quote == '[')
+    {
+        quote = ']';
+    }
+    if ((quote != '\'' && quote != '"' && quote != ']' && quote != '`')
+        || s[size - 1] != quote)
+    {
+        return sqlite3_mprintf("%.*s", (int)size, s);
+    }
+
+    char* dst = sqlite3_malloc64(size);
+    if (dst == NULL)
+    {
+        return NULL;
+    }
+
+    size_t i, n = 0;
+    for (i = 1; i < size - 1; i++)
+    {
+        dst[n++] = s[i];
+        if (s[i] == quote && s[i + 1] == quote)
+        {
+            i++;
+        }
+    }
+    dst[n] = '\0';
+    return dst;
+}
+
+static int _sqlite_vtab_parse_boolean(const char* s, int* val)
+{
+    if (sqlite3_stricmp(s, "1") == 0 || sqlite3_stricmp(s, "true") == 0
+        || sqlite3_stricmp(s, "yes") == 0 || sqlite3_stricmp(s, "on") == 0)
+    {
+        *val = 1;
+        return 0;
+    }
+    if (sqlite3_stricmp(s, "0") == 0 || sqlite3_stricmp(s, "false") == 0
+        || sqlite3_stricmp(s, "no") == 0 || sqlite3_stricmp(s, "off") == 0)
+    {
+        *val = 0;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Parse one module argument, either `'path'` or `key=value`.
+ * @return  SQLite error code.
+ */
+static int _sqlite_vtab_parse_arg(sqlite_vtab_file_t* self, const char* arg, char** errmsg)
+{
+    const char* eq = strchr(arg, '=');
+    if (arg[strspn(arg, " \t")] == '\'' || arg[strspn(arg, " \t")] == '"' || eq == NULL)
+    {
+        eq = NULL;
+    }
+
+    char* key = eq != NULL ? _sqlite_vtab_dequote(arg, eq - arg) : sqlite3_mprintf("filename");
+    char* value = eq != NULL ? _sqlite_vtab_dequote(eq + 1, strlen(eq + 1))
+        : _sqlite_vtab_dequote(arg, strlen(arg));
+    int ret = SQLITE_OK;
+
+    if (key == NULL || value == NULL)
+    {
+        ret = SQLITE_NOMEM;
+    }
+    else if (sqlite3_stricmp(key, "filename") == 0)
+    {
+        sqlite3_free(self->config.filename);
+        self->config.filename = value;
+        value = NULL;
+    }
+    else if (sqlite3_stricmp(key, "header") == 0 && self->type == AUTO_SQLITE_VTAB_CSV)
+    {
+        if (_sqlite_vtab_parse_boolean(value, &self->config.header) != 0)
+        {
+            *errmsg = sqlite3_mprintf("invalid value of header: %s", value);
+            ret = SQLITE_ERROR;
+        }
+    }
+    else if (sqlite3_stricmp(key, "delimiter") == 0 && self->type == AUTO_SQLITE_VTAB_CSV)
+    {
+        if (strlen(value) != 1)
+        {
+            *errmsg = sqlite3_mprintf("delimiter must be one character");
+            ret = SQLITE_ERROR;
+        }
+        self->config.delimiter = value[0];
+    }
+    else
+    {
+        *errmsg = sqlite3_mprintf("unknown argument: %s", key);
+        ret = SQLITE_ERROR;
+    }
+
+    sqlite3_free(key);
+    sqlite3_free(value);
+    return ret;
+}
+
+static auto_csv_t* _sqlite_vtab_open(sqlite_vtab_file_t* self, char** errmsg)
+{
+    /* JSON text never contains NUL, so each NDJSON line is one field. */
+    char delimiter = self->type == AUTO_SQLITE_VTAB_CSV ? self->config.delimiter : '\0';
+
+    int errcode;
+    auto_csv_t* csv = auto_csv_open_file(self->config.filename, delimiter, &errcode);
+    if (csv == NULL)
+    {
+        char buf[256];
+        *errmsg = sqlite3_mprintf("open %s failed: %s", self->config.filename,
+            auto_strerror(errcode, buf, sizeof(buf)));
+    }
+    return csv;
+}
+
+static int _sqlite_vtab_read(auto_csv_t* csv, const auto_csv_field_t** fields, char** errmsg)
+{
+    int ret = auto_csv_next(csv, fields);
+    if (ret < 0)
+    {
+        char buf[256];
+        *errmsg = sqlite3_mprintf("read failed: %s", auto_strerror(-ret, buf, sizeof(buf)));
+    }
+    return ret;
+}
+
+/**
+ * @brief Build table schema from CSV header or first row.
+ */
+static int _sqlite_vtab_schema_csv(sqlite_vtab_file_t* self, sqlite3_str* schema,
+    const auto_csv_field_t* fields, int field_cnt)
+{
+    int i;
+    for (i = 0; i < field_cnt; i++)
+    {
+        if (self->config.header && fields[i].size != 0)
+        {
+            sqlite3_str_appendf(schema, "%s\"%.*w\"", i == 0 ? "" : ",",
+                (int)fields[i].size, fields[i].data);
+        }
+        else
+        {
+            sqlite3_str_appendf(schema, "%s\"c%d\"", i == 0 ? "" : ",", i + 1);
+        }
+    }
+    self->column_cnt = field_cnt;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Build table schema from keys of first NDJSON object.
+ */
+static int _sqlite_vtab_schema_ndjson(sqlite_vtab_file_t* self, sqlite3_str* schema,
+    const auto_csv_field_t* fields, int field_cnt, char** errmsg)
+{
+    cJSON* json = field_cnt == 1 ? cJSON_ParseWithLength(fields[0].data, fields[0].size) : NULL;
+    if (json == NULL || json->type != cJSON_Object)
+    {
+        cJSON_Delete(json);
+        *errmsg = sqlite3_mprintf("first line of %s is not a JSON object", self->config.filename);
+        return SQLITE_ERROR;
+    }
+
+    int cnt = 0;
+    cJSON* item;
+    cJSON_ArrayForEach(item, json)
+    {
+        cnt++;
+    }
+
+    if ((self->columns = sqlite3_malloc64(sizeof(char*) * (cnt + 1))) == NULL)
+    {
+        cJSON_Delete(json);
+        return SQLITE_NOMEM;
+    }
+    cJSON_ArrayForEach(item, json)
+    {
+        if ((self->columns[self->column_cnt] = sqlite3_mprintf("%s", item->string)) == NULL)
+        {
+            cJSON_Delete(json);
+            return SQLITE_NOMEM;
+        }
+        sqlite3_str_appendf(schema, "%s\"%w\"", self->column_cnt == 0 ? "" : ",", item->string);
+        self->column_cnt++;
+    }
+
+    cJSON_Delete(json);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Read first line of file and declare table schema.
+ */
+static int _sqlite_vtab_declare(sqlite3* db, sqlite_vtab_file_t* self, char** errmsg)
+{
+    auto_csv_t* csv = _sqlite_vtab_open(self, errmsg);
+    if (csv == NULL)
+    {
+        return SQLITE_ERROR;
+    }
+
+    const auto_csv_field_t* fields;
+    int field_cnt = _sqlite_vtab_read(csv, &fields, errmsg);
+    if (field_cnt <= 0)
+    {
+        auto_csv_close(csv);
+        if (field_cnt == 0)
+        {
+            *errmsg = sqlite3_mprintf("no column in %s", self->config.filename);
+        }
+        return SQLITE_ERROR;
+    }
+
+    sqlite3_str* schema = sqlite3_str_new(db);
+    sqlite3_str_appendall(schema, "CREATE TABLE x(");
+
+    int ret = self->type == AUTO_SQLITE_VTAB_CSV
+        ? _sqlite_vtab_schema_csv(self, schema, fields, field_cnt)
+        : _sqlite_vtab_schema_ndjson(self, schema, fields, field_cnt, errmsg);
+    auto_csv_close(csv);
+
+    sqlite3_str_appendall(schema, ")");
+    char* sql = sqlite3_str_finish(schema);
+    if (ret == SQLITE_OK)
+    {
+        ret = sql != NULL ? sqlite3_declare_vtab(db, sql) : SQLITE_NOMEM;
+    }
+    sqlite3_free(sql);
+
+    return ret;
+}
+
+static int _sqlite_vtab_connect(sqlite3* db, void* aux, int argc,
+    const char* const* argv, sqlite3_vtab** vtab, char** errmsg)
+{
+    int i, ret;
+    sqlite_vtab_file_t* self = sqlite3_malloc64(sizeof(sqlite_vtab_file_t));
+    if (self == NULL)
+    {
+        return SQLITE_NOMEM;
+    }
+    memset(self, 0, sizeof(*self));
+    self->type = (sqlite_vtab_type_t)(intptr_t)aux;
+    self->config.delimiter = ',';
+    self->config.header = 1;
+
+    for (i = 3; i < argc; i++)
+    {
+        if ((ret = _sqlite_vtab_parse_arg(self, argv[i], errmsg)) != SQLITE_OK)
+        {
+            goto error;
+        }
+    }
+    if (self->config.filename == NULL)
+    {
+        *errmsg = sqlite3_mprintf("filename is required");
+        ret = SQLITE_ERROR;
+        goto error;
+    }
+
+    /* Reading files must not be triggered by untrusted schema. */
+    sqlite3_vtab_config(db, SQLITE_VTAB_DIRECTONLY);
+
+    if ((ret = _sqlite_vtab_declare(db, self, errmsg)) != SQLITE_OK)
+    {
+        goto error;
+    }
+
+    *vtab = &self->base;
+    return SQLITE_OK;
+
+error:
+    _sqlite_vtab_free(self);
+    return ret;
+}
+
+/**
+ * @brief Same as connect, but must be a different function so that the
+ *   module is not eponymous.
+ */
+static int _sqlite_vtab_create(sqlite3* db, void* aux, int argc,
+    const char* const* argv, sqlite3_vtab** vtab, char** errmsg)
+{
+    return _sqlite_vtab_connect(db, aux, argc, argv, vtab, errmsg);
+}
+
+static int _sqlite_vtab_disconnect(sqlite3_vtab* vtab)
+{
+    _sqlite_vtab_free((sqlite_vtab_file_t*)vtab);
+    return SQLITE_OK;
+}
+
+static int _sqlite_vtab_best_index(sqlite3_vtab* vtab, sqlite3_index_info* info)
+{
+    (void)vtab;
+
+    /* Always full scan, but remember used columns so others are not parsed. */
+    info->idxStr = sqlite3_mprintf("%llx", (unsigned long long)info->colUsed);
+    info->needToFreeIdxStr = 1;
+    info->estimatedCost = 1000000;
+    return info->idxStr != NULL ? SQLITE_OK : SQLITE_NOMEM;
+}
+
+static int _sqlite_vtab_open_cursor(sqlite3_vtab* vtab, sqlite3_vtab_cursor** cursor)
+{
+    sqlite_vtab_file_t* tab = (sqlite_vtab_file_t*)vtab;
+    sqlite_vtab_cursor_t* self = sqlite3_malloc64(sizeof(sqlite_vtab_cursor_t));
+    if (self == NULL)
+    {
+        return SQLITE_NOMEM;
+    }
+    memset(self, 0, sizeof(*self));
+
+    if (tab->type == AUTO_SQLITE_VTAB_NDJSON
+        && (self->values = sqlite3_malloc64(sizeof(cJSON*) * tab->column_cnt)) == NULL)
+    {
+        sqlite3_free(self);
+        return SQLITE_NOMEM;
+    }
+
+    *cursor = &self->base;
+    return SQLITE_OK;
+}
+
+static void _sqlite_vtab_cursor_reset(sqlite_vtab_cursor_t* self)
+{
+    if (self->csv != NULL)
+    {
+        auto_csv_close(self->csv);
+        self->csv = NULL;
+    }
+    cJSON_Delete(self->json);
+    self->json = NULL;
+    self->fields = NULL;
+    self->field_cnt = 0;
+}
+
+static int _sqlite_vtab_close_cursor(sqlite3_vtab_cursor* cursor)
+{
+    sqlite_vtab_cursor_t* self = (sqlite_vtab_cursor_t*)cursor;
+    _sqlite_vtab_cursor_reset(self);
+    sqlite3_free(self->values);
+    sqlite3_free(self);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Find values of used columns in current NDJSON row.
+ */
+static int _sqlite_vtab_next_ndjson(sqlite_vtab_cursor_t* self, sqlite_vtab_file_t* tab)
+{
+    cJSON_Delete(self->json);
+    self->json = NULL;
+    memset(self->values, 0, sizeof(cJSON*) * tab->column_cnt);
+
+    /* Nothing to parse, like `SELECT count(*)`. */
+    if (self->col_used == 0)
+    {
+        return SQLITE_OK;
+    }
+
+    if (self->field_cnt == 1)
+    {
+        self->json = cJSON_ParseWithLength(self->fields[0].data, self->fields[0].size);
+    }
+    if (self->json == NULL || self->json->type != cJSON_Object)
+    {
+        tab->base.zErrMsg = sqlite3_mprintf("row %lld of %s is not a JSON object",
+            self->rowid, tab->config.filename);
+        return SQLITE_ERROR;
+    }
+
+    /* Keys are usually in the same order as columns, so try next column first. */
+    int i, hint = 0;
+    cJSON* item;
+    cJSON_ArrayForEach(item, self->json)
+    {
+        for (i = 0; i < tab->column_cnt; i++)
+        {
+            int idx = (hint + i) % tab->column_cnt;
+            if (strcmp(tab->columns[idx], item->string) == 0)
+            {
+                if (_sqlite_vtab_column_used(self->col_used, idx))
+                {
+                    self->values[idx] = item;
+                }
+                hint = idx + 1;
+                break;
+            }
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+static int _sqlite_vtab_next(sqlite3_vtab_cursor* cursor)
+{
+    sqlite_vtab_cursor_t* self = (sqlite_vtab_cursor_t*)cursor;
+    sqlite_vtab_file_t* tab = (sqlite_vtab_file_t*)cursor->pVtab;
+
+    if (self->csv == NULL)
+    {
+        return SQLITE_OK;
+    }
+
+    if ((self->field_cnt = _sqlite_vtab_read(self->csv, &self->fields, &tab->base.zErrMsg)) <= 0)
+    {
+        int ret = self->field_cnt < 0 ? SQLITE_IOERR : SQLITE_OK;
+        _sqlite_vtab_cursor_reset(self);
+        return ret;
+    }
+    self->rowid++;
+
+    return tab->type == AUTO_SQLITE_VTAB_NDJSON ? _sqlite_vtab_next_ndjson(self, tab) : SQLITE_OK;
+}
+
+static int _sqlite_vtab_filter(sqlite3_vtab_cursor* cursor, int idxNum,
+    const char* idxStr, int argc, sqlite3_value** argv)
+{
+    (void)idxNum; (void)argc; (void)argv;
+    sqlite_vtab_cursor_t* self = (sqlite_vtab_cursor_t*)cursor;
+    sqlite_vtab_file_t* tab = (sqlite_vtab_file_t*)cursor->pVtab;
+
+    _sqlite_vtab_cursor_reset(self);
+    self->rowid = 0;
+    self->col_used = idxStr != NULL ? (sqlite3_uint64)strtoull(idxStr, NULL, 16)
+        : (sqlite3_uint64)-1;
+
+    if ((self->csv = _sqlite_vtab_open(tab, &tab->base.zErrMsg)) == NULL)
+    {
+        return SQLITE_ERROR;
+    }
+
+    /* Skip header */
+    if (tab->type == AUTO_SQLITE_VTAB_CSV && tab->config.header
+        && _sqlite_vtab_read(self->csv, &self->fields, &tab->base.zErrMsg) < 0)
+    {
+        _sqlite_vtab_cursor_reset(self);
+        return SQLITE_IOERR;
+    }
+
+    return _sqlite_vtab_next(cursor);
+}
+
+static int _sqlite_vtab_eof(sqlite3_vtab_cursor* cursor)
+{
+    return ((sqlite_vtab_cursor_t*)cursor)->csv == NULL;
+}
+
+static void _sqlite_vtab_result_json(sqlite3_context* ctx, const cJSON* item)
+{
+    if (item == NULL)
+    {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    switch (item->type)
+    {
+    case cJSON_False:
+        sqlite3_result_int(ctx, 0);
+        break;
+
+    case cJSON_True:
+        sqlite3_result_int(ctx, 1);
+        break;
+
+    case cJSON_Number:
+        if (item->valuedouble >= -9007199254740992.0 && item->valuedouble <= 9007199254740992.0
+            && item->valuedouble == (double)(sqlite3_int64)item->valuedouble)
+        {
+            sqlite3_result_int64(ctx, (sqlite3_int64)item->valuedouble);
+        }
+        else
+        {
+            sqlite3_result_double(ctx, item->valuedouble);
+        }
+        break;
+
+    case cJSON_String:
+        sqlite3_result_text(ctx, item->valuestring, -1, SQLITE_TRANSIENT);
+        break;
+
+    case cJSON_Array:
+    case cJSON_Object:
+        sqlite3_result_text(ctx, cJSON_PrintUnformatted(item), -1, cJSON_free);
+        break;
+
+    default:
+        sqlite3_result_null(ctx);
+        break;
+    }
+}
+
+static int _sqlite_vtab_column(sqlite3_vtab_cursor* cursor, sqlite3_context* ctx, int i)
+{
+    sqlite_vtab_cursor_t* self = (sqlite_vtab_cursor_t*)cursor;
+    sqlite_vtab_file_t* tab = (sqlite_vtab_file_t*)cursor->pVtab;
+
+    if (tab->type == AUTO_SQLITE_VTAB_NDJSON)
+    {
+        _sqlite_vtab_result_json(ctx, self->values[i]);
+    }
+    else if (i < self->field_cnt)
+    {
+        /* Field is only valid until next row. */
+        sqlite3_result_text(ctx, self->fields[i].data, (int)self->fields[i].size,
+            SQLITE_TRANSIENT);
+    }
+    else
+    {
+        sqlite3_result_null(ctx);
+    }
+
+    return SQLITE_OK;
+}
+
+static int _sqlite_vtab_rowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* rowid)
+{
+    *rowid = ((sqlite_vtab_cursor_t*)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Read-only module. Fields are named so that it builds with newer
+ *   SQLite that appends methods.
+ */
+static const sqlite3_module s_sqlite_vtab_module = {
+    .iVersion       = 0,
+    .xCreate        = _sqlite_vtab_create,
+    .xConnect       = _sqlite_vtab_connect,
+    .xBestIndex     = _sqlite_vtab_best_index,
+    .xDisconnect    = _sqlite_vtab_disconnect,
+    .xDestroy       = _sqlite_vtab_disconnect,
+    .xOpen          = _sqlite_vtab_open_cursor,
+    .xClose         = _sqlite_vtab_close_cursor,
+    .xFilter        = _sqlite_vtab_filter,
+    .xNext          = _sqlite_vtab_next,
+    .xEof           = _sqlite_vtab_eof,
+    .xColumn        = _sqlite_vtab_column,
+    .xRowid         = _sqlite_vtab_rowid,
+};
+
+int auto_sqlite_vtab_init(sqlite3* db)
+{
+    int ret = sqlite3_create_module(db, "csv", &s_sqlite_vtab_module,
+        (void*)(intptr_t)AUTO_SQLITE_VTAB_CSV);
+    if (ret != SQLITE_OK)
+    {
+        return ret;
+    }
+    return sqlite3_create_module(db, "ndjson", &s_sqlite_vtab_module,
+        (void*)(intptr_t)AUTO_SQLITE_VTAB_NDJSON);
+}
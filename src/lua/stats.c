@@ -0,0 +1,100 @@
+#include <uv.h>
+#include "stats.h"
+
+static void _stats_set_integer(lua_State* L, const char* name, uint64_t value)
+{
+    lua_pushinteger(L, (lua_Integer)value);
+    lua_setfield(L, -2, name);
+}
+
+/**
+ * @brief Set field \p name to \p value in nanoseconds, as seconds.
+ */
+static void _stats_set_seconds(lua_State* L, const char* name, uint64_t value)
+{
+    lua_pushnumber(L, (lua_Number)value / 1e9);
+    lua_setfield(L, -2, name);
+}
+
+void auto_lua_push_coroutine_stats(lua_State* L, const auto_coroutine_stats_t* stats)
+{
+    lua_createtable(L, 0, 3);
+    _stats_set_integer(L, "resume", stats->resume);
+    _stats_set_seconds(L, "time", stats->time);
+    _stats_set_integer(L, "preempt", stats->preempt);
+}
+
+static void _stats_push_coroutine_list(lua_State* L, auto_runtime_t* rt)
+{
+    lua_Integer idx = 1;
+    lua_createtable(L, (int)ev_map_size(&rt->schedule.all_table), 0);
+
+    auto_map_node_t* it = ev_map_begin(&rt->schedule.all_table);
+    for (; it != NULL; it = ev_map_next(it), idx++)
+    {
+        atd_coroutine_impl_t* impl = container_of(it, atd_coroutine_impl_t, t_node);
+
+        auto_lua_push_coroutine_stats(L, &impl->stats);
+
+        /*
+         * The thread is not exposed, it hosts other coroutines once this one
+         * finishes.
+         */
+        _stats_set_integer(L, "id", impl->trace.id);
+        luaL_traceback(L, impl->base.L, NULL, 0);
+        lua_setfield(L, -2, "traceback");
+
+        const char* status = "wait";
+        if (impl->base.status & AUTO_COROUTINE_DEAD)
+        {
+            status = "dead";
+        }
+        else if (impl->base.status & AUTO_COROUTINE_BUSY)
+        {
+            status = "busy";
+        }
+        lua_pushstring(L, status);
+        lua_setfield(L, -2, "status");
+
+        lua_rawseti(L, -2, idx);
+    }
+}
+
+int auto_lua_stats(lua_State* L)
+{
+    int detail = lua_toboolean(L, 1);
+    auto_runtime_t* rt = auto_get_runtime(L);
+    uint64_t now = uv_hrtime();
+
+    lua_newtable(L);
+
+    _stats_set_integer(L, "coroutines", ev_map_size(&rt->schedule.all_table));
+    _stats_set_integer(L, "busy", ev_list_size(&rt->schedule.busy_queue));
+    _stats_set_integer(L, "wait", ev_list_size(&rt->schedule.wait_queue));
+
+    _stats_set_integer(L, "resume", rt->stats.resume);
+    uint64_t interval = now - rt->stats.query_time;
+    lua_pushnumber(L, interval != 0 ?
+        (lua_Number)(rt->stats.resume - rt->stats.query_resume) * 1e9 / (lua_Number)interval : 0);
+    lua_setfield(L, -2, "resume_rate");
+    rt->stats.query_time = now;
+    rt->stats.query_resume = rt->stats.resume;
+
+    _stats_set_seconds(L, "uptime", now - rt->stats.start_time);
+    _stats_set_seconds(L, "resume_time", rt->stats.resume_time);
+    _stats_set_seconds(L, "poll_time", rt->stats.poll_time);
+
+    _stats_set_integer(L, "preempt", rt->stats.preempt);
+    _stats_set_integer(L, "spurious_wakeup", rt->stats.spurious_wakeup);
+    _stats_set_integer(L, "busy_poll", rt->stats.busy_poll);
+    _stats_set_integer(L, "loop_lag", rt->stats.loop_lag);
+    _stats_set_integer(L, "loop_lag_max", rt->stats.loop_lag_max);
+
+    if (detail)
+    {
+        _stats_push_coroutine_list(L, rt);
+        lua_setfield(L, -2, "list");
+    }
+
+    return 1;
+}
@@ -0,0 +1,33 @@
+#ifndef __AUTO_LUA_STATS_H__
+#define __AUTO_LUA_STATS_H__
+
+#include "api.h"
+#include "runtime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Push scheduler statistics on top of stack.
+ *
+ * If the first argument is true, statistics of every managed coroutine are
+ * included as well.
+ *
+ * @param[in] L Lua VM.
+ * @return      Always 1.
+ */
+AUTO_LOCAL int auto_lua_stats(lua_State* L);
+
+/**
+ * @brief Push statistics of coroutine as table on top of stack.
+ * @param[in] L     Lua VM.
+ * @param[in] stats Coroutine statistics.
+ */
+AUTO_LOCAL void auto_lua_push_coroutine_stats(lua_State* L, const auto_coroutine_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
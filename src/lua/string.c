@@ -1,4 +1,5 @@
 #include "lua/string.h"
+#include "lua/regex.h"
 #include <assert.h>
 
 typedef struct string_split_helper
@@ -39,11 +40,12 @@ int auto_lua_string_split(lua_State* L)
     size_t pat_sz;
     const char* pat = luaL_checklstring(L, 2, &pat_sz);
 
+    /* Nothing below borrow regex, and nothing leaks if error raised. */
     size_t err_pos;
-    auto_regex_code_t* code = api.regex->create(pat, pat_sz, &err_pos);
-    if (code == NULL)
+    lua_regex_cache_entry_t* entry = auto_regex_cache_borrow(L, pat, pat_sz, &err_pos);
+    if (entry == NULL)
     {
-        return api.lua->A_error(L, "compile regex failed at position %d", (int)err_pos);
+        return auto_regex_cache_error(L, err_pos);
     }
 
     string_split_helper_t helper;
@@ -51,10 +53,15 @@ int auto_lua_string_split(lua_State* L)
     helper.str = str;
     helper.offset = 0;
 
+    auto_regex_match_data_t* match_data = auto_regex_match_data_push(L, entry->code);
+
     lua_newtable(L);
     while (helper.offset < str_sz)
     {
-        if (api.regex->match(code, str, str_sz, helper.offset, _string_split_cb, &helper) <= 0)
+        /* The subject only need to be checked for UTF validity once. */
+        int flags = helper.offset == 0 ? 0 : AUTO_REGEX_NO_UTF_CHECK;
+        if (api.regex->match_ex(entry->code, str, str_sz, helper.offset, flags,
+            match_data, _string_split_cb, &helper) <= 0)
         {
             break;
         }
@@ -69,7 +76,5 @@ int auto_lua_string_split(lua_State* L)
         lua_rawseti(L, -2, luaL_len(L, -2) + 1);
     }
 
-    api.regex->destroy(code);
-
     return 1;
 }
@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include "runtime.h"
+#include "api/coroutine.h"
+#include "sync.h"
+
+#define AUTO_MUTEX_NAME     "__auto_mutex"
+#define AUTO_SEMAPHORE_NAME "__auto_semaphore"
+#define AUTO_WAITGROUP_NAME "__auto_waitgroup"
+
+/**
+ * @brief Coroutine waiting for a synchronization object.
+ */
+typedef struct sync_waiter
+{
+    auto_list_node_t        node;       /**< Node in wait queue */
+    auto_coroutine_t*       co;         /**< Waiting coroutine */
+    auto_coroutine_hook_t*  hook;       /**< Hook to cancel wait if \p co is closed */
+    struct sync_base*       belong;     /**< Object waiting for */
+    int                     granted;    /**< Object is handed over, not in queue any more */
+} sync_waiter_t;
+
+/**
+ * @brief Common header of synchronization objects.
+ */
+typedef struct sync_base
+{
+    auto_list_t             wait_queue; /**< #sync_waiter_t, first come first served */
+
+    /**
+     * @brief Hand object over again if it is granted to a waiter that is
+     *   closed before taking it, or NULL if nothing to hand over.
+     */
+    void                    (*regrant)(struct sync_base* self);
+} sync_base_t;
+
+typedef struct lua_mutex
+{
+    sync_base_t             base;
+    auto_coroutine_t*       owner;      /**< Coroutine that holds the lock */
+    auto_coroutine_hook_t*  owner_hook; /**< Hook to unlock if \p owner finishes */
+} lua_mutex_t;
+
+typedef struct lua_semaphore
+{
+    sync_base_t             base;
+    lua_Integer             count;      /**< Available permits */
+} lua_semaphore_t;
+
+typedef struct lua_waitgroup
+{
+    sync_base_t             base;
+    lua_Integer             count;      /**< Unfinished tasks */
+} lua_waitgroup_t;
+
+/**
+ * @brief Hand object over to the first waiter and wake it up.
+ * @return  The waiting coroutine, or NULL if nobody is waiting.
+ */
+static auto_coroutine_t* _sync_grant(sync_base_t* self)
+{
+    auto_list_node_t* it = ev_list_pop_front(&self->wait_queue);
+    if (it == NULL)
+    {
+        return NULL;
+    }
+
+    sync_waiter_t* waiter = container_of(it, sync_waiter_t, node);
+    waiter->granted = 1;
+    api_coroutine.set_state(waiter->co, AUTO_COROUTINE_BUSY);
+
+    return waiter->co;
+}
+
+/**
+ * @brief Remove waiter if its coroutine is closed.
+ */
+static void _sync_on_waiter_state_change(auto_coroutine_t* co, void* arg)
+{
+    sync_waiter_t* waiter = arg;
+    sync_base_t* self = waiter->belong;
+
+    if (!(co->status & AUTO_COROUTINE_DEAD))
+    {
+        return;
+    }
+
+    api_coroutine.unhook(co, waiter->hook);
+    if (!waiter->granted)
+    {
+        ev_list_erase(&self->wait_queue, &waiter->node);
+    }
+    else if (self->regrant != NULL)
+    {
+        self->regrant(self);
+    }
+    free(waiter);
+}
+
+static int _sync_on_resume(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    sync_base_t* self = lua_touserdata(L, 1);
+    sync_waiter_t* waiter = (sync_waiter_t*)ctx;
+
+    /* Granted wins over timeout, as the object is already ours. */
+    if (!waiter->granted && !auto_runtime_timeout_expired(waiter->co))
+    {
+        api_coroutine.set_state(waiter->co, AUTO_COROUTINE_WAIT);
+        return lua_yieldk(L, 0, ctx, _sync_on_resume);
+    }
+
+    int granted = waiter->granted;
+    if (!granted)
+    {
+        ev_list_erase(&self->wait_queue, &waiter->node);
+    }
+    auto_runtime_timeout_stop(waiter->co);
+    api_coroutine.unhook(waiter->co, waiter->hook);
+    free(waiter);
+
+    lua_pushboolean(L, granted);
+    if (granted)
+    {
+        return 1;
+    }
+    lua_pushstring(L, "timeout");
+    return 2;
+}
+
+/**
+ * @brief Wait until object at index 1 is handed over by #_sync_grant().
+ * @param[in] L         Lua VM.
+ * @param[in] timeout   Timeout in milliseconds, or -1 if no limit.
+ * @return              `true` if granted, `false, "timeout"` if timeout.
+ */
+static int _sync_wait(lua_State* L, lua_Integer timeout)
+{
+    sync_base_t* self = lua_touserdata(L, 1);
+
+    if (timeout == 0)
+    {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, "timeout");
+        return 2;
+    }
+
+    auto_coroutine_t* co = api_coroutine.find(L);
+    if (co == NULL)
+    {
+        return api.lua->A_error(L, ERR_HINT_NOT_IN_MANAGED_COROUTINE);
+    }
+
+    sync_waiter_t* waiter = malloc(sizeof(sync_waiter_t));
+    waiter->co = co;
+    waiter->belong = self;
+    waiter->granted = 0;
+    waiter->hook = api_coroutine.hook(co, _sync_on_waiter_state_change, waiter);
+    ev_list_push_back(&self->wait_queue, &waiter->node);
+
+    if (timeout > 0)
+    {
+        auto_runtime_timeout_start(co, (uint64_t)timeout);
+    }
+
+    api_coroutine.set_state(co, AUTO_COROUTINE_WAIT);
+    return lua_yieldk(L, 0, (lua_KContext)waiter, _sync_on_resume);
+}
+
+/**
+ * @brief Set metatable of object on top of stack.
+ * @param[in] L         Lua VM.
+ * @param[in] name      Metatable name.
+ * @param[in] methods   Object methods.
+ * @param[in] len       `__len` metamethod, or NULL.
+ * @param[in] gc        `__gc` metamethod, or NULL.
+ */
+static void _sync_set_metatable(lua_State* L, const char* name, const luaL_Reg* methods,
+    lua_CFunction len, lua_CFunction gc)
+{
+    if (luaL_newmetatable(L, name) != 0)
+    {
+        if (len != NULL)
+        {
+            lua_pushcfunction(L, len);
+            lua_setfield(L, -2, "__len");
+        }
+        if (gc != NULL)
+        {
+            lua_pushcfunction(L, gc);
+            lua_setfield(L, -2, "__gc");
+        }
+        lua_newtable(L);
+        luaL_setfuncs(L, methods, 0);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+}
+
+static void _mutex_on_owner_state_change(auto_coroutine_t* co, void* arg);
+
+/**
+ * @brief Set lock owner. Ownership is tracked by hook, so a finished owner
+ *   is never mistaken for the coroutine that reuses its context.
+ * @param[in] self  Mutex.
+ * @param[in] co    New owner, or NULL to unlock.
+ */
+static void _mutex_set_owner(lua_mutex_t* self, auto_coroutine_t* co)
+{
+    if (self->owner != NULL)
+    {
+        api_coroutine.unhook(self->owner, self->owner_hook);
+        self->owner_hook = NULL;
+    }
+
+    self->owner = co;
+    if (co != NULL)
+    {
+        self->owner_hook = api_coroutine.hook(co, _mutex_on_owner_state_change, self);
+    }
+}
+
+/**
+ * @brief Unlock mutex if owner finishes or is closed without unlock.
+ */
+static void _mutex_on_owner_state_change(auto_coroutine_t* co, void* arg)
+{
+    lua_mutex_t* self = arg;
+
+    if (co->status & AUTO_COROUTINE_DEAD)
+    {
+        _mutex_set_owner(self, _sync_grant(&self->base));
+    }
+}
+
+static int _mutex_gc(lua_State* L)
+{
+    lua_mutex_t* self = lua_touserdata(L, 1);
+    _mutex_set_owner(self, NULL);
+    return 0;
+}
+
+static int _mutex_lock(lua_State* L)
+{
+    lua_mutex_t* self = luaL_checkudata(L, 1, AUTO_MUTEX_NAME);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
+    auto_coroutine_t* co = api_coroutine.find(L);
+    if (co == NULL)
+    {
+        return api.lua->A_error(L, ERR_HINT_NOT_IN_MANAGED_COROUTINE);
+    }
+
+    if (self->owner == NULL)
+    {
+        _mutex_set_owner(self, co);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+    if (self->owner == co)
+    {
+        return api.lua->A_error(L, "mutex is already locked by current coroutine");
+    }
+
+    return _sync_wait(L, timeout);
+}
+
+static int _mutex_unlock(lua_State* L)
+{
+    lua_mutex_t* self = luaL_checkudata(L, 1, AUTO_MUTEX_NAME);
+    if (self->owner == NULL || self->owner != api_coroutine.find(L))
+    {
+        return api.lua->A_error(L, "mutex is not locked by current coroutine");
+    }
+
+    _mutex_set_owner(self, _sync_grant(&self->base));
+    return 0;
+}
+
+static int _mutex_locked(lua_State* L)
+{
+    lua_mutex_t* self = luaL_checkudata(L, 1, AUTO_MUTEX_NAME);
+    lua_pushboolean(L, self->owner != NULL);
+    return 1;
+}
+
+int auto_lua_mutex(lua_State* L)
+{
+    static const luaL_Reg s_mutex_method[] = {
+        { "lock",       _mutex_lock },
+        { "locked",     _mutex_locked },
+        { "unlock",     _mutex_unlock },
+        { NULL,         NULL },
+    };
+
+    lua_mutex_t* self = lua_newuserdata(L, sizeof(lua_mutex_t));
+    ev_list_init(&self->base.wait_queue);
+    self->base.regrant = NULL;
+    self->owner = NULL;
+    self->owner_hook = NULL;
+    _sync_set_metatable(L, AUTO_MUTEX_NAME, s_mutex_method, NULL, _mutex_gc);
+
+    return 1;
+}
+
+static int _semaphore_acquire(lua_State* L)
+{
+    lua_semaphore_t* self = luaL_checkudata(L, 1, AUTO_SEMAPHORE_NAME);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
+
+    if (self->count > 0)
+    {
+        self->count--;
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    return _sync_wait(L, timeout);
+}
+
+/**
+ * @brief Give a permit back.
+ */
+static void _semaphore_regrant(sync_base_t* base)
+{
+    lua_semaphore_t* self = container_of(base, lua_semaphore_t, base);
+
+    /* Permit goes to waiter directly, so it cannot be taken by others. */
+    if (_sync_grant(&self->base) == NULL)
+    {
+        self->count++;
+    }
+}
+
+static int _semaphore_release(lua_State* L)
+{
+    lua_semaphore_t* self = luaL_checkudata(L, 1, AUTO_SEMAPHORE_NAME);
+    _semaphore_regrant(&self->base);
+    return 0;
+}
+
+static int _semaphore_len(lua_State* L)
+{
+    lua_semaphore_t* self = luaL_checkudata(L, 1, AUTO_SEMAPHORE_NAME);
+    lua_pushinteger(L, self->count);
+    return 1;
+}
+
+int auto_lua_semaphore(lua_State* L)
+{
+    static const luaL_Reg s_semaphore_method[] = {
+        { "acquire",    _semaphore_acquire },
+        { "release",    _semaphore_release },
+        { NULL,         NULL },
+    };
+
+    lua_Integer count = luaL_optinteger(L, 1, 1);
+    luaL_argcheck(L, count >= 0, 1, "must not be negative");
+
+    lua_semaphore_t* self = lua_newuserdata(L, sizeof(lua_semaphore_t));
+    ev_list_init(&self->base.wait_queue);
+    self->base.regrant = _semaphore_regrant;
+    self->count = count;
+    _sync_set_metatable(L, AUTO_SEMAPHORE_NAME, s_semaphore_method, _semaphore_len, NULL);
+
+    return 1;
+}
+
+static int _waitgroup_add(lua_State* L)
+{
+    lua_waitgroup_t* self = luaL_checkudata(L, 1, AUTO_WAITGROUP_NAME);
+    lua_Integer delta = luaL_optinteger(L, 2, 1);
+
+    if (self->count + delta < 0)
+    {
+        return api.lua->A_error(L, "negative waitgroup counter");
+    }
+
+    self->count += delta;
+    if (self->count == 0)
+    {
+        while (_sync_grant(&self->base) != NULL)
+        {
+        }
+    }
+
+    return 0;
+}
+
+static int _waitgroup_done(lua_State* L)
+{
+    lua_settop(L, 1);
+    lua_pushinteger(L, -1);
+    return _waitgroup_add(L);
+}
+
+static int _waitgroup_wait(lua_State* L)
+{
+    lua_waitgroup_t* self = luaL_checkudata(L, 1, AUTO_WAITGROUP_NAME);
+    lua_Integer timeout = auto_runtime_opt_timeout(L, 2);
+
+    if (self->count == 0)
+    {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    return _sync_wait(L, timeout);
+}
+
+static int _waitgroup_len(lua_State* L)
+{
+    lua_waitgroup_t* self = luaL_checkudata(L, 1, AUTO_WAITGROUP_NAME);
+    lua_pushinteger(L, self->count);
+    return 1;
+}
+
+int auto_lua_waitgroup(lua_State* L)
+{
+    static const luaL_Reg s_waitgroup_method[] = {
+        { "add",        _waitgroup_add },
+        { "done",       _waitgroup_done },
+        { "wait",       _waitgroup_wait },
+        { NULL,         NULL },
+    };
+
+    lua_waitgroup_t* self = lua_newuserdata(L, sizeof(lua_waitgroup_t));
+    ev_list_init(&self->base.wait_queue);
+    self->base.regrant = NULL;
+    self->count = 0;
+    _sync_set_metatable(L, AUTO_WAITGROUP_NAME, s_waitgroup_method, _waitgroup_len, NULL);
+
+    return 1;
+}
@@ -0,0 +1,35 @@
+#ifndef __AUTO_LUA_SYNC_H__
+#define __AUTO_LUA_SYNC_H__
+
+#include "api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Create a mutex for managed coroutines.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_mutex(lua_State* L);
+
+/**
+ * @brief Create a counting semaphore for managed coroutines.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_semaphore(lua_State* L);
+
+/**
+ * @brief Create a wait group for managed coroutines.
+ * @param[in] L     Lua VM.
+ * @return          Always 1.
+ */
+AUTO_LOCAL int auto_lua_waitgroup(lua_State* L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,7 @@
 #include "runtime.h"
 #include "api/coroutine.h"
+#include "lua/regex.h"
+#include "utils/trace.h"
 #include "utils.h"
 #include <string.h>
 #include <stdlib.h>
@@ -18,6 +20,8 @@ static void _print_usage(const char* name)
         "Usage: %s [OPTIONS] [SCRIPT]\n"
         "  -h,--help\n"
         "    Show this help and exit.\n"
+        "  --trace=FILE\n"
+        "    Write Chrome trace of scheduler events to FILE at exit.\n"
     ;
     fprintf(stdout, s_usage, name, name);
     exit(EXIT_SUCCESS);
@@ -33,11 +37,52 @@ static int _init_parse_args_finalize(auto_runtime_t* rt, const char* name)
     return 0;
 }
 
+static void _runtime_preempt_hook(lua_State* L, lua_Debug* ar)
+{
+    (void)ar;
+
+    /* Hook is inherited by threads created in this coroutine. */
+    auto_coroutine_t* co = api_coroutine.find(L);
+    if (co == NULL)
+    {
+        lua_sethook(L, NULL, 0, 0);
+        return;
+    }
+
+    atd_coroutine_impl_t* impl = container_of(co, atd_coroutine_impl_t, base);
+    if (impl->preempt.time != 0 && uv_hrtime() - impl->preempt.since < impl->preempt.time)
+    {
+        return;
+    }
+
+    /* Try again at next hook. */
+    if (!lua_isyieldable(L))
+    {
+        return;
+    }
+
+    impl->stats.preempt++;
+    impl->rt->stats.preempt++;
+    lua_yield(L, 0);
+}
+
+/**
+ * @brief Remove preempt hook inherited or left by previous coroutine.
+ */
+static void _runtime_preempt_clear(lua_State* L)
+{
+    if (lua_gethook(L) == _runtime_preempt_hook)
+    {
+        lua_sethook(L, NULL, 0, 0);
+    }
+}
+
 static void _runtime_destroy_thread(auto_runtime_t* rt, lua_State* L, atd_coroutine_impl_t* thr)
 {
     assert(ev_list_size(&thr->hook.queue) == 0);
 
     ev_map_erase(&rt->schedule.all_table, &thr->t_node);
+    auto_runtime_timer_stop(rt, &thr->timer);
 
     if (thr->base.status)
     {
@@ -48,14 +93,41 @@ static void _runtime_destroy_thread(auto_runtime_t* rt, lua_State* L, atd_corout
         ev_list_erase(&rt->schedule.wait_queue, &thr->q_node);
     }
 
-    luaL_unref(L, LUA_REGISTRYINDEX, thr->data.ref_key);
+    /*
+     * A thread that returned normally is clean and can host next coroutine.
+     * Threads with error or closed while running are left to GC.
+     */
+    if (!(thr->base.status & AUTO_COROUTINE_ERROR) && lua_status(thr->base.L) == LUA_OK
+        && rt->pool.n_thread < AUTO_RUNTIME_POOL_SIZE)
+    {
+        lua_settop(thr->base.L, 0);
+        _runtime_preempt_clear(thr->base.L);
+        rt->pool.thread[rt->pool.n_thread++] = thr->data.ref_key;
+    }
+    else
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, thr->data.ref_key);
+    }
     thr->data.ref_key = LUA_NOREF;
-    free(thr);
+
+    auto_runtime_coroutine_release(rt, thr);
 }
 
 static void _runtime_gc_release_coroutine(auto_runtime_t* rt)
 {
     auto_list_node_t * it;
+
+    /* Cancel wait operations of unfinished coroutines, so no hook is left. */
+    auto_map_node_t* m_it = ev_map_begin(&rt->schedule.all_table);
+    for (; m_it != NULL; m_it = ev_map_next(m_it))
+    {
+        atd_coroutine_impl_t* thr = container_of(m_it, atd_coroutine_impl_t, t_node);
+        if (!(thr->base.status & AUTO_COROUTINE_DEAD))
+        {
+            auto_runtime_coroutine_close(&thr->base);
+        }
+    }
+
     while ((it = ev_list_begin(&rt->schedule.busy_queue)) != NULL)
     {
         atd_coroutine_impl_t* thr = container_of(it, atd_coroutine_impl_t, q_node);
@@ -78,6 +150,16 @@ static int _init_parse_args(auto_runtime_t* rt, int argc, char* argv[])
             _print_usage(get_filename(argv[0]));
         }
 
+        if (strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            if (rt->config.trace_file != NULL)
+            {
+                free(rt->config.trace_file);
+            }
+            rt->config.trace_file = auto_strdup(argv[i] + 8);
+            continue;
+        }
+
         if (rt->config.script_file != NULL)
         {
             free(rt->config.script_file);
@@ -106,6 +188,61 @@ static void _on_runtime_notify(uv_async_t *handle)
     (void)handle;
 }
 
+/**
+ * @brief Let timer handle expire at next tick of timer wheel.
+ */
+static void _runtime_timer_update(auto_runtime_t* rt);
+
+static void _on_runtime_timer(uv_timer_t* handle)
+{
+    auto_runtime_t* rt = container_of(handle, auto_runtime_t, timer.handle);
+
+    /* Timer expires late if coroutines run too long without yield. */
+    uv_update_time(&rt->loop);
+    uint64_t now = uv_now(&rt->loop);
+    rt->stats.loop_lag = now > rt->timer.due ? now - rt->timer.due : 0;
+    if (rt->stats.loop_lag > rt->stats.loop_lag_max)
+    {
+        rt->stats.loop_lag_max = rt->stats.loop_lag;
+    }
+    rt->timer.due = UINT64_MAX;
+
+    uint64_t trace_beg = AUTO_TRACE_BEGIN();
+    auto_timewheel_process(&rt->timer.wheel, now);
+    _runtime_timer_update(rt);
+    AUTO_TRACE_END("timer", trace_beg);
+
+    /*
+     * Timers may run before polling for I/O, so return to scheduler now,
+     * otherwise the coroutines just woken up wait for next I/O event.
+     */
+    uv_stop(&rt->loop);
+}
+
+static void _runtime_timer_update(auto_runtime_t* rt)
+{
+    uint64_t next = auto_timewheel_next(&rt->timer.wheel);
+    if (next == UINT64_MAX)
+    {
+        if (rt->timer.due != UINT64_MAX)
+        {
+            uv_timer_stop(&rt->timer.handle);
+            rt->timer.due = UINT64_MAX;
+        }
+        return;
+    }
+
+    uint64_t due = rt->timer.wheel.now + next;
+    if (due == rt->timer.due)
+    {
+        return;
+    }
+
+    uint64_t now = uv_now(&rt->loop);
+    rt->timer.due = due;
+    uv_timer_start(&rt->timer.handle, _on_runtime_timer, due > now ? due - now : 0, 0);
+}
+
 static void _thread_trigger_hook(atd_coroutine_impl_t* thr)
 {
     thr->hook.it = ev_list_begin(&thr->hook.queue);
@@ -134,11 +271,31 @@ static int _runtime_schedule_one_pass(auto_runtime_t* rt, lua_State* L)
         }
 
         /* Resume coroutine */
+        unsigned woken = thr->flags.woken;
+        thr->flags.woken = 0;
+        uint64_t beg = uv_hrtime();
+        thr->preempt.since = beg;
         int ret = lua_resume(thr->base.L, L, thr->base.nresults, &thr->base.nresults);
+        uint64_t cost = uv_hrtime() - beg;
+
+        thr->stats.resume++;
+        thr->stats.time += cost;
+        if (auto_trace_enabled)
+        {
+            auto_trace_record(thr->trace.id, "run", beg, cost);
+        }
+        rt->stats.resume++;
+        rt->stats.resume_time += cost;
 
         /* Coroutine yield */
         if (ret == LUA_YIELD)
         {
+            /* Woken up for nothing, the waker should be more precise. */
+            if (woken && thr->base.status == AUTO_COROUTINE_WAIT)
+            {
+                rt->stats.spurious_wakeup++;
+            }
+
             _thread_trigger_hook(thr);
 
             /* Anything received treat as busy coroutine */
@@ -173,10 +330,17 @@ static void _init_runtime(auto_runtime_t* rt, int argc, char* argv[])
 {
     uv_loop_init(&rt->loop);
     uv_async_init(&rt->loop, &rt->notifier, _on_runtime_notify);
+    uv_timer_init(&rt->loop, &rt->timer.handle);
+    auto_timewheel_init(&rt->timer.wheel, uv_now(&rt->loop));
+    rt->stats.start_time = uv_hrtime();
+    rt->stats.query_time = rt->stats.start_time;
+    rt->timer.due = UINT64_MAX;
 
     ev_list_init(&rt->schedule.busy_queue);
     ev_list_init(&rt->schedule.wait_queue);
+    ev_list_init(&rt->pool.coroutine);
     ev_map_init(&rt->schedule.all_table, _on_cmp_thread, NULL);
+    auto_regex_cache_init(rt);
 
     int ret;
     if ((ret = atd_read_self_script(&rt->script.data, &rt->script.size)) != 0)
@@ -191,6 +355,14 @@ static void _init_runtime(auto_runtime_t* rt, int argc, char* argv[])
     {
         _init_parse_args(rt, argc, argv);
     }
+
+    if (rt->config.trace_file != NULL
+        && (ret = auto_trace_init(rt->config.trace_file)) != 0)
+    {
+        fprintf(stderr, "open trace file `%s` failed: %s(%d)\n", rt->config.trace_file,
+                auto_strerror(ret, rt->cache.errbuf, sizeof(rt->cache.errbuf)), ret);
+        exit(EXIT_FAILURE);
+    }
 }
 
 static void _runtime_exit(auto_runtime_t* rt)
@@ -200,8 +372,20 @@ static void _runtime_exit(auto_runtime_t* rt)
     /* Release all coroutine */
     _runtime_gc_release_coroutine(rt);
 
+    /* Release pooled coroutine context */
+    auto_list_node_t* it;
+    while ((it = ev_list_pop_front(&rt->pool.coroutine)) != NULL)
+    {
+        free(container_of(it, atd_coroutine_impl_t, q_node));
+    }
+    rt->pool.n_thread = 0;
+
+    /* Release cached regex */
+    auto_regex_cache_exit(rt);
+
     /* Close all handles */
     uv_close((uv_handle_t*)&rt->notifier, NULL);
+    uv_close((uv_handle_t*)&rt->timer.handle, NULL);
     uv_run(&rt->loop, UV_RUN_DEFAULT);
 
     if ((ret = uv_loop_close(&rt->loop)) != 0)
@@ -234,6 +418,14 @@ static void _runtime_exit(auto_runtime_t* rt)
         free(rt->config.script_name);
         rt->config.script_name = NULL;
     }
+
+    /* Write trace after all coroutines and handles are released. */
+    auto_trace_exit();
+    if (rt->config.trace_file != NULL)
+    {
+        free(rt->config.trace_file);
+        rt->config.trace_file = NULL;
+    }
 }
 
 static int _auto_runtime_gc(lua_State* L)
@@ -275,6 +467,132 @@ auto_runtime_t* auto_get_runtime(lua_State* L)
     return rt;
 }
 
+void auto_runtime_timer_start(auto_runtime_t* rt, auto_timewheel_node_t* node,
+    uint64_t timeout, auto_timewheel_fn fn)
+{
+    auto_timewheel_start(&rt->timer.wheel, node, uv_now(&rt->loop) + timeout, fn);
+    _runtime_timer_update(rt);
+}
+
+void auto_runtime_timer_stop(auto_runtime_t* rt, auto_timewheel_node_t* node)
+{
+    if (node->slot == NULL)
+    {
+        return;
+    }
+
+    auto_timewheel_stop(&rt->timer.wheel, node);
+    _runtime_timer_update(rt);
+}
+
+static void _on_coroutine_timeout(auto_timewheel_node_t* node)
+{
+    atd_coroutine_impl_t* impl = container_of(node, atd_coroutine_impl_t, timer);
+    impl->flags.timeout = 1;
+    api_coroutine.set_state(&impl->base, AUTO_COROUTINE_BUSY);
+}
+
+void auto_runtime_timeout_start(auto_coroutine_t* co, uint64_t timeout)
+{
+    atd_coroutine_impl_t* impl = container_of(co, atd_coroutine_impl_t, base);
+    impl->flags.timeout = 0;
+    auto_runtime_timer_start(impl->rt, &impl->timer, timeout, _on_coroutine_timeout);
+}
+
+int auto_runtime_timeout_expired(auto_coroutine_t* co)
+{
+    atd_coroutine_impl_t* impl = container_of(co, atd_coroutine_impl_t, base);
+    return impl->flags.timeout;
+}
+
+int auto_runtime_timeout_stop(auto_coroutine_t* co)
+{
+    atd_coroutine_impl_t* impl = container_of(co, atd_coroutine_impl_t, base);
+    auto_runtime_timer_stop(impl->rt, &impl->timer);
+
+    int expired = impl->flags.timeout;
+    impl->flags.timeout = 0;
+    return expired;
+}
+
+void auto_runtime_preempt(auto_coroutine_t* co, int count, uint64_t time)
+{
+    atd_coroutine_impl_t* impl = container_of(co, atd_coroutine_impl_t, base);
+    impl->preempt.time = time * 1000 * 1000;
+
+    if (count <= 0 && time == 0)
+    {
+        _runtime_preempt_clear(co->L);
+        return;
+    }
+
+    impl->preempt.since = uv_hrtime();
+    lua_sethook(co->L, _runtime_preempt_hook, LUA_MASKCOUNT,
+        time != 0 ? AUTO_RUNTIME_PREEMPT_CHECK : count);
+}
+
+const auto_coroutine_stats_t* auto_runtime_coroutine_stats(auto_coroutine_t* co)
+{
+    atd_coroutine_impl_t* impl = container_of(co, atd_coroutine_impl_t, base);
+    return &impl->stats;
+}
+
+lua_Integer auto_runtime_opt_timeout(lua_State* L, int idx)
+{
+    if (lua_isnoneornil(L, idx))
+    {
+        return -1;
+    }
+
+    lua_Integer timeout = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, timeout >= 0, idx, "timeout must not be negative");
+    return timeout;
+}
+
+atd_coroutine_impl_t* auto_runtime_coroutine_alloc(auto_runtime_t* rt)
+{
+    auto_list_node_t* it = ev_list_pop_front(&rt->pool.coroutine);
+    if (it != NULL)
+    {
+        return container_of(it, atd_coroutine_impl_t, q_node);
+    }
+    return malloc(sizeof(atd_coroutine_impl_t));
+}
+
+void auto_runtime_coroutine_close(auto_coroutine_t* co)
+{
+    atd_coroutine_impl_t* thr = container_of(co, atd_coroutine_impl_t, base);
+
+    api_coroutine.set_state(co, AUTO_COROUTINE_DEAD);
+    _thread_trigger_hook(thr);
+}
+
+void auto_runtime_coroutine_release(auto_runtime_t* rt, atd_coroutine_impl_t* thr)
+{
+    if (ev_list_size(&rt->pool.coroutine) < AUTO_RUNTIME_POOL_SIZE)
+    {
+        ev_list_push_front(&rt->pool.coroutine, &thr->q_node);
+        return;
+    }
+    free(thr);
+}
+
+lua_State* auto_runtime_new_thread(lua_State* L)
+{
+    auto_runtime_t* rt = auto_get_runtime(L);
+    if (rt->pool.n_thread == 0)
+    {
+        lua_State* co = lua_newthread(L);
+        _runtime_preempt_clear(co);
+        return co;
+    }
+
+    int ref = rt->pool.thread[--rt->pool.n_thread];
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    return lua_tothread(L, -1);
+}
+
 int auto_schedule(auto_runtime_t* rt, lua_State* L)
 {
     for (;;)
@@ -286,13 +604,27 @@ int auto_schedule(auto_runtime_t* rt, lua_State* L)
             break;
         }
 
+        /*
+         * Only block for events when no coroutine is busy. A blocking
+         * primitive must set its coroutine to wait state, otherwise the
+         * process spins here.
+         */
         uv_run_mode mode = UV_RUN_ONCE;
         if (ev_list_size(&rt->schedule.busy_queue) != 0)
         {
             mode = UV_RUN_NOWAIT;
+            rt->stats.busy_poll++;
         }
 
+        uint64_t beg = uv_hrtime();
         uv_run(&rt->loop, mode);
+        uint64_t cost = uv_hrtime() - beg;
+
+        rt->stats.poll_time += cost;
+        if (auto_trace_enabled)
+        {
+            auto_trace_record(0, "poll", beg, cost);
+        }
     }
 
     return 0;
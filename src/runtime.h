@@ -5,6 +5,7 @@
 #include "lua/api.h"
 #include "utils/list.h"
 #include "utils/map.h"
+#include "utils/timewheel.h"
 
 /**
  * @brief The period of check global looping flag.
@@ -12,13 +13,38 @@
  */
 #define AUTO_CHECK_PERIOD   100
 
+/**
+ * @brief The default number of compiled regex kept in regex cache.
+ */
+#define AUTO_REGEX_CACHE_SIZE   64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Max number of finished coroutines kept for reuse.
+ */
+#define AUTO_RUNTIME_POOL_SIZE  1024
+
+/**
+ * @brief Number of instructions between checks of time based preemption.
+ */
+#define AUTO_RUNTIME_PREEMPT_CHECK  1000
+
 struct atd_coroutine_impl;
 typedef struct atd_coroutine_impl atd_coroutine_impl_t;
 
+/**
+ * @brief Statistics of one coroutine.
+ */
+typedef struct auto_coroutine_stats
+{
+    uint64_t                resume;         /**< Number of times resumed */
+    uint64_t                time;           /**< Time spent in lua_resume(), in nanoseconds */
+    uint64_t                preempt;        /**< Number of times preempted */
+} auto_coroutine_stats_t;
+
 struct auto_coroutine_hook
 {
     auto_list_node_t         node;
@@ -44,6 +70,7 @@ typedef struct auto_runtime
         char*               script_file;    /**< Full path to run script */
         char*               script_path;    /**< Path to script without file name */
         char*               script_name;    /**< Script name without path */
+        char*               trace_file;     /**< Path to write trace, NULL if disabled */
     } config;
 
     struct
@@ -52,8 +79,48 @@ typedef struct auto_runtime
         auto_list_t         busy_queue;     /**< Coroutine that ready to schedule */
         auto_list_t         wait_queue;     /**< Coroutine that wait for some events */
         auto_list_node_t*   busy_iter;      /**< Iterator for busy_queue */
+        uint64_t            id_seq;         /**< Last coroutine id */
     } schedule;
 
+    struct
+    {
+        uint64_t            spurious_wakeup;    /**< Coroutine woken up but wait again without return */
+        uint64_t            busy_poll;          /**< Event loop polled without blocking, because of busy coroutine */
+        uint64_t            resume;             /**< Number of coroutine resumes */
+        uint64_t            resume_time;        /**< Time spent in lua_resume(), in nanoseconds */
+        uint64_t            poll_time;          /**< Time spent in uv_run(), in nanoseconds */
+        uint64_t            preempt;            /**< Number of preemptions */
+        uint64_t            loop_lag;           /**< How late last timer expires, in milliseconds */
+        uint64_t            loop_lag_max;       /**< Max value of loop_lag */
+        uint64_t            start_time;         /**< When runtime start, by uv_hrtime() */
+        uint64_t            query_time;         /**< When statistics last queried, by uv_hrtime() */
+        uint64_t            query_resume;       /**< Number of resumes when last queried */
+    } stats;
+
+    struct
+    {
+        uv_timer_t          handle;         /**< The only timer handle, expires at next tick of wheel */
+        auto_timewheel_t    wheel;          /**< All timers, one tick per millisecond */
+        uint64_t            due;            /**< When handle expires, UINT64_MAX if not active */
+    } timer;
+
+    struct
+    {
+        auto_list_t         coroutine;      /**< Released coroutine context for reuse */
+        int                 thread[AUTO_RUNTIME_POOL_SIZE]; /**< Registry reference of finished Lua thread for reuse */
+        size_t              n_thread;       /**< Number of pooled Lua threads */
+    } pool;
+
+    struct
+    {
+        auto_map_t          table;          /**< Cached regex, indexed by pattern */
+        auto_list_t         lru;            /**< Cached regex, most recently used at front */
+        size_t              capacity;       /**< Max number of cached regex */
+        struct lua_regex_cache_entry* borrowed; /**< Last borrowed regex, referenced by runtime */
+        uint64_t            hit;            /**< Cache hit counter */
+        uint64_t            miss;           /**< Cache miss counter */
+    } regex_cache;
+
     struct
     {
         char                errbuf[1024];
@@ -73,15 +140,35 @@ struct atd_coroutine_impl
         int                 ref_key;        /**< Reference key of coroutine in Lua VM */
     } data;
 
+    auto_timewheel_node_t   timer;          /**< Timer of sleep and wait timeout */
+
+    struct
+    {
+        uint64_t            time;           /**< Time budget in nanoseconds, 0 if count based */
+        uint64_t            since;          /**< When current time slice start */
+    } preempt;
+
+    auto_coroutine_stats_t  stats;          /**< Statistics */
+
+    struct
+    {
+        uint64_t            id;             /**< Unique id, as track in trace */
+        uint64_t            wait_since;     /**< When coroutine start waiting, 0 if not traced */
+        char                wait_name[32];  /**< What coroutine is waiting for */
+    } trace;
+
     struct
     {
         auto_list_t         queue;          /**< Schedule hook queue */
         auto_list_node_t*   it;             /**< Global iterator */
+        auto_coroutine_hook_t token[2];     /**< Inline tokens for first hooks, in use if `impl` is set */
     } hook;
 
     struct
     {
         unsigned            protect : 1;    /**< Run in protected mode */
+        unsigned            timeout : 1;    /**< Wait timeout expired */
+        unsigned            woken : 1;      /**< Moved from wait queue since last resume */
     } flags;
 };
 
@@ -95,6 +182,27 @@ AUTO_LOCAL int atd_init_runtime(lua_State* L, int argc, char* argv[]);
 
 AUTO_LOCAL auto_runtime_t* auto_get_runtime(lua_State* L);
 
+/**
+ * @brief Start timer in runtime timer wheel.
+ *
+ * Timers share one event loop handle, so start and stop a timer does not
+ * allocate anything.
+ *
+ * @param[in] rt        Global runtime.
+ * @param[in] node      Timer, restarted if active.
+ * @param[in] timeout   Timeout in milliseconds.
+ * @param[in] fn        Expire callback.
+ */
+AUTO_LOCAL void auto_runtime_timer_start(auto_runtime_t* rt, auto_timewheel_node_t* node,
+    uint64_t timeout, auto_timewheel_fn fn);
+
+/**
+ * @brief Stop timer. It is safe to stop an inactive timer.
+ * @param[in] rt    Global runtime.
+ * @param[in] node  Timer.
+ */
+AUTO_LOCAL void auto_runtime_timer_stop(auto_runtime_t* rt, auto_timewheel_node_t* node);
+
 /**
  * @brief Run scheduler.
  *
@@ -110,6 +218,104 @@ AUTO_LOCAL auto_runtime_t* auto_get_runtime(lua_State* L);
  */
 AUTO_LOCAL int auto_schedule(auto_runtime_t* rt, lua_State* L);
 
+/**
+ * @brief Get a coroutine context, reusing a released one if possible.
+ * @param[in] rt    Global runtime.
+ * @return          Coroutine context, not initialized.
+ */
+AUTO_LOCAL atd_coroutine_impl_t* auto_runtime_coroutine_alloc(auto_runtime_t* rt);
+
+/**
+ * @brief Release coroutine context that is not in any schedule queue.
+ * @param[in] rt    Global runtime.
+ * @param[in] thr   Coroutine context.
+ */
+AUTO_LOCAL void auto_runtime_coroutine_release(auto_runtime_t* rt, atd_coroutine_impl_t* thr);
+
+/**
+ * @brief Close coroutine that is not finished.
+ *
+ * The coroutine is set to dead state and all hooks run, just like it finish
+ * execution, so wait operations it is linked to are canceled. The context is
+ * reused once released, so a wait operation that keeps a coroutine must hook
+ * it and drop the reference when the coroutine is dead.
+ *
+ * @param[in] co    Managed coroutine.
+ */
+AUTO_LOCAL void auto_runtime_coroutine_close(auto_coroutine_t* co);
+
+/**
+ * @brief Push a Lua thread for new managed coroutine on top of stack.
+ *
+ * A thread of finished coroutine is reused if possible, so it works like
+ * `lua_newthread()` but is cheaper for short-lived coroutines.
+ *
+ * @param[in] L     Lua VM.
+ * @return          Lua thread.
+ */
+AUTO_LOCAL lua_State* auto_runtime_new_thread(lua_State* L);
+
+/**
+ * @brief Start wait timeout of coroutine.
+ *
+ * When timeout, the coroutine is set to busy state, and
+ * #auto_runtime_timeout_expired() return true. A coroutine only has one
+ * timeout, so wait operations use it for deadline and only one can be
+ * active at the same time.
+ *
+ * @param[in] co        Managed coroutine.
+ * @param[in] timeout   Timeout in milliseconds.
+ */
+AUTO_LOCAL void auto_runtime_timeout_start(auto_coroutine_t* co, uint64_t timeout);
+
+/**
+ * @brief Check whether wait timeout of coroutine expired.
+ * @param[in] co    Managed coroutine.
+ * @return          Boolean.
+ */
+AUTO_LOCAL int auto_runtime_timeout_expired(auto_coroutine_t* co);
+
+/**
+ * @brief Stop wait timeout of coroutine. It is safe to call if no timeout.
+ * @param[in] co    Managed coroutine.
+ * @return          Whether timeout expired.
+ */
+AUTO_LOCAL int auto_runtime_timeout_stop(auto_coroutine_t* co);
+
+/**
+ * @brief Let coroutine yield to scheduler after running for a budget.
+ *
+ * If a coroutine runs Lua code for a long time without yield, other
+ * coroutines and I/O callbacks are blocked. With budget set, the coroutine
+ * is forced to yield once it runs \p count instructions, or \p time
+ * milliseconds, and stays busy so it continues in next schedule pass.
+ *
+ * It uses Lua count hook, so coroutine is not preempted in code that cannot
+ * yield (e.g. metamethod called from C function), and it replaces hook set
+ * by `debug.sethook()`.
+ *
+ * @param[in] co    Managed coroutine.
+ * @param[in] count Instruction budget.
+ * @param[in] time  Time budget in milliseconds, \p count is ignored if non-zero.
+ *   If both are zero, preemption is disabled.
+ */
+AUTO_LOCAL void auto_runtime_preempt(auto_coroutine_t* co, int count, uint64_t time);
+
+/**
+ * @brief Get statistics of coroutine.
+ * @param[in] co    Managed coroutine.
+ * @return          Statistics, valid until coroutine is destroyed.
+ */
+AUTO_LOCAL const auto_coroutine_stats_t* auto_runtime_coroutine_stats(auto_coroutine_t* co);
+
+/**
+ * @brief Get optional timeout argument of wait operation.
+ * @param[in] L     Lua VM.
+ * @param[in] idx   Stack index.
+ * @return          Timeout in milliseconds, or -1 if \p idx is none or nil.
+ */
+AUTO_LOCAL lua_Integer auto_runtime_opt_timeout(lua_State* L, int idx);
+
 #ifdef __cplusplus
 }
 #endif
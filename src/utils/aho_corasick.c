@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include "aho_corasick.h"
+
+typedef struct auto_ac_key
+{
+    struct auto_ac_key*     next;       /**< Next keyword */
+    size_t                  id;         /**< Keyword id */
+    size_t                  size;       /**< Keyword size */
+    unsigned char*          data;       /**< Keyword bytes */
+} auto_ac_key_t;
+
+typedef struct auto_ac_output
+{
+    size_t                  id;         /**< Keyword id */
+    uint32_t                next;       /**< Next output of same state, 0 if none */
+} auto_ac_output_t;
+
+struct auto_ac_s
+{
+    struct
+    {
+        auto_ac_key_t*      head;       /**< Keywords, in reverse order */
+        size_t              count;      /**< Keyword count */
+        size_t              total;      /**< Sum of keyword size */
+    } keys;
+
+    /**
+     * @brief Byte to class map.
+     *
+     * Bytes not in any keyword share class 0, so the transition table only
+     * needs one column for them.
+     */
+    uint16_t                cls[256];
+    size_t                  cls_sz;     /**< Class count */
+
+    size_t                  state_sz;   /**< State count, state 0 is root */
+    uint32_t*               delta;      /**< Full transition table, state_sz * cls_sz */
+    uint32_t*               fail;       /**< Failure link */
+    uint32_t*               report;     /**< Nearest state (self or by failure link) that has output, 0 if none */
+    uint32_t*               out_head;   /**< First output of state, 0 if none */
+    auto_ac_output_t*       outputs;    /**< Outputs, index 0 is unused */
+};
+
+static void _ac_free_table(auto_ac_t* self)
+{
+    free(self->delta);
+    self->delta = NULL;
+    free(self->fail);
+    self->fail = NULL;
+    free(self->report);
+    self->report = NULL;
+    free(self->out_head);
+    self->out_head = NULL;
+    free(self->outputs);
+    self->outputs = NULL;
+}
+
+auto_ac_t* auto_ac_create(void)
+{
+    auto_ac_t* self = malloc(sizeof(auto_ac_t));
+    if (self == NULL)
+    {
+        return NULL;
+    }
+
+    memset(self, 0, sizeof(*self));
+    return self;
+}
+
+void auto_ac_destroy(auto_ac_t* self)
+{
+    auto_ac_key_t* key;
+    while ((key = self->keys.head) != NULL)
+    {
+        self->keys.head = key->next;
+        free(key);
+    }
+
+    _ac_free_table(self);
+    free(self);
+}
+
+int auto_ac_add(auto_ac_t* self, const void* key, size_t size, size_t id)
+{
+    if (size == 0 || self->delta != NULL)
+    {
+        return EINVAL;
+    }
+
+    auto_ac_key_t* rec = malloc(sizeof(auto_ac_key_t) + size);
+    if (rec == NULL)
+    {
+        return ENOMEM;
+    }
+
+    rec->id = id;
+    rec->size = size;
+    rec->data = (unsigned char*)(rec + 1);
+    memcpy(rec->data, key, size);
+
+    rec->next = self->keys.head;
+    self->keys.head = rec;
+    self->keys.count++;
+    self->keys.total += size;
+
+    return 0;
+}
+
+static void _ac_build_class(auto_ac_t* self)
+{
+    memset(self->cls, 0, sizeof(self->cls));
+    self->cls_sz = 1;
+
+    auto_ac_key_t* key;
+    for (key = self->keys.head; key != NULL; key = key->next)
+    {
+        size_t i;
+        for (i = 0; i < key->size; i++)
+        {
+            if (self->cls[key->data[i]] == 0)
+            {
+                self->cls[key->data[i]] = (uint16_t)self->cls_sz++;
+            }
+        }
+    }
+}
+
+static void _ac_build_trie(auto_ac_t* self)
+{
+    self->state_sz = 1;
+
+    uint32_t out_idx = 1;
+    auto_ac_key_t* key;
+    for (key = self->keys.head; key != NULL; key = key->next)
+    {
+        uint32_t state = 0;
+
+        size_t i;
+        for (i = 0; i < key->size; i++)
+        {
+            uint32_t* next = &self->delta[state * self->cls_sz + self->cls[key->data[i]]];
+            if (*next == 0)
+            {
+                *next = (uint32_t)self->state_sz++;
+            }
+            state = *next;
+        }
+
+        self->outputs[out_idx].id = key->id;
+        self->outputs[out_idx].next = self->out_head[state];
+        self->out_head[state] = out_idx++;
+    }
+}
+
+/**
+ * @brief Compute failure links in BFS order and fill missing transitions,
+ *   so scanning never follow failure links.
+ */
+static int _ac_build_fail(auto_ac_t* self)
+{
+    uint32_t* queue = malloc(sizeof(uint32_t) * self->state_sz);
+    if (queue == NULL)
+    {
+        return ENOMEM;
+    }
+
+    size_t q_beg = 0, q_end = 0;
+    queue[q_end++] = 0;
+
+    while (q_beg < q_end)
+    {
+        uint32_t state = queue[q_beg++];
+        uint32_t* row = &self->delta[state * self->cls_sz];
+        const uint32_t* fail_row = &self->delta[self->fail[state] * self->cls_sz];
+
+        size_t c;
+        for (c = 0; c < self->cls_sz; c++)
+        {
+            /* Row of current state only contains trie edges at this point. */
+            if (row[c] == 0)
+            {
+                row[c] = state == 0 ? 0 : fail_row[c];
+                continue;
+            }
+
+            uint32_t child = row[c];
+            uint32_t fail = state == 0 ? 0 : fail_row[c];
+            self->fail[child] = fail;
+            self->report[child] = self->out_head[child] != 0 ? child : self->report[fail];
+            queue[q_end++] = child;
+        }
+    }
+
+    free(queue);
+    return 0;
+}
+
+int auto_ac_compile(auto_ac_t* self)
+{
+    if (self->delta != NULL)
+    {
+        return EINVAL;
+    }
+
+    _ac_build_class(self);
+
+    /* Upper bound of state count. */
+    size_t max_state = self->keys.total + 1;
+    if (max_state > UINT32_MAX)
+    {
+        return E2BIG;
+    }
+
+    self->delta = calloc(max_state * self->cls_sz, sizeof(uint32_t));
+    self->fail = calloc(max_state, sizeof(uint32_t));
+    self->report = calloc(max_state, sizeof(uint32_t));
+    self->out_head = calloc(max_state, sizeof(uint32_t));
+    self->outputs = calloc(self->keys.count + 1, sizeof(auto_ac_output_t));
+    if (self->delta == NULL || self->fail == NULL || self->report == NULL
+        || self->out_head == NULL || self->outputs == NULL)
+    {
+        goto error;
+    }
+
+    _ac_build_trie(self);
+    if (_ac_build_fail(self) != 0)
+    {
+        goto error;
+    }
+
+    return 0;
+
+error:
+    _ac_free_table(self);
+    return ENOMEM;
+}
+
+int auto_ac_scan(const auto_ac_t* self, const void* data, size_t size,
+    auto_ac_cb cb, void* arg)
+{
+    const unsigned char* p = data;
+    const uint32_t* delta = self->delta;
+    const size_t cls_sz = self->cls_sz;
+
+    if (delta == NULL)
+    {
+        return 0;
+    }
+
+    uint32_t state = 0;
+    size_t i;
+    for (i = 0; i < size; i++)
+    {
+        state = delta[state * cls_sz + self->cls[p[i]]];
+
+        uint32_t hit;
+        for (hit = self->report[state]; hit != 0; hit = self->report[self->fail[hit]])
+        {
+            uint32_t out;
+            for (out = self->out_head[hit]; out != 0; out = self->outputs[out].next)
+            {
+                int ret = cb(self->outputs[out].id, i + 1, arg);
+                if (ret != 0)
+                {
+                    return ret;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef __AUTO_UTILS_AHO_CORASICK_H__
+#define __AUTO_UTILS_AHO_CORASICK_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct auto_ac_s;
+typedef struct auto_ac_s auto_ac_t;
+
+/**
+ * @brief Keyword hit callback.
+ * @param[in] id    Keyword id passed to #auto_ac_add().
+ * @param[in] pos   Position just after the keyword in data.
+ * @param[in] arg   User defined argument.
+ * @return          0 to continue, non-zero to stop scan.
+ */
+typedef int (*auto_ac_cb)(size_t id, size_t pos, void* arg);
+
+/**
+ * @brief Create an empty Aho-Corasick automaton.
+ * @return          Automaton, or NULL if out of memory.
+ */
+auto_ac_t* auto_ac_create(void);
+
+/**
+ * @brief Destroy automaton.
+ * @param[in] self  Automaton.
+ */
+void auto_ac_destroy(auto_ac_t* self);
+
+/**
+ * @brief Add keyword. Must be called before #auto_ac_compile().
+ * @param[in] self  Automaton.
+ * @param[in] key   Keyword, must not be empty.
+ * @param[in] size  Keyword size in bytes.
+ * @param[in] id    Keyword id, report in #auto_ac_cb.
+ * @return          Errno.
+ */
+int auto_ac_add(auto_ac_t* self, const void* key, size_t size, size_t id);
+
+/**
+ * @brief Build the automaton. No keyword can be added after compile.
+ * @param[in] self  Automaton.
+ * @return          Errno.
+ */
+int auto_ac_compile(auto_ac_t* self);
+
+/**
+ * @brief Report every keyword occurrence in \p data in one pass.
+ * @param[in] self  Compiled automaton.
+ * @param[in] data  Data to scan.
+ * @param[in] size  Data size in bytes.
+ * @param[in] cb    Hit callback.
+ * @param[in] arg   User defined argument.
+ * @return          0 if scan finish, otherwise the non-zero value of \p cb.
+ */
+int auto_ac_scan(const auto_ac_t* self, const void* data, size_t size,
+    auto_ac_cb cb, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
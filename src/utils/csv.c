@@ -0,0 +1,551 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include "csv.h"
+#include "mmap.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define AUTO_CSV_SSE2
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#   endif
+#endif
+
+/**
+ * @brief Initial buffer size for chunked input.
+ */
+#define AUTO_CSV_CHUNK_SIZE     (64 * 1024)
+
+/**
+ * @brief Field offset that is not in scratch buffer.
+ */
+#define AUTO_CSV_NOT_SCRATCH    ((size_t)-1)
+
+struct auto_csv_s
+{
+    char                    delimiter;  /**< Field delimiter */
+    int                     bom_checked;/**< Whether UTF-8 BOM is checked */
+
+    struct
+    {
+        const char*         data;       /**< Data to parse */
+        size_t              size;       /**< Data size */
+        size_t              pos;        /**< Parse position */
+        int                 eof;        /**< No more data after #auto_csv_s::input::size */
+    } input;
+
+    struct
+    {
+        auto_csv_read_fn    fn;         /**< Read callback, NULL if not chunked */
+        void*               arg;        /**< Read callback argument */
+        char*               data;       /**< Chunk buffer */
+        size_t              capacity;   /**< Chunk buffer capacity */
+    } chunk;
+
+    auto_mmap_t             mmap;       /**< File mapping */
+    FILE*                   file;       /**< File if mapping failed */
+
+    struct
+    {
+        auto_csv_field_t*   data;       /**< Fields of current row */
+        size_t*             scratch_off;/**< Offset in scratch buffer, or #AUTO_CSV_NOT_SCRATCH */
+        size_t              size;       /**< Field count */
+        size_t              capacity;   /**< Field capacity */
+    } fields;
+
+    struct
+    {
+        char*               data;       /**< Unescaped quoted fields */
+        size_t              size;       /**< Used size */
+        size_t              capacity;   /**< Capacity */
+    } scratch;
+};
+
+#if defined(AUTO_CSV_SSE2)
+static unsigned _csv_ctz(unsigned mask)
+{
+#   if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (unsigned)idx;
+#   else
+    return (unsigned)__builtin_ctz(mask);
+#   endif
+}
+#endif
+
+/**
+ * @brief Find first delimiter, CR or LF.
+ * @return  Position of the byte, or \p end if not found.
+ */
+static const char* _csv_scan(const char* p, const char* end, char delimiter)
+{
+#if defined(AUTO_CSV_SSE2)
+    const __m128i v_delim = _mm_set1_epi8(delimiter);
+    const __m128i v_lf = _mm_set1_epi8('\n');
+    const __m128i v_cr = _mm_set1_epi8('\r');
+
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, v_delim),
+            _mm_or_si128(_mm_cmpeq_epi8(v, v_lf), _mm_cmpeq_epi8(v, v_cr)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(m);
+        if (mask != 0)
+        {
+            return p + _csv_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+
+    for (; p < end; p++)
+    {
+        if (*p == delimiter || *p == '\n' || *p == '\r')
+        {
+            return p;
+        }
+    }
+    return end;
+}
+
+static int _csv_scratch_append(auto_csv_t* self, const char* data, size_t size)
+{
+    /* Always allocate so that empty field has valid address. */
+    if (self->scratch.data == NULL || self->scratch.size + size > self->scratch.capacity)
+    {
+        size_t new_capacity = self->scratch.capacity * 2;
+        if (new_capacity < self->scratch.size + size)
+        {
+            new_capacity = self->scratch.size + size + 64;
+        }
+        char* new_data = realloc(self->scratch.data, new_capacity);
+        if (new_data == NULL)
+        {
+            return ENOMEM;
+        }
+        self->scratch.data = new_data;
+        self->scratch.capacity = new_capacity;
+    }
+
+    memcpy(self->scratch.data + self->scratch.size, data, size);
+    self->scratch.size += size;
+    return 0;
+}
+
+static int _csv_push_field(auto_csv_t* self, const char* data, size_t size, size_t scratch_off)
+{
+    if (self->fields.size == self->fields.capacity)
+    {
+        size_t new_capacity = self->fields.capacity == 0 ? 16 : self->fields.capacity * 2;
+        auto_csv_field_t* new_data = realloc(self->fields.data,
+            sizeof(auto_csv_field_t) * new_capacity);
+        if (new_data == NULL)
+        {
+            return ENOMEM;
+        }
+        self->fields.data = new_data;
+
+        size_t* new_off = realloc(self->fields.scratch_off, sizeof(size_t) * new_capacity);
+        if (new_off == NULL)
+        {
+            return ENOMEM;
+        }
+        self->fields.scratch_off = new_off;
+        self->fields.capacity = new_capacity;
+    }
+
+    self->fields.data[self->fields.size].data = data;
+    self->fields.data[self->fields.size].size = size;
+    self->fields.scratch_off[self->fields.size] = scratch_off;
+    self->fields.size++;
+    return 0;
+}
+
+/**
+ * @brief Move the last field into scratch buffer so more data can be appended.
+ */
+static int _csv_field_to_scratch(auto_csv_t* self, size_t idx)
+{
+    if (self->fields.scratch_off[idx] != AUTO_CSV_NOT_SCRATCH)
+    {
+        return 0;
+    }
+
+    size_t off = self->scratch.size;
+    int ret = _csv_scratch_append(self, self->fields.data[idx].data,
+        self->fields.data[idx].size);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    self->fields.scratch_off[idx] = off;
+    return 0;
+}
+
+/**
+ * @brief Parse quoted field starting after the opening quote.
+ * @param[in,out] pp    Parse position, updated to the byte after the closing quote.
+ * @return              0 if success, -1 if need more data, or errno.
+ */
+static int _csv_parse_quoted(auto_csv_t* self, const char** pp, const char* end)
+{
+    const char* seg = *pp;
+    const char* p = seg;
+    size_t scratch_off = AUTO_CSV_NOT_SCRATCH;
+    int ret;
+
+    for (;;)
+    {
+        const char* quote = memchr(p, '"', end - p);
+        if (quote == NULL || (quote + 1 == end && !self->input.eof))
+        {
+            if (!self->input.eof)
+            {
+                return -1;
+            }
+            /* Unterminated quote, take the rest of input. */
+            quote = end;
+        }
+        else if (quote + 1 < end && quote[1] == '"')
+        {
+            /* Escaped quote, keep one of them. */
+            if (scratch_off == AUTO_CSV_NOT_SCRATCH)
+            {
+                scratch_off = self->scratch.size;
+            }
+            if ((ret = _csv_scratch_append(self, seg, quote + 1 - seg)) != 0)
+            {
+                return ret;
+            }
+            p = seg = quote + 2;
+            continue;
+        }
+
+        if (scratch_off == AUTO_CSV_NOT_SCRATCH)
+        {
+            ret = _csv_push_field(self, seg, quote - seg, AUTO_CSV_NOT_SCRATCH);
+        }
+        else if ((ret = _csv_scratch_append(self, seg, quote - seg)) == 0)
+        {
+            ret = _csv_push_field(self, NULL, self->scratch.size - scratch_off, scratch_off);
+        }
+        *pp = quote < end ? quote + 1 : end;
+        return ret;
+    }
+}
+
+/**
+ * @brief Parse one row at current position.
+ * @param[out] consumed Bytes consumed by the row, including line ending.
+ * @return              0 if success, -1 if need more data, or errno.
+ */
+static int _csv_parse_row(auto_csv_t* self, size_t* consumed)
+{
+    const char* beg = self->input.data + self->input.pos;
+    const char* end = self->input.data + self->input.size;
+    const char* p = beg;
+    const char delimiter = self->delimiter;
+    int ret;
+
+    self->fields.size = 0;
+    self->scratch.size = 0;
+
+    for (;;)
+    {
+        if (p < end && *p == '"')
+        {
+            p++;
+            if ((ret = _csv_parse_quoted(self, &p, end)) != 0)
+            {
+                return ret;
+            }
+
+            /* Text after closing quote is appended as is. */
+            const char* s = _csv_scan(p, end, delimiter);
+            if (s == end && !self->input.eof)
+            {
+                return -1;
+            }
+            if (s != p)
+            {
+                size_t idx = self->fields.size - 1;
+                if ((ret = _csv_field_to_scratch(self, idx)) != 0
+                    || (ret = _csv_scratch_append(self, p, s - p)) != 0)
+                {
+                    return ret;
+                }
+                self->fields.data[idx].size += s - p;
+            }
+            p = s;
+        }
+        else
+        {
+            const char* s = _csv_scan(p, end, delimiter);
+            if (s == end && !self->input.eof)
+            {
+                return -1;
+            }
+            if ((ret = _csv_push_field(self, p, s - p, AUTO_CSV_NOT_SCRATCH)) != 0)
+            {
+                return ret;
+            }
+            p = s;
+        }
+
+        if (p == end)
+        {
+            break;
+        }
+        if (*p == delimiter)
+        {
+            p++;
+            continue;
+        }
+        if (*p == '\r')
+        {
+            if (p + 1 == end && !self->input.eof)
+            {
+                return -1;
+            }
+            p++;
+            if (p < end && *p == '\n')
+            {
+                p++;
+            }
+            break;
+        }
+        /* LF */
+        p++;
+        break;
+    }
+
+    *consumed = p - beg;
+    return 0;
+}
+
+/**
+ * @brief Read more data for chunked input.
+ * @return  0 if success, or errno.
+ */
+static int _csv_fill(auto_csv_t* self)
+{
+    size_t remain = self->input.size - self->input.pos;
+
+    /* A row larger than buffer, grow it. */
+    if (self->input.pos == 0 && remain == self->chunk.capacity)
+    {
+        size_t new_capacity = self->chunk.capacity * 2;
+        char* new_data = realloc(self->chunk.data, new_capacity);
+        if (new_data == NULL)
+        {
+            return ENOMEM;
+        }
+        self->chunk.data = new_data;
+        self->chunk.capacity = new_capacity;
+    }
+    else if (self->input.pos != 0)
+    {
+        memmove(self->chunk.data, self->chunk.data + self->input.pos, remain);
+    }
+
+    size_t read_sz = self->chunk.fn(self->chunk.data + remain,
+        self->chunk.capacity - remain, self->chunk.arg);
+
+    self->input.data = self->chunk.data;
+    self->input.size = remain + read_sz;
+    self->input.pos = 0;
+    self->input.eof = read_sz == 0;
+    return 0;
+}
+
+static auto_csv_t* _csv_create(char delimiter)
+{
+    auto_csv_t* self = calloc(1, sizeof(auto_csv_t));
+    if (self == NULL)
+    {
+        return NULL;
+    }
+    self->delimiter = delimiter;
+    return self;
+}
+
+static size_t _csv_file_read(void* buf, size_t size, void* arg)
+{
+    return fread(buf, 1, size, (FILE*)arg);
+}
+
+auto_csv_t* auto_csv_open_memory(const char* data, size_t size, char delimiter)
+{
+    auto_csv_t* self = _csv_create(delimiter);
+    if (self == NULL)
+    {
+        return NULL;
+    }
+
+    self->input.data = data;
+    self->input.size = size;
+    self->input.eof = 1;
+    return self;
+}
+
+auto_csv_t* auto_csv_open_reader(auto_csv_read_fn fn, void* arg, char delimiter)
+{
+    auto_csv_t* self = _csv_create(delimiter);
+    if (self == NULL)
+    {
+        return NULL;
+    }
+
+    if ((self->chunk.data = malloc(AUTO_CSV_CHUNK_SIZE)) == NULL)
+    {
+        free(self);
+        return NULL;
+    }
+    self->chunk.fn = fn;
+    self->chunk.arg = arg;
+    self->chunk.capacity = AUTO_CSV_CHUNK_SIZE;
+    return self;
+}
+
+auto_csv_t* auto_csv_open_file(const char* path, char delimiter, int* errcode)
+{
+    auto_csv_t* self;
+    auto_mmap_t mapping;
+
+    /* Not mappable (pipe, device, ...) or empty, read it as stream. */
+    if ((*errcode = auto_mmap_open(&mapping, path)) == 0 && mapping.size != 0)
+    {
+        if ((self = auto_csv_open_memory(mapping.data, mapping.size, delimiter)) == NULL)
+        {
+            auto_mmap_close(&mapping);
+            *errcode = ENOMEM;
+            return NULL;
+        }
+        self->mmap = mapping;
+        return self;
+    }
+
+    FILE* file;
+#if defined(_MSC_VER)
+    *errcode = fopen_s(&file, path, "rb");
+#else
+    file = fopen(path, "rb");
+    *errcode = errno;
+#endif
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    if ((self = auto_csv_open_reader(_csv_file_read, file, delimiter)) == NULL)
+    {
+        fclose(file);
+        *errcode = ENOMEM;
+        return NULL;
+    }
+    self->file = file;
+
+    *errcode = 0;
+    return self;
+}
+
+void auto_csv_close(auto_csv_t* self)
+{
+    auto_mmap_close(&self->mmap);
+    if (self->file != NULL)
+    {
+        fclose(self->file);
+        self->file = NULL;
+    }
+    free(self->chunk.data);
+    free(self->fields.data);
+    free(self->fields.scratch_off);
+    free(self->scratch.data);
+    free(self);
+}
+
+int auto_csv_next(auto_csv_t* self, const auto_csv_field_t** fields)
+{
+    int ret;
+    size_t consumed;
+
+    for (;;)
+    {
+        if (self->input.pos == self->input.size)
+        {
+            if (self->input.eof || self->chunk.fn == NULL)
+            {
+                return 0;
+            }
+            if ((ret = _csv_fill(self)) != 0)
+            {
+                return -ret;
+            }
+            continue;
+        }
+
+        if (!self->bom_checked)
+        {
+            if (self->input.size - self->input.pos < 3 && !self->input.eof
+                && self->chunk.fn != NULL)
+            {
+                if ((ret = _csv_fill(self)) != 0)
+                {
+                    return -ret;
+                }
+                continue;
+            }
+            if (self->input.size - self->input.pos >= 3
+                && memcmp(self->input.data + self->input.pos, "\xEF\xBB\xBF", 3) == 0)
+            {
+                self->input.pos += 3;
+            }
+            self->bom_checked = 1;
+            continue;
+        }
+
+        if ((ret = _csv_parse_row(self, &consumed)) < 0)
+        {
+            if (self->chunk.fn == NULL)
+            {
+                /* Never happen: memory input is always at eof. */
+                return -EINVAL;
+            }
+            if ((ret = _csv_fill(self)) != 0)
+            {
+                return -ret;
+            }
+            continue;
+        }
+        if (ret != 0)
+        {
+            return -ret;
+        }
+
+        const char* row = self->input.data + self->input.pos;
+        self->input.pos += consumed;
+
+        /* Skip empty line. */
+        if (self->fields.size == 1 && self->fields.data[0].size == 0 && *row != '"')
+        {
+            continue;
+        }
+        break;
+    }
+
+    /* Scratch buffer does not move any more, fix field address. */
+    size_t i;
+    for (i = 0; i < self->fields.size; i++)
+    {
+        if (self->fields.scratch_off[i] != AUTO_CSV_NOT_SCRATCH)
+        {
+            self->fields.data[i].data = self->scratch.data + self->fields.scratch_off[i];
+        }
+    }
+
+    *fields = self->fields.data;
+    return (int)self->fields.size;
+}
@@ -0,0 +1,82 @@
+#ifndef __AUTO_UTILS_CSV_H__
+#define __AUTO_UTILS_CSV_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct auto_csv_s;
+typedef struct auto_csv_s auto_csv_t;
+
+/**
+ * @brief CSV field.
+ */
+typedef struct auto_csv_field
+{
+    const char* data;   /**< Field content, not NUL terminated */
+    size_t      size;   /**< Field size in bytes */
+} auto_csv_field_t;
+
+/**
+ * @brief Read more data for chunked input.
+ * @param[out] buf  Buffer to fill.
+ * @param[in] size  Buffer size.
+ * @param[in] arg   User defined argument.
+ * @return          Number of bytes read, 0 if end of input.
+ */
+typedef size_t (*auto_csv_read_fn)(void* buf, size_t size, void* arg);
+
+/**
+ * @brief Parse CSV in memory. The data is not copied, so it must be valid
+ *   until the reader is closed.
+ * @param[in] data      CSV content.
+ * @param[in] size      Content size.
+ * @param[in] delimiter Field delimiter.
+ * @return              Reader, or NULL if out of memory.
+ */
+auto_csv_t* auto_csv_open_memory(const char* data, size_t size, char delimiter);
+
+/**
+ * @brief Parse CSV file. The file is mapped into memory if possible,
+ *   otherwise it is read in chunks.
+ * @param[in] path      File path.
+ * @param[in] delimiter Field delimiter.
+ * @param[out] errcode  Errno if failed.
+ * @return              Reader, or NULL if failed.
+ */
+auto_csv_t* auto_csv_open_file(const char* path, char delimiter, int* errcode);
+
+/**
+ * @brief Parse CSV from chunked input.
+ * @param[in] fn        Read callback.
+ * @param[in] arg       User defined argument passed to \p fn.
+ * @param[in] delimiter Field delimiter.
+ * @return              Reader, or NULL if out of memory.
+ */
+auto_csv_t* auto_csv_open_reader(auto_csv_read_fn fn, void* arg, char delimiter);
+
+/**
+ * @brief Close reader.
+ * @param[in] self  Reader.
+ */
+void auto_csv_close(auto_csv_t* self);
+
+/**
+ * @brief Read next row.
+ *
+ * Quoted fields are unescaped. Empty lines are skipped. A leading UTF-8 BOM
+ * is ignored.
+ *
+ * @param[in] self      Reader.
+ * @param[out] fields   Fields of row, valid until next call.
+ * @return              Number of fields, 0 if end of input, or negative errno.
+ */
+int auto_csv_next(auto_csv_t* self, const auto_csv_field_t** fields);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
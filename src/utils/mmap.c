@@ -0,0 +1,159 @@
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "mmap.h"
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+int auto_mmap_open(auto_mmap_t* self, const char* path)
+{
+    memset(self, 0, sizeof(*self));
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EACCES;
+    }
+    if (GetFileType(file) != FILE_TYPE_DISK)
+    {
+        CloseHandle(file);
+        return ENODEV;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        CloseHandle(file);
+        return EIO;
+    }
+    if ((unsigned long long)file_size.QuadPart > SIZE_MAX)
+    {
+        CloseHandle(file);
+        return EFBIG;
+    }
+    if (file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return 0;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return ENOMEM;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return ENOMEM;
+    }
+
+    self->data = data;
+    self->size = (size_t)file_size.QuadPart;
+    self->file = file;
+    self->mapping = mapping;
+
+    return 0;
+}
+
+void auto_mmap_close(auto_mmap_t* self)
+{
+    if (self->data != NULL)
+    {
+        UnmapViewOfFile(self->data);
+        self->data = NULL;
+    }
+    if (self->mapping != NULL)
+    {
+        CloseHandle(self->mapping);
+        self->mapping = NULL;
+    }
+    if (self->file != NULL)
+    {
+        CloseHandle(self->file);
+        self->file = NULL;
+    }
+    self->size = 0;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int auto_mmap_open(auto_mmap_t* self, const char* path)
+{
+    memset(self, 0, sizeof(*self));
+
+    /* Opening a FIFO waits for writer and closing it loses data, so only open regular file. */
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return errno;
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        return ENODEV;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return errno;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        int errcode = errno;
+        close(fd);
+        return errcode;
+    }
+    if ((uint64_t)st.st_size > SIZE_MAX)
+    {
+        close(fd);
+        return EFBIG;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int errcode = errno;
+
+    /* Mapping is still valid after close. */
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return errcode;
+    }
+    posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    self->data = data;
+    self->size = (size_t)st.st_size;
+
+    return 0;
+}
+
+void auto_mmap_close(auto_mmap_t* self)
+{
+    if (self->data != NULL)
+    {
+        munmap((void*)self->data, self->size);
+        self->data = NULL;
+    }
+    self->size = 0;
+}
+
+#endif
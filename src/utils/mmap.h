@@ -0,0 +1,45 @@
+#ifndef __AUTO_UTILS_MMAP_H__
+#define __AUTO_UTILS_MMAP_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Read-only file mapping.
+ */
+typedef struct auto_mmap
+{
+    const char* data;       /**< File content, NULL if file is empty */
+    size_t      size;       /**< File size */
+
+#if defined(_WIN32)
+    void*       file;       /**< File handle */
+    void*       mapping;    /**< File mapping handle */
+#endif
+} auto_mmap_t;
+
+/**
+ * @brief Map whole file into memory for sequential read.
+ *
+ * Empty file gives an empty mapping.
+ * @param[out] self Mapping.
+ * @param[in] path  File path.
+ * @return          Errno. ENODEV if \p path is not a regular file (e.g. a
+ *   pipe), which is left unopened on POSIX.
+ */
+int auto_mmap_open(auto_mmap_t* self, const char* path);
+
+/**
+ * @brief Unmap file. It is safe to close a mapping twice.
+ * @param[in] self  Mapping.
+ */
+void auto_mmap_close(auto_mmap_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
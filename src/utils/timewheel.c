@@ -0,0 +1,201 @@
+#include <string.h>
+#include "timewheel.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define AUTO_TIMEWHEEL_MASK     (AUTO_TIMEWHEEL_SLOTS - 1)
+
+/**
+ * @brief The max distance to current tick.
+ */
+#define AUTO_TIMEWHEEL_MAX      ((UINT64_C(1) << (AUTO_TIMEWHEEL_BITS * AUTO_TIMEWHEEL_LEVELS)) - 1)
+
+static unsigned _timewheel_ctz(uint64_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return (unsigned)idx;
+#else
+    return (unsigned)__builtin_ctzll(mask);
+#endif
+}
+
+static unsigned _timewheel_slot_index(uint64_t tick, unsigned level)
+{
+    return (unsigned)(tick >> (level * AUTO_TIMEWHEEL_BITS)) & AUTO_TIMEWHEEL_MASK;
+}
+
+static void _timewheel_insert(auto_timewheel_t* self, auto_timewheel_node_t* node)
+{
+    if (node->expire < self->now)
+    {
+        node->expire = self->now;
+    }
+    else if (node->expire - self->now > AUTO_TIMEWHEEL_MAX)
+    {
+        node->expire = self->now + AUTO_TIMEWHEEL_MAX;
+    }
+
+    /* Find the lowest level that the whole distance fits in. */
+    uint64_t delta = node->expire - self->now;
+    unsigned level = 0;
+    while (level < AUTO_TIMEWHEEL_LEVELS - 1 && (delta >> ((level + 1) * AUTO_TIMEWHEEL_BITS)) != 0)
+    {
+        level++;
+    }
+
+    unsigned idx = _timewheel_slot_index(node->expire, level);
+    node->slot = &self->slots[level][idx];
+    ev_list_push_back(node->slot, &node->node);
+    self->bitmap[level] |= UINT64_C(1) << idx;
+}
+
+static void _timewheel_remove(auto_timewheel_t* self, auto_timewheel_node_t* node)
+{
+    auto_list_t* slot = node->slot;
+    ev_list_erase(slot, &node->node);
+    node->slot = NULL;
+
+    if (ev_list_size(slot) == 0)
+    {
+        size_t pos = (size_t)(slot - &self->slots[0][0]);
+        self->bitmap[pos / AUTO_TIMEWHEEL_SLOTS] &= ~(UINT64_C(1) << (pos % AUTO_TIMEWHEEL_SLOTS));
+    }
+}
+
+/**
+ * @brief Move timers of current round in \p level to lower levels.
+ */
+static void _timewheel_cascade(auto_timewheel_t* self, unsigned level)
+{
+    unsigned idx = _timewheel_slot_index(self->now, level);
+    auto_list_t* slot = &self->slots[level][idx];
+
+    auto_list_node_t* it;
+    while ((it = ev_list_begin(slot)) != NULL)
+    {
+        auto_timewheel_node_t* node = container_of(it, auto_timewheel_node_t, node);
+        _timewheel_remove(self, node);
+        _timewheel_insert(self, node);
+    }
+}
+
+void auto_timewheel_init(auto_timewheel_t* self, uint64_t now)
+{
+    memset(self, 0, sizeof(*self));
+    self->now = now;
+}
+
+void auto_timewheel_start(auto_timewheel_t* self, auto_timewheel_node_t* node,
+    uint64_t expire, auto_timewheel_fn fn)
+{
+    auto_timewheel_stop(self, node);
+
+    node->expire = expire;
+    node->fn = fn;
+    _timewheel_insert(self, node);
+    self->size++;
+}
+
+void auto_timewheel_stop(auto_timewheel_t* self, auto_timewheel_node_t* node)
+{
+    if (node->slot == NULL)
+    {
+        return;
+    }
+
+    _timewheel_remove(self, node);
+    self->size--;
+}
+
+void auto_timewheel_process(auto_timewheel_t* self, uint64_t now)
+{
+    while (self->size != 0 && self->now <= now)
+    {
+        unsigned level;
+        for (level = 1; level < AUTO_TIMEWHEEL_LEVELS; level++)
+        {
+            if (_timewheel_slot_index(self->now, level - 1) != 0)
+            {
+                break;
+            }
+            _timewheel_cascade(self, level);
+        }
+
+        /*
+         * Timers started by callbacks must not join the slot being processed,
+         * so move current tick forward first.
+         */
+        auto_list_t* slot = &self->slots[0][_timewheel_slot_index(self->now, 0)];
+        self->now++;
+
+        auto_list_node_t* it;
+        while ((it = ev_list_begin(slot)) != NULL)
+        {
+            auto_timewheel_node_t* node = container_of(it, auto_timewheel_node_t, node);
+            auto_timewheel_stop(self, node);
+            node->fn(node);
+        }
+
+        /* Skip ticks that have nothing to do. */
+        uint64_t next = auto_timewheel_next(self);
+        if (next != 0)
+        {
+            self->now += next < now - self->now + 1 ? next : now - self->now + 1;
+        }
+    }
+
+    if (self->now <= now)
+    {
+        self->now = now + 1;
+    }
+}
+
+uint64_t auto_timewheel_next(const auto_timewheel_t* self)
+{
+    if (self->size == 0)
+    {
+        return UINT64_MAX;
+    }
+
+    uint64_t ret = UINT64_MAX;
+
+    unsigned level;
+    for (level = 0; level < AUTO_TIMEWHEEL_LEVELS; level++)
+    {
+        if (self->bitmap[level] == 0)
+        {
+            continue;
+        }
+
+        /*
+         * Slot of current round in upper level is already moved down unless
+         * the round starts at current tick.
+         */
+        unsigned shift = level * AUTO_TIMEWHEEL_BITS;
+        unsigned idx = _timewheel_slot_index(self->now, level);
+        uint64_t round_start = self->now >> shift << shift;
+        if (level != 0 && round_start != self->now)
+        {
+            idx++;
+        }
+
+        /* Rotate so the bit of \p idx is bit 0. */
+        idx &= AUTO_TIMEWHEEL_MASK;
+        uint64_t mask = self->bitmap[level];
+        mask = idx == 0 ? mask : (mask >> idx) | (mask << (AUTO_TIMEWHEEL_SLOTS - idx));
+
+        uint64_t dist = _timewheel_ctz(mask) + (level != 0 && round_start != self->now ? 1 : 0);
+        uint64_t tick = round_start + (dist << shift);
+        uint64_t wait = tick - self->now;
+        if (wait < ret)
+        {
+            ret = wait;
+        }
+    }
+
+    return ret;
+}
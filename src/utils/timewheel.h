@@ -0,0 +1,111 @@
+#ifndef __AUTO_UTILS_TIMEWHEEL_H__
+#define __AUTO_UTILS_TIMEWHEEL_H__
+
+#include <stdint.h>
+#include "utils/list.h"
+
+/**
+ * @brief Number of bits of slot index in each level.
+ */
+#define AUTO_TIMEWHEEL_BITS     6
+
+/**
+ * @brief Number of slots in each level.
+ */
+#define AUTO_TIMEWHEEL_SLOTS    (1 << AUTO_TIMEWHEEL_BITS)
+
+/**
+ * @brief Number of levels. The wheel covers 2^36 ticks, and longer timeout
+ *   is clamped.
+ */
+#define AUTO_TIMEWHEEL_LEVELS   6
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct auto_timewheel_node;
+
+/**
+ * @brief Timer callback.
+ * @param[in] node  Expired timer, which is no longer in the wheel.
+ */
+typedef void (*auto_timewheel_fn)(struct auto_timewheel_node* node);
+
+/**
+ * @brief Timer in wheel. It is usually embedded in owner structure.
+ */
+typedef struct auto_timewheel_node
+{
+    auto_list_node_t        node;       /**< Slot list node */
+    auto_list_t*            slot;       /**< Slot it belongs to, NULL if not active */
+    uint64_t                expire;     /**< Expire tick */
+    auto_timewheel_fn       fn;         /**< Expire callback */
+} auto_timewheel_node_t;
+
+/**
+ * @brief Hierarchical timer wheel.
+ *
+ * Level 0 has one slot per tick. A slot in level N covers a whole round of
+ * level N-1, and its timers are moved to lower level when the round begins.
+ * Start and stop a timer is O(1).
+ */
+typedef struct auto_timewheel
+{
+    uint64_t                now;        /**< Next tick to process */
+    size_t                  size;       /**< Number of active timers */
+    uint64_t                bitmap[AUTO_TIMEWHEEL_LEVELS];  /**< Non-empty slots */
+    auto_list_t             slots[AUTO_TIMEWHEEL_LEVELS][AUTO_TIMEWHEEL_SLOTS];
+} auto_timewheel_t;
+
+/**
+ * @brief Initialize timer wheel.
+ * @param[out] self Timer wheel.
+ * @param[in] now   Current tick.
+ */
+AUTO_LOCAL void auto_timewheel_init(auto_timewheel_t* self, uint64_t now);
+
+/**
+ * @brief Start timer. If the timer is active, it is restarted.
+ * @param[in] self      Timer wheel.
+ * @param[in] node      Timer.
+ * @param[in] expire    Expire tick. A tick already passed expires on next process.
+ * @param[in] fn        Expire callback.
+ */
+AUTO_LOCAL void auto_timewheel_start(auto_timewheel_t* self, auto_timewheel_node_t* node,
+    uint64_t expire, auto_timewheel_fn fn);
+
+/**
+ * @brief Stop timer. It is safe to stop an inactive timer.
+ * @param[in] self  Timer wheel.
+ * @param[in] node  Timer.
+ */
+AUTO_LOCAL void auto_timewheel_stop(auto_timewheel_t* self, auto_timewheel_node_t* node);
+
+/**
+ * @brief Expire all timers up to \p now (inclusive).
+ *
+ * Callbacks may start or stop any timer.
+ *
+ * @param[in] self  Timer wheel.
+ * @param[in] now   Current tick.
+ */
+AUTO_LOCAL void auto_timewheel_process(auto_timewheel_t* self, uint64_t now);
+
+/**
+ * @brief Get number of ticks before next process is needed.
+ *
+ * The result is exact if the next timer is in level 0, otherwise it is when
+ * the next timer is moved to lower level.
+ *
+ * @param[in] self  Timer wheel.
+ * @return          Number of ticks after last processed tick, or UINT64_MAX if
+ *   no active timer.
+ */
+AUTO_LOCAL uint64_t auto_timewheel_next(const auto_timewheel_t* self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "utils/list.h"
+#include "trace.h"
+
+/**
+ * @brief Duration of metadata event.
+ */
+#define AUTO_TRACE_META     UINT64_MAX
+
+typedef struct trace_event
+{
+    uint64_t                ts;             /**< Start time, by uv_hrtime() */
+    uint64_t                dur;            /**< Duration, #AUTO_TRACE_META for track name */
+    uint64_t                id;             /**< Coroutine id, 0 for thread */
+    char                    name[40];       /**< Event name */
+} trace_event_t;
+
+typedef struct trace_buffer
+{
+    auto_list_node_t        node;           /**< Node in buffer list */
+    size_t                  index;          /**< Thread index, as track of thread */
+    uint64_t                pos;            /**< Number of events recorded */
+    trace_event_t           events[AUTO_TRACE_BUFFER_SIZE];
+} trace_buffer_t;
+
+typedef struct trace_ctx
+{
+    FILE*                   file;           /**< Output file */
+    uint64_t                start;          /**< When trace start */
+    uv_key_t                key;            /**< Buffer of current thread */
+    uv_mutex_t              lock;           /**< Protect buffer list */
+    auto_list_t             buffers;        /**< Buffer of all threads */
+} trace_ctx_t;
+
+int auto_trace_enabled = 0;
+
+static trace_ctx_t s_trace;
+
+static trace_buffer_t* _trace_get_buffer(void)
+{
+    trace_buffer_t* buf = uv_key_get(&s_trace.key);
+    if (buf != NULL)
+    {
+        return buf;
+    }
+
+    if ((buf = malloc(sizeof(trace_buffer_t))) == NULL)
+    {
+        return NULL;
+    }
+    buf->pos = 0;
+
+    uv_mutex_lock(&s_trace.lock);
+    buf->index = ev_list_size(&s_trace.buffers);
+    ev_list_push_back(&s_trace.buffers, &buf->node);
+    uv_mutex_unlock(&s_trace.lock);
+
+    uv_key_set(&s_trace.key, buf);
+    return buf;
+}
+
+static void _trace_push(uint64_t id, const char* name, uint64_t ts, uint64_t dur)
+{
+    trace_buffer_t* buf = _trace_get_buffer();
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    trace_event_t* e = &buf->events[buf->pos % AUTO_TRACE_BUFFER_SIZE];
+    e->ts = ts;
+    e->dur = dur;
+    e->id = id;
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    buf->pos++;
+}
+
+void auto_trace_record(uint64_t id, const char* name, uint64_t ts, uint64_t dur)
+{
+    _trace_push(id, name, ts, dur);
+}
+
+void auto_trace_name(uint64_t id, const char* name)
+{
+    _trace_push(id, name, uv_hrtime(), AUTO_TRACE_META);
+}
+
+int auto_trace_init(const char* path)
+{
+#if defined(_MSC_VER)
+    int ret = fopen_s(&s_trace.file, path, "wb");
+    if (ret != 0)
+    {
+        return ret;
+    }
+#else
+    if ((s_trace.file = fopen(path, "wb")) == NULL)
+    {
+        return errno;
+    }
+#endif
+
+    uv_key_create(&s_trace.key);
+    uv_mutex_init(&s_trace.lock);
+    ev_list_init(&s_trace.buffers);
+    s_trace.start = uv_hrtime();
+    auto_trace_enabled = 1;
+
+    /* Loop thread is the first one. */
+    _trace_get_buffer();
+
+    return 0;
+}
+
+/**
+ * @brief Write string as JSON string.
+ */
+static void _trace_write_string(FILE* file, const char* str)
+{
+    fputc('"', file);
+    for (; *str != '\0'; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', file);
+            fputc(c, file);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(file, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * @brief Write one event. Coroutines are in process 2 with coroutine id as
+ *   thread id, and threads are in process 1.
+ */
+static void _trace_write_event(FILE* file, const trace_buffer_t* buf, const trace_event_t* e)
+{
+    int pid = e->id != 0 ? 2 : 1;
+    uint64_t tid = e->id != 0 ? e->id : buf->index;
+
+    if (e->dur == AUTO_TRACE_META)
+    {
+        fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%" PRIu64 ",\"args\":{\"name\":",
+            pid, tid);
+        _trace_write_string(file, e->name);
+        fputs("}}", file);
+        return;
+    }
+
+    uint64_t ts = e->ts > s_trace.start ? e->ts - s_trace.start : 0;
+    fputs(",\n{\"ph\":\"X\",\"name\":", file);
+    _trace_write_string(file, e->name);
+    fprintf(file, ",\"pid\":%d,\"tid\":%" PRIu64 ",\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u}",
+        pid, tid, ts / 1000, (unsigned)(ts % 1000), e->dur / 1000, (unsigned)(e->dur % 1000));
+}
+
+static void _trace_write(FILE* file)
+{
+    uint64_t dropped = 0;
+
+    fputs("{\"traceEvents\":[\n"
+        "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"threads\"}},\n"
+        "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":2,\"args\":{\"name\":\"coroutines\"}}", file);
+
+    auto_list_node_t* it = ev_list_begin(&s_trace.buffers);
+    for (; it != NULL; it = ev_list_next(it))
+    {
+        trace_buffer_t* buf = container_of(it, trace_buffer_t, node);
+
+        fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            (unsigned)buf->index, buf->index == 0 ? "loop" : "worker", (unsigned)buf->index);
+
+        uint64_t beg = 0;
+        if (buf->pos > AUTO_TRACE_BUFFER_SIZE)
+        {
+            beg = buf->pos - AUTO_TRACE_BUFFER_SIZE;
+            dropped += beg;
+        }
+        for (; beg < buf->pos; beg++)
+        {
+            _trace_write_event(file, buf, &buf->events[beg % AUTO_TRACE_BUFFER_SIZE]);
+        }
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%" PRIu64 "}}\n", dropped);
+}
+
+void auto_trace_exit(void)
+{
+    if (!auto_trace_enabled)
+    {
+        return;
+    }
+    auto_trace_enabled = 0;
+
+    _trace_write(s_trace.file);
+    fclose(s_trace.file);
+    s_trace.file = NULL;
+
+    auto_list_node_t* it;
+    while ((it = ev_list_pop_front(&s_trace.buffers)) != NULL)
+    {
+        free(container_of(it, trace_buffer_t, node));
+    }
+    uv_mutex_destroy(&s_trace.lock);
+    uv_key_delete(&s_trace.key);
+}
@@ -0,0 +1,81 @@
+#ifndef __AUTO_UTILS_TRACE_H__
+#define __AUTO_UTILS_TRACE_H__
+
+#include <stdint.h>
+#include <uv.h>
+#include <autodo.h>
+
+/**
+ * @brief Number of events kept for each thread. Oldest events are
+ *   overwritten when buffer is full.
+ */
+#define AUTO_TRACE_BUFFER_SIZE  (64 * 1024)
+
+/**
+ * @brief Start time of traced operation, or 0 if trace is disabled.
+ */
+#define AUTO_TRACE_BEGIN() \
+    (auto_trace_enabled ? uv_hrtime() : 0)
+
+/**
+ * @brief Record operation started by #AUTO_TRACE_BEGIN() on track of
+ *   current thread.
+ */
+#define AUTO_TRACE_END(name, beg) \
+    do \
+    { \
+        if (auto_trace_enabled) \
+        { \
+            auto_trace_record(0, name, beg, uv_hrtime() - (beg)); \
+        } \
+    } while (0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Non-zero if trace is enabled. Check it before recording anything,
+ *   so trace costs nothing when disabled.
+ */
+AUTO_LOCAL extern int auto_trace_enabled;
+
+/**
+ * @brief Enable trace.
+ *
+ * Events are recorded into a ring buffer of the recording thread, so no lock
+ * is needed except the first time a thread records. They are written as
+ * Chrome trace event JSON by #auto_trace_exit().
+ *
+ * @param[in] path  Output file.
+ * @return          0 if success, or errno.
+ */
+AUTO_LOCAL int auto_trace_init(const char* path);
+
+/**
+ * @brief Write recorded events and disable trace. Other threads must stop
+ *   recording before call.
+ */
+AUTO_LOCAL void auto_trace_exit(void);
+
+/**
+ * @brief Record a complete event.
+ * @param[in] id    Coroutine id as track, or 0 for current thread.
+ * @param[in] name  Event name, truncated if too long.
+ * @param[in] ts    Start time, by `uv_hrtime()`.
+ * @param[in] dur   Duration in nanoseconds.
+ */
+AUTO_LOCAL void auto_trace_record(uint64_t id, const char* name, uint64_t ts, uint64_t dur);
+
+/**
+ * @brief Name the track of coroutine.
+ * @param[in] id    Coroutine id.
+ * @param[in] name  Track name, truncated if too long.
+ */
+AUTO_LOCAL void auto_trace_name(uint64_t id, const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+-- Benchmark: spawn and await short-lived coroutines.
+--
+-- Usage: [COROUTINES=n] [BATCH=n] autodo test/benchmark/coroutine.lua
+--
+-- Spawn BATCH coroutines at a time and await all of them, until COROUTINES
+-- coroutines are finished. Each coroutine returns its argument, so results
+-- are stored as well.
+
+local co_count = tonumber(os.getenv("COROUTINES")) or 1000000
+local batch = tonumber(os.getenv("BATCH")) or 100
+
+local function task(v)
+    return v
+end
+
+local beg_cpu = os.clock()
+
+local sum, list = 0, {}
+for base = 0, co_count - 1, batch do
+    for i = 1, batch do
+        list[i] = auto.coroutine(task, base + i)
+    end
+    for i = 1, batch do
+        local _, v = list[i]:await()
+        sum = sum + v
+    end
+end
+assert(sum == co_count * (co_count + 1) // 2)
+
+local cpu = os.clock() - beg_cpu
+print(string.format("%d coroutines in batch of %d: %.3fs cpu, %.0f spawn+await/s",
+    co_count, batch, cpu, co_count / cpu))
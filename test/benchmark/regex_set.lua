@@ -0,0 +1,88 @@
+-- Benchmark: classify log lines by many patterns.
+--
+-- Usage: [LINES=n] autodo test/benchmark/regex_set.lua
+--
+-- Compare calling regex:match() for every pattern against one
+-- auto.regex_set() match per line. The corpus is generated so the result
+-- is reproducible.
+
+local line_count = tonumber(os.getenv("LINES")) or 50000
+
+local services = { "auth", "billing", "gateway", "indexer", "mailer", "scheduler", "search", "storage", "upload", "worker" }
+local levels = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" }
+local messages = {
+    "request completed status=%d latency=%dms",
+    "connection refused to host 10.0.%d.%d",
+    "user u%d logged in from 192.168.%d.1",
+    "cache miss for key item:%d shard=%d",
+    "retrying job %d attempt=%d",
+    "GET /api/v1/items/%d HTTP/1.1\" %d",
+    "disk usage %d%% on volume vol%d",
+    "timeout after %dms waiting for lock %d",
+}
+
+-- 300 classifier rules, each targets one service and one kind of message.
+local rules = {}
+local rule_templates = {
+    "%s\\[\\d+\\]: request completed status=5\\d\\d",
+    "%s\\[\\d+\\]: connection refused to host (\\S+)",
+    "%s\\[\\d+\\]: user u\\d+ logged in",
+    "%s\\[\\d+\\]: cache miss for key item:\\d+ shard=[0-3]$",
+    "%s\\[\\d+\\]: retrying job \\d+ attempt=[5-9]",
+    "%s\\[\\d+\\]: GET /api/v1/items/\\d+ HTTP/1\\.1\" 404",
+    "%s\\[\\d+\\]: disk usage 9\\d%% on volume",
+    "%s\\[\\d+\\]: timeout after \\d{4,}ms",
+    "ERROR %s\\[\\d+\\]: .*refused",
+    "WARN %s-%d\\[",
+}
+for i = 1, 300 do
+    local tpl = rule_templates[(i - 1) % #rule_templates + 1]
+    local svc = services[(i - 1) // #rule_templates % #services + 1]
+    rules[i] = string.format(tpl, svc .. "-" .. ((i - 1) // 100), i % 7)
+end
+
+math.randomseed(1)
+local lines = {}
+for i = 1, line_count do
+    local msg = string.format(messages[math.random(#messages)], math.random(100, 999), math.random(1, 9))
+    lines[i] = string.format("2026-10-18T12:%02d:%02d.%03dZ node%d %s %s-%d[%d]: %s",
+        math.random(0, 59), math.random(0, 59), math.random(0, 999), math.random(1, 20),
+        levels[math.random(#levels)], services[math.random(#services)], math.random(0, 2),
+        math.random(1000, 9999), msg)
+end
+
+local function bench(name, fn)
+    local beg = os.clock()
+    local hit = fn()
+    local cost = os.clock() - beg
+    print(string.format("%-10s %8.3f s  %10.0f lines/s  %d hits", name, cost, line_count / cost, hit))
+    return hit
+end
+
+local regex_list = {}
+for i, p in ipairs(rules) do
+    regex_list[i] = auto.regex(p)
+end
+
+local hit_naive = bench("regex", function()
+    local hit = 0
+    for _, line in ipairs(lines) do
+        for _, re in ipairs(regex_list) do
+            if re:match(line) ~= nil then
+                hit = hit + 1
+            end
+        end
+    end
+    return hit
+end)
+
+local set = auto.regex_set(rules)
+local hit_set = bench("regex_set", function()
+    local hit = 0
+    for _, line in ipairs(lines) do
+        hit = hit + #set:match(line)
+    end
+    return hit
+end)
+
+assert(hit_naive == hit_set)
@@ -0,0 +1,33 @@
+-- Benchmark: many coroutines polling with auto.sleep().
+--
+-- Usage: [COROUTINES=n] [ROUNDS=n] autodo test/benchmark/sleep.lua
+--
+-- Every coroutine sleeps ROUNDS times with a random timeout up to 50ms,
+-- like a polling loop. Print CPU time spent by the runtime, which excludes
+-- the time actually slept.
+
+local co_count = tonumber(os.getenv("COROUTINES")) or 100000
+local rounds = tonumber(os.getenv("ROUNDS")) or 10
+
+local wakeups = 0
+local function sleeper(seed)
+    for i = 1, rounds do
+        auto.sleep((seed * 7919 + i * 104729) % 50 + 1)
+        wakeups = wakeups + 1
+    end
+end
+
+local beg_cpu = os.clock()
+local beg_time = os.time()
+
+local list = {}
+for i = 1, co_count do
+    list[i] = auto.coroutine(sleeper, i)
+end
+for i = 1, co_count do
+    list[i]:await()
+end
+
+local cpu = os.clock() - beg_cpu
+print(string.format("%d coroutines x %d sleeps: %.3fs cpu, %ds wall, %.0f sleeps/s cpu",
+    co_count, rounds, cpu, os.time() - beg_time, wakeups / cpu))
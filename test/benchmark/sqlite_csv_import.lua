@@ -0,0 +1,37 @@
+-- Benchmark: import a generated CSV file into an on-disk database.
+--
+-- Usage: [ROWS=n] [BATCH=n] autodo test/benchmark/sqlite_csv_import.lua
+--
+-- The CSV file and database are created in the current directory and
+-- removed afterwards. Rows are imported once as text and once with type
+-- inference, and the throughput is printed in rows per second.
+
+local row_count = tonumber(os.getenv("ROWS")) or 200000
+local batch_size = tonumber(os.getenv("BATCH")) or 0
+
+local csv_path = "sqlite_csv_import.bench.csv"
+local db_path = "sqlite_csv_import.bench.db"
+
+local f = assert(io.open(csv_path, "w"))
+f:write("id,name,score,comment\n")
+for i = 1, row_count do
+    f:write(string.format("%d,user%d,%d.%d,\"note %d, see \"\"ref\"\"\"\n", i, i % 1000, i % 100, i % 10, i))
+end
+f:close()
+
+local function run(name, opt)
+    os.remove(db_path)
+    local db = auto.sqlite({ filename = db_path })
+    local beg = os.clock()
+    local cnt = db:from_csv_file("t", csv_path, opt)
+    local cost = os.clock() - beg
+    db:close()
+    assert(cnt == row_count)
+    print(string.format("%-12s %8d rows  %.3fs  %10.0f rows/s", name, cnt, cost, cnt / cost))
+end
+
+run("text", { batch_size = batch_size })
+run("infer_types", { batch_size = batch_size, infer_types = true })
+
+os.remove(db_path)
+os.remove(csv_path)
@@ -0,0 +1,65 @@
+local function worker(ms, ...)
+    local ret = table.pack(...)
+    return auto.coroutine(function()
+        auto.sleep(ms)
+        return table.unpack(ret, 1, ret.n)
+    end)
+end
+
+-- Results are in list order, not finish order
+local list = { worker(60, "a"), worker(20, "b", 2), worker(40) }
+local ret = auto.await_all(list)
+assert(#ret == 3)
+assert(ret[1].n == 2 and ret[1][1] == true and ret[1][2] == "a")
+assert(ret[2].n == 3 and ret[2][1] == true and ret[2][2] == "b" and ret[2][3] == 2)
+assert(ret[3].n == 1 and ret[3][1] == true)
+
+-- Finished coroutines return at once
+ret = auto.await_all(list, 0)
+assert(#ret == 3 and ret[2][2] == "b")
+ret = auto.await_all({})
+assert(type(ret) == "table" and #ret == 0)
+
+-- First one wins
+list = { worker(80, "slow"), worker(10, "fast"), worker(80, "slow") }
+local idx, ok, val = auto.await_any(list)
+assert(idx == 2 and ok == true and val == "fast")
+
+-- Lowest finished index when several are already finished
+auto.await_all(list)
+idx, ok, val = auto.await_any(list)
+assert(idx == 1 and ok == true and val == "slow")
+
+-- Timeout
+list = { worker(200, 1), worker(10, 2) }
+local err
+ret, err = auto.await_all(list, 30)
+assert(ret == nil and err == "timeout")
+idx, err = auto.await_any({ worker(200) }, 10)
+assert(idx == nil and err == "timeout")
+ret = auto.await_all(list, 5000)
+assert(ret[1][2] == 1 and ret[2][2] == 2)
+
+-- Records are unlinked after timeout, await still works
+local co = worker(30, "x")
+assert(auto.await_any({ co, co }, 0) == nil)
+ok, val = co:await()
+assert(ok and val == "x")
+
+-- Bad arguments
+assert(not pcall(auto.await_any, {}))
+assert(not pcall(auto.await_all, { 1 }))
+assert(not pcall(auto.await_all, {}, -1))
+
+-- Fan out / fan in
+list = {}
+for i = 1, 2000 do
+    list[i] = auto.coroutine(function()
+        auto.sleep(i % 10)
+        return i
+    end)
+end
+ret = auto.await_all(list)
+for i = 1, 2000 do
+    assert(ret[i][2] == i)
+end
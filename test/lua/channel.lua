@@ -0,0 +1,177 @@
+-- Producer and consumer with back pressure
+local ch = auto.channel(4)
+assert(ch:capacity() == 4 and #ch == 0)
+
+local max_buffered = 0
+local producer = auto.coroutine(function()
+    for i = 1, 100 do
+        assert(ch:send(i))
+        if #ch > max_buffered then
+            max_buffered = #ch
+        end
+    end
+    ch:close()
+end)
+
+local sum, count = 0, 0
+while true do
+    local v, ok = ch:recv()
+    if not ok then
+        break
+    end
+    sum = sum + v
+    count = count + 1
+end
+assert(count == 100 and sum == 5050)
+assert(max_buffered <= 4)
+assert(producer:await())
+
+-- Closed channel keeps buffered messages, and refuse new ones
+ch = auto.channel(2)
+assert(ch:send("a"))
+ch:close()
+assert(ch:closed())
+local ok, err = ch:send("b")
+assert(ok == false and err == "closed")
+local v
+v, ok = ch:recv()
+assert(v == "a" and ok == true)
+v, ok = ch:recv()
+assert(v == nil and ok == false)
+
+-- Any value including nil and false can be sent
+ch = auto.channel(3)
+ch:send(false)
+ch:send(nil)
+ch:send({ 1 })
+v, ok = ch:recv()
+assert(v == false and ok)
+v, ok = ch:recv()
+assert(v == nil and ok)
+v, ok = ch:recv()
+assert(v[1] == 1 and ok)
+
+-- Timeout
+v, ok, err = ch:recv(10)
+assert(v == nil and ok == false and err == "timeout")
+v, ok, err = ch:recv(0)
+assert(err == "timeout")
+ch = auto.channel(1)
+assert(ch:send(1, 0))
+ok, err = ch:send(2, 10)
+assert(ok == false and err == "timeout")
+assert(#ch == 1)
+
+-- Close wakes up blocked senders and receivers
+local blocked = auto.coroutine(function()
+    return ch:send(3)
+end)
+local empty = auto.channel(1)
+local receiver = auto.coroutine(function()
+    return empty:recv()
+end)
+auto.sleep(5)
+ch:close()
+empty:close()
+local co_ok, send_ok, send_err = blocked:await()
+assert(co_ok and send_ok == false and send_err == "closed")
+local r_ok, r_v, r_recv_ok = receiver:await()
+assert(r_ok and r_v == nil and r_recv_ok == false)
+
+-- Many blocked receivers each get one message
+ch = auto.channel(1)
+local got = {}
+local receivers = {}
+for i = 1, 10 do
+    receivers[i] = auto.coroutine(function()
+        local value = ch:recv()
+        got[#got + 1] = value
+    end)
+end
+for i = 1, 10 do
+    ch:send(i)
+end
+for i = 1, 10 do
+    receivers[i]:await()
+end
+table.sort(got)
+assert(#got == 10 and got[1] == 1 and got[10] == 10)
+
+-- Select
+local a, b = auto.channel(1), auto.channel(1)
+auto.coroutine(function()
+    auto.sleep(10)
+    b:send("from b")
+end)
+local idx
+idx, v, ok = auto.channel_select({ a, b })
+assert(idx == 2 and v == "from b" and ok)
+
+a:send("from a")
+idx, v, ok = auto.channel_select({ a, b })
+assert(idx == 1 and v == "from a" and ok)
+
+assert(auto.channel_select({ a, b }, 10) == nil)
+
+b:close()
+idx, v, ok = auto.channel_select({ a, b })
+assert(idx == 2 and v == nil and ok == false)
+
+-- A waiting select is removed from all channels
+local c = auto.channel(1)
+local selector = auto.coroutine(function()
+    return auto.channel_select({ a, c })
+end)
+auto.sleep(5)
+c:send("c")
+local s_ok, s_idx, s_v = selector:await()
+assert(s_ok and s_idx == 2 and s_v == "c")
+a:send("still here")
+assert(a:recv() == "still here")
+
+assert(not pcall(auto.channel, 0))
+assert(not pcall(auto.channel_select, { a, {} }))
+
+-- Closed receiver leaves the channel, its context is safe to reuse
+local function elapsed_sleep(ms)
+    local beg = auto.stats().uptime
+    auto.sleep(ms)
+    return auto.stats().uptime - beg
+end
+local d = auto.channel()
+local closed = auto.coroutine(function() return d:recv() end)
+coroutine.yield()
+coroutine.yield()
+closed:close()
+coroutine.yield()
+coroutine.yield()
+local sleeper = auto.coroutine(elapsed_sleep, 200)
+coroutine.yield()
+coroutine.yield()
+d:send(1)
+local _, t = sleeper:await()
+assert(t >= 0.15, t)
+assert(#d == 1 and d:recv() == 1)
+
+-- Wakeup of receiver closed before it runs goes to the next one
+local first = auto.coroutine(function() return d:recv() end)
+local second = auto.coroutine(function() return d:recv() end)
+coroutine.yield()
+coroutine.yield()
+d:send(2)
+first:close()
+local r_ok, r_v = second:await()
+assert(r_ok and r_v == 2)
+
+-- Changing the list of a waiting select does not affect it
+local e = auto.channel(1)
+local list = { e, auto.channel(1) }
+selector = auto.coroutine(function() return auto.channel_select(list) end)
+coroutine.yield()
+coroutine.yield()
+list[1] = nil
+list[2] = {}
+collectgarbage()
+e:send("e")
+s_ok, s_idx, s_v = selector:await()
+assert(s_ok and s_idx == 1 and s_v == "e")
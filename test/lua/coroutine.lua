@@ -22,3 +22,74 @@ assert(b2 == true)
 
 assert(ret1 == 20)
 assert(ret2 == 40)
+
+-- Multiple, nil and no results
+local c3 = auto.coroutine(function() return 1, nil, "x" end)
+local c4 = auto.coroutine(function() return nil end)
+local c5 = auto.coroutine(function() end)
+local r = table.pack(c3:await())
+assert(r.n == 4 and r[1] == true and r[2] == 1 and r[3] == nil and r[4] == "x")
+r = table.pack(c4:await())
+assert(r.n == 2 and r[1] == true and r[2] == nil)
+r = table.pack(c5:await())
+assert(r.n == 1 and r[1] == true)
+
+-- Results are kept after await, and operations on finished coroutine are no-op
+r = table.pack(c3:await())
+assert(r.n == 4 and r[4] == "x")
+c3:suspend()
+c3:resume()
+c3:close()
+assert(select("#", c3:await()) == 4)
+
+-- Threads of finished coroutines are reused, state must not leak
+for round = 1, 3 do
+    local list = {}
+    for i = 1, 100 do
+        list[i] = auto.coroutine(function(v)
+            coroutine.yield()
+            return v, round
+        end, i)
+    end
+    for i = 1, 100 do
+        local ok, v, rnd = list[i]:await()
+        assert(ok and v == i and rnd == round)
+    end
+end
+
+-- Close running coroutine wakes up waiters
+local c6 = auto.coroutine(function()
+    auto.sleep(10000)
+    return "never"
+end)
+local w = auto.coroutine(function()
+    return c6:await()
+end)
+coroutine.yield()
+c6:close()
+local ok, b, v = w:await()
+assert(ok == true and b == false and v == nil)
+
+-- Close waiting coroutine cancels its wait, so the context is safe to reuse
+local function elapsed_sleep(ms)
+    local beg = auto.stats().uptime
+    auto.sleep(ms)
+    return auto.stats().uptime - beg
+end
+for _, wait in ipairs({
+    function(co) return co:await() end,
+    function(co) return auto.await_all({ co }) end,
+    function(co) return auto.await_any({ co }) end,
+}) do
+    local target = auto.coroutine(function() auto.sleep(20) end)
+    local waiter = auto.coroutine(wait, target)
+    coroutine.yield()
+    coroutine.yield()
+    waiter:close()
+    coroutine.yield()
+    coroutine.yield()
+    local sleeper = auto.coroutine(elapsed_sleep, 200)
+    assert(target:await())
+    local _, t = sleeper:await()
+    assert(t >= 0.15, t)
+end
@@ -0,0 +1,120 @@
+local path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/csv_rows.csv"
+
+local function write_file(content)
+    local f = io.open(path, "wb")
+    f:write(content)
+    f:close()
+end
+
+-- Quoted fields, escaped quotes, CRLF, BOM and empty lines
+write_file("\xEF\xBB\xBFa,\"b,\"\"c\"\"\",\"d\ne\"\r\n\r\n1,,3\n\"\"\n")
+local rows = {}
+for row in auto.csv_rows(path) do
+    table.insert(rows, row)
+end
+assert(#rows == 3)
+assert(rows[1][1] == "a" and rows[1][2] == "b,\"c\"" and rows[1][3] == "d\ne")
+assert(#rows[2] == 3 and rows[2][2] == "" and rows[2][3] == "3")
+assert(#rows[3] == 1 and rows[3][1] == "")
+
+-- Rows keyed by header, extra fields keyed by index
+write_file("id;name\n1;alice\n2;bob;x\n")
+rows = {}
+for row in auto.csv_rows(path, { header = true, delimiter = ";" }) do
+    table.insert(rows, row)
+end
+assert(#rows == 2)
+assert(rows[1].id == "1" and rows[1].name == "alice")
+assert(rows[2].name == "bob" and rows[2][3] == "x")
+
+-- Break out of loop and overwrite the file
+local cnt = 0
+write_file(string.rep("x,y\n", 1000))
+for _ in auto.csv_rows(path) do
+    cnt = cnt + 1
+    if cnt == 10 then
+        break
+    end
+end
+assert(cnt == 10)
+write_file("")
+for _ in auto.csv_rows(path) do
+    error("empty file has no row")
+end
+
+assert(not pcall(auto.csv_rows, path .. ".missing"))
+assert(not pcall(auto.csv_rows, path, { delimiter = "::" }))
+
+-- Pipe is read in 64 KiB chunks, rows across chunk boundary are parsed again
+if package.config:sub(1, 1) ~= "/" then
+    return
+end
+
+local CHUNK = 64 * 1024
+local fifo = path .. ".fifo"
+
+local function read_all(file)
+    local result = {}
+    for row in auto.csv_rows(file) do
+        table.insert(result, row)
+    end
+    return result
+end
+
+local function read_fifo(content)
+    write_file(content)
+    os.remove(fifo)
+    assert(os.execute(string.format("mkfifo '%s'", fifo)))
+    assert(os.execute(string.format("cat '%s' > '%s' &", path, fifo)))
+    local result = read_all(fifo)
+    os.remove(fifo)
+    return result
+end
+
+local parts = { "\xEF\xBB\xBFid,text\n" }
+local size = #parts[1]
+local function add(row)
+    table.insert(parts, row)
+    size = size + #row
+end
+local function pad_to(offset)
+    add("0," .. string.rep("f", offset - size - 3) .. "\n")
+end
+
+-- Escaped quote split by first chunk boundary, the row start at `s1`
+local s1 = CHUNK - 1 - #"1,\"aaaa"
+pad_to(s1)
+add("1,\"aaaa\"\"b\"\n")
+-- CR split by second chunk boundary, which is `s1 + CHUNK`
+local quoted = "2,\"c\r\nd\""
+pad_to(s1 + CHUNK - 1 - #quoted)
+add(quoted .. "\r\n")
+-- Row larger than chunk grow the buffer
+local big = string.rep("x", 3 * CHUNK)
+add("3,\"" .. big .. "\"\"\"\n")
+add("4,end")
+
+local content = table.concat(parts)
+rows = read_fifo(content)
+assert(#rows == 7)
+assert(rows[1][1] == "id" and rows[1][2] == "text")
+assert(rows[3][1] == "1" and rows[3][2] == "aaaa\"b")
+assert(rows[5][1] == "2" and rows[5][2] == "c\r\nd")
+assert(rows[6][1] == "3" and rows[6][2] == big .. "\"")
+assert(rows[7][1] == "4" and rows[7][2] == "end")
+
+-- Same as mapped file
+local expect = read_all(path)
+assert(#expect == #rows)
+for i = 1, #rows do
+    assert(#expect[i] == #rows[i])
+    for j = 1, #rows[i] do
+        assert(expect[i][j] == rows[i][j])
+    end
+end
+
+-- Input shorter than BOM is read again before checking BOM
+rows = read_fifo("a")
+assert(#rows == 1 and rows[1][1] == "a")
+assert(#read_fifo("\xEF\xBB\xBF") == 0)
+assert(#read_fifo("") == 0)
@@ -0,0 +1,55 @@
+-- Blocking operations must not spin: CPU time stays low while waiting.
+local function cpu_of(fn)
+    local beg = os.clock()
+    fn()
+    return os.clock() - beg
+end
+
+local LIMIT = 0.1
+
+-- Sleep, await, channel and wait group
+local cpu = cpu_of(function()
+    local ch = auto.channel()
+    local wg = auto.waitgroup()
+    wg:add()
+    local co = auto.coroutine(function()
+        auto.sleep(300)
+        ch:send(1)
+        wg:done()
+        return 1
+    end)
+    assert(ch:recv() == 1)
+    assert(wg:wait())
+    assert(co:await())
+end)
+assert(cpu < LIMIT, "waiting coroutine spins: " .. cpu)
+
+if package.config:sub(1, 1) ~= "/" then
+    return
+end
+
+-- Join a sleeping child
+cpu = cpu_of(function()
+    local proc = auto.process({ file = "sleep", args = { "sleep", "1" } })
+    assert(proc:join() == 0)
+end)
+assert(cpu < LIMIT, "process:join() spins: " .. cpu)
+
+-- Write to a child that does not read yet
+cpu = cpu_of(function()
+    local proc = auto.process({
+        file = "sh",
+        args = { "sh", "-c", "sleep 1; cat >/dev/null" },
+        stdio = { "enable_stdin" },
+    })
+    local late = false
+    auto.coroutine(function()
+        auto.sleep(500)
+        late = true
+    end)
+    assert(proc:cin(string.rep("x", 1024 * 1024)) == 1024 * 1024)
+    assert(late, "process:cin() returns before data is written")
+    proc:kill(9)
+    proc:join()
+end)
+assert(cpu < LIMIT, "process:cin() spins: " .. cpu)
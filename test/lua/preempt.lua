@@ -0,0 +1,77 @@
+-- A busy loop does not block other coroutines when preemption is enabled
+local function busy(flag)
+    local n = 0
+    while not flag.stop do
+        n = n + 1
+    end
+    return n
+end
+
+for _, opt in ipairs({ { count = 10000 }, { time = 5 } }) do
+    local flag = {}
+    local co = auto.coroutine(busy, flag)
+    co:preempt(opt)
+
+    local sleeper = auto.coroutine(function()
+        auto.sleep(20)
+        flag.stop = true
+    end)
+    assert(sleeper:await(5000))
+
+    local ok, n = co:await(5000)
+    assert(ok and n > 0)
+    assert(co:preempted() > 0)
+end
+
+-- Hook is not inherited by plain Lua coroutines and new managed coroutines
+local child
+local co = auto.coroutine(function()
+    local t = coroutine.wrap(function()
+        local s = 0
+        for i = 1, 100000 do s = s + i end
+        return s
+    end)
+    assert(t() == 5000050000)
+    child = auto.coroutine(function()
+        local s = 0
+        for i = 1, 100000 do s = s + i end
+        return s
+    end)
+    local s = 0
+    for i = 1, 100000 do s = s + i end
+    return s
+end)
+co:preempt({ count = 1000 })
+local ok, s = co:await()
+assert(ok and s == 5000050000 and co:preempted() > 0)
+ok, s = child:await()
+assert(ok and s == 5000050000 and child:preempted() == 0)
+
+-- Disabled by default, and can be turned off
+co = auto.coroutine(function()
+    local s = 0
+    for i = 1, 100000 do s = s + i end
+    return s
+end)
+co:preempt({ count = 100 })
+co:preempt()
+assert(co:await())
+assert(co:preempted() == 0)
+
+-- Non-yieldable code is not preempted
+co = auto.coroutine(function()
+    local t = {}
+    for i = 1, 1000 do t[i] = (i * 7919) % 1000 end
+    table.sort(t, function(a, b)
+        for _ = 1, 10 do end
+        return a < b
+    end)
+    return t[1], t[1000]
+end)
+co:preempt({ count = 100 })
+local a, b
+ok, a, b = co:await()
+assert(ok and a == 0 and b == 999)
+
+assert(not pcall(co.preempt, co, { count = -1 }))
+assert(not pcall(co.preempt, co, 1))
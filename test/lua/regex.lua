@@ -6,3 +6,9 @@ local match_list = pattern:match(data)
 assert(match_list ~= nil)
 
 io.write(auto.json():encode(match_list))
+
+-- Many groups
+local many = auto.regex(string.rep("(a)", 40))
+match_list = many:match(string.rep("a", 40))
+assert(#match_list == 41 and match_list[41][3] == "a" and match_list[1][2] == 40)
+assert(many:match(string.rep("a", 39)) == nil)
@@ -0,0 +1,38 @@
+local stat = auto.regex_cache()
+local hit = stat.hit
+local miss = stat.miss
+
+-- Same pattern is compiled only once
+local p1 = auto.regex("cache (\\d+)")
+local p2 = auto.regex("cache (\\d+)")
+assert(p1:match("cache 1") ~= nil)
+assert(p2:match("cache 2") ~= nil)
+
+stat = auto.regex_cache()
+assert(stat.miss == miss + 1)
+assert(stat.hit == hit + 1)
+
+-- string_split share the same cache
+for i = 1, 100 do
+    local l = auto.string_split("a,b,c", ",")
+    assert(#l == 3)
+end
+
+stat = auto.regex_cache()
+assert(stat.miss == miss + 2)
+assert(stat.hit == hit + 100)
+
+-- regex_set share the same cache
+local set = auto.regex_set({ "cache (\\d+)", "set \\d+" })
+assert(#set:match("set 1") == 1)
+stat = auto.regex_cache()
+assert(stat.miss == miss + 3)
+assert(stat.hit == hit + 101)
+
+-- Evicted regex is still usable
+stat = auto.regex_cache(0)
+assert(stat.size == 0)
+assert(p1:match("cache 3") ~= nil)
+
+stat = auto.regex_cache(64)
+assert(stat.capacity == 64)
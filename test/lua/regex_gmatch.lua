@@ -0,0 +1,48 @@
+-- gmatch yield captures, unset group is false
+local result = {}
+for a, b in auto.regex("(\\w)(\\d)?"):gmatch("a1 b c3") do
+    table.insert(result, a .. tostring(b))
+end
+assert(table.concat(result, ",") == "a1,bfalse,c3")
+
+-- Whole match is returned if no capture group
+result = {}
+for m in auto.regex("\\d+"):gmatch("ab12cd345", 3) do
+    table.insert(result, m)
+end
+assert(table.concat(result, ",") == "2,345")
+
+-- Empty match advance one character
+local empty = auto.regex("x*")
+assert(empty:count("axxb") == 4)
+assert(auto.regex(""):count("h\u{e9}llo") == 6)
+
+-- find_all return flat { pos, length, ... } list
+local pos = auto.regex("\\d+"):find_all("ab12cd345")
+assert(#pos == 4)
+assert(pos[1] == 2 and pos[2] == 2 and pos[3] == 6 and pos[4] == 3)
+
+-- replace with template
+local str, cnt = auto.regex("(\\d+)-(\\d+)"):replace("1-2 33-44", "${2}:$1$$")
+assert(str == "2:1$ 44:33$")
+assert(cnt == 2)
+
+str, cnt = empty:replace("axxb", "-")
+assert(str == "-a--b-")
+assert(cnt == 4)
+
+-- replace with function, nil keep original text
+str = auto.regex("\\d+"):replace("1 2 3", function(m)
+    if m == "2" then
+        return nil
+    end
+    return m * 10
+end)
+assert(str == "10 2 30")
+
+-- replace at most n times
+str, cnt = auto.regex("\\d"):replace("1 2 3", "x", 2)
+assert(str == "x x 3")
+assert(cnt == 2)
+
+assert(pcall(function() auto.regex("a"):replace("a", "$5") end) == false)
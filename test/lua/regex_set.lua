@@ -0,0 +1,54 @@
+local patterns = {
+    "connection refused",
+    "status=5\\d\\d",
+    "user (\\w+) logged in",
+    "^\\d+$",
+    "timeout|deadline",
+    "colou?r",
+}
+local set = auto.regex_set(patterns)
+assert(#set == #patterns)
+
+local function check(line, expect)
+    assert(table.concat(set:match(line), ",") == expect, line)
+end
+
+check("connection refused by peer", "1")
+check("request done status=503", "2")
+check("user bob logged in, connection refused", "1,3")
+check("12345", "4")
+check("deadline exceeded", "5")
+check("color and colour", "6")
+check("nothing interesting", "")
+
+-- Result is same as matching every pattern
+local regex_list = {}
+for i, p in ipairs(patterns) do
+    regex_list[i] = auto.regex(p)
+end
+for _, line in ipairs({ "status=500 timeout", "colr", "user  logged in", "" }) do
+    local expect = {}
+    for i, re in ipairs(regex_list) do
+        if re:match(line) ~= nil then
+            table.insert(expect, i)
+        end
+    end
+    check(line, table.concat(expect, ","))
+end
+
+assert(#auto.regex_set({}):match("any") == 0)
+assert(pcall(auto.regex_set, { "(" }) == false)
+
+-- Quoted parentheses in group do not hide alternation
+local quoted = { "(x|\\Q)\\Eabc(\\Q(\\E))", "[\\Q]\\E]yz" }
+local quoted_set = auto.regex_set(quoted)
+for _, line in ipairs({ "x", ")abc(", "]yz", "yz", "abc" }) do
+    local expect = {}
+    for i, p in ipairs(quoted) do
+        if auto.regex(p):match(line) ~= nil then
+            table.insert(expect, i)
+        end
+    end
+    assert(table.concat(quoted_set:match(line), ",") == table.concat(expect, ","), line)
+end
+assert(#quoted_set:match("x") == 1)
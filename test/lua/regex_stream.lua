@@ -0,0 +1,51 @@
+local data = "id=1 foo\nid=22 bar \u{e9}\u{e9}\nid=333 foo"
+local path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/regex_stream.txt"
+local file = io.open(path, "wb")
+file:write(data)
+file:close()
+
+local function collect(iter)
+    local result = {}
+    for pos, v in iter do
+        table.insert(result, pos .. ":" .. v)
+    end
+    return table.concat(result, ",")
+end
+
+local function chunk_reader(size)
+    local pos = 1
+    return function()
+        if pos > #data then
+            return nil
+        end
+        local chunk = data:sub(pos, pos + size - 1)
+        pos = pos + size
+        return chunk
+    end
+end
+
+local cases = {
+    { "id=(\\d+)", "0:1,9:22,24:333" },
+    { "\u{e9}+", "19:\u{e9}\u{e9}" },
+    { "(?m)^id", "0:id,9:id,24:id" },
+    { "foo$", "31:foo" },
+}
+
+for _, case in ipairs(cases) do
+    local re = auto.regex(case[1])
+
+    -- Offsets are absolute, same as matching the whole string
+    assert(collect(re:gmatch_file(path)) == case[2], case[1])
+
+    -- Matches across chunk boundary are found
+    for _, size in ipairs({ 1, 2, 3, 7, 1024 }) do
+        assert(collect(re:gmatch_stream(chunk_reader(size))) == case[2], case[1])
+    end
+end
+
+assert(pcall(function() auto.regex("x"):gmatch_file(path .. ".missing") end) == false)
+
+-- Only regular file can be mapped
+assert(pcall(function() auto.regex("x"):gmatch_file(os.getenv("CMAKE_CURRENT_BINARY_DIR")) end) == false)
+
+auto.fs_delete(path)
@@ -0,0 +1,29 @@
+-- Coroutines wake up in order of timeout
+local order = {}
+local list = {}
+for i, timeout in ipairs({ 30, 10, 200, 0, 20, 70 }) do
+    list[i] = auto.coroutine(function()
+        auto.sleep(timeout)
+        order[#order + 1] = timeout
+    end)
+end
+for _, co in ipairs(list) do
+    co:await()
+end
+assert(table.concat(order, ",") == "0,10,20,30,70,200")
+
+-- Coroutine resumed early does not wake up again by its old timer
+local stage = 0
+local co = auto.coroutine(function()
+    auto.sleep(100000)
+    stage = 1
+end)
+auto.sleep(1)
+co:resume()
+auto.sleep(1)
+assert(stage == 1)
+
+-- Sleep time is respected
+local beg = os.time()
+auto.sleep(1100)
+assert(os.time() - beg >= 1)
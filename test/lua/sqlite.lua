@@ -1,7 +1,15 @@
 local db = auto.sqlite()
 assert(db ~= nil)
 
-local csv_file_path = os.getenv("PROJECT_SOURCE_DIR") .. "/third_party/CsvParser/examples/example_file_with_header.csv"
+local csv_file_path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/sqlite.csv"
+local f = assert(io.open(csv_file_path, "wb"))
+f:write([[
+Country,Continent/Area,National Language
+United States,North America,English
+Canada,North America,English / French
+Mexico,North America,Spainish
+]])
+f:close()
 
 db:from_csv_file("a_test_table", csv_file_path)
 io.write(db:to_csv("a_test_table") .. "\n")
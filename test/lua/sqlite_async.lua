@@ -0,0 +1,96 @@
+local db = auto.sqlite({ filename = ":memory:" })
+db:exec("CREATE TABLE t(id INTEGER, name TEXT, score REAL, data BLOB)")
+local insert = db:prepare("INSERT INTO t VALUES(?, ?, ?, ?)")
+local data = {}
+for i = 1, 1000 do
+    data[i] = { i, "name" .. i, i / 4, i % 10 == 0 and "a\0b" or nil }
+end
+insert:exec_many(data)
+insert:close()
+
+-- exec_async return the same rows as exec, small batches exercise back pressure
+local sql = "SELECT * FROM t ORDER BY id; SELECT count(*) AS n FROM t"
+local expect, expect_cnt = db:exec(sql, { typed = true })
+local rows, cnt = db:exec_async(sql, { batch_size = 7 })
+assert(cnt == expect_cnt and cnt == 1001)
+for i = 1, cnt do
+    for k, v in pairs(expect[i]) do
+        assert(rows[i][k] == v)
+    end
+    for k in pairs(rows[i]) do
+        assert(expect[i][k] ~= nil)
+    end
+end
+assert(math.type(rows[1].id) == "integer")
+assert(rows[10].data == "a\0b")
+assert(rows[1001].n == 1000)
+
+-- step_async deliver rows in batches, then nil
+local stmt = db:prepare("SELECT id FROM t WHERE id > ? ORDER BY id")
+stmt:bind(990)
+local batches = {}
+while true do
+    local batch = stmt:step_async(4)
+    if batch == nil then
+        break
+    end
+    table.insert(batches, #batch)
+end
+assert(table.concat(batches, ",") == "4,4,2")
+stmt:reset()
+
+-- Error is raised in the calling coroutine
+local ok, err = pcall(db.exec_async, db, "SELECT * FROM no_such_table")
+assert(not ok and string.find(err, "no_such_table"))
+assert(#db:exec("SELECT 1 AS v") == 1)
+
+-- Other coroutines keep running during a long query
+local ticks = 0
+local running = true
+local ticker = auto.coroutine(function()
+    while running do
+        ticks = ticks + 1
+        auto.sleep(1)
+    end
+end)
+local slow = "WITH RECURSIVE r(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM r WHERE i < 2000000) SELECT sum(i) AS s FROM r"
+rows = db:exec_async(slow)
+running = false
+ticker:await()
+assert(rows[1].s == 2000001000000)
+assert(ticks > 1)
+
+-- Connection is busy while an async query is running
+local query = auto.coroutine(function()
+    return db:exec_async(slow)
+end)
+auto.sleep(1)
+ok, err = pcall(db.exec, db, "SELECT 1")
+assert(not ok and string.find(err, "busy"))
+local ret
+ok, ret = query:await()
+assert(ok and ret[1].s == 2000001000000)
+
+-- Close waiting coroutine interrupt its query, and it is never woken up again
+query = auto.coroutine(function()
+    return db:exec_async(slow)
+end)
+auto.sleep(1)
+query:close()
+assert(tonumber(db:exec("SELECT 1 AS v")[1].v) == 1)
+local sleeper = auto.coroutine(function()
+    local beg = auto.stats().uptime
+    auto.sleep(200)
+    return auto.stats().uptime - beg
+end)
+local _, elapsed = sleeper:await()
+assert(elapsed >= 0.15, elapsed)
+
+-- Close interrupt running query
+query = auto.coroutine(function()
+    return pcall(db.exec_async, db, slow)
+end)
+auto.sleep(1)
+db:close()
+local q_ok, p_ok = query:await()
+assert(q_ok and p_ok == false)
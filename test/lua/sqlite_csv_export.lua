@@ -0,0 +1,84 @@
+local db = auto.sqlite({ filename = ":memory:" })
+db:exec("CREATE TABLE t(id INTEGER, name TEXT, score REAL)")
+local insert = db:prepare("INSERT INTO t VALUES(?, ?, ?)")
+insert:exec_many({
+    { 1, "plain", 1.5 },
+    { 2, "a,b", nil },
+    { 3, 'say "hi"', 2 },
+    { 4, "two\nlines", nil },
+    { 5, " padded ", nil },
+})
+insert:close()
+
+local expect = "id,name,score\r\n"
+    .. "1,plain,1.5\r\n"
+    .. "2,\"a,b\",\r\n"
+    .. "3,\"say \"\"hi\"\"\",2.0\r\n"
+    .. "4,\"two\nlines\",\r\n"
+    .. "5,\" padded \","
+
+-- to_csv keep the old format without trailing line wrapper
+assert(db:to_csv("t") == expect)
+
+-- Iterator return header then one line per row
+local lines = {}
+for line in db:to_csv_rows("t") do
+    table.insert(lines, line)
+end
+assert(#lines == 6)
+assert(lines[1] == "id,name,score\r\n")
+assert(table.concat(lines) == expect .. "\r\n")
+
+-- Break out of iterator release the statement
+for _ in db:to_csv_rows("t") do
+    break
+end
+
+-- File export stream rows, round trip through from_csv_file
+local path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/sqlite_csv_export.csv"
+db:to_csv_file("t", path, "w")
+local f = io.open(path, "rb")
+assert(f:read("a") == expect .. "\r\n")
+f:close()
+
+assert(db:from_csv_file("copy", path, { infer_types = true }) == 5)
+local rows = db:exec("SELECT * FROM copy ORDER BY id")
+assert(rows[2].name == "a,b")
+assert(rows[3].name == 'say "hi"')
+assert(rows[4].name == "two\nlines")
+
+-- Larger than write buffer
+db:exec("CREATE TABLE big(v TEXT)")
+insert = db:prepare("INSERT INTO big VALUES(?)")
+local big = {}
+for i = 1, 2000 do
+    big[i] = { string.rep("x", i % 97) .. i }
+end
+insert:exec_many(big)
+insert:close()
+db:to_csv_file("big", path, "w")
+f = io.open(path, "rb")
+local data = f:read("a")
+f:close()
+assert(data == db:to_csv("big") .. "\r\n")
+os.remove(path)
+
+-- Error is raised for unknown table
+assert(not pcall(db.to_csv, db, "no_such_table"))
+assert(not pcall(db.to_csv_rows, db, "no_such_table"))
+
+-- Iterator stop on closed or busy connection
+local iter = db:to_csv_rows("t")
+assert(iter() == "id,name,score\r\n")
+local slow = "WITH RECURSIVE r(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM r WHERE i < 2000000) SELECT sum(i) AS s FROM r"
+local query = auto.coroutine(function()
+    return db:exec_async(slow)
+end)
+auto.sleep(1)
+local ok, err = pcall(iter)
+assert(not ok and string.find(err, "busy"), err)
+assert(query:await())
+
+db:close()
+ok, err = pcall(iter)
+assert(not ok and string.find(err, "closed"), err)
@@ -0,0 +1,51 @@
+local db = auto.sqlite({ filename = ":memory:" })
+
+-- Header row gives column names, values are kept as text by default
+local csv = "id,name,score\n1,alice,1.5\n2,bob,2\n"
+assert(db:from_csv("plain", csv) == 2)
+local rows = db:exec("SELECT * FROM plain ORDER BY id")
+assert(rows[1].id == "1" and rows[1].name == "alice" and rows[1].score == "1.5")
+
+-- Type inference store numbers natively and empty fields as NULL
+csv = "id,name,score,code\n1,alice,1.5,007\n2,,-2e3,42\n3,carol,,x\n"
+assert(db:from_csv("typed", csv, { infer_types = true, batch_size = 2 }) == 3)
+rows = db:exec("SELECT * FROM typed ORDER BY id", { typed = true })
+assert(math.type(rows[1].id) == "integer" and rows[1].id == 1)
+assert(rows[1].score == 1.5)
+assert(rows[1].code == "007")
+assert(rows[2].name == nil)
+assert(rows[2].score == -2000.0)
+-- Column type come from the first row, so "code" is TEXT
+assert(rows[2].code == "42")
+assert(rows[3].score == nil and rows[3].code == "x")
+
+-- Without header columns are named c1, c2, ... and short rows are padded
+assert(db:from_csv("noheader", "a,b,c\nd,e\n", false) == 2)
+rows = db:exec("SELECT * FROM noheader ORDER BY c1")
+assert(rows[1].c3 == "c")
+assert(rows[2].c2 == "e" and rows[2].c3 == nil)
+
+-- A bad row roll back the whole import
+local ok = pcall(db.from_csv, db, "bad", "a,b\n1,2\n3,4,5\n")
+assert(not ok)
+assert(#db:exec("SELECT name FROM sqlite_master WHERE name = 'bad'") == 0)
+
+-- Import inside a transaction is a savepoint of it
+db:exec("BEGIN")
+assert(db:from_csv("in_txn", "v\n1\n2\n") == 2)
+ok = pcall(db.from_csv, db, "in_txn", "v\n3\n4,5\n")
+assert(not ok)
+db:exec("COMMIT")
+assert(#db:exec("SELECT * FROM in_txn") == 2)
+
+-- File import
+local path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/sqlite_csv_import.csv"
+local f = io.open(path, "w")
+f:write("k,v\n")
+for i = 1, 1000 do
+    f:write(string.format("%d,value %d\n", i, i))
+end
+f:close()
+assert(db:from_csv_file("file", path, { infer_types = true, batch_size = 100 }) == 1000)
+assert(db:exec("SELECT sum(k) AS s FROM file", { typed = true })[1].s == 500500)
+os.remove(path)
@@ -0,0 +1,70 @@
+local db = auto.sqlite({ filename = ":memory:" })
+db:exec("CREATE TABLE t(name TEXT, score INTEGER)")
+local insert = db:prepare("INSERT INTO t VALUES(?, ?)")
+local data = {}
+for i = 1, 10 do
+    data[i] = { "user_" .. i, i }
+end
+insert:exec_many(data)
+insert:close()
+
+-- Built-in regexp, also used by REGEXP operator
+assert(db:exec("SELECT count(*) AS n FROM t WHERE name REGEXP '_[0-9]$'", { typed = true })[1].n == 9)
+assert(db:exec("SELECT regexp('^u.*1', 'user_10') AS m", { typed = true })[1].m == 1)
+assert(db:exec("SELECT regexp('^x', 'user_10') AS m", { typed = true })[1].m == 0)
+assert(db:exec("SELECT regexp('^x', NULL) AS m", { typed = true })[1].m == nil)
+assert(db:exec("SELECT regexp_capture('key=value', '(\\w+)=(\\w+)', 2) AS v", { typed = true })[1].v == "value")
+assert(db:exec("SELECT regexp_capture('key=value', '\\w+') AS v", { typed = true })[1].v == "key")
+assert(db:exec("SELECT regexp_capture('key', '(=)') AS v", { typed = true })[1].v == nil)
+assert(pcall(db.exec, db, "SELECT regexp('(', 'x')") == false)
+
+-- JSON extraction is native to SQLite
+assert(db:exec([[SELECT '{"a":{"b":3}}' ->> '$.a.b' AS v]], { typed = true })[1].v == 3)
+
+-- Scalar function
+db:create_function("add_one", function(v) return v + 1 end, { nargs = 1, deterministic = true })
+local rows = db:exec("SELECT add_one(score) AS v FROM t ORDER BY score", { typed = true })
+assert(#rows == 10 and rows[1].v == 2 and rows[10].v == 11)
+assert(db:exec("SELECT add_one(1.5) AS v", { typed = true })[1].v == 2.5)
+
+-- Arguments and results keep their types
+db:create_function("echo", function(...) return ... end)
+assert(db:exec("SELECT echo('abc') AS v", { typed = true })[1].v == "abc")
+assert(db:exec("SELECT echo(NULL) AS v", { typed = true })[1].v == nil)
+assert(db:exec("SELECT typeof(echo(1)) AS v", { typed = true })[1].v == "integer")
+db:create_function("is_even", function(v) return v % 2 == 0 end, { nargs = 1 })
+assert(db:exec("SELECT count(*) AS n FROM t WHERE is_even(score)", { typed = true })[1].n == 5)
+
+-- Errors raised in Lua are reported as SQL errors
+db:create_function("fail", function() error("boom") end)
+local ok, err = pcall(db.exec, db, "SELECT fail()")
+assert(not ok and string.find(err, "boom"))
+db:create_function("bad_result", function() return {} end)
+ok, err = pcall(db.exec, db, "SELECT bad_result()")
+assert(not ok and string.find(err, "unsupported return type"))
+
+-- Redefining a function replaces it
+db:create_function("add_one", function(v) return v + 100 end, { nargs = 1 })
+assert(db:exec("SELECT add_one(1) AS v", { typed = true })[1].v == 101)
+
+-- Aggregate function
+db:create_function("concat_all", {
+    step = function(state, v)
+        state[#state + 1] = v
+    end,
+    final = function(state)
+        return table.concat(state, ",")
+    end,
+}, { nargs = 1 })
+assert(db:exec("SELECT concat_all(score) AS v FROM t WHERE score <= 3", { typed = true })[1].v == "1,2,3")
+assert(db:exec("SELECT concat_all(score) AS v FROM t WHERE score > 100", { typed = true })[1].v == "")
+rows = db:exec("SELECT score % 2 AS k, concat_all(score) AS v FROM t GROUP BY k ORDER BY k")
+assert(rows[1].v == "2,4,6,8,10" and rows[2].v == "1,3,5,7,9")
+assert(pcall(db.create_function, db, "bad_agg", { step = function() end }) == false)
+
+-- Lua functions cannot run outside of Lua thread
+auto.coroutine(function()
+    local ok, err = pcall(db.exec_async, db, "SELECT add_one(1)")
+    assert(not ok and string.find(err, "async"))
+    assert(db:exec_async("SELECT regexp('^a', 'abc') AS m", { typed = true })[1].m == 1)
+end)
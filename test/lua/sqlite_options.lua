@@ -0,0 +1,56 @@
+local path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/sqlite_options.db"
+os.remove(path)
+os.remove(path .. "-wal")
+os.remove(path .. "-shm")
+
+local function pragma(db, name)
+    local rows = db:exec("PRAGMA " .. name, { typed = true })
+    local _, v = next(rows[1])
+    return v
+end
+
+local db = auto.sqlite({
+    filename = path,
+    journal_mode = "WAL",
+    synchronous = "normal",
+    cache_size = -4096,
+    mmap_size = 1048576,
+    temp_store = "memory",
+    busy_timeout = 250,
+})
+assert(pragma(db, "journal_mode") == "wal")
+assert(pragma(db, "synchronous") == 1)
+assert(pragma(db, "cache_size") == -4096)
+assert(pragma(db, "temp_store") == 2)
+db:exec("CREATE TABLE t(v INTEGER); INSERT INTO t VALUES(1)")
+db:close()
+
+-- Integer values are accepted for enumerations
+db = auto.sqlite({ filename = path, synchronous = 3, temp_store = 1 })
+assert(pragma(db, "synchronous") == 3)
+assert(pragma(db, "temp_store") == 1)
+db:close()
+
+-- Read only connection can not write
+db = auto.sqlite({ filename = path, readonly = true, nomutex = true })
+assert(db:exec("SELECT v FROM t", { typed = true })[1].v == 1)
+assert(not pcall(db.exec, db, "INSERT INTO t VALUES(2)"))
+
+-- Worker thread cannot share a connection without mutex
+local ok, err = pcall(db.exec_async, db, "SELECT v FROM t")
+assert(not ok and err:find("nomutex", 1, true), err)
+db:close()
+ok, err = pcall(auto.sqlite_pool, { filename = path, nomutex = true })
+assert(not ok and err:find("nomutex", 1, true), err)
+
+-- Read only open does not create file
+assert(not pcall(auto.sqlite, { filename = path .. ".missing", readonly = true }))
+
+-- Invalid values are rejected
+assert(not pcall(auto.sqlite, { filename = ":memory:", journal_mode = "fast" }))
+assert(not pcall(auto.sqlite, { filename = ":memory:", synchronous = 7 }))
+assert(not pcall(auto.sqlite, { filename = ":memory:", cache_size = "big" }))
+
+os.remove(path)
+os.remove(path .. "-wal")
+os.remove(path .. "-shm")
@@ -0,0 +1,89 @@
+local path = os.getenv("CMAKE_CURRENT_BINARY_DIR") .. "/sqlite_pool.db"
+os.remove(path)
+os.remove(path .. "-wal")
+os.remove(path .. "-shm")
+
+local db = auto.sqlite({ filename = path })
+db:exec("CREATE TABLE t(id INTEGER PRIMARY KEY, v INTEGER)")
+local insert = db:prepare("INSERT INTO t VALUES(?, ?)")
+local data = {}
+for i = 1, 1000 do
+    data[i] = { i, i % 10 }
+end
+insert:exec_many(data)
+insert:close()
+
+local pool = auto.sqlite_pool({ filename = path, size = 3 })
+assert(#pool == 3)
+assert(pool:exec("PRAGMA journal_mode")[1].journal_mode == "wal")
+
+-- More queries than connections, extra ones wait for an idle connection
+local slow = "WITH RECURSIVE r(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM r WHERE i < 300000) SELECT sum(i) AS s FROM r"
+local queries = {}
+for i = 1, 8 do
+    queries[i] = auto.coroutine(function()
+        local rows = pool:exec(slow)
+        local cnt = pool:exec("SELECT count(*) AS n FROM t WHERE v = " .. (i % 10))
+        return rows[1].s, cnt[1].n
+    end)
+end
+for i = 1, 8 do
+    local ok, s, n = queries[i]:await()
+    assert(ok and s == 45000150000 and n == 100)
+end
+
+-- Writer keeps working while readers hold snapshots
+local rows, cnt = pool:exec("SELECT * FROM t WHERE id <= 3 ORDER BY id")
+assert(cnt == 3 and rows[3].v == 3)
+db:exec("UPDATE t SET v = 100 WHERE id = 1")
+assert(pool:exec("SELECT v FROM t WHERE id = 1")[1].v == 100)
+
+-- Connections are read only
+local ok, err = pcall(pool.exec, pool, "DELETE FROM t")
+assert(not ok and string.find(err, "readonly"))
+assert(#pool:exec("SELECT 1 AS v") == 1)
+
+-- Waiter closed after it is woken up pass the connection on
+local single = auto.sqlite_pool({ filename = path, size = 1 })
+local b, c
+local a = auto.coroutine(function()
+    single:exec(slow)
+    b:close()
+end)
+b = auto.coroutine(function() return single:exec("SELECT 1 AS v") end)
+c = auto.coroutine(function() return single:exec("SELECT 2 AS v") end)
+coroutine.yield()
+coroutine.yield()
+assert(a:await())
+local c_ok, c_rows = c:await()
+assert(c_ok and c_rows[1].v == 2)
+
+-- Waiter closed in queue leaves it
+a = auto.coroutine(function() return single:exec(slow) end)
+b = auto.coroutine(function() return single:exec("SELECT 1 AS v") end)
+coroutine.yield()
+coroutine.yield()
+b:close()
+assert(a:await())
+assert(single:exec("SELECT 3 AS v")[1].v == 3)
+single:close()
+
+-- Close interrupt running queries and fail waiting ones
+local running = {}
+for i = 1, 4 do
+    running[i] = auto.coroutine(function()
+        return pcall(pool.exec, pool, slow)
+    end)
+end
+auto.sleep(1)
+pool:close()
+for i = 1, 4 do
+    local q_ok, p_ok = running[i]:await()
+    assert(q_ok and p_ok == false)
+end
+assert(not pcall(pool.exec, pool, "SELECT 1"))
+
+assert(not pcall(auto.sqlite_pool, { size = 2 }))
+assert(not pcall(auto.sqlite_pool, { filename = path, size = 0 }))
+
+db:close()
@@ -0,0 +1,44 @@
+local db = auto.sqlite({ filename = ":memory:" })
+
+-- Multiple statements, results of all statements are returned
+local rows, cnt = db:exec([[
+    CREATE TABLE t(id INTEGER, name TEXT, score REAL);
+    INSERT INTO t VALUES(1, 'alice', 1.5), (2, NULL, 2.5), (3, 'carol', NULL);
+    SELECT * FROM t ORDER BY id;
+]], { typed = true })
+assert(cnt == 3 and #rows == 3)
+
+-- Values keep native types with `typed`, NULL is not set
+assert(math.type(rows[1].id) == "integer")
+assert(rows[1].name == "alice")
+assert(rows[2].score == 2.5)
+assert(rows[2].name == nil)
+assert(rows[3].score == nil)
+
+-- Values are text by default
+rows = db:exec("SELECT * FROM t ORDER BY id")
+assert(rows[1].id == "1" and rows[1].name == "alice" and rows[1].score == "1.5")
+assert(rows[2].name == nil and rows[3].score == nil)
+
+-- Columnar result
+local cols
+cols, cnt = db:exec("SELECT id, name FROM t ORDER BY id", { columnar = true, typed = true })
+assert(cnt == 3)
+assert(cols.id[1] == 1 and cols.id[2] == 2 and cols.id[3] == 3)
+assert(cols.name[1] == "alice" and cols.name[2] == nil and cols.name[3] == "carol")
+
+-- Fetch all rows of prepared statement
+local stmt = db:prepare("SELECT id FROM t WHERE id > ? ORDER BY id")
+stmt:bind(1)
+rows, cnt = stmt:fetch_all()
+assert(cnt == 2 and rows[1].id == 2 and rows[2].id == 3)
+
+stmt:reset():bind(0)
+cols, cnt = stmt:fetch_all({ columnar = true })
+assert(cnt == 3 and #cols.id == 3)
+
+-- No result
+rows, cnt = db:exec("DELETE FROM t")
+assert(cnt == 0 and next(rows) == nil)
+
+assert(pcall(db.exec, db, "SELECT * FROM no_such_table") == false)
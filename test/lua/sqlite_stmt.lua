@@ -0,0 +1,71 @@
+local db = auto.sqlite({ filename = ":memory:" })
+db:exec("CREATE TABLE t(id INTEGER, name TEXT, score REAL, data BLOB)")
+
+-- exec_many insert rows in one transaction, positional and named
+local insert = db:prepare("INSERT INTO t VALUES(?, ?, ?, ?)")
+assert(insert:exec_many({
+    { 1, "alice", 1.5 },
+    { 2, "bob", 2 },
+    { 3, nil, nil, "a\0b" },
+}) == 3)
+insert:close()
+
+local named = db:prepare("INSERT INTO t(id, name) VALUES(:id, @name)")
+named:bind({ id = 4, name = "carol" })
+assert(named:step() == nil)
+named:reset()
+assert(named:exec_many({ { id = 5, name = "dave" } }) == 1)
+
+-- Short row does not reuse values of previous row
+db:exec("CREATE TABLE s(a, b)")
+local insert_s = db:prepare("INSERT INTO s VALUES(?, ?)")
+insert_s:exec_many({ { 1, "x" }, { 2 } })
+insert_s:close()
+assert(db:exec("SELECT b FROM s WHERE a = 2")[1].b == nil)
+
+-- step return rows with native types
+local query = db:prepare("SELECT * FROM t WHERE id >= ? ORDER BY id")
+query:bind(1)
+local row = query:step()
+assert(row.id == 1 and math.type(row.id) == "integer")
+assert(row.name == "alice")
+assert(row.score == 1.5)
+assert(row.data == nil)
+
+-- rows() restart the query and accept new parameters
+local ids = {}
+for r in query:rows(3) do
+    table.insert(ids, r.id)
+end
+assert(table.concat(ids, ",") == "3,4,5")
+
+for r in query:rows(3) do
+    if r.id == 3 then
+        assert(r.data == "a\0b")
+    end
+end
+
+-- Failed row rollback the whole batch
+db:exec("CREATE TABLE u(id INTEGER UNIQUE)")
+local insert_u = db:prepare("INSERT INTO u VALUES(?)")
+assert(pcall(insert_u.exec_many, insert_u, { { 1 }, { 2 }, { 2 } }) == false)
+assert(#db:exec("SELECT * FROM u") == 0)
+
+-- Statement is reused from cache after close
+local s1 = db:prepare("SELECT count(*) AS cnt FROM t")
+assert(s1:step().cnt == 5)
+s1:close()
+assert(pcall(s1.step, s1) == false)
+local s2 = db:prepare("SELECT count(*) AS cnt FROM t")
+assert(s2:step().cnt == 5)
+
+-- Same SQL can be used by two statements at the same time
+local s3 = db:prepare("SELECT count(*) AS cnt FROM t")
+assert(s3:step().cnt == 5)
+
+assert(pcall(db.prepare, db, "SELECT * FROM no_such_table") == false)
+assert(pcall(db.prepare, db, "SELECT 1; SELECT 2") == false)
+
+-- Statement is invalid after connection closed
+db:close()
+assert(pcall(s2.step, s2) == false)
@@ -0,0 +1,48 @@
+local dir = os.getenv("CMAKE_CURRENT_BINARY_DIR")
+local csv_path = dir .. "/sqlite_vtab.csv"
+local ndjson_path = dir .. "/sqlite_vtab.ndjson"
+
+local f = io.open(csv_path, "wb")
+f:write("id,name,score\r\n")
+for i = 1, 100 do
+    f:write(string.format("%d,\"name, %d\",%d\r\n", i, i, i * 10))
+end
+f:close()
+
+f = io.open(ndjson_path, "wb")
+f:write('{"id":1,"name":"alice","tags":["a","b"],"ok":true}\n')
+f:write('{"name":"bob","id":2,"score":1.5}\n')
+f:write('\n')
+f:write('{"id":3}\n')
+f:close()
+
+local db = auto.sqlite({ filename = ":memory:" })
+
+-- CSV file is queried in place, column names come from header
+db:exec(string.format("CREATE VIRTUAL TABLE temp.t USING csv('%s')", csv_path))
+local rows = db:exec("SELECT name, score FROM t WHERE id = '42'")
+assert(#rows == 1 and rows[1].name == "name, 42" and rows[1].score == "420")
+assert(db:exec("SELECT count(*) AS n FROM t", { typed = true })[1].n == 100)
+assert(db:exec("SELECT sum(score) AS s FROM t", { typed = true })[1].s == 50500)
+assert(db:exec("SELECT rowid FROM t WHERE id = '1'", { typed = true })[1].rowid == 1)
+
+-- Without header, columns are named c1, c2, ...
+db:exec(string.format("CREATE VIRTUAL TABLE temp.raw USING csv(filename='%s', header=false)", csv_path))
+rows = db:exec("SELECT c1 FROM raw LIMIT 1")
+assert(rows[1].c1 == "id")
+
+-- NDJSON columns come from keys of first object
+db:exec(string.format("CREATE VIRTUAL TABLE temp.j USING ndjson('%s')", ndjson_path))
+rows = db:exec("SELECT * FROM j ORDER BY id", { typed = true })
+assert(#rows == 3)
+assert(rows[1].id == 1 and rows[1].name == "alice" and rows[1].tags == '["a","b"]' and rows[1].ok == 1)
+assert(rows[2].name == "bob")
+assert(rows[3].name == nil)
+assert(db:exec("SELECT count(*) AS n FROM j", { typed = true })[1].n == 3)
+
+-- Bad arguments
+assert(not pcall(db.exec, db, "CREATE VIRTUAL TABLE temp.e1 USING csv()"))
+assert(not pcall(db.exec, db, "CREATE VIRTUAL TABLE temp.e2 USING csv('" .. csv_path .. ".missing')"))
+assert(not pcall(db.exec, db, "CREATE VIRTUAL TABLE temp.e3 USING csv('" .. csv_path .. "', bad=1)"))
+
+db:close()
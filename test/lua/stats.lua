@@ -0,0 +1,72 @@
+local s = auto.stats()
+assert(s.coroutines == 1 and s.busy == 1 and s.wait == 0)
+assert(s.list == nil)
+
+-- A slow coroutine can be found by time
+local function spin(ms)
+    local beg = os.clock()
+    while os.clock() - beg < ms / 1000 do end
+end
+
+local slow = auto.coroutine(function()
+    for _ = 1, 5 do
+        spin(10)
+        coroutine.yield()
+    end
+end)
+local sleepers = {}
+for i = 1, 10 do
+    sleepers[i] = auto.coroutine(function()
+        auto.sleep(200)
+    end)
+end
+-- New coroutines run in next schedule pass
+coroutine.yield()
+coroutine.yield()
+
+s = auto.stats(true)
+assert(s.coroutines == 12)
+assert(s.wait == 10 and s.busy == 2)
+assert(#s.list == 12)
+local slowest
+for _, v in ipairs(s.list) do
+    assert(math.type(v.id) == "integer" and v.id > 0)
+    assert(v.traceback:find("stack traceback", 1, true))
+    assert(v.status == "busy" or v.status == "wait")
+    assert(v.resume >= 0 and v.time >= 0 and v.preempt == 0)
+    if slowest == nil or v.time > slowest.time then
+        slowest = v
+    end
+end
+assert(slowest.time >= 0.005)
+
+assert(slow:await())
+local cs = slow:stats()
+assert(cs.resume == 6 and cs.time >= 0.05 and cs.preempt == 0)
+auto.await_all(sleepers)
+cs = sleepers[1]:stats()
+assert(cs.resume == 2 and cs.time < cs.resume)
+
+-- Global counters
+s = auto.stats()
+assert(s.coroutines == 1)
+assert(s.resume > 20 and s.resume_rate > 0)
+assert(s.resume_time >= 0.05 and s.poll_time >= 0.1)
+assert(s.uptime >= s.resume_time)
+assert(s.spurious_wakeup >= 0 and s.busy_poll > 0)
+
+-- Loop lag when a coroutine blocks the loop
+local t = auto.coroutine(function() auto.sleep(10) end)
+coroutine.yield()
+coroutine.yield()
+spin(100)
+t:await()
+s = auto.stats()
+assert(s.loop_lag_max >= 50, s.loop_lag_max)
+
+-- Preemption is counted
+local p = auto.coroutine(function() spin(50) end)
+p:preempt({ count = 1000 })
+p:await()
+assert(p:stats().preempt > 0 and p:stats().preempt == p:preempted())
+assert(auto.stats().preempt == p:preempted())
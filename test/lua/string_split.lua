@@ -26,3 +26,9 @@ if true then
     local l = auto.string_split(src, "hello world")
     assert(json:compare(json:encode(dst), json:encode(l)) == true)
 end
+
+-- Pattern with many groups
+do
+    local l = auto.string_split("x" .. string.rep("a", 40) .. "y", string.rep("(a)", 40))
+    assert(#l == 2 and l[1] == "x" and l[2] == "y")
+end
@@ -0,0 +1,157 @@
+-- Semaphore caps concurrency
+local sem = auto.semaphore(3)
+assert(#sem == 3)
+local running, max_running, finished = 0, 0, 0
+local list = {}
+for i = 1, 20 do
+    list[i] = auto.coroutine(function()
+        assert(sem:acquire())
+        running = running + 1
+        if running > max_running then
+            max_running = running
+        end
+        auto.sleep(i % 3 + 1)
+        running = running - 1
+        finished = finished + 1
+        sem:release()
+    end)
+end
+for i = 1, 20 do
+    assert(list[i]:await())
+end
+assert(max_running == 3 and finished == 20 and #sem == 3)
+
+-- Semaphore timeout
+sem = auto.semaphore(0)
+local ok, err = sem:acquire(10)
+assert(ok == false and err == "timeout")
+ok, err = sem:acquire(0)
+assert(ok == false and err == "timeout")
+sem:release()
+assert(sem:acquire(0))
+
+-- Waiters are served in order
+sem = auto.semaphore(0)
+local order = {}
+for i = 1, 5 do
+    list[i] = auto.coroutine(function()
+        sem:acquire()
+        order[#order + 1] = i
+    end)
+end
+auto.sleep(1)
+for i = 1, 5 do
+    sem:release()
+end
+for i = 1, 5 do
+    list[i]:await()
+end
+assert(table.concat(order, ",") == "1,2,3,4,5")
+
+-- Mutex protects critical section across yields
+local mutex = auto.mutex()
+local counter = 0
+local inside = 0
+for i = 1, 10 do
+    list[i] = auto.coroutine(function()
+        for _ = 1, 5 do
+            mutex:lock()
+            inside = inside + 1
+            assert(inside == 1)
+            local v = counter
+            auto.sleep(0)
+            counter = v + 1
+            inside = inside - 1
+            mutex:unlock()
+        end
+    end)
+end
+for i = 1, 10 do
+    assert(list[i]:await())
+end
+assert(counter == 50 and not mutex:locked())
+
+-- Mutex misuse
+assert(not pcall(mutex.unlock, mutex))
+mutex:lock()
+assert(mutex:locked())
+assert(not pcall(mutex.lock, mutex))
+local other = auto.coroutine(function()
+    local ok1 = pcall(mutex.unlock, mutex)
+    local ok2, err2 = mutex:lock(10)
+    return ok1, ok2, err2
+end)
+local _, ok1, ok2, err2 = other:await()
+assert(ok1 == false and ok2 == false and err2 == "timeout")
+mutex:unlock()
+
+-- Wait group
+local wg = auto.waitgroup()
+assert(wg:wait())
+local done = 0
+for i = 1, 8 do
+    wg:add()
+    auto.coroutine(function()
+        auto.sleep(i)
+        done = done + 1
+        wg:done()
+    end)
+end
+assert(#wg == 8)
+local waiters = {}
+for i = 1, 3 do
+    waiters[i] = auto.coroutine(function()
+        return wg:wait()
+    end)
+end
+assert(wg:wait())
+assert(done == 8 and #wg == 0)
+for i = 1, 3 do
+    local co_ok, wg_ok = waiters[i]:await()
+    assert(co_ok and wg_ok)
+end
+assert(not pcall(wg.done, wg))
+
+wg:add(2)
+ok, err = wg:wait(10)
+assert(ok == false and err == "timeout")
+wg:add(-2)
+assert(wg:wait(0))
+
+-- Closed waiter does not take the permit
+sem = auto.semaphore(0)
+local closed = auto.coroutine(function() return sem:acquire() end)
+coroutine.yield()
+coroutine.yield()
+closed:close()
+sem:release()
+assert(#sem == 1)
+assert(sem:acquire(200))
+
+-- Permit granted to a waiter closed before it runs goes to the next one
+local first = auto.coroutine(function() return sem:acquire() end)
+local second = auto.coroutine(function() return sem:acquire() end)
+coroutine.yield()
+coroutine.yield()
+sem:release()
+first:close()
+local co_ok, sem_ok = second:await()
+assert(co_ok and sem_ok and #sem == 0)
+
+-- Closed waiter does not take the lock
+mutex:lock()
+closed = auto.coroutine(function() return mutex:lock() end)
+coroutine.yield()
+coroutine.yield()
+closed:close()
+mutex:unlock()
+assert(not mutex:locked())
+
+-- Lock is released when owner finishes, and owner is not mistaken for the
+-- coroutine that reuses its context
+local owner = auto.coroutine(function() return mutex:lock() end)
+assert(owner:await())
+assert(not mutex:locked())
+other = auto.coroutine(function() return pcall(mutex.unlock, mutex) end)
+local _, unlocked = other:await()
+assert(unlocked == false)
@@ -0,0 +1,60 @@
+local autodo = os.getenv("AUTODO")
+local dir = os.getenv("CMAKE_CURRENT_BINARY_DIR")
+if autodo == nil or package.config:sub(1, 1) ~= "/" then
+    return
+end
+
+local script = dir .. "/trace_child.lua"
+local output = dir .. "/trace.json"
+os.remove(output)
+
+local f = assert(io.open(script, "wb"))
+f:write([[
+local ch = auto.channel()
+local co = auto.coroutine(function()
+    auto.sleep(20)
+    ch:send(1)
+    auto.sleep(10)
+    return 1
+end)
+assert(ch:recv() == 1)
+assert(co:await())
+local proc = auto.process({ file = "sleep", args = { "sleep", "0.05" } })
+proc:join()
+]])
+f:close()
+
+local proc = auto.process({ file = autodo, args = { autodo, "--trace=" .. output, script } })
+assert(proc:join() == 0)
+
+f = assert(io.open(output, "rb"))
+local data = f:read("a")
+f:close()
+
+local db = auto.sqlite({ filename = ":memory:" })
+db:exec("CREATE TABLE t(c TEXT)")
+local insert = db:prepare("INSERT INTO t VALUES(?)")
+insert:exec_many({ { data } })
+insert:close()
+assert(db:exec("SELECT json_valid(c) AS v FROM t", { typed = true })[1].v == 1)
+
+local names = {}
+for _, row in ipairs(db:exec([[
+    SELECT DISTINCT e.value ->> '$.name' AS name, e.value ->> '$.ph' AS ph, e.value ->> '$.pid' AS pid
+    FROM t, json_each(t.c, '$.traceEvents') AS e
+]])) do
+    names[row.name .. "/" .. row.ph .. "/" .. row.pid] = true
+end
+
+-- Coroutine tracks: run slices, named waits and track names
+for _, v in ipairs({
+    "run/X/2", "wait sleep/X/2", "wait recv/X/2", "wait await/X/2", "wait join/X/2",
+    "thread_name/M/2",
+}) do
+    assert(names[v], v)
+end
+
+-- Thread tracks: polls, timer and process callbacks
+for _, v in ipairs({ "poll/X/1", "timer/X/1", "process exit/X/1", "thread_name/M/1", "process_name/M/1" }) do
+    assert(names[v], v)
+end
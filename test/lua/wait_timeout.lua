@@ -0,0 +1,57 @@
+-- await() timeout, the coroutine keeps running
+local done = false
+local co = auto.coroutine(function()
+    auto.sleep(200)
+    done = true
+    return 42
+end)
+local ok, err = co:await(10)
+assert(ok == false and err == "timeout" and not done)
+
+-- Result in time wins
+local ret
+ok, ret = co:await(5000)
+assert(ok == true and ret == 42 and done)
+
+-- Finished coroutine returns at once, even with zero timeout
+ok, ret = co:await(0)
+assert(ok == true and ret == 42)
+
+-- Timeout does not leak into next wait
+local fast = auto.coroutine(function()
+    auto.sleep(20)
+    return "fast"
+end)
+ok, ret = fast:await(1000)
+assert(ok and ret == "fast")
+auto.sleep(50)
+
+assert(not pcall(co.await, co, -1))
+
+-- Process wait operations
+if package.config:sub(1, 1) == "/" then
+    local proc = auto.process({ file = "sleep", args = { "sleep", "5" }, stdio = { "enable_stdout" } })
+    local beg = os.time()
+    local code
+    code, err = proc:join(50)
+    assert(code == nil and err == "timeout")
+    local out
+    out, err = proc:cout(50)
+    assert(out == nil and err == "timeout")
+    assert(proc:running())
+    proc:kill(9)
+    assert(type(proc:join(5000)) == "number")
+    assert(os.time() - beg < 5)
+
+    proc = auto.process({ file = "echo", args = { "echo", "hello" }, stdio = { "enable_stdout" } })
+    local text = ""
+    while true do
+        out = proc:cout(5000)
+        if out == nil then
+            break
+        end
+        text = text .. out
+    end
+    assert(text == "hello\n")
+    assert(proc:join(5000) == 0)
+end